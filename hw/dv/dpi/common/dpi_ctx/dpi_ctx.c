@@ -0,0 +1,153 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "dpi_ctx.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct dpi_ctx_entry {
+  void *ctx;
+  // A pointer that SystemVerilog might pass in place of ctx, or NULL
+  void *alias;
+  dpi_ctx_reopen_fn reopen;
+  dpi_ctx_thread_fn stop_threads;
+  dpi_ctx_thread_fn start_threads;
+  char *kind;
+  char *name;
+};
+
+// There are only a handful of DPI models in a simulation, so the registry is
+// a simple array.
+static struct dpi_ctx_entry *entries;
+static size_t num_entries;
+static size_t cap_entries;
+static size_t num_aliases;
+
+static char *copy_str(const char *str) {
+  char *ret = (char *)malloc(strlen(str) + 1);
+  assert(ret);
+  strcpy(ret, str);
+  return ret;
+}
+
+void dpi_ctx_register(void *ctx, const char *kind, const char *name) {
+  assert(ctx && kind && name);
+
+  if (num_entries == cap_entries) {
+    cap_entries = cap_entries ? 2 * cap_entries : 8;
+    entries = (struct dpi_ctx_entry *)realloc(
+        entries, cap_entries * sizeof(struct dpi_ctx_entry));
+    assert(entries);
+  }
+
+  struct dpi_ctx_entry *entry = &entries[num_entries++];
+  entry->ctx = ctx;
+  entry->alias = NULL;
+  entry->reopen = NULL;
+  entry->stop_threads = NULL;
+  entry->start_threads = NULL;
+  entry->kind = copy_str(kind);
+  entry->name = copy_str(name);
+}
+
+void dpi_ctx_unregister(void *ctx) {
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (entries[i].ctx != ctx) {
+      continue;
+    }
+    if (entries[i].alias) {
+      --num_aliases;
+    }
+    free(entries[i].kind);
+    free(entries[i].name);
+    entries[i] = entries[--num_entries];
+    return;
+  }
+}
+
+void *dpi_ctx_resolve(void *ctx) {
+  if (!num_aliases) {
+    return ctx;
+  }
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (entries[i].alias == ctx) {
+      return entries[i].ctx;
+    }
+  }
+  return ctx;
+}
+
+size_t dpi_ctx_count(void) { return num_entries; }
+
+void dpi_ctx_get(size_t idx, void **ctx, const char **kind, const char **name) {
+  assert(idx < num_entries);
+  *ctx = entries[idx].ctx;
+  *kind = entries[idx].kind;
+  *name = entries[idx].name;
+}
+
+bool dpi_ctx_alias(void *old_ctx, const char *kind, const char *name) {
+  assert(old_ctx);
+
+  for (size_t i = 0; i < num_entries; ++i) {
+    struct dpi_ctx_entry *entry = &entries[i];
+    if (strcmp(entry->kind, kind) != 0 || strcmp(entry->name, name) != 0) {
+      continue;
+    }
+    if (!entry->alias) {
+      ++num_aliases;
+    }
+    entry->alias = old_ctx;
+    return true;
+  }
+  return false;
+}
+
+void dpi_ctx_set_reopen(void *ctx, dpi_ctx_reopen_fn fn) {
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (entries[i].ctx == ctx) {
+      entries[i].reopen = fn;
+      return;
+    }
+  }
+  assert(0 && "Context not registered");
+}
+
+void dpi_ctx_reopen_files(void) {
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (entries[i].reopen) {
+      entries[i].reopen(entries[i].ctx);
+    }
+  }
+}
+
+void dpi_ctx_set_threads(void *ctx, dpi_ctx_thread_fn stop,
+                         dpi_ctx_thread_fn start) {
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (entries[i].ctx == ctx) {
+      entries[i].stop_threads = stop;
+      entries[i].start_threads = start;
+      return;
+    }
+  }
+  assert(0 && "Context not registered");
+}
+
+void dpi_ctx_stop_threads(void) {
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (entries[i].stop_threads) {
+      entries[i].stop_threads(entries[i].ctx);
+    }
+  }
+}
+
+void dpi_ctx_start_threads(void) {
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (entries[i].start_threads) {
+      entries[i].start_threads(entries[i].ctx);
+    }
+  }
+}
@@ -0,0 +1,154 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_DPI_COMMON_DPI_CTX_DPI_CTX_H_
+#define OPENTITAN_HW_DV_DPI_COMMON_DPI_CTX_DPI_CTX_H_
+
+/**
+ * A registry of the contexts of DPI models
+ *
+ * DPI models return a context pointer from their create function, which the
+ * SystemVerilog side stores in a chandle and passes back on every call. If
+ * the simulation state is saved to a checkpoint and restored in another
+ * process, the restored chandles hold pointers from the old process.
+ *
+ * To handle this, each model registers its context under a kind (the name of
+ * the model) and an instance name. When restoring a checkpoint, the models
+ * first create fresh contexts in the new process. The saved pointers are then
+ * declared as aliases of the new contexts with the same kind and name, and the
+ * models map the chandles that they are passed with dpi_ctx_resolve().
+ *
+ * Models that write output files can also register a function to reopen
+ * them. A simulation that forks a child process for each test in a batch uses
+ * this to give each test its own copy of the files.
+ *
+ * Only the calling thread survives a fork, so models that run helper threads
+ * register functions to stop and restart them as well. The threads are
+ * stopped in the parent for the duration of a batch, so that it doesn't keep
+ * reading input that is meant for the children, and restarted in each child.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * A function that reopens the output files of the DPI model with context ctx,
+ * relative to the current directory
+ */
+typedef void (*dpi_ctx_reopen_fn)(void *ctx);
+
+/**
+ * A function that stops or restarts the helper threads of the DPI model with
+ * context ctx
+ */
+typedef void (*dpi_ctx_thread_fn)(void *ctx);
+
+/**
+ * Register a newly created context
+ *
+ * @param ctx context pointer, as returned to SystemVerilog
+ * @param kind C string naming the type of DPI model (e.g. "uartdpi")
+ * @param name C string naming this instance of the model
+ */
+void dpi_ctx_register(void *ctx, const char *kind, const char *name);
+
+/**
+ * Remove a context from the registry. Call this before freeing it.
+ *
+ * @param ctx context pointer, as passed to dpi_ctx_register()
+ */
+void dpi_ctx_unregister(void *ctx);
+
+/**
+ * Map a context pointer passed from SystemVerilog to the live context
+ *
+ * If ctx is an alias (see dpi_ctx_alias()), this returns the context that it
+ * aliases. Otherwise, it returns ctx unchanged. This is cheap when there are
+ * no aliases, which is the case unless a checkpoint has been restored.
+ *
+ * @param ctx context pointer passed from SystemVerilog
+ * @return the context to use
+ */
+void *dpi_ctx_resolve(void *ctx);
+
+/**
+ * Get the number of registered contexts
+ */
+size_t dpi_ctx_count(void);
+
+/**
+ * Get a registered context by index
+ *
+ * @param idx index of the context, less than dpi_ctx_count()
+ * @param ctx set to the context pointer
+ * @param kind set to the kind passed to dpi_ctx_register()
+ * @param name set to the name passed to dpi_ctx_register()
+ */
+void dpi_ctx_get(size_t idx, void **ctx, const char **kind, const char **name);
+
+/**
+ * Make old_ctx an alias of the registered context with the given kind and
+ * name
+ *
+ * @param old_ctx context pointer saved by another process
+ * @param kind kind of the context
+ * @param name name of the context
+ * @return true if a matching context was found
+ */
+bool dpi_ctx_alias(void *old_ctx, const char *kind, const char *name);
+
+/**
+ * Set the function that dpi_ctx_reopen_files() calls for a context
+ *
+ * @param ctx context pointer, as passed to dpi_ctx_register()
+ * @param fn function to call, or NULL for none
+ */
+void dpi_ctx_set_reopen(void *ctx, dpi_ctx_reopen_fn fn);
+
+/**
+ * Ask every registered model to reopen its output files
+ *
+ * This is called in a forked child after changing to the directory that its
+ * output should go to. Output written before the fork stays in the old files.
+ */
+void dpi_ctx_reopen_files(void);
+
+/**
+ * Set the functions that dpi_ctx_stop_threads() and dpi_ctx_start_threads()
+ * call for a context
+ *
+ * Several models may share a helper thread, so both functions must do
+ * nothing if the threads are already stopped (or running).
+ *
+ * @param ctx context pointer, as passed to dpi_ctx_register()
+ * @param stop function that stops the threads, or NULL for none
+ * @param start function that restarts them, or NULL for none
+ */
+void dpi_ctx_set_threads(void *ctx, dpi_ctx_thread_fn stop,
+                         dpi_ctx_thread_fn start);
+
+/**
+ * Ask every registered model to stop its helper threads
+ *
+ * This is called before forking. Until dpi_ctx_start_threads() is called,
+ * the models don't see any new input.
+ */
+void dpi_ctx_stop_threads(void);
+
+/**
+ * Ask every registered model to restart its helper threads
+ *
+ * This is called in a forked child, and in the parent once it is done
+ * forking.
+ */
+void dpi_ctx_start_threads(void);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+#endif  // OPENTITAN_HW_DV_DPI_COMMON_DPI_CTX_DPI_CTX_H_
@@ -0,0 +1,502 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "dpi_io.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * An input channel
+ *
+ * The data read from fd goes through a single-producer, single-consumer ring
+ * buffer. rptr and wptr count all the bytes ever read and written, and size is
+ * a power of two, so a pointer's position in buf is the pointer modulo size.
+ * The I/O thread writes wptr and the simulation thread writes rptr. Each side
+ * publishes its pointer with a release store and reads the other side's with
+ * an acquire load.
+ *
+ * A record channel reads fd into a line buffer instead, and only writes whole
+ * records to the ring buffer, so it is full once there is no space for one
+ * more record.
+ */
+struct dpi_io_chan {
+  char *name;
+  int fd;
+  size_t rptr;
+  size_t wptr;
+  size_t size;
+  char *buf;
+  // The ring buffer is full once it has less than this much space: one byte,
+  // or one record for a record channel
+  size_t min_space;
+  // For a record channel: the parser, the data read from fd but not parsed
+  // yet (with space for a terminating NUL), and the record being parsed
+  dpi_io_parse_fn parse;
+  void *parse_arg;
+  char *line;
+  size_t line_len;
+  void *record;
+  // Set by the I/O thread when it stops reading fd after an error or EOF
+  bool done;
+  // Next channel in the list of open channels
+  struct dpi_io_chan *next;
+};
+
+// Protects the list of channels and the state of the I/O thread. The I/O
+// thread holds it except when it is waiting in poll().
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dpi_io_chan *chans;
+// Incremented whenever a channel is opened or closed
+static unsigned long chans_gen;
+static bool io_thread_running;
+static bool io_thread_stop;
+// Set while dpi_io_suspend() is in effect
+static bool io_suspended;
+static pthread_t io_thread;
+// A pipe that the simulation thread writes to wake the I/O thread from poll()
+static int wake_rfd = -1;
+static int wake_wfd = -1;
+
+static size_t load_acquire(const size_t *ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(size_t *ptr, size_t val) {
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static void wake_io_thread(void) {
+  char dummy = 0;
+  // If the pipe is full, there's a wakeup pending already.
+  ssize_t rv = write(wake_wfd, &dummy, 1);
+  (void)rv;
+}
+
+/**
+ * Check whether a channel's ring buffer is full (I/O thread only)
+ */
+static bool chan_full(struct dpi_io_chan *chan) {
+  return chan->size - (chan->wptr - load_acquire(&chan->rptr)) <
+         chan->min_space;
+}
+
+/**
+ * Read as much data as fits into a channel's ring buffer (I/O thread only)
+ */
+static void chan_fill(struct dpi_io_chan *chan) {
+  while (!chan->done) {
+    size_t wptr = chan->wptr;
+    size_t space = chan->size - (wptr - load_acquire(&chan->rptr));
+    if (!space) {
+      return;
+    }
+    size_t pos = wptr & (chan->size - 1);
+    size_t contig = chan->size - pos;
+    if (contig > space) {
+      contig = space;
+    }
+
+    ssize_t num_read = read(chan->fd, &chan->buf[pos], contig);
+    if (num_read > 0) {
+      store_release(&chan->wptr, wptr + num_read);
+      if ((size_t)num_read < contig) {
+        // Nothing more to read for now
+        return;
+      }
+      continue;
+    }
+    if (num_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+      fprintf(stderr, "%s: Read failed: %s\n", chan->name, strerror(errno));
+    }
+
+    // Stop polling the file descriptor, which would otherwise stay readable
+    chan->done = true;
+  }
+}
+
+/**
+ * Parse the complete lines in a record channel's line buffer, for as long as
+ * there is space for their records (I/O thread only)
+ */
+static void chan_parse_lines(struct dpi_io_chan *chan) {
+  while (chan->line_len && !chan_full(chan)) {
+    char *end = (char *)memchr(chan->line, '\n', chan->line_len);
+    size_t len;
+    if (end) {
+      len = end - chan->line;
+    } else if (chan->line_len == DPI_IO_MAX_LINE || chan->done) {
+      // A line that is too long, or the last one before the end of the file
+      len = chan->line_len;
+    } else {
+      return;
+    }
+    size_t consumed = end ? len + 1 : len;
+
+    chan->line[len] = '\0';
+    if (len && chan->line[len - 1] == '\r') {
+      chan->line[len - 1] = '\0';
+    }
+    if (chan->parse(chan->parse_arg, chan->line, chan->record)) {
+      // Copy the record in, in two parts if it wraps around the end
+      size_t wptr = chan->wptr;
+      size_t pos = wptr & (chan->size - 1);
+      size_t first = chan->size - pos;
+      if (first > chan->min_space) {
+        first = chan->min_space;
+      }
+      memcpy(&chan->buf[pos], chan->record, first);
+      memcpy(chan->buf, (char *)chan->record + first,
+             chan->min_space - first);
+      store_release(&chan->wptr, wptr + chan->min_space);
+    }
+
+    chan->line_len -= consumed;
+    memmove(chan->line, chan->line + consumed, chan->line_len);
+  }
+}
+
+/**
+ * Read lines into a record channel's line buffer and parse them (I/O thread
+ * only)
+ */
+static void chan_fill_lines(struct dpi_io_chan *chan) {
+  while (!chan->done) {
+    chan_parse_lines(chan);
+    size_t space = DPI_IO_MAX_LINE - chan->line_len;
+    if (chan_full(chan) || !space) {
+      return;
+    }
+
+    ssize_t num_read = read(chan->fd, &chan->line[chan->line_len], space);
+    if (num_read > 0) {
+      chan->line_len += num_read;
+      continue;
+    }
+    if (num_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+      fprintf(stderr, "%s: Read failed: %s\n", chan->name, strerror(errno));
+    }
+    chan->done = true;
+  }
+  // Parse the last line, which may not have a line ending
+  chan_parse_lines(chan);
+}
+
+static void *io_thread_main(void *unused) {
+  (void)unused;
+  struct pollfd *fds = NULL;
+  struct dpi_io_chan **fd_chans = NULL;
+  size_t cap_fds = 0;
+
+  pthread_mutex_lock(&io_lock);
+  while (!io_thread_stop) {
+    size_t num_chans = 0;
+    for (struct dpi_io_chan *chan = chans; chan; chan = chan->next) {
+      ++num_chans;
+    }
+    if (num_chans + 1 > cap_fds) {
+      cap_fds = num_chans + 1;
+      fds = (struct pollfd *)realloc(fds, cap_fds * sizeof(struct pollfd));
+      fd_chans = (struct dpi_io_chan **)realloc(
+          fd_chans, cap_fds * sizeof(struct dpi_io_chan *));
+      assert(fds && fd_chans);
+    }
+
+    nfds_t num_fds = 0;
+    fds[num_fds].fd = wake_rfd;
+    fds[num_fds].events = POLLIN;
+    fd_chans[num_fds++] = NULL;
+
+    // Lines may have been left unparsed while a record channel was full
+    for (struct dpi_io_chan *chan = chans; chan; chan = chan->next) {
+      if (chan->parse) {
+        chan_parse_lines(chan);
+      }
+    }
+
+    // Before deciding not to poll a full channel, make sure that the
+    // simulation thread will wake this thread up when it reads from it. The
+    // fence pairs with the one in dpi_io_read(): either this thread sees the
+    // simulation thread's latest read pointer, or the simulation thread sees
+    // that the buffer was full.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (struct dpi_io_chan *chan = chans; chan; chan = chan->next) {
+      if (chan->done || chan_full(chan)) {
+        continue;
+      }
+      fds[num_fds].fd = chan->fd;
+      fds[num_fds].events = POLLIN;
+      fd_chans[num_fds++] = chan;
+    }
+
+    unsigned long gen = chans_gen;
+    pthread_mutex_unlock(&io_lock);
+    int rv = poll(fds, num_fds, -1);
+    int poll_errno = errno;
+    pthread_mutex_lock(&io_lock);
+
+    if (rv < 0) {
+      if (poll_errno != EINTR) {
+        fprintf(stderr, "DPI I/O: poll failed: %s\n", strerror(poll_errno));
+      }
+      continue;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char dummy[64];
+      while (read(wake_rfd, dummy, sizeof(dummy)) > 0) {
+      }
+    }
+
+    // If a channel was closed while polling, its file descriptor may have
+    // been closed (or even reused) too.
+    if (gen != chans_gen) {
+      continue;
+    }
+
+    for (nfds_t i = 1; i < num_fds; ++i) {
+      if (fds[i].revents & POLLNVAL) {
+        fd_chans[i]->done = true;
+      } else if (fds[i].revents && fd_chans[i]->parse) {
+        chan_fill_lines(fd_chans[i]);
+      } else if (fds[i].revents) {
+        chan_fill(fd_chans[i]);
+      }
+    }
+  }
+  pthread_mutex_unlock(&io_lock);
+
+  free(fds);
+  free(fd_chans);
+  return NULL;
+}
+
+/**
+ * Create the wake pipe and start the I/O thread. Call with io_lock held.
+ *
+ * @return true on success
+ */
+static bool start_io_thread(void) {
+  int pipe_fds[2];
+  if (pipe(pipe_fds) != 0) {
+    fprintf(stderr, "DPI I/O: Unable to create wakeup pipe: %s\n",
+            strerror(errno));
+    return false;
+  }
+  // Neither end ever needs to block
+  fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(pipe_fds[1], F_SETFL, O_NONBLOCK);
+  wake_rfd = pipe_fds[0];
+  wake_wfd = pipe_fds[1];
+
+  io_thread_stop = false;
+  if (pthread_create(&io_thread, NULL, io_thread_main, NULL) != 0) {
+    fprintf(stderr, "DPI I/O: Unable to create I/O thread\n");
+    close(wake_rfd);
+    close(wake_wfd);
+    wake_rfd = wake_wfd = -1;
+    return false;
+  }
+  io_thread_running = true;
+  return true;
+}
+
+/**
+ * Stop the I/O thread and close the wake pipe. Call without io_lock held,
+ * once io_thread_stop has been set.
+ */
+static void stop_io_thread(void) {
+  wake_io_thread();
+  pthread_join(io_thread, NULL);
+  close(wake_rfd);
+  close(wake_wfd);
+  wake_rfd = wake_wfd = -1;
+  io_thread_running = false;
+}
+
+static void chan_free(struct dpi_io_chan *chan) {
+  free(chan->record);
+  free(chan->line);
+  free(chan->buf);
+  free(chan->name);
+  free(chan);
+}
+
+/**
+ * Open a channel
+ *
+ * @param min_space 1 for a byte channel, or the record size
+ * @param parse parser for a record channel, or NULL for a byte channel
+ */
+static struct dpi_io_chan *chan_open(const char *name, int fd,
+                                     size_t buf_size, size_t min_space,
+                                     dpi_io_parse_fn parse, void *arg) {
+  assert(name && fd >= 0);
+
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+    fprintf(stderr, "%s: Unable to make fd non-blocking: %s\n", name,
+            strerror(errno));
+    return NULL;
+  }
+
+  // Round the size up to a power of two, so that pointers can be masked
+  size_t pow2_size = 16;
+  while (pow2_size < buf_size) {
+    pow2_size <<= 1;
+  }
+
+  struct dpi_io_chan *chan =
+      (struct dpi_io_chan *)calloc(1, sizeof(struct dpi_io_chan));
+  assert(chan);
+  chan->name = strdup(name);
+  chan->buf = (char *)malloc(pow2_size);
+  assert(chan->name && chan->buf);
+  chan->fd = fd;
+  chan->size = pow2_size;
+  chan->min_space = min_space;
+  if (parse) {
+    chan->parse = parse;
+    chan->parse_arg = arg;
+    chan->line = (char *)malloc(DPI_IO_MAX_LINE + 1);
+    chan->record = malloc(min_space);
+    assert(chan->line && chan->record);
+  }
+
+  pthread_mutex_lock(&io_lock);
+  if (!io_thread_running && !io_suspended && !start_io_thread()) {
+    pthread_mutex_unlock(&io_lock);
+    chan_free(chan);
+    return NULL;
+  }
+  chan->next = chans;
+  chans = chan;
+  ++chans_gen;
+  bool running = io_thread_running;
+  pthread_mutex_unlock(&io_lock);
+
+  if (running) {
+    wake_io_thread();
+  }
+  return chan;
+}
+
+struct dpi_io_chan *dpi_io_open(const char *name, int fd, size_t buf_size) {
+  return chan_open(name, fd, buf_size, 1, NULL, NULL);
+}
+
+struct dpi_io_chan *dpi_io_open_records(const char *name, int fd,
+                                        size_t record_size,
+                                        size_t max_records,
+                                        dpi_io_parse_fn parse, void *arg) {
+  assert(record_size && max_records && parse);
+  return chan_open(name, fd, record_size * max_records, record_size, parse,
+                   arg);
+}
+
+void dpi_io_close(struct dpi_io_chan *chan) {
+  if (!chan) {
+    return;
+  }
+
+  pthread_mutex_lock(&io_lock);
+  struct dpi_io_chan **link = &chans;
+  while (*link != chan) {
+    assert(*link && "Channel not open");
+    link = &(*link)->next;
+  }
+  *link = chan->next;
+  ++chans_gen;
+  bool last = !chans && io_thread_running;
+  if (last) {
+    io_thread_stop = true;
+  }
+  pthread_mutex_unlock(&io_lock);
+
+  // The I/O thread doesn't touch the channel once it has been unlinked
+  if (last) {
+    stop_io_thread();
+  } else if (io_thread_running) {
+    wake_io_thread();
+  }
+
+  chan_free(chan);
+}
+
+void dpi_io_suspend(void) {
+  pthread_mutex_lock(&io_lock);
+  io_suspended = true;
+  bool running = io_thread_running;
+  io_thread_stop = true;
+  pthread_mutex_unlock(&io_lock);
+
+  if (running) {
+    stop_io_thread();
+  }
+}
+
+void dpi_io_resume(void) {
+  pthread_mutex_lock(&io_lock);
+  io_suspended = false;
+  if (chans && !io_thread_running) {
+    start_io_thread();
+  }
+  pthread_mutex_unlock(&io_lock);
+  // A new thread polls all the channels before it sleeps, so there's no need
+  // to wake it.
+}
+
+size_t dpi_io_available(const struct dpi_io_chan *chan) {
+  return load_acquire(&chan->wptr) - chan->rptr;
+}
+
+size_t dpi_io_read(struct dpi_io_chan *chan, void *dst, size_t len) {
+  size_t rptr = chan->rptr;
+  size_t avail = load_acquire(&chan->wptr) - rptr;
+  if (!avail) {
+    return 0;
+  }
+  if (len > avail) {
+    len = avail;
+  }
+
+  // Copy out, in two parts if the data wraps around the end of the buffer
+  size_t pos = rptr & (chan->size - 1);
+  size_t first = chan->size - pos;
+  if (first > len) {
+    first = len;
+  }
+  memcpy(dst, &chan->buf[pos], first);
+  memcpy((char *)dst + first, chan->buf, len - first);
+  store_release(&chan->rptr, rptr + len);
+
+  // If the buffer was full, the I/O thread may have stopped polling this
+  // channel. See the matching fence in io_thread_main().
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (chan->size - (__atomic_load_n(&chan->wptr, __ATOMIC_RELAXED) - rptr) <
+      chan->min_space) {
+    wake_io_thread();
+  }
+  return len;
+}
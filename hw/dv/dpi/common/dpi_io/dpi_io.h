@@ -0,0 +1,146 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_DPI_COMMON_DPI_IO_DPI_IO_H_
+#define OPENTITAN_HW_DV_DPI_COMMON_DPI_IO_DPI_IO_H_
+
+/**
+ * A shared input thread for DPI models
+ *
+ * DPI models that take input from the host (through a pseudo-terminal, a FIFO
+ * or a socket) used to poll their file descriptor with a non-blocking read()
+ * on every tick, which costs a system call per model per clock cycle even
+ * when nothing is connected.
+ *
+ * Instead, a model opens a channel for its file descriptor. A single I/O
+ * thread, shared by all the channels, sleeps in poll() until any of them has
+ * data and then reads it in batches into the channel's lock-free ring buffer.
+ * The model's tick function only has to check the ring buffer, which is a
+ * memory access rather than a system call.
+ *
+ * A record channel goes further, and also parses its input on the I/O
+ * thread: each line is turned into a fixed-size record by a function that the
+ * model provides, and the model reads whole records.
+ *
+ * The functions below must all be called from the simulation thread. The I/O
+ * thread is started when the first channel is opened and stopped when the
+ * last one is closed. Only the calling thread survives a fork, so a process
+ * that forks must stop the I/O thread with dpi_io_suspend() first, and call
+ * dpi_io_resume() in the parent and the child afterwards.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct dpi_io_chan;
+
+/**
+ * Default size of a channel's ring buffer, in bytes
+ */
+#define DPI_IO_DEFAULT_BUF_SIZE 4096
+
+/**
+ * Longest line that a record channel parses. Longer lines are split.
+ */
+#define DPI_IO_MAX_LINE 256
+
+/**
+ * Parse a line of input into a record
+ *
+ * Called on the I/O thread, so it must not touch any state that the
+ * simulation thread changes.
+ *
+ * @param arg argument given to dpi_io_open_records()
+ * @param line C string holding the line, without the line ending
+ * @param record buffer for the record, of the channel's record size
+ * @return true to queue the record, false to drop the line
+ */
+typedef bool (*dpi_io_parse_fn)(void *arg, const char *line, void *record);
+
+/**
+ * Start reading from a file descriptor on the I/O thread
+ *
+ * The file descriptor is made non-blocking. It still belongs to the caller,
+ * which must close the channel before closing the file descriptor.
+ *
+ * @param name C string naming the channel in messages
+ * @param fd file descriptor to read from
+ * @param buf_size size of the ring buffer, in bytes. Rounded up to a power of
+ *                 two.
+ * @return the new channel, or NULL on error
+ */
+struct dpi_io_chan *dpi_io_open(const char *name, int fd, size_t buf_size);
+
+/**
+ * Start reading lines from a file descriptor on the I/O thread, and parsing
+ * them into records
+ *
+ * As for dpi_io_open(), the file descriptor is made non-blocking and still
+ * belongs to the caller. Read the records with dpi_io_read(), with a len of
+ * record_size. Once max_records records are queued, the I/O thread stops
+ * reading until the simulation thread catches up.
+ *
+ * @param name C string naming the channel in messages
+ * @param fd file descriptor to read from
+ * @param record_size size of a record, in bytes
+ * @param max_records number of records to queue (at least)
+ * @param parse function to parse a line into a record
+ * @param arg argument passed to parse
+ * @return the new channel, or NULL on error
+ */
+struct dpi_io_chan *dpi_io_open_records(const char *name, int fd,
+                                        size_t record_size,
+                                        size_t max_records,
+                                        dpi_io_parse_fn parse, void *arg);
+
+/**
+ * Stop reading from a channel's file descriptor and free the channel
+ *
+ * @param chan channel, as returned by dpi_io_open(). May be NULL.
+ */
+void dpi_io_close(struct dpi_io_chan *chan);
+
+/**
+ * Get the number of bytes that can be read from a channel without waiting
+ *
+ * This doesn't make any system calls.
+ *
+ * @param chan channel to check
+ */
+size_t dpi_io_available(const struct dpi_io_chan *chan);
+
+/**
+ * Non-blocking read from a channel
+ *
+ * For a record channel, len must be a multiple of the record size.
+ *
+ * @param chan channel to read from
+ * @param dst buffer to read into
+ * @param len maximum number of bytes to read
+ * @return the number of bytes read, which is 0 if no data is available
+ */
+size_t dpi_io_read(struct dpi_io_chan *chan, void *dst, size_t len);
+
+/**
+ * Stop the I/O thread, if it is running
+ *
+ * The channels stay open, and the data already in their buffers can still be
+ * read, but nothing more is read from their file descriptors until
+ * dpi_io_resume() is called. Channels opened in the meantime wait as well.
+ */
+void dpi_io_suspend(void);
+
+/**
+ * Restart the I/O thread after dpi_io_suspend(), if any channels are open
+ */
+void dpi_io_resume(void);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+#endif  // OPENTITAN_HW_DV_DPI_COMMON_DPI_IO_DPI_IO_H_
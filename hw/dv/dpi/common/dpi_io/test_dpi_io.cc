@@ -0,0 +1,215 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Test of the shared DPI input thread, run by the DV model tests in
+// hw/meson.build.
+//
+// Data is written to pipes in chunks of varying sizes, and read back in
+// chunks of other sizes, through ring buffers much smaller than the data, so
+// that the buffers wrap around and fill up many times. This is done for a
+// byte channel and for a record channel, whose records don't divide the
+// buffer size. It also checks that nothing is read while the I/O thread is
+// suspended.
+
+#include <signal.h>
+
+#include "hw/dv/verilator/cpp/test_check.h"
+
+// The test looks at the state of the I/O thread and the channels, which is
+// private to dpi_io.c, so that is included rather than linked. Like the DPI
+// models that use it, it is compiled as C++.
+#include "hw/dv/dpi/common/dpi_io/dpi_io.c"
+
+#define NUM_BYTES (1 << 20)
+#define NUM_LINES 20000
+
+static char pattern(size_t idx) { return (char)(idx * 7 + (idx >> 9)); }
+
+struct writer_args {
+  int fd;
+  const char *data;
+  size_t len;
+};
+
+// Write all the data in chunks of varying sizes, then close the pipe
+static void *writer_main(void *args_void) {
+  struct writer_args *args = (struct writer_args *)args_void;
+  unsigned seed = 2;
+  for (size_t done = 0; done < args->len;) {
+    size_t len = 1 + rand_r(&seed) % 100;
+    if (len > args->len - done) {
+      len = args->len - done;
+    }
+    ssize_t rv = write(args->fd, args->data + done, len);
+    if (rv > 0) {
+      done += rv;
+    }
+  }
+  close(args->fd);
+  return NULL;
+}
+
+static void start_writer(pthread_t *thread, struct writer_args *args, int fd,
+                         const char *data, size_t len) {
+  args->fd = fd;
+  args->data = data;
+  args->len = len;
+  pthread_create(thread, NULL, writer_main, args);
+}
+
+static void test_bytes(void) {
+  char *data = (char *)malloc(NUM_BYTES);
+  for (size_t i = 0; i < NUM_BYTES; ++i) {
+    data[i] = pattern(i);
+  }
+
+  int fds[2];
+  TEST_CHECK(pipe(fds) == 0, "pipe");
+  struct dpi_io_chan *chan = dpi_io_open("bytes", fds[0], 20);
+  TEST_CHECK(chan && chan->size == 32,
+             "buffer size rounded up to a power of two");
+  pthread_t writer;
+  struct writer_args args;
+  start_writer(&writer, &args, fds[1], data, NUM_BYTES);
+
+  size_t read = 0;
+  bool in_order = true;
+  unsigned seed = 1;
+  while (read < NUM_BYTES) {
+    char buf[64];
+    size_t avail = dpi_io_available(chan);
+    TEST_CHECK(avail <= chan->size, "more available than fits in the buffer");
+    size_t len = dpi_io_read(chan, buf, 1 + rand_r(&seed) % sizeof(buf));
+    if (!len) {
+      sched_yield();
+      continue;
+    }
+    in_order = in_order && memcmp(buf, &data[read], len) == 0;
+    read += len;
+  }
+  TEST_CHECK(in_order, "bytes read back in order");
+
+  pthread_join(writer, NULL);
+  dpi_io_close(chan);
+  close(fds[0]);
+  free(data);
+}
+
+struct record {
+  unsigned seq;
+  char text[8];
+};
+
+// Parse "<seq> <text>" lines, and drop anything else
+static bool parse_record(void *arg, const char *line, void *record_void) {
+  struct record *record = (struct record *)record_void;
+  int *num_dropped = (int *)arg;
+  memset(record, 0, sizeof(*record));
+  if (sscanf(line, "%u %7s", &record->seq, record->text) != 2) {
+    ++*num_dropped;
+    return false;
+  }
+  return true;
+}
+
+static void test_records(void) {
+  // Numbered lines with both line endings, comments that are dropped, a line
+  // that is split because it is too long, and a last line with no line ending
+  size_t cap = NUM_LINES * 16 + 2 * DPI_IO_MAX_LINE;
+  char *data = (char *)malloc(cap);
+  size_t len = 0;
+  for (int i = 0; i < NUM_LINES; ++i) {
+    if (i == NUM_LINES / 2) {
+      memset(&data[len], '#', DPI_IO_MAX_LINE + 10);
+      len += DPI_IO_MAX_LINE + 10;
+      data[len++] = '\n';
+    }
+    len += snprintf(&data[len], cap - len, i % 3 ? "%d r%d\n" : "%d r%d\r\n",
+                    i, i % 1000);
+    if (i % 7 == 0) {
+      len += snprintf(&data[len], cap - len, "# %d\n", i);
+    }
+  }
+  len += snprintf(&data[len], cap - len, "%d last", NUM_LINES);
+
+  int fds[2];
+  TEST_CHECK(pipe(fds) == 0, "pipe");
+  int num_dropped = 0;
+  struct dpi_io_chan *chan = dpi_io_open_records(
+      "records", fds[0], sizeof(struct record), 5, parse_record, &num_dropped);
+  TEST_CHECK(chan && chan->size == 64, "buffer holds 5 records");
+  pthread_t writer;
+  struct writer_args args;
+  start_writer(&writer, &args, fds[1], data, len);
+
+  bool in_order = true;
+  int num_records = 0;
+  while (num_records <= NUM_LINES) {
+    struct record records[3];
+    size_t got = dpi_io_read(chan, records, sizeof(records));
+    TEST_CHECK(got % sizeof(struct record) == 0, "partial record read");
+    if (!got) {
+      sched_yield();
+      continue;
+    }
+    for (size_t i = 0; i < got / sizeof(struct record); ++i) {
+      char text[8];
+      if (num_records == NUM_LINES) {
+        snprintf(text, sizeof(text), "last");
+      } else {
+        snprintf(text, sizeof(text), "r%d", num_records % 1000);
+      }
+      in_order = in_order && records[i].seq == (unsigned)num_records &&
+                 strcmp(records[i].text, text) == 0;
+      ++num_records;
+    }
+  }
+  TEST_CHECK(in_order, "records read back in order");
+
+  pthread_join(writer, NULL);
+  // Give the I/O thread time to parse anything that shouldn't be there
+  usleep(10000);
+  TEST_CHECK(dpi_io_available(chan) == 0, "extra records");
+  TEST_CHECK(num_dropped == (NUM_LINES + 6) / 7 + 2, "comment lines dropped");
+  dpi_io_close(chan);
+  close(fds[0]);
+  free(data);
+}
+
+static void test_suspend(void) {
+  int fds[2];
+  TEST_CHECK(pipe(fds) == 0, "pipe");
+  struct dpi_io_chan *chan = dpi_io_open("suspend", fds[0], 16);
+
+  dpi_io_suspend();
+  TEST_CHECK(!io_thread_running, "I/O thread stopped");
+  TEST_CHECK(write(fds[1], "abc", 3) == 3, "write");
+  usleep(10000);
+  TEST_CHECK(dpi_io_available(chan) == 0, "read while suspended");
+
+  dpi_io_resume();
+  TEST_CHECK(io_thread_running, "I/O thread restarted");
+  char buf[4] = {0};
+  size_t got = 0;
+  while (got < 3) {
+    got += dpi_io_read(chan, &buf[got], sizeof(buf) - 1 - got);
+  }
+  TEST_CHECK(strcmp(buf, "abc") == 0, "read after resume");
+
+  dpi_io_close(chan);
+  TEST_CHECK(!io_thread_running, "I/O thread stopped with the last channel");
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int main(void) {
+  // Fail rather than hang if a wakeup is lost
+  alarm(60);
+
+  test_bytes();
+  test_records();
+  test_suspend();
+
+  return test_check_result();
+}
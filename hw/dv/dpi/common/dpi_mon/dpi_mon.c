@@ -0,0 +1,62 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "dpi_mon.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Buffer size for binary logs, which are only read after the simulation
+#define DPI_MON_BIN_BUF_SIZE (64 * 1024)
+
+int dpi_mon_parse_mode(const char *mode) {
+  if (!strcmp(mode, "off")) {
+    return DPI_MON_OFF;
+  }
+  if (!strcmp(mode, "binary")) {
+    return DPI_MON_BINARY;
+  }
+  if (!strcmp(mode, "text")) {
+    return DPI_MON_TEXT;
+  }
+  return -1;
+}
+
+FILE *dpi_mon_open(const char *path, int mode, int kind, uint32_t param) {
+  assert(mode == DPI_MON_BINARY || mode == DPI_MON_TEXT);
+
+  FILE *file = fopen(path, mode == DPI_MON_BINARY ? "wb" : "w");
+  if (!file) {
+    return NULL;
+  }
+  if (mode == DPI_MON_TEXT) {
+    // more useful for tail -f
+    setlinebuf(file);
+    return file;
+  }
+
+  setvbuf(file, NULL, _IOFBF, DPI_MON_BIN_BUF_SIZE);
+  uint8_t header[16] = {'O', 'T', 'D', 'P', 'I', 'M', 'O', 'N'};
+  dpi_mon_put_u16(&header[8], DPI_MON_VERSION);
+  header[10] = kind;
+  header[11] = 0;
+  dpi_mon_put_u32(&header[12], param);
+  fwrite(header, 1, sizeof(header), file);
+  return file;
+}
+
+void dpi_mon_record(FILE *file, int type, int flags, uint32_t tick,
+                    const void *payload, size_t len) {
+  assert(len <= 0xffff);
+
+  uint8_t header[8];
+  header[0] = type;
+  header[1] = flags;
+  dpi_mon_put_u16(&header[2], len);
+  dpi_mon_put_u32(&header[4], tick);
+  fwrite(header, 1, sizeof(header), file);
+  if (len) {
+    fwrite(payload, 1, len, file);
+  }
+}
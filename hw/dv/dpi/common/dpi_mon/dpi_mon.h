@@ -0,0 +1,111 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_DPI_COMMON_DPI_MON_DPI_MON_H_
+#define OPENTITAN_HW_DV_DPI_COMMON_DPI_MON_DPI_MON_H_
+
+/**
+ * Output modes and binary log format for DPI bus monitors
+ *
+ * A bus monitor (such as the SPI and USB ones) can be off, write a compact
+ * binary log, or write a text log. Formatting text on every tick is slow, so
+ * the binary log records one event per pin change or decoded transaction
+ * instead, and util/dpi_mon_convert.py turns it into the text log (or, for
+ * USB, a pcap file) after the simulation.
+ *
+ * A binary log starts with a 16 byte header:
+ *
+ *   offset 0   "OTDPIMON"
+ *   offset 8   u16 format version (DPI_MON_VERSION)
+ *   offset 10  u8 kind of monitor (DPI_MON_KIND_*)
+ *   offset 11  u8 reserved, 0
+ *   offset 12  u32 monitor parameter (the log level, and for SPI the mode
+ *              in bits 31:24)
+ *
+ * It is followed by records, each of which has an 8 byte header and then
+ * `len` bytes of payload:
+ *
+ *   offset 0   u8 type of record (defined by each monitor)
+ *   offset 1   u8 flags (defined by each monitor)
+ *   offset 2   u16 len
+ *   offset 4   u32 tick
+ *
+ * All multi-byte fields are little-endian.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Output modes
+#define DPI_MON_OFF 0
+#define DPI_MON_BINARY 1
+#define DPI_MON_TEXT 2
+
+// Kinds of monitor, in the header of a binary log
+#define DPI_MON_KIND_SPI 1
+#define DPI_MON_KIND_USB 2
+
+#define DPI_MON_VERSION 1
+
+/**
+ * Parse the name of an output mode
+ *
+ * @param mode C string: "off", "binary" or "text"
+ * @return DPI_MON_OFF, DPI_MON_BINARY or DPI_MON_TEXT, or -1 if mode isn't
+ *         one of these
+ */
+int dpi_mon_parse_mode(const char *mode);
+
+/**
+ * Open the output file of a monitor
+ *
+ * A text log is line buffered, so that it can be followed with `tail -f`. A
+ * binary log is fully buffered, and starts with the header described above.
+ *
+ * @param path path of the file to create
+ * @param mode DPI_MON_BINARY or DPI_MON_TEXT
+ * @param kind kind of monitor (DPI_MON_KIND_*), for the binary header
+ * @param param monitor parameter, for the binary header
+ * @return the file, or NULL (with errno set) on error
+ */
+FILE *dpi_mon_open(const char *path, int mode, int kind, uint32_t param);
+
+/**
+ * Write a record to a binary log
+ *
+ * @param file binary log, as returned by dpi_mon_open()
+ * @param type type of record
+ * @param flags flags of the record
+ * @param tick simulation time of the event
+ * @param payload payload of the record, or NULL if len is 0
+ * @param len length of the payload, in bytes. At most 65535.
+ */
+void dpi_mon_record(FILE *file, int type, int flags, uint32_t tick,
+                    const void *payload, size_t len);
+
+/**
+ * Store a little-endian u16 in a record payload
+ */
+static inline void dpi_mon_put_u16(uint8_t *buf, uint32_t val) {
+  buf[0] = val & 0xff;
+  buf[1] = (val >> 8) & 0xff;
+}
+
+/**
+ * Store a little-endian u32 in a record payload
+ */
+static inline void dpi_mon_put_u32(uint8_t *buf, uint32_t val) {
+  dpi_mon_put_u16(buf, val);
+  dpi_mon_put_u16(buf + 2, val >> 16);
+}
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+#endif  // OPENTITAN_HW_DV_DPI_COMMON_DPI_MON_DPI_MON_H_
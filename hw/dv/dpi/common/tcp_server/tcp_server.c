@@ -9,87 +9,173 @@
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 /**
- * Simple buffer for passing data between TCP sockets and DPI modules
+ * Lock-free single-producer, single-consumer ring buffer for passing data
+ * between TCP sockets and DPI modules
+ *
+ * rptr and wptr count all the bytes ever read and written, so the buffer holds
+ * wptr - rptr bytes and a pointer's position in buf is the pointer modulo size,
+ * which is a power of two. Only the producer writes wptr and only the consumer
+ * writes rptr. Each side publishes its pointer with a release store and reads
+ * the other side's with an acquire load, so the data covered by a pointer is
+ * always visible to the side that reads it.
  */
-const int BUFSIZE_BYTE = 256;
-
 struct tcp_buf {
-  unsigned int rptr;
-  unsigned int wptr;
-  char buf[BUFSIZE_BYTE];
+  size_t rptr;
+  size_t wptr;
+  size_t size;
+  char *buf;
 };
 
+static size_t load_acquire(const size_t *ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(size_t *ptr, size_t val) {
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
 /**
- * TCP Server thread context structure
+ * Get the contiguous free space at the write pointer (producer only)
+ *
+ * @param buf buffer to write
+ * @param dst set to the start of the free space
+ * @return the number of bytes that can be written to dst
  */
-struct tcp_server_ctx {
-  // Writeable by the host thread
-  char *display_name;
-  uint16_t listen_port;
-  volatile bool socket_run;
-  // Writeable by the server thread
-  tcp_buf *buf_in;
-  tcp_buf *buf_out;
-  int sfd;  // socket fd
-  int cfd;  // client fd
-  pthread_t sock_thread;
-};
+static size_t tcp_buffer_write_region(struct tcp_buf *buf, char **dst) {
+  size_t wptr = buf->wptr;
+  size_t space = buf->size - (wptr - load_acquire(&buf->rptr));
+  size_t pos = wptr & (buf->size - 1);
+  size_t contig = buf->size - pos;
+  *dst = &buf->buf[pos];
+  return space < contig ? space : contig;
+}
 
-static bool tcp_buffer_is_full(struct tcp_buf *buf) {
-  if (buf->wptr >= buf->rptr) {
-    return (buf->wptr - buf->rptr) == (BUFSIZE_BYTE - 1);
-  } else {
-    return (buf->rptr - buf->wptr) == 1;
-  }
+/**
+ * Mark len bytes at the write pointer as written (producer only)
+ */
+static void tcp_buffer_commit_write(struct tcp_buf *buf, size_t len) {
+  store_release(&buf->wptr, buf->wptr + len);
 }
 
-static bool tcp_buffer_is_empty(struct tcp_buf *buf) {
-  return (buf->wptr == buf->rptr);
+/**
+ * Get the contiguous data at the read pointer (consumer only)
+ *
+ * @param buf buffer to read
+ * @param src set to the start of the data
+ * @return the number of bytes that can be read from src
+ */
+static size_t tcp_buffer_read_region(struct tcp_buf *buf, const char **src) {
+  size_t rptr = buf->rptr;
+  size_t used = load_acquire(&buf->wptr) - rptr;
+  size_t pos = rptr & (buf->size - 1);
+  size_t contig = buf->size - pos;
+  *src = &buf->buf[pos];
+  return used < contig ? used : contig;
 }
 
-static void tcp_buffer_put_byte(struct tcp_buf *buf, char dat) {
-  bool done = false;
-  while (!done) {
-    if (!tcp_buffer_is_full(buf)) {
-      buf->buf[buf->wptr++] = dat;
-      buf->wptr %= BUFSIZE_BYTE;
-      done = true;
-    }
-  }
+/**
+ * Mark len bytes at the read pointer as read (consumer only)
+ */
+static void tcp_buffer_commit_read(struct tcp_buf *buf, size_t len) {
+  store_release(&buf->rptr, buf->rptr + len);
 }
 
-static bool tcp_buffer_get_byte(struct tcp_buf *buf, char *dat) {
-  if (tcp_buffer_is_empty(buf)) {
-    return false;
+static struct tcp_buf *tcp_buffer_new(size_t size) {
+  // Round the size up to a power of two, so that pointers can be masked
+  size_t pow2_size = 16;
+  while (pow2_size < size) {
+    pow2_size <<= 1;
   }
-  *dat = buf->buf[buf->rptr++];
-  buf->rptr %= BUFSIZE_BYTE;
-  return true;
-}
 
-static struct tcp_buf *tcp_buffer_new(void) {
   struct tcp_buf *buf_new;
   buf_new = (struct tcp_buf *)malloc(sizeof(struct tcp_buf));
+  assert(buf_new);
+  buf_new->buf = (char *)malloc(pow2_size);
+  assert(buf_new->buf);
   buf_new->rptr = 0;
   buf_new->wptr = 0;
+  buf_new->size = pow2_size;
   return buf_new;
 }
 
 static void tcp_buffer_free(struct tcp_buf **buf) {
+  if (*buf) {
+    free((*buf)->buf);
+  }
   free(*buf);
   *buf = NULL;
 }
 
+/**
+ * TCP Server thread context structure
+ */
+struct tcp_server_ctx {
+  // Writeable by the host thread
+  char *display_name;
+  uint16_t listen_port;
+  bool socket_run;
+  bool client_close_req;
+  // Whether the server thread is running, and whether it may listen on
+  // another port if listen_port is taken. Only accessed by the host thread
+  // while the server thread isn't running.
+  bool thread_running;
+  bool any_port;
+  // Written by the host thread and read by the server thread
+  tcp_buf *buf_out;
+  // Written by the server thread and read by the host thread
+  tcp_buf *buf_in;
+  // A pipe that the host thread writes to wake the server thread from poll()
+  int wake_rfd;
+  int wake_wfd;
+  // Set by the server thread while it is about to sleep, or is sleeping, in
+  // poll(). Whichever thread clears it is responsible for the wakeup.
+  bool server_sleeping;
+  // Only accessed by the server thread
+  int sfd;  // socket fd
+  int cfd;  // client fd
+  pthread_t sock_thread;
+};
+
+/**
+ * Wake the server thread, whether or not it is waiting in poll()
+ *
+ * @param ctx context object
+ */
+static void wake_server(struct tcp_server_ctx *ctx) {
+  char dummy = 0;
+  // If the pipe is full, there's a wakeup pending already.
+  ssize_t rv = write(ctx->wake_wfd, &dummy, 1);
+  (void)rv;
+}
+
+/**
+ * Wake the server thread only if it is sleeping in poll()
+ *
+ * This is called from the data path, after a fence that orders it with the
+ * buffer pointer update it is waking the server for. If the server thread
+ * isn't going to sleep, it picks up the update itself, so there is no need
+ * for a system call.
+ *
+ * @param ctx context object
+ */
+static void wake_server_if_sleeping(struct tcp_server_ctx *ctx) {
+  if (__atomic_load_n(&ctx->server_sleeping, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&ctx->server_sleeping, false, __ATOMIC_ACQ_REL)) {
+    wake_server(ctx);
+  }
+}
+
 /**
  * Start a TCP server
  *
@@ -146,6 +232,17 @@ static int start(struct tcp_server_ctx *ctx) {
   addr.sin_port = htons(ctx->listen_port);
 
   rv = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+  if (rv != 0 && errno == EADDRINUSE && ctx->any_port) {
+    // Let the system pick a free port
+    addr.sin_port = 0;
+    rv = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+    socklen_t addr_len = sizeof(addr);
+    if (rv == 0 &&
+        getsockname(sfd, (struct sockaddr *)&addr, &addr_len) == 0) {
+      printf("%s: Port %d is in use, listening on port %d instead\n",
+             ctx->display_name, ctx->listen_port, ntohs(addr.sin_port));
+    }
+  }
   if (rv != 0) {
     fprintf(stderr, "%s: Failed to bind socket: %s (%d)\n", ctx->display_name,
             strerror(errno), errno);
@@ -222,64 +319,99 @@ static void stop(struct tcp_server_ctx *ctx) {
 }
 
 /**
- * Receive a byte from a connected client
+ * Close the connection to the client (server thread only)
  *
  * @param ctx context object
- * @param cmd byte received
- * @return true if a byte was read
  */
-static bool get_byte(struct tcp_server_ctx *ctx, char *cmd) {
+static void client_close(struct tcp_server_ctx *ctx) {
   assert(ctx);
 
-  ssize_t num_read = read(ctx->cfd, cmd, 1);
-
-  if (num_read == 0) {
-    return false;
+  if (!ctx->cfd) {
+    return;
   }
-  if (num_read == -1) {
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-      return false;
-    } else if (errno == EBADF) {
-      // Possibly client went away? Accept a new connection.
-      fprintf(stderr, "%s: Client disappeared.\n", ctx->display_name);
-      tcp_server_client_close(ctx);
-      return false;
-    } else {
-      fprintf(stderr, "%s: Error while reading from client: %s (%d)\n",
-              ctx->display_name, strerror(errno), errno);
-      assert(0 && "Error reading from client");
+
+  close(ctx->cfd);
+  ctx->cfd = 0;
+}
+
+/**
+ * Receive as much data from the client as fits in the input buffer
+ *
+ * @param ctx context object
+ */
+static void client_recv(struct tcp_server_ctx *ctx) {
+  while (ctx->cfd) {
+    char *dst;
+    size_t space = tcp_buffer_write_region(ctx->buf_in, &dst);
+    if (!space) {
+      return;
+    }
+
+    ssize_t num_read = recv(ctx->cfd, dst, space, 0);
+    if (num_read == 0) {
+      printf("%s: Remote disconnected.\n", ctx->display_name);
+      client_close(ctx);
+      return;
+    }
+    if (num_read == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      } else if (errno == EINTR) {
+        continue;
+      } else if (errno == EBADF || errno == ECONNRESET) {
+        // Possibly client went away? Accept a new connection.
+        fprintf(stderr, "%s: Client disappeared.\n", ctx->display_name);
+        client_close(ctx);
+        return;
+      } else {
+        fprintf(stderr, "%s: Error while reading from client: %s (%d)\n",
+                ctx->display_name, strerror(errno), errno);
+        assert(0 && "Error reading from client");
+      }
+    }
+
+    tcp_buffer_commit_write(ctx->buf_in, num_read);
+    if ((size_t)num_read < space) {
+      // Nothing more to read for now
+      return;
     }
   }
-  assert(num_read == 1);
-  return true;
 }
 
 /**
- * Send a byte to a connected client
+ * Send as much of the output buffer to the client as it will take
  *
  * @param ctx context object
- * @param cmd byte to send
+ * @return false if data is left that the client couldn't take yet
  */
-static void put_byte(struct tcp_server_ctx *ctx, char cmd) {
-  while (1) {
-    ssize_t num_written = send(ctx->cfd, &cmd, sizeof(cmd), MSG_NOSIGNAL);
+static bool client_send(struct tcp_server_ctx *ctx) {
+  while (ctx->cfd) {
+    const char *src;
+    size_t len = tcp_buffer_read_region(ctx->buf_out, &src);
+    if (!len) {
+      return true;
+    }
+
+    ssize_t num_written = send(ctx->cfd, src, len, MSG_NOSIGNAL);
     if (num_written == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return false;
+      } else if (errno == EINTR) {
         continue;
-      } else if (errno == EPIPE) {
+      } else if (errno == EPIPE || errno == ECONNRESET) {
         printf("%s: Remote disconnected.\n", ctx->display_name);
-        tcp_server_client_close(ctx);
-        break;
+        client_close(ctx);
+        return true;
       } else {
         fprintf(stderr, "%s: Error while writing to client: %s (%d)\n",
                 ctx->display_name, strerror(errno), errno);
         assert(0 && "Error writing to client.");
       }
     }
-    if (num_written >= 1) {
-      break;
-    }
+
+    tcp_buffer_commit_read(ctx->buf_out, num_written);
   }
+  return true;
 }
 
 /**
@@ -291,6 +423,13 @@ static void ctx_free(struct tcp_server_ctx *ctx) {
   // Free the buffers
   tcp_buffer_free(&ctx->buf_in);
   tcp_buffer_free(&ctx->buf_out);
+  // Close the wakeup pipe
+  if (ctx->wake_rfd > 0) {
+    close(ctx->wake_rfd);
+  }
+  if (ctx->wake_wfd > 0) {
+    close(ctx->wake_wfd);
+  }
   // Free the display name
   free(ctx->display_name);
   // Free the ctx
@@ -301,13 +440,19 @@ static void ctx_free(struct tcp_server_ctx *ctx) {
 /**
  * Thread function to create a new server instance
  *
+ * The thread sleeps in poll() until there is a connection to accept, data
+ * from the client that fits in the input buffer, space in the client socket
+ * for pending output, or a wakeup from the host thread. The host thread wakes
+ * it when it writes to an empty output buffer or reads from a full input
+ * buffer while the server is sleeping, and when it asks for the client to be
+ * disconnected or shuts the server down.
+ *
  * @param ctx_void context object
  * @return Always returns NULL
  */
 static void *server_create(void *ctx_void) {
   // Cast to a server struct
   struct tcp_server_ctx *ctx = (struct tcp_server_ctx *)ctx_void;
-  struct timeval timeout;
 
   // Start the server
   int rv = start(ctx);
@@ -317,61 +462,74 @@ static void *server_create(void *ctx_void) {
     goto err_cleanup_return;
   }
 
-  // Initialise timeout
-  timeout.tv_sec = 0;
-
-  // Initialise fd_set
-
   // Start waiting for connection / data
-  char xfer_data;
-  while (ctx->socket_run) {
-    // Initialise structure of fds
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    if (ctx->sfd) {
-      FD_SET(ctx->sfd, &read_fds);
+  while (__atomic_load_n(&ctx->socket_run, __ATOMIC_ACQUIRE)) {
+    if (__atomic_exchange_n(&ctx->client_close_req, false, __ATOMIC_ACQ_REL)) {
+      client_send(ctx);
+      client_close(ctx);
     }
-    if (ctx->cfd) {
-      FD_SET(ctx->cfd, &read_fds);
-    }
-    // max fd num
-    int mfd = (ctx->cfd > ctx->sfd) ? ctx->cfd : ctx->sfd;
 
-    // Set timeout - 50us gives good performance
-    timeout.tv_usec = 50;
+    // Move data between the buffers and the client
+    bool send_blocked = !client_send(ctx);
+    client_recv(ctx);
+
+    // Before going to sleep, say so and check the buffers again. The fence
+    // pairs with the one in tcp_server_write() (or tcp_server_read()): either
+    // this thread sees the host's latest pointer, or the host sees
+    // server_sleeping and wakes it up.
+    __atomic_store_n(&ctx->server_sleeping, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    const char *src;
+    char *dst;
+    bool out_pending = tcp_buffer_read_region(ctx->buf_out, &src) != 0;
+    bool in_full = tcp_buffer_write_region(ctx->buf_in, &dst) == 0;
+    if (ctx->cfd && out_pending && !send_blocked) {
+      __atomic_store_n(&ctx->server_sleeping, false, __ATOMIC_RELAXED);
+      continue;
+    }
 
-    // Wait for socket activity or timeout
-    rv = select(mfd + 1, &read_fds, NULL, NULL, &timeout);
+    struct pollfd fds[2];
+    nfds_t num_fds = 0;
+    fds[num_fds].fd = ctx->wake_rfd;
+    fds[num_fds++].events = POLLIN;
+    if (ctx->cfd) {
+      fds[num_fds].fd = ctx->cfd;
+      fds[num_fds++].events =
+          (in_full ? 0 : POLLIN) | (send_blocked ? POLLOUT : 0);
+    } else if (ctx->sfd) {
+      // Only one client is served at a time
+      fds[num_fds].fd = ctx->sfd;
+      fds[num_fds++].events = POLLIN;
+    }
 
+    rv = poll(fds, num_fds, -1);
+    __atomic_store_n(&ctx->server_sleeping, false, __ATOMIC_RELAXED);
     if (rv < 0) {
-      printf("%s: Socket read failed, port: %d\n", ctx->display_name,
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("%s: Socket poll failed, port: %d\n", ctx->display_name,
              ctx->listen_port);
-      tcp_server_client_close(ctx);
+      client_close(ctx);
+      continue;
     }
 
-    // New connection
-    if (FD_ISSET(ctx->sfd, &read_fds)) {
-      client_tryaccept(ctx);
-    }
-
-    // New client data
-    if (FD_ISSET(ctx->cfd, &read_fds)) {
-      while (get_byte(ctx, &xfer_data)) {
-        tcp_buffer_put_byte(ctx->buf_in, xfer_data);
+    if (fds[0].revents & POLLIN) {
+      char dummy[64];
+      while (read(ctx->wake_rfd, dummy, sizeof(dummy)) > 0) {
       }
     }
 
-    if (ctx->cfd != 0) {
-      while (tcp_buffer_get_byte(ctx->buf_out, &xfer_data)) {
-        put_byte(ctx, xfer_data);
-      }
+    // New connection
+    if (!ctx->cfd && ctx->sfd && num_fds > 1 && (fds[1].revents & POLLIN)) {
+      client_tryaccept(ctx);
     }
   }
 
 err_cleanup_return:
 
   // Simulation done - clean up
-  tcp_server_client_close(ctx);
+  client_close(ctx);
   stop(ctx);
 
   return NULL;
@@ -379,13 +537,20 @@ err_cleanup_return:
 
 // Abstract interface functions
 tcp_server_ctx *tcp_server_create(const char *display_name, int listen_port) {
+  return tcp_server_create_with_buf_size(display_name, listen_port,
+                                         TCP_SERVER_DEFAULT_BUF_SIZE);
+}
+
+tcp_server_ctx *tcp_server_create_with_buf_size(const char *display_name,
+                                                int listen_port,
+                                                size_t buf_size) {
   struct tcp_server_ctx *ctx =
       (struct tcp_server_ctx *)calloc(1, sizeof(struct tcp_server_ctx));
   assert(ctx);
 
   // Create the buffers
-  struct tcp_buf *buf_in = tcp_buffer_new();
-  struct tcp_buf *buf_out = tcp_buffer_new();
+  struct tcp_buf *buf_in = tcp_buffer_new(buf_size);
+  struct tcp_buf *buf_out = tcp_buffer_new(buf_size);
   assert(buf_in);
   assert(buf_out);
 
@@ -399,39 +564,112 @@ tcp_server_ctx *tcp_server_create(const char *display_name, int listen_port) {
   ctx->display_name = strdup(display_name);
   assert(ctx->display_name);
 
+  // Set up the pipe used to wake the server thread. Both ends are
+  // non-blocking: the host never waits to wake the server, and the server
+  // empties the pipe without waiting.
+  int wake_fds[2];
+  if (pipe(wake_fds) != 0 || fcntl(wake_fds[0], F_SETFL, O_NONBLOCK) != 0 ||
+      fcntl(wake_fds[1], F_SETFL, O_NONBLOCK) != 0) {
+    fprintf(stderr, "%s: Unable to create wakeup pipe: %s (%d)\n",
+            ctx->display_name, strerror(errno), errno);
+    ctx_free(ctx);
+    return NULL;
+  }
+  ctx->wake_rfd = wake_fds[0];
+  ctx->wake_wfd = wake_fds[1];
+
   if (pthread_create(&ctx->sock_thread, NULL, server_create, (void *)ctx) !=
       0) {
     fprintf(stderr, "%s: Unable to create TCP socket thread\n",
             ctx->display_name);
     ctx_free(ctx);
-    free(ctx);
     return NULL;
   }
+  ctx->thread_running = true;
   return ctx;
 }
 
 bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat) {
-  return tcp_buffer_get_byte(ctx->buf_in, dat);
+  struct tcp_buf *buf = ctx->buf_in;
+  size_t rptr = buf->rptr;
+  if (load_acquire(&buf->wptr) == rptr) {
+    return false;
+  }
+  *dat = buf->buf[rptr & (buf->size - 1)];
+  tcp_buffer_commit_read(buf, 1);
+
+  // If the buffer was full, the server thread may have stopped receiving.
+  // See the matching fence in server_create().
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&buf->wptr, __ATOMIC_RELAXED) - rptr == buf->size) {
+    wake_server_if_sleeping(ctx);
+  }
+  return true;
 }
 
 void tcp_server_write(struct tcp_server_ctx *ctx, char dat) {
-  tcp_buffer_put_byte(ctx->buf_out, dat);
+  struct tcp_buf *buf = ctx->buf_out;
+  size_t wptr = buf->wptr;
+  while (wptr - load_acquire(&buf->rptr) == buf->size) {
+    // Wait for the server thread to send some data
+    sched_yield();
+  }
+  buf->buf[wptr & (buf->size - 1)] = dat;
+  tcp_buffer_commit_write(buf, 1);
+
+  // If the buffer was empty, the server thread may be asleep. See the
+  // matching fence in server_create().
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&buf->rptr, __ATOMIC_RELAXED) == wptr) {
+    wake_server_if_sleeping(ctx);
+  }
 }
 
 void tcp_server_close(struct tcp_server_ctx *ctx) {
-  // Shut down the socket thread
-  ctx->socket_run = false;
-  pthread_join(ctx->sock_thread, NULL);
+  tcp_server_suspend(ctx);
   ctx_free(ctx);
 }
 
-void tcp_server_client_close(struct tcp_server_ctx *ctx) {
+void tcp_server_suspend(struct tcp_server_ctx *ctx) {
   assert(ctx);
+  if (!ctx->thread_running) {
+    return;
+  }
 
-  if (!ctx->cfd) {
+  // Shut down the socket thread, which closes the sockets on its way out
+  __atomic_store_n(&ctx->socket_run, false, __ATOMIC_RELEASE);
+  wake_server(ctx);
+  pthread_join(ctx->sock_thread, NULL);
+  ctx->thread_running = false;
+}
+
+void tcp_server_resume(struct tcp_server_ctx *ctx) {
+  assert(ctx);
+  if (ctx->thread_running) {
     return;
   }
 
-  close(ctx->cfd);
-  ctx->cfd = 0;
+  // Whatever is buffered belongs to the old client, if there was one
+  ctx->buf_in->rptr = ctx->buf_in->wptr = 0;
+  ctx->buf_out->rptr = ctx->buf_out->wptr = 0;
+  ctx->client_close_req = false;
+  ctx->server_sleeping = false;
+  ctx->socket_run = true;
+  ctx->any_port = true;
+
+  if (pthread_create(&ctx->sock_thread, NULL, server_create, (void *)ctx) !=
+      0) {
+    fprintf(stderr, "%s: Unable to create TCP socket thread\n",
+            ctx->display_name);
+    return;
+  }
+  ctx->thread_running = true;
+}
+
+void tcp_server_client_close(struct tcp_server_ctx *ctx) {
+  assert(ctx);
+
+  // The client fd belongs to the server thread, so ask it to close it.
+  __atomic_store_n(&ctx->client_close_req, true, __ATOMIC_RELEASE);
+  wake_server(ctx);
 }
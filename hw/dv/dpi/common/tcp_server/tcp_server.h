@@ -10,16 +10,28 @@
  *
  * This is intended to be used by simulation add-on DPI modules to provide
  * basic TCP socket communication between a host and simulated peripherals.
+ *
+ * Data is passed between the simulation and the server thread through a pair
+ * of lock-free single-producer, single-consumer ring buffers. The server
+ * thread moves data between the rings and the socket in batches and sleeps in
+ * poll() when there is nothing to do, so reading and writing from the
+ * simulation doesn't make a system call per byte.
  */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct tcp_server_ctx;
 
+/**
+ * Default size of each of the ring buffers, in bytes
+ */
+#define TCP_SERVER_DEFAULT_BUF_SIZE 16384
+
 /**
  * Non-blocking read of a byte from a connected client
  *
@@ -41,7 +53,7 @@ bool tcp_server_read(struct tcp_server_ctx *ctx, char *dat);
 void tcp_server_write(struct tcp_server_ctx *ctx, char dat);
 
 /**
- * Create a new TCP server instance
+ * Create a new TCP server instance with buffers of the default size
  *
  * @param display_name C string description of server
  * @param listen_port On which port the server should listen
@@ -49,6 +61,19 @@ void tcp_server_write(struct tcp_server_ctx *ctx, char dat);
  */
 tcp_server_ctx *tcp_server_create(const char *display_name, int listen_port);
 
+/**
+ * Create a new TCP server instance
+ *
+ * @param display_name C string description of server
+ * @param listen_port On which port the server should listen
+ * @param buf_size Size of each of the receive and transmit buffers, in bytes.
+ *                 Rounded up to a power of two.
+ * @return A pointer to the created context struct
+ */
+tcp_server_ctx *tcp_server_create_with_buf_size(const char *display_name,
+                                                int listen_port,
+                                                size_t buf_size);
+
 /**
  * Shut down the server and free all reserved memory
  *
@@ -59,10 +84,36 @@ void tcp_server_close(struct tcp_server_ctx *ctx);
 /**
  * Instruct the server to disconnect a client
  *
+ * The server thread closes the connection when it next wakes up, once it has
+ * tried to send anything that is already buffered.
+ *
  * @param ctx tcp server context object
  */
 void tcp_server_client_close(struct tcp_server_ctx *ctx);
 
+/**
+ * Stop the server thread, if it is running
+ *
+ * The server stops listening and disconnects any client. Only the calling
+ * thread survives a fork, so a process that forks must call this first.
+ * Until tcp_server_resume() is called, tcp_server_read() returns nothing and
+ * tcp_server_write() blocks once the output buffer is full.
+ *
+ * @param ctx tcp server context object
+ */
+void tcp_server_suspend(struct tcp_server_ctx *ctx);
+
+/**
+ * Restart the server thread after tcp_server_suspend()
+ *
+ * Anything left in the buffers is discarded. If the listening port is in use
+ * (for example by another process forked from the same parent), the server
+ * listens on a free port instead and prints its number.
+ *
+ * @param ctx tcp server context object
+ */
+void tcp_server_resume(struct tcp_server_ctx *ctx);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
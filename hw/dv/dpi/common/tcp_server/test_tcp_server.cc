@@ -0,0 +1,172 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Test of the TCP server, run by the DV model tests in hw/meson.build.
+//
+// It first checks the ring buffers on their own, with reads and writes of
+// varying lengths that wrap around the end many times. It then connects a
+// client, which sends more data than fits in the buffers and reads it back
+// as the simulation side echoes it, so that both the full input buffer and
+// the empty output buffer have to wake the server thread.
+
+#include <arpa/inet.h>
+#include <signal.h>
+
+#include "hw/dv/verilator/cpp/test_check.h"
+
+// The ring buffer functions are static, so the server is included rather than
+// linked. Like the DPI models that use it, it is compiled as C++.
+#include "hw/dv/dpi/common/tcp_server/tcp_server.c"
+
+#define NUM_BYTES (1 << 20)
+#define RING_SIZE 64
+
+static char pattern(size_t idx) { return (char)(idx * 7 + (idx >> 9)); }
+
+static void test_ring(void) {
+  struct tcp_buf *buf = tcp_buffer_new(RING_SIZE - 1);
+  TEST_CHECK(buf->size == RING_SIZE,
+             "buffer size rounded up to a power of two");
+
+  size_t written = 0;
+  size_t read = 0;
+  unsigned seed = 1;
+  while (read < 100 * RING_SIZE) {
+    // Write a random amount, up to what is free
+    char *dst;
+    size_t space = tcp_buffer_write_region(buf, &dst);
+    TEST_CHECK(space <= RING_SIZE - (written - read), "write region too big");
+    TEST_CHECK(dst + space <= buf->buf + buf->size, "write region wraps");
+    size_t len = space ? rand_r(&seed) % (space + 1) : 0;
+    for (size_t i = 0; i < len; ++i) {
+      dst[i] = pattern(written + i);
+    }
+    tcp_buffer_commit_write(buf, len);
+    written += len;
+
+    // Read a random amount, up to what is there
+    const char *src;
+    size_t avail = tcp_buffer_read_region(buf, &src);
+    TEST_CHECK(avail <= written - read, "read region too big");
+    TEST_CHECK(src + avail <= buf->buf + buf->size, "read region wraps");
+    TEST_CHECK(avail || written == read,
+               "read region empty with data buffered");
+    len = avail ? rand_r(&seed) % (avail + 1) : 0;
+    for (size_t i = 0; i < len; ++i) {
+      if (src[i] != pattern(read + i)) {
+        TEST_CHECK(false, "data read back out of order");
+        break;
+      }
+    }
+    tcp_buffer_commit_read(buf, len);
+    read += len;
+  }
+  TEST_CHECK(buf->wptr == written && buf->rptr == read,
+             "pointers count bytes");
+  tcp_buffer_free(&buf);
+}
+
+struct client_args {
+  int port;
+  bool ok;
+};
+
+// Send NUM_BYTES to the server and check that they are echoed back
+static void *client_main(void *args_void) {
+  struct client_args *args = (struct client_args *)args_void;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(args->port);
+  while (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    usleep(1000);
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  char *out = (char *)malloc(NUM_BYTES);
+  size_t sent = 0;
+  size_t received = 0;
+  args->ok = true;
+  while (received < NUM_BYTES) {
+    struct pollfd pfd = {fd, (short)(POLLIN | (sent < NUM_BYTES ? POLLOUT : 0)),
+                         0};
+    poll(&pfd, 1, -1);
+    if (sent < NUM_BYTES && (pfd.revents & POLLOUT)) {
+      char chunk[4096];
+      size_t len = NUM_BYTES - sent < sizeof(chunk) ? NUM_BYTES - sent
+                                                    : sizeof(chunk);
+      for (size_t i = 0; i < len; ++i) {
+        chunk[i] = pattern(sent + i);
+      }
+      ssize_t rv = send(fd, chunk, len, 0);
+      if (rv > 0) {
+        sent += rv;
+      }
+    }
+    if (pfd.revents & POLLIN) {
+      ssize_t rv = recv(fd, out + received, NUM_BYTES - received, 0);
+      if (rv <= 0) {
+        args->ok = false;
+        break;
+      }
+      received += rv;
+    }
+  }
+  for (size_t i = 0; i < received; ++i) {
+    if (out[i] != pattern(i)) {
+      args->ok = false;
+      break;
+    }
+  }
+  free(out);
+  close(fd);
+  return NULL;
+}
+
+static void test_echo(void) {
+  // Find a free port
+  int probe = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  socklen_t addr_len = sizeof(addr);
+  bind(probe, (struct sockaddr *)&addr, sizeof(addr));
+  getsockname(probe, (struct sockaddr *)&addr, &addr_len);
+  close(probe);
+
+  struct tcp_server_ctx *ctx =
+      tcp_server_create_with_buf_size("test", ntohs(addr.sin_port), 256);
+  struct client_args args = {ntohs(addr.sin_port), false};
+  pthread_t client;
+  pthread_create(&client, NULL, client_main, &args);
+
+  // Echo everything, stalling now and then so that the input buffer fills up
+  for (size_t echoed = 0; echoed < NUM_BYTES;) {
+    char c;
+    if (!tcp_server_read(ctx, &c)) {
+      sched_yield();
+      continue;
+    }
+    tcp_server_write(ctx, c);
+    if (++echoed % 100000 == 0) {
+      usleep(10000);
+    }
+  }
+
+  pthread_join(client, NULL);
+  TEST_CHECK(args.ok, "data echoed through the server");
+  tcp_server_close(ctx);
+}
+
+int main(void) {
+  // Fail rather than hang if a wakeup is lost
+  alarm(60);
+
+  test_ring();
+  test_echo();
+
+  return test_check_result();
+}
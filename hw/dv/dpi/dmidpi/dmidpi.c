@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "dmidpi.h"
+#include "dpi_ctx.h"
 #include "tcp_server.h"
 
 #include <assert.h>
@@ -373,6 +374,15 @@ static void update_dmi_state(struct dmidpi_ctx *ctx) {
   }
 }
 
+// Called through dpi_ctx_stop_threads() and dpi_ctx_start_threads()
+static void dmidpi_stop_server(void *ctx_void) {
+  tcp_server_suspend(((struct dmidpi_ctx *)ctx_void)->sock);
+}
+
+static void dmidpi_start_server(void *ctx_void) {
+  tcp_server_resume(((struct dmidpi_ctx *)ctx_void)->sock);
+}
+
 void *dmidpi_create(const char *display_name, int listen_port) {
   // Create context
   struct dmidpi_ctx *ctx =
@@ -391,11 +401,14 @@ void *dmidpi_create(const char *display_name, int listen_port) {
       "  remote_bitbang_port %d\n",
       display_name, listen_port, listen_port);
 
+  dpi_ctx_register(ctx, "dmidpi", display_name);
+  dpi_ctx_set_threads(ctx, dmidpi_stop_server, dmidpi_start_server);
+
   return (void *)ctx;
 }
 
 void dmidpi_close(void *ctx_void) {
-  struct dmidpi_ctx *ctx = (struct dmidpi_ctx *)ctx_void;
+  struct dmidpi_ctx *ctx = (struct dmidpi_ctx *)dpi_ctx_resolve(ctx_void);
   if (!ctx) {
     return;
   }
@@ -403,6 +416,7 @@ void dmidpi_close(void *ctx_void) {
   // Shut down the server
   tcp_server_close(ctx->sock);
 
+  dpi_ctx_unregister(ctx);
   free(ctx);
 }
 
@@ -412,7 +426,7 @@ void dmidpi_tick(void *ctx_void, svBit *dmi_req_valid,
                  const svBit dmi_rsp_valid, svBit *dmi_rsp_ready,
                  const svBitVecVal *dmi_rsp_data,
                  const svBitVecVal *dmi_rsp_resp, svBit *dmi_rst_n) {
-  struct dmidpi_ctx *ctx = (struct dmidpi_ctx *)ctx_void;
+  struct dmidpi_ctx *ctx = (struct dmidpi_ctx *)dpi_ctx_resolve(ctx_void);
 
   if (!ctx) {
     return;
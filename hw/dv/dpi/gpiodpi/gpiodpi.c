@@ -3,6 +3,9 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "gpiodpi.h"
+#include "dpi_ctx.h"
+#include "dpi_io.h"
+#include "verilator_sim_ctrl.h"
 
 #ifdef __linux__
 #include <pty.h>
@@ -11,9 +14,12 @@
 #endif
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +33,25 @@
 #define SET_BIT(word, bit_idx) ((word) |= (1 << (bit_idx)))
 #define CLR_BIT(word, bit_idx) ((word) &= ~(1 << (bit_idx)))
 
+// The most commands from the host-to-device FIFO that are queued
+#define GPIODPI_MAX_QUEUED 64
+
+// When to apply an event
+#define GPIODPI_ASAP 0   // as soon as it is read
+#define GPIODPI_AT 1     // at cycle |time|
+#define GPIODPI_AFTER 2  // |time| cycles after it is read
+
+/**
+ * A change to the pins that the host drives, from one command
+ */
+struct gpiodpi_event {
+  int timing;
+  uint64_t time;
+  // Pins to pull high, and pins to pull low
+  uint32_t set_pins;
+  uint32_t clr_pins;
+};
+
 struct gpiodpi_ctx {
   // The number of pins we're driving.
   int n_bits;
@@ -40,6 +65,27 @@ struct gpiodpi_ctx {
   char dev_to_host_path[PATH_MAX];
   int host_to_dev_fifo;
   char host_to_dev_path[PATH_MAX];
+
+  // Commands from the host-to-device FIFO, parsed on the I/O thread, and the
+  // one that has been read from the channel but isn't due yet
+  struct dpi_io_chan *host_to_dev;
+  struct gpiodpi_event host_event;
+  bool host_event_pending;
+
+  // Events from the stimulus script, in order, and the next one to apply
+  struct gpiodpi_event *script;
+  size_t script_len;
+  size_t script_pos;
+
+  // The pins last written to the device-to-host FIFO, and whether any have
+  // been written yet
+  uint32_t out_data;
+  uint32_t out_oe;
+  bool out_valid;
+  // Set once old output has been discarded because nobody reads the FIFO,
+  // and once writing to it has failed
+  bool out_dropped;
+  bool out_failed;
 };
 
 /**
@@ -71,6 +117,7 @@ static int open_fifo(char *path_buf, int flags) {
   return fd;
 }
 
+
 /**
  * Print out a usage message for the GPIO interface.
  *
@@ -86,15 +133,213 @@ static void print_usage(char *rfifo, char *wfifo, int n_bits) {
       rfifo, wfifo, n_bits);
   printf(
       "GPIO: To measure the values of the pins as driven by the device, run\n");
-  printf("$ cat %s  # '0' low, '1' high, 'X' floating\n", rfifo);
+  printf("$ cat %s  # '0' low, '1' high, 'X' floating, then @cycle\n", rfifo);
   printf("GPIO: To drive the pins, run a command like\n");
   printf("$ echo 'h09 l31' > %s  # Pull the pin 9 high, and pin 31 low.\n",
          wfifo);
 }
 
-void *gpiodpi_create(const char *name, int n_bits) {
+/**
+ * Parses an unsigned decimal number from |text|, advancing it forward as
+ * necessary.
+ *
+ * @return false if |text| doesn't start with a digit, or the number is too
+ *         big.
+ */
+static bool parse_dec(const char **text, uint64_t *value) {
+  if (!isdigit((unsigned char)**text)) {
+    return false;
+  }
+
+  *value = 0;
+  for (; isdigit((unsigned char)**text); ++*text) {
+    uint64_t digit = **text - '0';
+    if (*value > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+    *value = *value * 10 + digit;
+  }
+  return true;
+}
+
+/**
+ * Parses a line of commands into an event.
+ *
+ * The line is a space-separated sequence of commands. |hNN| pulls pin NN
+ * (in decimal) high and |lNN| pulls it low. It may start with |@NN|, to apply
+ * the commands at cycle NN, or |+NN|, to apply them NN cycles later. A |#|
+ * starts a comment.
+ *
+ * @arg line the line to parse.
+ * @arg n_bits the number of pins supported.
+ * @arg event set to the event.
+ * @arg err set to a description of the first error.
+ * @return 1 for an event, 0 for a line with nothing on it, or -1 on error.
+ */
+static int parse_command(const char *line, int n_bits,
+                         struct gpiodpi_event *event, char *err,
+                         size_t err_len) {
+  memset(event, 0, sizeof(*event));
+  event->timing = GPIODPI_ASAP;
+  bool empty = true;
+
+  const char *text = line;
+  while (true) {
+    while (isspace((unsigned char)*text)) {
+      ++text;
+    }
+    if (*text == '\0' || *text == '#') {
+      break;
+    }
+
+    const char *cmd = text++;
+    uint64_t value;
+    bool valid = parse_dec(&text, &value) &&
+                 (*text == '\0' || isspace((unsigned char)*text));
+    switch (*cmd) {
+      case '@':
+      case '+':
+        valid = valid && empty;
+        if (!valid) {
+          break;
+        }
+        event->timing = *cmd == '@' ? GPIODPI_AT : GPIODPI_AFTER;
+        event->time = value;
+        break;
+      case 'l':
+      case 'L':
+      case 'h':
+      case 'H':
+        if (!valid) {
+          break;
+        }
+        if (value >= (uint64_t)n_bits) {
+          snprintf(err, err_len, "No such pin: `%.*s'", (int)(text - cmd),
+                   cmd);
+          return -1;
+        }
+        if (tolower(*cmd) == 'h') {
+          SET_BIT(event->set_pins, value);
+          CLR_BIT(event->clr_pins, value);
+        } else {
+          SET_BIT(event->clr_pins, value);
+          CLR_BIT(event->set_pins, value);
+        }
+        break;
+      default:
+        valid = false;
+        break;
+    }
+    if (!valid) {
+      while (*text != '\0' && !isspace((unsigned char)*text)) {
+        ++text;
+      }
+      snprintf(err, err_len, "Invalid command: `%.*s'", (int)(text - cmd),
+               cmd);
+      return -1;
+    }
+    empty = false;
+  }
+  return empty ? 0 : 1;
+}
+
+/**
+ * Parses a command from the host-to-device FIFO, on the I/O thread.
+ */
+static bool parse_host_command(void *ctx_void, const char *line,
+                               void *record) {
+  struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)ctx_void;
+  char err[64];
+  int rv = parse_command(line, ctx->n_bits, (struct gpiodpi_event *)record,
+                         err, sizeof(err));
+  if (rv < 0) {
+    fprintf(stderr, "GPIO: %s, ignoring `%s'\n", err, line);
+  }
+  return rv > 0;
+}
+
+/**
+ * Loads a stimulus script, with one line of commands per event.
+ *
+ * The times of the events are absolute: |@NN| is at cycle NN, |+NN| is NN
+ * cycles after the previous event, and a line without either is at the same
+ * time as the previous event.
+ *
+ * @return false if the script couldn't be read or parsed.
+ */
+static bool load_script(struct gpiodpi_ctx *ctx, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "GPIO: Unable to open stimulus script at %s: %s\n", path,
+            strerror(errno));
+    return false;
+  }
+
+  size_t cap = 0;
+  uint64_t time = 0;
+  char line[DPI_IO_MAX_LINE];
+  unsigned line_no = 0;
+  bool ok = true;
+  while (fgets(line, sizeof(line), file)) {
+    ++line_no;
+    struct gpiodpi_event event;
+    char err[64];
+    int rv = parse_command(line, ctx->n_bits, &event, err, sizeof(err));
+    if (rv < 0) {
+      fprintf(stderr, "GPIO: %s:%u: %s\n", path, line_no, err);
+      ok = false;
+      break;
+    }
+    if (rv == 0) {
+      continue;
+    }
+
+    if (event.timing == GPIODPI_AT) {
+      if (event.time < time) {
+        fprintf(stderr, "GPIO: %s:%u: Cycle %llu is before the previous "
+                "event\n", path, line_no, (unsigned long long)event.time);
+        ok = false;
+        break;
+      }
+      time = event.time;
+    } else if (event.timing == GPIODPI_AFTER) {
+      time += event.time;
+    }
+    event.timing = GPIODPI_AT;
+    event.time = time;
+
+    if (ctx->script_len == cap) {
+      cap = cap ? 2 * cap : 64;
+      ctx->script = (struct gpiodpi_event *)realloc(
+          ctx->script, cap * sizeof(struct gpiodpi_event));
+      assert(ctx->script);
+    }
+    ctx->script[ctx->script_len++] = event;
+  }
+  fclose(file);
+
+  if (ok) {
+    printf("GPIO: Loaded %zu event(s) from stimulus script %s.\n",
+           ctx->script_len, path);
+  }
+  return ok;
+}
+
+// Called through dpi_ctx_stop_threads() and dpi_ctx_start_threads(). The I/O
+// thread is shared, so it doesn't matter which context asks.
+static void gpiodpi_suspend_io(void *ctx_void) {
+  (void)ctx_void;
+  dpi_io_suspend();
+}
+
+static void gpiodpi_resume_io(void *ctx_void) {
+  (void)ctx_void;
+  dpi_io_resume();
+}
+
+void *gpiodpi_create(const char *name, int n_bits, const char *script_path) {
   struct gpiodpi_ctx *ctx =
-      (struct gpiodpi_ctx *)malloc(sizeof(struct gpiodpi_ctx));
+      (struct gpiodpi_ctx *)calloc(1, sizeof(struct gpiodpi_ctx));
   assert(ctx);
 
   // n_bits > 32 requires more sophisticated handling of svBitVecVal which we
@@ -119,128 +364,168 @@ void *gpiodpi_create(const char *name, int n_bits) {
   if (ctx->dev_to_host_fifo < 0) {
     return NULL;
   }
+  // Never block the simulation if nobody reads the output
+  int flags = fcntl(ctx->dev_to_host_fifo, F_GETFL, 0);
+  if (flags == -1 ||
+      fcntl(ctx->dev_to_host_fifo, F_SETFL, flags | O_NONBLOCK) == -1) {
+    fprintf(stderr, "GPIO: Unable to make %s non-blocking: %s\n",
+            ctx->dev_to_host_path, strerror(errno));
+    return NULL;
+  }
 
   ctx->host_to_dev_fifo = open_fifo(ctx->host_to_dev_path, O_RDWR);
   if (ctx->host_to_dev_fifo < 0) {
     return NULL;
   }
 
-  int flags = fcntl(ctx->host_to_dev_fifo, F_GETFL, 0);
-  fcntl(ctx->host_to_dev_fifo, F_SETFL, flags | O_NONBLOCK);
+  // Commands are read and parsed on the shared I/O thread
+  ctx->host_to_dev = dpi_io_open_records(
+      "GPIO", ctx->host_to_dev_fifo, sizeof(struct gpiodpi_event),
+      GPIODPI_MAX_QUEUED, parse_host_command, ctx);
+  if (!ctx->host_to_dev) {
+    return NULL;
+  }
 
   print_usage(ctx->dev_to_host_path, ctx->host_to_dev_path, ctx->n_bits);
 
+  if (strlen(script_path) != 0 && !load_script(ctx, script_path)) {
+    // Don't let a test run without the stimulus it asked for
+    VerilatorSimCtrl::GetInstance().RequestStop(false);
+  }
+
+  dpi_ctx_register(ctx, "gpiodpi", name);
+  dpi_ctx_set_threads(ctx, gpiodpi_suspend_io, gpiodpi_resume_io);
+
   return (void *)ctx;
 }
 
 void gpiodpi_device_to_host(void *ctx_void, svBitVecVal *gpio_data,
                             svBitVecVal *gpio_oe) {
-  struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)ctx_void;
+  struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)dpi_ctx_resolve(ctx_void);
   assert(ctx);
 
+  // Only report a change in what the host would measure
+  uint32_t mask = ctx->n_bits == 32 ? ~0u : (1u << ctx->n_bits) - 1;
+  uint32_t oe = gpio_oe[0] & mask;
+  uint32_t data = gpio_data[0] & oe;
+  if (ctx->out_valid && oe == ctx->out_oe && data == ctx->out_data) {
+    return;
+  }
+  ctx->out_data = data;
+  ctx->out_oe = oe;
+  ctx->out_valid = true;
+
   // Write 0, 1, or X (when oe is not set) for each GPIO pin, in big endian
-  // order (i.e., pin 0 is the last character written). Finish it with a
-  // newline.
-  char gpio_str[32 + 1];
+  // order (i.e., pin 0 is the last character written), followed by the cycle.
+  // Finish it with a newline.
+  char gpio_str[32 + 24];
   char *pin_char = gpio_str;
   for (int i = ctx->n_bits - 1; i >= 0; --i, ++pin_char) {
-    if (!GET_BIT(gpio_oe[0], i)) {
+    if (!GET_BIT(oe, i)) {
       *pin_char = 'X';
-    } else if (GET_BIT(gpio_data[0], i)) {
+    } else if (GET_BIT(data, i)) {
       *pin_char = '1';
     } else {
       *pin_char = '0';
     }
   }
-  *pin_char = '\n';
-
-  ssize_t written = write(ctx->dev_to_host_fifo, gpio_str, ctx->n_bits + 1);
-  assert(written == ctx->n_bits + 1);
+  int len = ctx->n_bits;
+  len += snprintf(pin_char, sizeof(gpio_str) - len, " @%lu\n",
+                  VerilatorSimCtrl::GetInstance().GetTime() / 2);
+
+  // The FIFO is open for reading as well, so that writing to it never blocks
+  // or fails for want of a reader. If nobody reads it and it fills up, throw
+  // away what is in it, so that a reader sees the latest state of the pins.
+  // Each update is written in one go, so the FIFO only ever holds whole
+  // lines.
+  ssize_t written = write(ctx->dev_to_host_fifo, gpio_str, len);
+  if (written < 0 && errno == EAGAIN) {
+    char discard[4096];
+    while (read(ctx->dev_to_host_fifo, discard, sizeof(discard)) > 0) {
+    }
+    written = write(ctx->dev_to_host_fifo, gpio_str, len);
+    if (!ctx->out_dropped) {
+      fprintf(stderr, "GPIO: Nobody is reading %s, keeping only the latest "
+              "updates.\n", ctx->dev_to_host_path);
+      ctx->out_dropped = true;
+    }
+  }
+  if (written != len && !ctx->out_failed) {
+    fprintf(stderr, "GPIO: Unable to write to %s, dropping updates.\n",
+            ctx->dev_to_host_path);
+    ctx->out_failed = true;
+  }
 }
 
 /**
- * Parses an unsigned decimal number from |text|, advancing it forward as
- * necessary.
- *
- * Returns upon encountering any non-decimal digit.
+ * Applies an event to the pins that the host drives.
  */
-static uint32_t parse_dec(char **text) {
-  if (text == NULL || *text == NULL) {
-    return 0;
-  }
-
-  uint32_t value = 0;
-  for (; **text != '\0'; ++*text) {
-    char c = **text;
-    uint32_t digit;
-    if (c >= '0' && c <= '9') {
-      digit = (c - '0');
-    } else {
-      break;
+static void apply_event(struct gpiodpi_ctx *ctx,
+                        const struct gpiodpi_event *event,
+                        const svBitVecVal *gpio_oe) {
+  for (int idx = 0; idx < ctx->n_bits; ++idx) {
+    if (GET_BIT(gpio_oe[0], idx)) {
+      continue;
+    }
+    if (GET_BIT(event->clr_pins, idx)) {
+      fprintf(stderr, "GPIO: Host tried to pull disabled pin low: pin %2d\n",
+              idx);
+    } else if (GET_BIT(event->set_pins, idx)) {
+      fprintf(stderr, "GPIO: Host tried to pull disabled pin high: pin %2d\n",
+              idx);
     }
-
-    value *= 10;
-    value += digit;
   }
-
-  return value;
+  ctx->driven_pin_values |= event->set_pins;
+  ctx->driven_pin_values &= ~event->clr_pins;
 }
 
 uint32_t gpiodpi_host_to_device_tick(void *ctx_void, svBitVecVal *gpio_oe) {
-  struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)ctx_void;
+  struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)dpi_ctx_resolve(ctx_void);
   assert(ctx);
 
-  char gpio_str[32 + 2];
-  ssize_t read_len = read(ctx->host_to_dev_fifo, gpio_str, 32 + 1);
-  if (read_len < 0) {
+  // Nothing to do on most cycles, which is cheap to check
+  if (ctx->script_pos == ctx->script_len && !ctx->host_event_pending &&
+      !dpi_io_available(ctx->host_to_dev)) {
     return ctx->driven_pin_values;
   }
-  gpio_str[read_len] = '\0';
-
-  char *gpio_text = gpio_str;
-  for (; *gpio_text != '\0'; ++gpio_text) {
-    switch (*gpio_text) {
-      case '\n':
-      case '\r':
-      case '\0':
-        goto parse_loop_end;
-      case 'l':
-      case 'L': {
-        ++gpio_text;
-        int idx = parse_dec(&gpio_text);
-        if (!GET_BIT(gpio_oe[0], idx)) {
-          fprintf(stderr,
-                  "GPIO: Host tried to pull disabled pin low: pin %2d\n", idx);
-        }
-        CLR_BIT(ctx->driven_pin_values, idx);
+
+  uint64_t cycle = VerilatorSimCtrl::GetInstance().GetTime() / 2;
+
+  while (ctx->script_pos < ctx->script_len &&
+         ctx->script[ctx->script_pos].time <= cycle) {
+    apply_event(ctx, &ctx->script[ctx->script_pos++], gpio_oe);
+  }
+
+  while (true) {
+    struct gpiodpi_event *event = &ctx->host_event;
+    if (!ctx->host_event_pending) {
+      if (!dpi_io_read(ctx->host_to_dev, event, sizeof(*event))) {
         break;
       }
-      case 'h':
-      case 'H': {
-        ++gpio_text;
-        int idx = parse_dec(&gpio_text);
-        if (!GET_BIT(gpio_oe[0], idx)) {
-          fprintf(stderr,
-                  "GPIO: Host tried to pull disabled pin high: pin %2d\n", idx);
-        }
-        SET_BIT(ctx->driven_pin_values, idx);
-        break;
+      ctx->host_event_pending = true;
+      if (event->timing == GPIODPI_AFTER) {
+        event->timing = GPIODPI_AT;
+        event->time += cycle;
       }
-      default:
-        break;
     }
+    if (event->timing == GPIODPI_AT && event->time > cycle) {
+      break;
+    }
+    apply_event(ctx, event, gpio_oe);
+    ctx->host_event_pending = false;
   }
 
-parse_loop_end:
   return ctx->driven_pin_values;
 }
 
 void gpiodpi_close(void *ctx_void) {
-  struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)ctx_void;
+  struct gpiodpi_ctx *ctx = (struct gpiodpi_ctx *)dpi_ctx_resolve(ctx_void);
   if (ctx == NULL) {
     return;
   }
 
+  dpi_io_close(ctx->host_to_dev);
+
   if (close(ctx->dev_to_host_fifo) != 0) {
     printf("GPIO: Failed to close FIFO file at %s: %s\n", ctx->dev_to_host_path,
            strerror(errno));
@@ -259,5 +544,7 @@ void gpiodpi_close(void *ctx_void) {
            ctx->host_to_dev_path, strerror(errno));
   }
 
+  dpi_ctx_unregister(ctx);
+  free(ctx->script);
   free(ctx);
 }
@@ -15,11 +15,21 @@ extern "C" {
  * @param name a name to use when creating the inner FIFO.
  * @param n_bits number of bits to write in each direction; this must be at
  *        most 32 bits.
+ * @param script_path path of a stimulus script to drive the pins from, or an
+ *        empty string for none. It has one command line (as for the FIFO) per
+ *        line, and is loaded before the simulation starts. The simulation is
+ *        stopped if it can't be loaded.
  */
-void *gpiodpi_create(const char *name, int n_bits);
+void *gpiodpi_create(const char *name, int n_bits, const char *script_path);
 
 /**
- * Attempt to post the current GPIO state to the outside world.
+ * Post the current GPIO state to the outside world, if it has changed.
+ *
+ * The state is written as one character per pin, followed by |@| and the
+ * current cycle. Nothing is written if the pins that are enabled, and their
+ * values, are the same as last time. The FIFO never blocks the simulation: if
+ * nobody reads it and it fills up, the old updates in it are discarded to
+ * make space for the new one.
  *
  * Intended to be called from SystemVerilog.
  */
@@ -27,13 +37,18 @@ void gpiodpi_device_to_host(void *ctx_void, svBitVecVal *gpio_data,
                             svBitVecVal *gpio_oe);
 
 /**
- * Attempt to read a GPIO command from the outside world.
+ * Apply the GPIO commands from the outside world that are due.
  *
  * The commands from the host should be a space-separated sequence of high and
- * low commands, terminated by a newline. A high command is of the form |hXX|,
- * where XX are hex digits, pulls the XXth GPIO pin high; a low command, |lXX|,
- * does the opposite. All other pins at left in an unspecified state. Invalid
- * commands are ignored.
+ * low commands, terminated by a newline. A high command is of the form |hNN|,
+ * where NN are decimal digits, pulls the NNth GPIO pin high; a low command,
+ * |lNN|, does the opposite. All other pins are left as they were. The line may
+ * start with |@NN|, to apply it at cycle NN, or |+NN|, to apply it NN cycles
+ * after it is read; otherwise it is applied as soon as it is read. Lines are
+ * applied in order. Lines with invalid commands are ignored.
+ *
+ * Commands are read and parsed off the simulation thread, so this is cheap
+ * enough to call on every clock cycle.
  *
  * Intended to be called from SystemVerilog.
  * @return the values to pull the GPIO pins to.
@@ -15,7 +15,8 @@ module gpiodpi
   input  logic [N_GPIO-1:0] gpio_en_d2p
 );
    import "DPI-C" function
-     chandle gpiodpi_create(input string name, input int n_bits);
+     chandle gpiodpi_create(input string name, input int n_bits,
+                            input string script_path);
 
    import "DPI-C" function
      void gpiodpi_device_to_host(input chandle ctx, input [N_GPIO-1:0] gpio_d2p,
@@ -29,9 +30,14 @@ module gpiodpi
                                      input [N_GPIO-1:0] gpio_en_d2p);
 
    chandle ctx;
+   string script_path;
 
    initial begin
-     ctx = gpiodpi_create(NAME, N_GPIO);
+     // +GPIODPI_SCRIPT_<NAME>=FILE drives the pins from a stimulus script
+     if (!$value$plusargs({"GPIODPI_SCRIPT_", NAME, "=%s"}, script_path)) begin
+       script_path = "";
+     end
+     ctx = gpiodpi_create(NAME, N_GPIO, script_path);
    end
 
    final begin
@@ -39,38 +45,23 @@ module gpiodpi
    end
 
    logic [N_GPIO-1:0] gpio_d2p_r;
+   logic [N_GPIO-1:0] gpio_en_d2p_r;
    always_ff @(posedge clk_i) begin
      gpio_d2p_r <= gpio_d2p;
-     if (gpio_d2p_r != gpio_d2p) begin
+     gpio_en_d2p_r <= gpio_en_d2p;
+     if (gpio_d2p_r != gpio_d2p || gpio_en_d2p_r != gpio_en_d2p) begin
        gpiodpi_device_to_host(ctx, gpio_d2p, gpio_en_d2p);
      end
    end
 
-   logic gpio_write_pulse;
-
+   // Commands are parsed off the simulation thread, and checking for one that
+   // is due is cheap, so this is called on every cycle to apply each one at
+   // the right time.
    always_ff @(posedge clk_i or negedge rst_ni) begin
      if (!rst_ni) begin
        gpio_p2d <= '0; // default value
-     end else if (gpio_write_pulse) begin
-       gpio_p2d <= gpiodpi_host_to_device_tick(ctx, gpio_en_d2p);
-     end
-   end
-
-   // gpiodpio_host_to_device_tick() will be called every MAX_COUNT
-   // clock posedges; this should be kept reasonably high, since each
-   // tick call will perform at least one syscall.
-   localparam MAX_COUNT = 2048;
-   logic [$clog2(MAX_COUNT)-1:0] counter;
-
-   assign gpio_write_pulse = counter == MAX_COUNT -1;
-
-   always_ff @(posedge clk_i or negedge rst_ni) begin
-     if (!rst_ni) begin
-       counter <= '0;
-     end else if (gpio_write_pulse) begin
-       counter <= '0;
      end else begin
-       counter <= counter + 1'b1;
+       gpio_p2d <= gpiodpi_host_to_device_tick(ctx, gpio_en_d2p);
      end
    end
 
@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "jtagdpi.h"
+#include "dpi_ctx.h"
 #include "tcp_server.h"
 
 #include <assert.h>
@@ -103,6 +104,15 @@ static void update_jtag_signals(struct jtagdpi_ctx *ctx) {
   }
 }
 
+// Called through dpi_ctx_stop_threads() and dpi_ctx_start_threads()
+static void jtagdpi_stop_server(void *ctx_void) {
+  tcp_server_suspend(((struct jtagdpi_ctx *)ctx_void)->sock);
+}
+
+static void jtagdpi_start_server(void *ctx_void) {
+  tcp_server_resume(((struct jtagdpi_ctx *)ctx_void)->sock);
+}
+
 void *jtagdpi_create(const char *display_name, int listen_port) {
   struct jtagdpi_ctx *ctx =
       (struct jtagdpi_ctx *)calloc(1, sizeof(struct jtagdpi_ctx));
@@ -122,21 +132,25 @@ void *jtagdpi_create(const char *display_name, int listen_port) {
       "  remote_bitbang_port %d\n",
       display_name, listen_port, listen_port);
 
+  dpi_ctx_register(ctx, "jtagdpi", display_name);
+  dpi_ctx_set_threads(ctx, jtagdpi_stop_server, jtagdpi_start_server);
+
   return (void *)ctx;
 }
 
 void jtagdpi_close(void *ctx_void) {
-  struct jtagdpi_ctx *ctx = (struct jtagdpi_ctx *)ctx_void;
+  struct jtagdpi_ctx *ctx = (struct jtagdpi_ctx *)dpi_ctx_resolve(ctx_void);
   if (!ctx) {
     return;
   }
   tcp_server_close(ctx->sock);
+  dpi_ctx_unregister(ctx);
   free(ctx);
 }
 
 void jtagdpi_tick(void *ctx_void, svBit *tck, svBit *tms, svBit *tdi,
                   svBit *trst_n, svBit *srst_n, const svBit tdo) {
-  struct jtagdpi_ctx *ctx = (struct jtagdpi_ctx *)ctx_void;
+  struct jtagdpi_ctx *ctx = (struct jtagdpi_ctx *)dpi_ctx_resolve(ctx_void);
 
   ctx->tdo = tdo;
 
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "dpi_mon.h"
 #include "spidpi.h"
 
 #define MON_BUFLEN 65
@@ -214,3 +215,30 @@ void monitor_spi(void *mon_void, FILE *mon_file, int loglevel, int tick,
   mon->prev_p2d = p2d;
   mon->prev_d2p = d2p;
 }
+
+/**
+ * SPI device monitor writing a binary log
+ *
+ * Records the pins whenever they change, for util/dpi_mon_convert.py to turn
+ * into the output of monitor_spi().
+ *
+ * @param mon_void - monitor context structure
+ * @param mon_file - FILE * for the binary log
+ * @param tick - simulation time
+ * @param p2d - bits of signals from pins to device
+ * @param d2p - bits of signals from device to pins
+ */
+void monitor_spi_record(void *mon_void, FILE *mon_file, int tick, int p2d,
+                        int d2p) {
+  struct mon_ctx *mon = (struct mon_ctx *)mon_void;
+  assert(mon);
+
+  if (((uint32_t)p2d == mon->prev_p2d) &&
+      ((uint32_t)d2p == mon->prev_d2p)) {
+    return;
+  }
+  uint8_t pins[2] = {(uint8_t)p2d, (uint8_t)d2p};
+  dpi_mon_record(mon_file, SPI_MON_PINS, 0, tick, pins, sizeof(pins));
+  mon->prev_p2d = p2d;
+  mon->prev_d2p = d2p;
+}
@@ -19,6 +19,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "dpi_ctx.h"
+#include "dpi_io.h"
+#include "dpi_mon.h"
 #include "spidpi.h"
 #include "verilator_sim_ctrl.h"
 
@@ -26,17 +29,78 @@
 // and resume at the first SPI packet
 // #define CONTROL_TRACE
 
-void *spidpi_create(const char *name, int mode, int loglevel) {
-  int i;
+// Write out the bytes received in the current CSB cycle
+static void spidpi_flush_rx(struct spidpi_ctx *ctx) {
+  int done = 0;
+  while (done < ctx->nrx) {
+    ssize_t rv = write(ctx->host, &ctx->rx_buf[done], ctx->nrx - done);
+    if (rv < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Most likely nobody is reading from the pseudo-terminal
+      if (!ctx->rx_dropped) {
+        fprintf(stderr, "SPI: Unable to write to %s, dropping data: %s\n",
+                ctx->ptyname, strerror(errno));
+        ctx->rx_dropped = 1;
+      }
+      break;
+    }
+    done += rv;
+  }
+  ctx->nrx = 0;
+}
+
+// Called through dpi_ctx_stop_threads() and dpi_ctx_start_threads(). The I/O
+// thread is shared, so it doesn't matter which context asks.
+static void spidpi_suspend_io(void *ctx_void) {
+  (void)ctx_void;
+  dpi_io_suspend();
+}
+
+static void spidpi_resume_io(void *ctx_void) {
+  (void)ctx_void;
+  dpi_io_resume();
+}
+
+void *spidpi_create(const char *name, int mode, int loglevel, int sck_div,
+                    int burst, int partial_wait, const char *mon_mode) {
   struct spidpi_ctx *ctx =
       (struct spidpi_ctx *)calloc(1, sizeof(struct spidpi_ctx));
   assert(ctx);
 
+  if (sck_div < SPIDPI_MIN_SCK_DIV) {
+    fprintf(stderr, "SPI: SCK divider %d is too small, using %d.\n", sck_div,
+            SPIDPI_MIN_SCK_DIV);
+    sck_div = SPIDPI_MIN_SCK_DIV;
+  }
+  if (burst < 1 || burst > MAX_TRANSACTION) {
+    fprintf(stderr, "SPI: Burst length %d is out of range, using %d.\n",
+            burst, MAX_TRANSACTION);
+    burst = MAX_TRANSACTION;
+  }
+  if (partial_wait < 0) {
+    fprintf(stderr, "SPI: Partial burst wait %d is negative, turning it off.\n",
+            partial_wait);
+    partial_wait = 0;
+  }
+  int mon = dpi_mon_parse_mode(mon_mode);
+  if (mon < 0) {
+    fprintf(stderr, "SPI: Unknown monitor mode `%s', turning it off.\n",
+            mon_mode);
+    mon = DPI_MON_OFF;
+  }
+
   ctx->loglevel = loglevel;
+  ctx->mon_mode = mon;
   ctx->mon = monitor_spi_init(mode);
   ctx->tick = 0;
+  ctx->sck_div = sck_div;
+  ctx->sck_cnt = 0;
+  ctx->internal_sck = 0;
   ctx->msbfirst = 1;
-  ctx->nmax = MAX_TRANSACTION;
+  ctx->nmax = burst;
+  ctx->partial_wait = partial_wait;
   ctx->nin = 0;
   ctx->nout = 0;
   ctx->bout = 0;
@@ -69,33 +133,55 @@ void *spidpi_create(const char *name, int mode, int loglevel) {
   int new_flags = fcntl(ctx->host, F_SETFL, cur_flags | O_NONBLOCK);
   assert(new_flags != -1 && "Unable to set FD flags");
 
+  // Input is read on the shared I/O thread
+  ctx->host_in = dpi_io_open("SPI", ctx->host, DPI_IO_DEFAULT_BUF_SIZE);
+  assert(ctx->host_in);
+
   printf(
       "\n"
       "SPI: Created %s for %s. Connect to it with any terminal program, e.g.\n"
       "$ screen %s\n"
-      "NOTE: a SPI transaction is run for every 4 characters entered.\n",
-      ctx->ptyname, name, ctx->ptyname);
-
-  rv = snprintf(ctx->mon_pathname, PATH_MAX, "%s/%s.log", cwd, name);
-  assert(rv <= PATH_MAX && rv > 0);
-  ctx->mon_file = fopen(ctx->mon_pathname, "w");
-  if (ctx->mon_file == NULL) {
-    fprintf(stderr, "SPI: Unable to open file at %s: %s\n", ctx->mon_pathname,
-            strerror(errno));
-    return NULL;
-  }
-  // more useful for tail -f
-  setlinebuf(ctx->mon_file);
-  printf(
-      "SPI: Monitor output file created at %s. Works well with tail:\n"
-      "$ tail -f %s\n",
-      ctx->mon_pathname, ctx->mon_pathname);
+      "NOTE: a SPI transaction is run for every %d characters entered.\n",
+      ctx->ptyname, name, ctx->ptyname, ctx->nmax);
+  if (ctx->partial_wait) {
+    printf("Fewer are sent after %d cycles without input.\n",
+           ctx->partial_wait);
+  }
+  printf("SCK runs at 1/%d of the primary clock.\n", 2 * ctx->sck_div);
+
+  if (ctx->mon_mode != DPI_MON_OFF) {
+    rv = snprintf(ctx->mon_pathname, PATH_MAX, "%s/%s.%s", cwd, name,
+                  ctx->mon_mode == DPI_MON_TEXT ? "log" : "mon");
+    assert(rv <= PATH_MAX && rv > 0);
+    ctx->mon_file =
+        dpi_mon_open(ctx->mon_pathname, ctx->mon_mode, DPI_MON_KIND_SPI,
+                     (uint32_t)mode << 24 | (loglevel & 0xffffff));
+    if (ctx->mon_file == NULL) {
+      fprintf(stderr, "SPI: Unable to open file at %s: %s\n",
+              ctx->mon_pathname, strerror(errno));
+      return NULL;
+    }
+    if (ctx->mon_mode == DPI_MON_TEXT) {
+      printf(
+          "SPI: Monitor output file created at %s. Works well with tail:\n"
+          "$ tail -f %s\n",
+          ctx->mon_pathname, ctx->mon_pathname);
+    } else {
+      printf(
+          "SPI: Binary monitor output file created at %s. Convert it with:\n"
+          "$ util/dpi_mon_convert.py %s\n",
+          ctx->mon_pathname, ctx->mon_pathname);
+    }
+  }
+
+  dpi_ctx_register(ctx, "spidpi", name);
+  dpi_ctx_set_threads(ctx, spidpi_suspend_io, spidpi_resume_io);
 
   return (void *)ctx;
 }
 
 char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
-  struct spidpi_ctx *ctx = (struct spidpi_ctx *)ctx_void;
+  struct spidpi_ctx *ctx = (struct spidpi_ctx *)dpi_ctx_resolve(ctx_void);
   assert(ctx);
   int d2p = d2p_data->aval;
 
@@ -108,37 +194,60 @@ char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
   }
 #endif
 
-  monitor_spi(ctx->mon, ctx->mon_file, ctx->loglevel, ctx->tick, ctx->driving,
-              d2p);
+  switch (ctx->mon_mode) {
+    case DPI_MON_TEXT:
+      monitor_spi(ctx->mon, ctx->mon_file, ctx->loglevel, ctx->tick,
+                  ctx->driving, d2p);
+      break;
+    case DPI_MON_BINARY:
+      monitor_spi_record(ctx->mon, ctx->mon_file, ctx->tick, ctx->driving,
+                         d2p);
+      break;
+    default:
+      break;
+  }
 
   if (ctx->state == SP_IDLE) {
-    int n = read(ctx->host, &(ctx->buf[ctx->nin]), ctx->nmax - ctx->nin);
-    if (n == -1) {
-      if (errno != EAGAIN) {
-        fprintf(stderr, "Read on SPI FIFO gave %s\n", strerror(errno));
-      }
-    } else {
-      ctx->nin += n;
-      if (ctx->nin == ctx->nmax) {
-        ctx->nout = 0;
-        ctx->nin = 0;
-        ctx->bout = ctx->msbfirst ? 0x80 : 0x01;
-        ctx->bin = ctx->msbfirst ? 0x80 : 0x01;
-        ctx->din = 0;
-        ctx->state = SP_CSFALL;
+    int n = dpi_io_read(ctx->host_in, &(ctx->buf[ctx->nin]),
+                        ctx->nmax - ctx->nin);
+    ctx->nin += n;
+    if (n) {
+      ctx->idle_wait = 0;
+    } else if (ctx->idle_wait < ctx->partial_wait) {
+      ++ctx->idle_wait;
+    }
+    // Start a transaction once there is a full burst or, if enabled, once
+    // the input has paused part way through one.
+    if (ctx->nin == ctx->nmax ||
+        (ctx->nin && ctx->partial_wait &&
+         ctx->idle_wait >= ctx->partial_wait)) {
+      ctx->nframe = ctx->nin;
+      ctx->nout = 0;
+      ctx->nin = 0;
+      ctx->bout = ctx->msbfirst ? 0x80 : 0x01;
+      ctx->bin = ctx->msbfirst ? 0x80 : 0x01;
+      ctx->din = 0;
+      ctx->state = SP_CSFALL;
 #ifdef CONTROL_TRACE
-        VerilatorSimCtrl::GetInstance().TraceOn();
+      VerilatorSimCtrl::GetInstance().TraceOn();
 #endif
-      }
     }
   }
-  // SPI clock toggles every 4th tick (i.e. freq=primary_frequency/8)
-  if ((ctx->tick & 3) || (ctx->state == SP_IDLE)) {
+  // SPI clock toggles every sck_div ticks (i.e. freq=primary_frequency /
+  // (2 * sck_div)). It keeps running while idle, so that transactions start
+  // on an SCK edge.
+  if (++ctx->sck_cnt == ctx->sck_div) {
+    ctx->sck_cnt = 0;
+    ctx->internal_sck ^= 1;
+  } else {
+    return ctx->driving;
+  }
+  if (ctx->state == SP_IDLE) {
     return ctx->driving;
   }
 
   // Only get here on sck edges when active
-  int internal_sck = (ctx->tick & 4) ? 1 : 0;
+  int internal_sck = ctx->internal_sck;
   int set_sck = (internal_sck ? P2D_SCK : 0);
   if (ctx->cpol) {
     set_sck ^= P2D_SCK;
@@ -155,7 +264,7 @@ char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
         if ((ctx->bout & 0xff) == 0) {
           ctx->bout = ctx->msbfirst ? 0x80 : 0x01;
           ctx->nout++;
-          if (ctx->nout == ctx->nmax) {
+          if (ctx->nout == ctx->nframe) {
             ctx->state = SP_LASTBIT;
           }
         }
@@ -177,8 +286,11 @@ char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
         ctx->din = ctx->din | ((d2p & D2P_SDO) ? ctx->bin : 0);
         ctx->bin = (ctx->msbfirst) ? ctx->bin >> 1 : ctx->bin << 1;
         if (ctx->bin == 0) {
-          int rv = write(ctx->host, &(ctx->din), 1);
-          assert(rv == 1 && "write() failed.");
+          // Received bytes are written out at the end of the transaction
+          if (ctx->nrx == MAX_TRANSACTION) {
+            spidpi_flush_rx(ctx);
+          }
+          ctx->rx_buf[ctx->nrx++] = ctx->din;
           ctx->bin = (ctx->msbfirst) ? 0x80 : 0x01;
           ctx->din = 0;
         }
@@ -194,6 +306,7 @@ char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
         // CSB high, clock stopped
         ctx->driving = P2D_CSB;
         ctx->state = SP_IDLE;
+        spidpi_flush_rx(ctx);
         break;
       case SP_FINISH:
         VerilatorSimCtrl::GetInstance().RequestStop(true);
@@ -207,10 +320,18 @@ char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data) {
 }
 
 void spidpi_close(void *ctx_void) {
-  struct spidpi_ctx *ctx = (struct spidpi_ctx *)ctx_void;
+  struct spidpi_ctx *ctx = (struct spidpi_ctx *)dpi_ctx_resolve(ctx_void);
   if (!ctx) {
     return;
   }
-  fclose(ctx->mon_file);
+  spidpi_flush_rx(ctx);
+  dpi_io_close(ctx->host_in);
+  if (ctx->mon_mode == DPI_MON_BINARY) {
+    dpi_mon_record(ctx->mon_file, SPI_MON_END, 0, ctx->tick, NULL, 0);
+  }
+  if (ctx->mon_file) {
+    fclose(ctx->mon_file);
+  }
+  dpi_ctx_unregister(ctx);
   free(ctx);
 }
@@ -10,16 +10,34 @@
 
 extern "C" {
 
-#define MAX_TRANSACTION 4
+// The largest number of bytes sent in one CSB cycle
+#define MAX_TRANSACTION 4096
+
+// The smallest number of primary clock cycles per SCK half period. At this
+// ratio (SCK at a quarter of the primary clock) the spi_device still sees
+// each SCK phase for two of its own clock cycles.
+#define SPIDPI_MIN_SCK_DIV 2
+
+struct dpi_io_chan;
+
 struct spidpi_ctx {
   int loglevel;
+  // Monitor output mode, DPI_MON_OFF, DPI_MON_BINARY or DPI_MON_TEXT
+  int mon_mode;
   char ptyname[64];
   int host;
   int device;
+  // Input from the host side of the pseudo-terminal
+  struct dpi_io_chan *host_in;
   FILE *mon_file;
   char mon_pathname[PATH_MAX];
   void *mon;
   int tick;
+  // Primary clock cycles per SCK half period
+  int sck_div;
+  // Ticks since the last SCK edge, and the SCK level before CPOL is applied
+  int sck_cnt;
+  int internal_sck;
   int cpol;
   int cpha;
   int msbfirst;  // shift direction
@@ -28,10 +46,21 @@ struct spidpi_ctx {
   int nin;
   int bin;
   int din;
+  // Most bytes to send in one CSB cycle, and the number in the current one
   int nmax;
+  int nframe;
+  // Ticks in SP_IDLE without any new input, and the number after which a
+  // partial burst is sent (0 to always wait for a full one)
+  int idle_wait;
+  int partial_wait;
   char driving;
   int state;
   char buf[MAX_TRANSACTION];
+  // Bytes received in the current CSB cycle, written out when it ends
+  char rx_buf[MAX_TRANSACTION];
+  int nrx;
+  // Set once received data has been dropped
+  int rx_dropped;
 };
 
 // SPI Host States
@@ -51,13 +80,37 @@ struct spidpi_ctx {
 #define P2D_CSB    0x2
 #define P2D_SDI    0x4
 
-void *spidpi_create(const char *name, int mode, int loglevel);
+// Records in a binary monitor log (see dpi_mon.h). The monitor is called on
+// every tick, but only records the ticks on which a pin changed; the pins
+// keep their values on the ticks in between.
+//
+// New pin values. Payload: u8 p2d, u8 d2p
+#define SPI_MON_PINS 1
+// End of the log. No payload; the tick is the last one monitored.
+#define SPI_MON_END 2
+
+/**
+ * Create a SPI host model
+ *
+ * @param name C string naming the SPI interface
+ * @param mode SPI mode, CPOL << 1 | CPHA
+ * @param loglevel bits selecting what the monitor logs
+ * @param sck_div primary clock cycles per SCK half period. Clamped to at least
+ *                SPIDPI_MIN_SCK_DIV.
+ * @param burst most bytes to send in one CSB cycle, up to MAX_TRANSACTION
+ * @param mon_mode C string selecting the monitor output: "off", "binary"
+ *                 (written to <name>.mon) or "text" (written to <name>.log)
+ */
+void *spidpi_create(const char *name, int mode, int loglevel, int sck_div,
+                    int burst, int partial_wait, const char *mon_mode);
 char spidpi_tick(void *ctx_void, const svLogicVecVal *d2p_data);
 void spidpi_close(void *ctx_void);
 
 // monitor
 void monitor_spi(void *mon_void, FILE *mon_file, int loglevel, int tick,
                  int p2d, int d2p);
+void monitor_spi_record(void *mon_void, FILE *mon_file, int tick, int p2d,
+                        int d2p);
 void *monitor_spi_init(int mode);
 }
 #endif  // OPENTITAN_HW_DV_DPI_SPIDPI_SPIDPI_H_
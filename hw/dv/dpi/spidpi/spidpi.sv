@@ -7,12 +7,27 @@
 // Bits in LOG_LEVEL sets what is output on info socket
 // 0x01 -- monitor packets
 // 0x08 -- bit level
+//
+// SCK_DIV is the number of clk_i cycles per SCK half period (at least 2), and
+// BURST is the most bytes sent with CSB held low. They can be overridden at
+// runtime with the `SPIDPI_SCK_DIV_<name>` and `SPIDPI_BURST_<name>` plusargs.
+//
+// Every transaction is BURST bytes long, unless the
+// `SPIDPI_PARTIAL_WAIT_<name>` plusarg is set to a number of clk_i cycles.
+// Then a transaction is also started with fewer bytes once the input has
+// paused for that long.
+//
+// The monitor is off unless the `SPIDPI_MON_<name>` plusarg selects "text"
+// (written to <name>.log) or "binary" (written to <name>.mon, and converted
+// to text with util/dpi_mon_convert.py).
 
 module spidpi
   #(
   parameter string NAME = "spi0",
   parameter MODE = 0,
-  parameter LOG_LEVEL = 9
+  parameter LOG_LEVEL = 9,
+  parameter int SCK_DIV = 4,
+  parameter int BURST = 4
   )(
   input  logic clk_i,
   input  logic rst_ni,
@@ -24,7 +39,9 @@ module spidpi
 
 );
   import "DPI-C" function
-    chandle spidpi_create(input string name, input int mode, input int loglevel);
+    chandle spidpi_create(input string name, input int mode, input int loglevel,
+                          input int sck_div, input int burst,
+                          input int partial_wait, input string mon_mode);
 
   import "DPI-C" function
     void spidpi_close(input chandle ctx);
@@ -33,9 +50,18 @@ module spidpi
     byte spidpi_tick(input chandle ctx_void, input [1:0] d2p_data);
 
   chandle ctx;
+  int sck_div = SCK_DIV;
+  int burst = BURST;
+  int partial_wait = 0;
+  string mon_mode = "off";
 
   initial begin
-    ctx = spidpi_create(NAME, MODE, LOG_LEVEL);
+    $value$plusargs({"SPIDPI_SCK_DIV_", NAME, "=%d"}, sck_div);
+    $value$plusargs({"SPIDPI_BURST_", NAME, "=%d"}, burst);
+    $value$plusargs({"SPIDPI_PARTIAL_WAIT_", NAME, "=%d"}, partial_wait);
+    $value$plusargs({"SPIDPI_MON_", NAME, "=%s"}, mon_mode);
+    ctx = spidpi_create(NAME, MODE, LOG_LEVEL, sck_div, burst, partial_wait,
+                        mon_mode);
   end
 
   final begin
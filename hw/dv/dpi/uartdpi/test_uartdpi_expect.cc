@@ -0,0 +1,168 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Test of UART pass/fail pattern matching, run by the DV model tests in
+// hw/meson.build.
+//
+// The output is fed in chunks that split the patterns at every position, to
+// check that literal patterns match across chunks and lines, that regular
+// expressions match whole lines, and that the verdict is only given once.
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+#include "hw/dv/dpi/uartdpi/uartdpi_expect.h"
+#include "hw/dv/verilator/cpp/test_check.h"
+
+// Load expectations from a string, through a temporary file
+static uartdpi_expect *load(const char *contents) {
+  char path[] = "/tmp/test_uartdpi_expect.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return nullptr;
+  }
+  size_t len = strlen(contents);
+  bool ok = write(fd, contents, len) == (ssize_t)len;
+  close(fd);
+  uartdpi_expect *expect = ok ? uartdpi_expect_load("test", path) : nullptr;
+  unlink(path);
+  return expect;
+}
+
+// Feed output one chunk at a time, split at split, and return the first
+// verdict
+static int feed(uartdpi_expect *expect, const std::string &output,
+                size_t split = 0) {
+  int verdict = UARTDPI_EXPECT_NONE;
+  for (size_t start = 0; start < output.size();) {
+    size_t end = start < split ? split : output.size();
+    for (size_t i = start; i < end; ++i) {
+      int rv = uartdpi_expect_feed(expect, output[i]);
+      if (verdict == UARTDPI_EXPECT_NONE) {
+        verdict = rv;
+      }
+    }
+    start = end;
+  }
+  return verdict;
+}
+
+// Feed output into fresh expectations, split at every position, and check
+// that it gives the same verdict every time
+static void check_output(const char *patterns, const std::string &output,
+                         int expected, const char *what) {
+  for (size_t split = 0; split <= output.size(); ++split) {
+    uartdpi_expect *expect = load(patterns);
+    TEST_CHECK(expect, "expectations file loads");
+    if (!expect) {
+      return;
+    }
+    bool ok = feed(expect, output, split) == expected;
+    uartdpi_expect_free(expect);
+    TEST_CHECK(ok, "%s (split at %zu)", what, split);
+    if (!ok) {
+      return;
+    }
+  }
+}
+
+static void test_literals() {
+  const char *patterns =
+      "# Comment\n"
+      "pass PASS!\n"
+      "  fail \tABABC\r\n";
+  check_output(patterns, "Test PASS!\n", UARTDPI_EXPECT_PASS, "literal pass");
+  check_output(patterns, "one\ntwo\r\nPASS!", UARTDPI_EXPECT_PASS,
+               "literal pass after other lines, with no line ending");
+  check_output(patterns, "PASS\nPASS?\n", UARTDPI_EXPECT_NONE,
+               "near misses of a literal");
+  check_output(patterns, "xABABABCx", UARTDPI_EXPECT_FAIL,
+               "literal whose prefix overlaps a partial match");
+  check_output(patterns, "ABAB\nABC", UARTDPI_EXPECT_NONE,
+               "literal interrupted by a newline");
+}
+
+static void test_regexes() {
+  const char *patterns =
+      "pass-re ^Done: [0-9]+$\n"
+      "fail-re ^ERROR\n";
+  check_output(patterns, "Done: 42\n", UARTDPI_EXPECT_PASS, "regex pass");
+  check_output(patterns, "Done: 42\r\n", UARTDPI_EXPECT_PASS,
+               "regex pass with \\r\\n");
+  check_output(patterns, "Done: 42", UARTDPI_EXPECT_NONE,
+               "regex waits for the end of the line");
+  check_output(patterns, "Not Done: 42\nDone: 4x\n", UARTDPI_EXPECT_NONE,
+               "regex only matches whole lines");
+  check_output(patterns, "ok\nERROR: oops\n", UARTDPI_EXPECT_FAIL,
+               "regex fail on a later line");
+
+  // A line that is too long is split, and the next part starts a new line
+  std::string output(UARTDPI_EXPECT_MAX_LINE, '.');
+  uartdpi_expect *expect = load(patterns);
+  TEST_CHECK(feed(expect, output + "ERROR\n") == UARTDPI_EXPECT_FAIL,
+             "long line split");
+  uartdpi_expect_free(expect);
+  expect = load(patterns);
+  TEST_CHECK(
+      feed(expect, output.substr(1) + "ERROR\n") == UARTDPI_EXPECT_NONE,
+      "line split too early");
+  TEST_CHECK(feed(expect, "ERROR\n") == UARTDPI_EXPECT_FAIL,
+             "line after a split line");
+  uartdpi_expect_free(expect);
+}
+
+static void test_expect() {
+  const char *patterns =
+      "expect Boot\n"
+      "expect-re ^Step [0-9]$\n"
+      "pass PASS\n";
+  check_output(patterns, "Boot\nStep 1\nPASS\n", UARTDPI_EXPECT_PASS,
+               "pass after expectations");
+  check_output(patterns, "Step 1\nBootPASS\n", UARTDPI_EXPECT_PASS,
+               "expectations in any order");
+  check_output(patterns, "Boot\nPASS\n", UARTDPI_EXPECT_FAIL,
+               "pass before a regex expectation");
+  check_output(patterns, "Step 1\nPASS Boot\n", UARTDPI_EXPECT_FAIL,
+               "pass before a literal expectation");
+
+  uartdpi_expect *expect = load(patterns);
+  feed(expect, "Step 1\nPASS\n");
+  std::string reason = uartdpi_expect_reason(expect);
+  TEST_CHECK(
+      reason.find("hadn't seen expect pattern 'Boot'") != std::string::npos,
+      "reason names the missing expectation");
+  uartdpi_expect_free(expect);
+}
+
+static void test_verdict_latched() {
+  uartdpi_expect *expect = load("pass PASS\nfail FAIL\n");
+  TEST_CHECK(!*uartdpi_expect_reason(expect), "no reason before a verdict");
+  TEST_CHECK(feed(expect, "FAIL") == UARTDPI_EXPECT_FAIL, "first verdict");
+  std::string reason = uartdpi_expect_reason(expect);
+  TEST_CHECK(reason == "test matched fail pattern 'FAIL'", "reason");
+  TEST_CHECK(feed(expect, "PASS FAIL") == UARTDPI_EXPECT_NONE,
+             "output ignored after a verdict");
+  TEST_CHECK(reason == uartdpi_expect_reason(expect), "reason kept");
+  uartdpi_expect_free(expect);
+}
+
+static void test_bad_files() {
+  TEST_CHECK(!uartdpi_expect_load("test", "/nonexistent/expect"),
+             "missing file");
+  TEST_CHECK(!load("pass\n"), "missing pattern");
+  TEST_CHECK(!load("maybe PASS\n"), "unknown kind");
+  TEST_CHECK(!load("pass-re (\n"), "bad regex");
+}
+
+int main(void) {
+  test_literals();
+  test_regexes();
+  test_expect();
+  test_verdict_latched();
+  test_bad_files();
+
+  return test_check_result();
+}
@@ -3,6 +3,10 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "uartdpi.h"
+#include "dpi_ctx.h"
+#include "dpi_io.h"
+#include "uartdpi_expect.h"
+#include "verilator_sim_ctrl.h"
 
 #ifdef __linux__
 #include <pty.h>
@@ -17,13 +21,92 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-void *uartdpi_create(const char *name, const char *log_file_path) {
-  struct uartdpi_ctx *ctx =
-      (struct uartdpi_ctx *)malloc(sizeof(struct uartdpi_ctx));
-  assert(ctx);
+// Open (or reopen) the log file at ctx->log_file_path
+static void uartdpi_open_log(struct uartdpi_ctx *ctx) {
+  FILE *log_file;
+  log_file = fopen(ctx->log_file_path, "w");
+  if (!log_file) {
+    fprintf(stderr, "UART: Unable to open log file at %s: %s\n",
+            ctx->log_file_path, strerror(errno));
+    return;
+  }
+
+  // The log file keeps its default (full) buffering: output is gathered in
+  // ctx->out_buf and uartdpi_flush() flushes the file after each chunk.
+  ctx->log_file = log_file;
+  printf("UART: Additionally writing all UART output to '%s'.\n",
+         ctx->log_file_path);
+}
+
+// Write the buffered output to the pseudo-terminal and the log file
+static void uartdpi_flush(struct uartdpi_ctx *ctx) {
+  if (!ctx->out_len) {
+    return;
+  }
+
+  size_t done = 0;
+  while (ctx->host >= 0 && done < ctx->out_len) {
+    ssize_t rv = write(ctx->host, ctx->out_buf + done, ctx->out_len - done);
+    if (rv < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Most likely nobody is reading from the pseudo-terminal and its buffer
+      // is full. The output still goes to the log file.
+      if (!ctx->pty_dropped) {
+        fprintf(stderr, "UART: Unable to write to %s, dropping output: %s\n",
+                ctx->ptyname, strerror(errno));
+        ctx->pty_dropped = true;
+      }
+      break;
+    }
+    done += rv;
+  }
+
+  if (ctx->log_file) {
+    size_t rv = fwrite(ctx->out_buf, sizeof(char), ctx->out_len, ctx->log_file);
+    assert(rv == ctx->out_len && "Write to log file failed.");
+    // Make each chunk show up in the log file straight away
+    fflush(ctx->log_file);
+  }
 
+  ctx->out_len = 0;
+}
+
+// Called through dpi_ctx_reopen_files() to start a new log file relative to
+// the current directory
+static void uartdpi_reopen_log(void *ctx_void) {
+  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
+  // Any buffered output belongs to the old file, which the parent process
+  // writes it to.
+  ctx->out_len = 0;
+  if (!ctx->log_file_path) {
+    return;
+  }
+  if (ctx->log_file) {
+    fclose(ctx->log_file);
+    ctx->log_file = NULL;
+  }
+  uartdpi_open_log(ctx);
+}
+
+// Called through dpi_ctx_stop_threads() and dpi_ctx_start_threads(). The I/O
+// thread is shared, so it doesn't matter which context asks.
+static void uartdpi_suspend_io(void *ctx_void) {
+  (void)ctx_void;
+  dpi_io_suspend();
+}
+
+static void uartdpi_resume_io(void *ctx_void) {
+  (void)ctx_void;
+  dpi_io_resume();
+}
+
+// Create the pseudo-terminal for pty mode
+static void uartdpi_open_pty(struct uartdpi_ctx *ctx, const char *name) {
   int rv;
 
   // Initialize UART pseudo-terminal
@@ -36,19 +119,70 @@ void *uartdpi_create(const char *name, const char *log_file_path) {
   rv = ttyname_r(ctx->device, ctx->ptyname, 64);
   assert(rv == 0 && "ttyname_r failed");
 
-  int cur_flags = fcntl(ctx->host, F_GETFL, 0);
-  assert(cur_flags != -1 && "Unable to read current flags.");
-  int new_flags = fcntl(ctx->host, F_SETFL, cur_flags | O_NONBLOCK);
-  assert(new_flags != -1 && "Unable to set FD flags");
+  // Input is read on the shared I/O thread, which also makes the host side
+  // non-blocking
+  ctx->host_in = dpi_io_open("UART", ctx->host, DPI_IO_DEFAULT_BUF_SIZE);
+  assert(ctx->host_in);
 
   printf(
       "\n"
       "UART: Created %s for %s. Connect to it with any terminal program, e.g.\n"
       "$ screen %s\n",
       ctx->ptyname, name, ctx->ptyname);
+}
+
+// Open the input file for file mode
+static void uartdpi_open_input(struct uartdpi_ctx *ctx, const char *name,
+                               const char *input_path) {
+  printf("\nUART: Not creating a pseudo-terminal for %s.\n", name);
+  if (strlen(input_path) == 0) {
+    return;
+  }
+
+  // Open a named pipe for writing too, so that it doesn't report EOF when
+  // the process writing to it closes it.
+  struct stat st;
+  bool is_fifo = stat(input_path, &st) == 0 && S_ISFIFO(st.st_mode);
+  ctx->in_fd = open(input_path, is_fifo ? O_RDWR : O_RDONLY);
+  if (ctx->in_fd < 0) {
+    fprintf(stderr, "UART: Unable to open input file at %s: %s\n", input_path,
+            strerror(errno));
+    return;
+  }
+
+  ctx->host_in = dpi_io_open("UART", ctx->in_fd, DPI_IO_DEFAULT_BUF_SIZE);
+  assert(ctx->host_in);
+  printf("UART: Reading input for %s from '%s'.\n", name, input_path);
+}
+
+void *uartdpi_create(const char *name, const char *log_file_path,
+                     const char *mode, const char *input_path,
+                     const char *expect_path) {
+  struct uartdpi_ctx *ctx =
+      (struct uartdpi_ctx *)calloc(1, sizeof(struct uartdpi_ctx));
+  assert(ctx);
+
+  ctx->host = -1;
+  ctx->device = -1;
+  ctx->in_fd = -1;
+
+  bool file_mode = strcmp(mode, "file") == 0;
+  if (!file_mode && strcmp(mode, "pty") != 0) {
+    fprintf(stderr,
+            "UART: Unknown mode '%s' for %s (expected 'pty' or 'file'). Using "
+            "a pseudo-terminal.\n",
+            mode, name);
+  }
+
+  if (file_mode) {
+    uartdpi_open_input(ctx, name, input_path);
+  } else {
+    uartdpi_open_pty(ctx, name);
+  }
 
   // Open log file (if requested)
   ctx->log_file = NULL;
+  ctx->log_file_path = NULL;
   bool write_log_file = strlen(log_file_path) != 0;
   if (write_log_file) {
     if (strcmp(log_file_path, "-") == 0) {
@@ -56,36 +190,45 @@ void *uartdpi_create(const char *name, const char *log_file_path) {
       printf("UART: Additionally writing all UART output to STDOUT.\n");
 
     } else {
-      FILE *log_file;
-      log_file = fopen(log_file_path, "w");
-      if (!log_file) {
-        fprintf(stderr, "UART: Unable to open log file at %s: %s\n",
-                log_file_path, strerror(errno));
-      } else {
-        // Switch log file output to line buffering to ensure lines written to
-        // the UART device show up in the log file as soon as a newline
-        // character is written.
-        rv = setvbuf(log_file, NULL, _IOLBF, 0);
-        assert(rv == 0);
-
-        ctx->log_file = log_file;
-        printf("UART: Additionally writing all UART output to '%s'.\n",
-               log_file_path);
-      }
+      ctx->log_file_path = strdup(log_file_path);
+      assert(ctx->log_file_path);
+      uartdpi_open_log(ctx);
     }
+  } else if (file_mode) {
+    printf("UART: No log file given, output of %s is discarded.\n", name);
   }
 
+  if (strlen(expect_path) != 0) {
+    ctx->expect = uartdpi_expect_load(name, expect_path);
+    if (!ctx->expect) {
+      // Don't let a test run without the checks it asked for
+      VerilatorSimCtrl::GetInstance().RequestStop(false);
+    }
+  }
+
+  dpi_ctx_register(ctx, "uartdpi", name);
+  dpi_ctx_set_reopen(ctx, uartdpi_reopen_log);
+  dpi_ctx_set_threads(ctx, uartdpi_suspend_io, uartdpi_resume_io);
+
   return (void *)ctx;
 }
 
 void uartdpi_close(void *ctx_void) {
-  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
+  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)dpi_ctx_resolve(ctx_void);
   if (!ctx) {
     return;
   }
 
-  close(ctx->host);
-  close(ctx->device);
+  uartdpi_flush(ctx);
+
+  dpi_io_close(ctx->host_in);
+  if (ctx->host >= 0) {
+    close(ctx->host);
+    close(ctx->device);
+  }
+  if (ctx->in_fd >= 0) {
+    close(ctx->in_fd);
+  }
 
   if (ctx->log_file) {
     // Always ensure the log file is flushed (most important when writing
@@ -95,33 +238,57 @@ void uartdpi_close(void *ctx_void) {
       fclose(ctx->log_file);
     }
   }
+  free(ctx->log_file_path);
+  uartdpi_expect_free(ctx->expect);
 
+  dpi_ctx_unregister(ctx);
   free(ctx);
 }
 
 int uartdpi_can_read(void *ctx_void) {
-  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
+  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)dpi_ctx_resolve(ctx_void);
 
-  int rv = read(ctx->host, &ctx->tmp_read, 1);
-  return (rv == 1);
+  // This is called on every cycle that the transmitter is idle, so it's a
+  // cheap place to notice that output has stopped mid-line.
+  if (ctx->out_len && ++ctx->idle_ticks >= UARTDPI_FLUSH_IDLE_TICKS) {
+    uartdpi_flush(ctx);
+  }
+
+  if (!ctx->host_in) {
+    return 0;
+  }
+  return dpi_io_read(ctx->host_in, &ctx->tmp_read, 1) == 1;
 }
 
 char uartdpi_read(void *ctx_void) {
-  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
+  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)dpi_ctx_resolve(ctx_void);
 
   return ctx->tmp_read;
 }
 
 void uartdpi_write(void *ctx_void, char c) {
-  int rv;
+  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)dpi_ctx_resolve(ctx_void);
 
-  struct uartdpi_ctx *ctx = (struct uartdpi_ctx *)ctx_void;
-
-  rv = write(ctx->host, &c, 1);
-  assert(rv == 1 && "Write to pseudo-terminal failed.");
+  ctx->out_buf[ctx->out_len++] = c;
+  ctx->idle_ticks = 0;
+  if (c == '\n' || ctx->out_len == UARTDPI_OUT_BUF_SIZE) {
+    uartdpi_flush(ctx);
+  }
 
-  if (ctx->log_file) {
-    rv = fwrite(&c, sizeof(char), 1, ctx->log_file);
-    assert(rv == 1 && "Write to log file failed.");
+  if (!ctx->expect) {
+    return;
+  }
+  int verdict = uartdpi_expect_feed(ctx->expect, c);
+  if (verdict == UARTDPI_EXPECT_NONE) {
+    return;
   }
+
+  // Stop straight away, rather than after whatever the software does next
+  VerilatorSimCtrl &simctrl = VerilatorSimCtrl::GetInstance();
+  ctx->verdict_cycle = simctrl.GetTime() / 2;
+  uartdpi_flush(ctx);
+  printf("\nUART: Test %s at cycle %lu: %s.\n",
+         verdict == UARTDPI_EXPECT_PASS ? "passed" : "failed",
+         ctx->verdict_cycle, uartdpi_expect_reason(ctx->expect));
+  simctrl.RequestStop(verdict == UARTDPI_EXPECT_PASS);
 }
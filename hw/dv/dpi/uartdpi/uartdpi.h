@@ -9,15 +9,61 @@ extern "C" {
 
 #include <stdio.h>
 
+struct dpi_io_chan;
+struct uartdpi_expect;
+
+// Size of the buffer for output that hasn't been written out yet
+#define UARTDPI_OUT_BUF_SIZE 4096
+
+// Write out a partial line once this many calls to uartdpi_can_read() have
+// passed without any more output (so that prompts show up)
+#define UARTDPI_FLUSH_IDLE_TICKS 100000
+
 struct uartdpi_ctx {
   char ptyname[64];
+  // Host and device sides of the pseudo-terminal, or -1 in file mode
   int host;
   int device;
+  // Input file in file mode, or -1
+  int in_fd;
+  // Input from the pseudo-terminal or the input file, or NULL if there is
+  // no input
+  struct dpi_io_chan *host_in;
   char tmp_read;
   FILE *log_file;
+  // Path of the log file, or NULL if there is none or it is STDOUT
+  char *log_file_path;
+  // Output that hasn't been written to the pseudo-terminal or the log file
+  char out_buf[UARTDPI_OUT_BUF_SIZE];
+  size_t out_len;
+  // Calls to uartdpi_can_read() since the last output
+  unsigned long idle_ticks;
+  // Set once output to the pseudo-terminal has been dropped
+  bool pty_dropped;
+  // Pass/fail patterns to match on the output, or NULL
+  struct uartdpi_expect *expect;
+  // The cycle on which a pass or fail pattern matched, if one has
+  unsigned long verdict_cycle;
 };
 
-void *uartdpi_create(const char *name, const char *log_file_path);
+/**
+ * Create a UART DPI model
+ *
+ * @param name C string naming the UART
+ * @param log_file_path file to copy all output to, "-" for STDOUT, or "" for
+ *                      none
+ * @param mode "pty" to connect the UART to a pseudo-terminal, or "file" to
+ *             only write output to the log file and read input from
+ *             input_path
+ * @param input_path file or named pipe to read input from in file mode, or ""
+ *                   for no input
+ * @param expect_path expectations file (see uartdpi_expect.h), or "" for
+ *                    none. The simulation stops as soon as the output matches
+ *                    a pass or fail pattern.
+ */
+void *uartdpi_create(const char *name, const char *log_file_path,
+                     const char *mode, const char *input_path,
+                     const char *expect_path);
 void uartdpi_close(void *ctx_void);
 int uartdpi_can_read(void *ctx_void);
 char uartdpi_read(void *ctx_void);
@@ -20,7 +20,9 @@ module uartdpi #(
   localparam int CYCLES_PER_SYMBOL = FREQ / BAUD;
 
   import "DPI-C" function
-    chandle uartdpi_create(input string name, input string log_file_path);
+    chandle uartdpi_create(input string name, input string log_file_path,
+                           input string mode, input string input_path,
+                           input string expect_path);
 
   import "DPI-C" function
     void uartdpi_close(input chandle ctx);
@@ -36,10 +38,19 @@ module uartdpi #(
 
   chandle ctx;
   string log_file_path = DEFAULT_LOG_FILE;
+  // "pty" to connect a pseudo-terminal, or "file" to only write the log file
+  // and take input from the `UARTDPI_IN_<name>` plusarg (if given).
+  string mode = "pty";
+  string input_path = "";
+  // Pass/fail patterns to stop the simulation on (see uartdpi_expect.h)
+  string expect_path = "";
 
   initial begin
     $value$plusargs({"UARTDPI_LOG_", NAME, "=%s"}, log_file_path);
-    ctx = uartdpi_create(NAME, log_file_path);
+    $value$plusargs({"UARTDPI_MODE_", NAME, "=%s"}, mode);
+    $value$plusargs({"UARTDPI_IN_", NAME, "=%s"}, input_path);
+    $value$plusargs({"UARTDPI_EXPECT_", NAME, "=%s"}, expect_path);
+    ctx = uartdpi_create(NAME, log_file_path, mode, input_path, expect_path);
   end
 
   final begin
@@ -0,0 +1,246 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "uartdpi_expect.h"
+
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum PatternKind { kPass, kFail, kExpect };
+
+struct Pattern {
+  PatternKind kind;
+  std::string text;
+  bool is_regex;
+  std::regex re;
+  // For literal patterns: the failure function of the Knuth-Morris-Pratt
+  // algorithm, and the length of the prefix of text that has been matched
+  std::vector<size_t> kmp_fail;
+  size_t matched_len;
+  // Set once an "expect" pattern has been seen
+  bool seen;
+};
+
+const char *KindName(PatternKind kind) {
+  switch (kind) {
+    case kPass:
+      return "pass";
+    case kFail:
+      return "fail";
+    default:
+      return "expect";
+  }
+}
+
+// Compute the KMP failure function: kmp_fail[i] is the length of the longest
+// proper prefix of text[0..i] that is also a suffix of it.
+void InitLiteral(Pattern &pattern) {
+  const std::string &text = pattern.text;
+  pattern.kmp_fail.assign(text.size(), 0);
+  size_t len = 0;
+  for (size_t i = 1; i < text.size(); ++i) {
+    while (len && text[i] != text[len]) {
+      len = pattern.kmp_fail[len - 1];
+    }
+    if (text[i] == text[len]) {
+      ++len;
+    }
+    pattern.kmp_fail[i] = len;
+  }
+  pattern.matched_len = 0;
+}
+
+// Advance a literal pattern by one byte. Returns true if it now matches.
+bool FeedLiteral(Pattern &pattern, char c) {
+  const std::string &text = pattern.text;
+  size_t len = pattern.matched_len;
+  while (len && c != text[len]) {
+    len = pattern.kmp_fail[len - 1];
+  }
+  if (c == text[len]) {
+    ++len;
+  }
+  if (len == text.size()) {
+    pattern.matched_len = pattern.kmp_fail[len - 1];
+    return true;
+  }
+  pattern.matched_len = len;
+  return false;
+}
+
+}  // namespace
+
+struct uartdpi_expect {
+  std::string name;
+  std::vector<Pattern> patterns;
+  bool has_regex;
+  // The current line, if any of the patterns are regular expressions. Holds
+  // at most UARTDPI_EXPECT_MAX_LINE bytes.
+  std::string line;
+  int verdict;
+  std::string reason;
+};
+
+// Record the match of a pattern. Returns the verdict, if it gives one.
+static int Matched(uartdpi_expect *expect, Pattern &pattern) {
+  if (pattern.kind == kExpect) {
+    pattern.seen = true;
+    return UARTDPI_EXPECT_NONE;
+  }
+
+  expect->reason = expect->name + " matched " + KindName(pattern.kind) +
+                   " pattern '" + pattern.text + "'";
+  expect->verdict =
+      pattern.kind == kPass ? UARTDPI_EXPECT_PASS : UARTDPI_EXPECT_FAIL;
+  if (pattern.kind != kPass) {
+    return expect->verdict;
+  }
+
+  // A pass only counts if everything that was expected has been seen
+  for (const Pattern &other : expect->patterns) {
+    if (other.kind == kExpect && !other.seen) {
+      expect->reason += ", but hadn't seen expect pattern '" + other.text + "'";
+      expect->verdict = UARTDPI_EXPECT_FAIL;
+    }
+  }
+  return expect->verdict;
+}
+
+// Match the current line against the regular expressions and start a new
+// one. Returns the verdict, if there is one.
+static int MatchLine(uartdpi_expect *expect) {
+  int verdict = UARTDPI_EXPECT_NONE;
+  for (Pattern &pattern : expect->patterns) {
+    if (pattern.is_regex && std::regex_search(expect->line, pattern.re)) {
+      verdict = Matched(expect, pattern);
+      if (verdict != UARTDPI_EXPECT_NONE) {
+        break;
+      }
+    }
+  }
+  expect->line.clear();
+  return verdict;
+}
+
+struct uartdpi_expect *uartdpi_expect_load(const char *name,
+                                           const char *path) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "UART: Unable to open expectations file `" << path << "'."
+              << std::endl;
+    return nullptr;
+  }
+
+  uartdpi_expect *expect = new uartdpi_expect();
+  expect->name = name;
+  expect->has_regex = false;
+  expect->verdict = UARTDPI_EXPECT_NONE;
+
+  std::string line;
+  unsigned line_no = 0;
+  while (std::getline(file, line)) {
+    ++line_no;
+    size_t kind_start = line.find_first_not_of(" \t\r");
+    if (kind_start == std::string::npos || line[kind_start] == '#') {
+      continue;
+    }
+    size_t kind_end = line.find_first_of(" \t", kind_start);
+    std::string kind = line.substr(kind_start, kind_end - kind_start);
+    size_t text_start = kind_end == std::string::npos
+                            ? std::string::npos
+                            : line.find_first_not_of(" \t", kind_end);
+    if (text_start == std::string::npos) {
+      std::cerr << "UART: " << path << ":" << line_no << ": Missing pattern."
+                << std::endl;
+      delete expect;
+      return nullptr;
+    }
+    size_t text_end = line.find_last_not_of("\r");
+
+    Pattern pattern;
+    pattern.text = line.substr(text_start, text_end + 1 - text_start);
+    pattern.seen = false;
+    pattern.is_regex = false;
+    const std::string re_suffix = "-re";
+    if (kind.size() > re_suffix.size() &&
+        kind.compare(kind.size() - re_suffix.size(), re_suffix.size(),
+                     re_suffix) == 0) {
+      pattern.is_regex = true;
+      kind.resize(kind.size() - re_suffix.size());
+    }
+
+    if (kind == "pass") {
+      pattern.kind = kPass;
+    } else if (kind == "fail") {
+      pattern.kind = kFail;
+    } else if (kind == "expect") {
+      pattern.kind = kExpect;
+    } else {
+      std::cerr << "UART: " << path << ":" << line_no
+                << ": Unknown pattern kind `" << kind << "'." << std::endl;
+      delete expect;
+      return nullptr;
+    }
+
+    if (pattern.is_regex) {
+      try {
+        pattern.re = std::regex(pattern.text);
+      } catch (const std::regex_error &err) {
+        std::cerr << "UART: " << path << ":" << line_no
+                  << ": Bad regular expression: " << err.what() << std::endl;
+        delete expect;
+        return nullptr;
+      }
+      expect->has_regex = true;
+    } else {
+      InitLiteral(pattern);
+    }
+    expect->patterns.push_back(std::move(pattern));
+  }
+
+  std::cout << "UART: Matching " << expect->patterns.size()
+            << " pattern(s) from `" << path << "' on the output of " << name
+            << "." << std::endl;
+  return expect;
+}
+
+int uartdpi_expect_feed(struct uartdpi_expect *expect, char c) {
+  if (expect->verdict != UARTDPI_EXPECT_NONE) {
+    return UARTDPI_EXPECT_NONE;
+  }
+
+  for (Pattern &pattern : expect->patterns) {
+    if (!pattern.is_regex && FeedLiteral(pattern, c)) {
+      int verdict = Matched(expect, pattern);
+      if (verdict != UARTDPI_EXPECT_NONE) {
+        return verdict;
+      }
+    }
+  }
+
+  if (!expect->has_regex) {
+    return UARTDPI_EXPECT_NONE;
+  }
+  if (c != '\n') {
+    expect->line.push_back(c);
+    if (expect->line.size() < UARTDPI_EXPECT_MAX_LINE) {
+      return UARTDPI_EXPECT_NONE;
+    }
+    // Split a line that is too long, rather than let it grow without bound
+  } else if (!expect->line.empty() && expect->line.back() == '\r') {
+    expect->line.pop_back();
+  }
+  return MatchLine(expect);
+}
+
+const char *uartdpi_expect_reason(const struct uartdpi_expect *expect) {
+  return expect->reason.c_str();
+}
+
+void uartdpi_expect_free(struct uartdpi_expect *expect) { delete expect; }
@@ -0,0 +1,83 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_DPI_UARTDPI_UARTDPI_EXPECT_H_
+#define OPENTITAN_HW_DV_DPI_UARTDPI_UARTDPI_EXPECT_H_
+
+/**
+ * Pass/fail pattern matching on the output of a UART
+ *
+ * The patterns are read from an expectations file, with one per line:
+ *
+ *   # A comment
+ *   pass PASS!
+ *   fail FAIL!
+ *   fail-re ^ERROR: .*
+ *   expect Boot ROM initialisation has completed
+ *
+ * A line starts with the kind of the pattern, followed by whitespace and the
+ * pattern itself, which runs to the end of the line. The kinds are:
+ *
+ *   pass      The test has passed, as long as every "expect" pattern has
+ *             been seen.
+ *   fail      The test has failed.
+ *   expect    Must be seen before a "pass" pattern for the test to pass.
+ *
+ * With a "-re" suffix, the pattern is an ECMAScript regular expression.
+ * Literal patterns are matched on every byte as it arrives, even across
+ * lines. Regular expressions are matched against each complete line (without
+ * the line ending) when its newline arrives. Lines longer than
+ * UARTDPI_EXPECT_MAX_LINE bytes are split.
+ */
+
+extern "C" {
+
+struct uartdpi_expect;
+
+// Results of uartdpi_expect_feed()
+#define UARTDPI_EXPECT_NONE 0
+#define UARTDPI_EXPECT_PASS 1
+#define UARTDPI_EXPECT_FAIL 2
+
+// Longest line that regular expressions are matched against
+#define UARTDPI_EXPECT_MAX_LINE 4096
+
+/**
+ * Load an expectations file
+ *
+ * @param name C string naming the UART in messages
+ * @param path path of the expectations file
+ * @return the expectations, or NULL if the file couldn't be read or parsed
+ */
+struct uartdpi_expect *uartdpi_expect_load(const char *name, const char *path);
+
+/**
+ * Match the next byte of UART output
+ *
+ * Once this has returned a verdict, it ignores any more output.
+ *
+ * @param expect expectations, as returned by uartdpi_expect_load()
+ * @param c next byte of output
+ * @return UARTDPI_EXPECT_PASS or UARTDPI_EXPECT_FAIL if c completed a match
+ *         of a pass or fail pattern, otherwise UARTDPI_EXPECT_NONE
+ */
+int uartdpi_expect_feed(struct uartdpi_expect *expect, char c);
+
+/**
+ * Describe the match that gave the verdict
+ *
+ * @return a C string, valid until the expectations are freed. Empty if there
+ *         is no verdict yet.
+ */
+const char *uartdpi_expect_reason(const struct uartdpi_expect *expect);
+
+/**
+ * Free expectations
+ *
+ * @param expect expectations, as returned by uartdpi_expect_load(). May be
+ *               NULL.
+ */
+void uartdpi_expect_free(struct uartdpi_expect *expect);
+}
+#endif  // OPENTITAN_HW_DV_DPI_UARTDPI_UARTDPI_EXPECT_H_
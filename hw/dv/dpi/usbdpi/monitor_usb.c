@@ -6,7 +6,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "dpi_mon.h"
 #include "usbdpi.h"
 
 const char *decode_pid[] = {
@@ -33,8 +35,8 @@ const char *decode_pid[] = {
 #define MS_GET_BYTES 2
 
 #define M_NONE 0
-#define M_HOST 1
-#define M_DEVICE 2
+#define M_HOST USB_MON_HOST
+#define M_DEVICE USB_MON_DEVICE
 
 #define SE0 0
 #define DK 1
@@ -43,6 +45,10 @@ const char *decode_pid[] = {
 #define MON_BYTES_SIZE 1024
 
 struct mon_ctx {
+  // Output mode, DPI_MON_OFF, DPI_MON_BINARY or DPI_MON_TEXT. The bus is
+  // decoded even when the output is off, because the host model uses the
+  // PIDs that the monitor sees.
+  int out_mode;
   int state;
   int driver;
   int pu;
@@ -53,13 +59,16 @@ struct mon_ctx {
   int byte;
   int sopAt;
   int lastpid;
+  // PID of the current packet, good or bad
+  int pid;
   unsigned char bytes[MON_BYTES_SIZE + 2];
 };
 
-void *monitor_usb_init() {
+void *monitor_usb_init(int mon_mode) {
   struct mon_ctx *mon = (struct mon_ctx *)calloc(1, sizeof(struct mon_ctx));
   assert(mon);
 
+  mon->out_mode = mon_mode;
   mon->state = MS_IDLE;
   mon->driver = M_NONE;
   mon->pu = 0;
@@ -88,6 +97,91 @@ char *pid_2data(int pid, unsigned char d0, unsigned char d1) {
   return dr;
 }
 
+/**
+ * Log the end of a packet as text
+ */
+static void log_packet(struct mon_ctx *mon, FILE *mon_file, int log,
+                       int compact, int tick) {
+  if ((log || compact) && (mon->state == MS_GET_BYTES) && (mon->byte > 0)) {
+    int i;
+    int text = 1;
+    uint32_t pkt_crc16, comp_crc16;
+
+    if (compact && mon->byte == 2) {
+      fprintf(mon_file, "mon: %8d -- %8d: (%c) SOP, PID %s, EOP\n",
+              mon->sopAt, tick, mon->driver == M_HOST ? 'H' : 'D',
+              pid_2data(mon->lastpid, mon->bytes[0], mon->bytes[1]));
+    } else if (compact && mon->byte == 1) {
+      fprintf(mon_file, "mon: %8d -- %8d: (%c) SOP, PID %s %02x EOP\n",
+              mon->sopAt, tick, mon->driver == M_HOST ? 'H' : 'D',
+              decode_pid[mon->lastpid & 0xf], mon->bytes[0]);
+    } else {
+      if (compact) {
+        fprintf(mon_file, "mon: %8d -- %8d: (%c) SOP, PID %s, EOP\n",
+                mon->sopAt, tick, mon->driver == M_HOST ? 'H' : 'D',
+                decode_pid[mon->lastpid & 0xf]);
+      }
+      fprintf(mon_file, "mon:     %s: ",
+              mon->driver == M_HOST ? "h->d" : "d->h");
+      comp_crc16 = CRC16(mon->bytes, mon->byte - 2);
+      pkt_crc16 = mon->bytes[mon->byte - 2] | mon->bytes[mon->byte - 1] << 8;
+      for (i = 0; i < mon->byte; i++) {
+        fprintf(mon_file, "%02x%s", mon->bytes[i],
+                ((i & 0xf) == 0xf) ? "\nmon:           "
+                                   : ((i + 1) == mon->byte) ? "" : ", ");
+        if ((mon->bytes[i] == 0x0d) || (mon->bytes[i] == 0x0a)) {
+          mon->bytes[i] = '_';
+        }
+        if (mon->bytes[i] == 0) {
+          mon->bytes[i] = '?';
+        }
+        if (i >= (mon->byte - 2)) {
+          mon->bytes[i] = 0;
+        } else if ((mon->bytes[i] < 32) || (mon->bytes[i] > 127)) {
+          text = 0;
+        }
+      }
+      if (comp_crc16 == pkt_crc16) {
+        fprintf(mon_file, "%s CRCOK\n",
+                (mon->byte == MON_BYTES_SIZE) ? "..." : "");
+      } else {
+        fprintf(mon_file, "%s\nmon:           CRC16 %04x BAD expected %04x\n",
+                (mon->byte == MON_BYTES_SIZE) ? "..." : "", pkt_crc16,
+                comp_crc16);
+      }
+      if (text && mon->byte > 2) {
+        fprintf(mon_file, "mon:          %s\n", mon->bytes);
+      }
+    }
+  } else if (compact) {
+    fprintf(mon_file, "mon: %8d -- %8d: (%c) SOP, PID %s EOP\n", mon->sopAt,
+            tick, mon->driver == M_HOST ? 'H' : 'D',
+            decode_pid[mon->lastpid & 0xf]);
+  }
+  if (log) {
+    fprintf(mon_file, "mon: %8d: (%c) EOP\n", tick,
+            mon->driver == M_HOST ? 'H' : 'D');
+  }
+}
+
+/**
+ * Record the end of a packet in a binary log
+ */
+static void record_packet(struct mon_ctx *mon, FILE *mon_file, int tick) {
+  uint8_t pkt[6 + MON_BYTES_SIZE];
+  int flags = mon->driver;
+  int nbytes = 0;
+  if (mon->state == MS_GET_BYTES) {
+    flags |= USB_MON_PKT_HAS_PID;
+    nbytes = mon->byte;
+  }
+  dpi_mon_put_u32(&pkt[0], mon->sopAt);
+  pkt[4] = mon->lastpid;
+  pkt[5] = mon->pid;
+  memcpy(&pkt[6], mon->bytes, nbytes);
+  dpi_mon_record(mon_file, USB_MON_PACKET, flags, tick, pkt, 6 + nbytes);
+}
+
 void monitor_usb(void *mon_void, FILE *mon_file, int loglevel, int tick,
                  int hdrive, int p2d, int d2p, int *lastpid) {
   struct mon_ctx *mon = (struct mon_ctx *)mon_void;
@@ -99,7 +193,11 @@ void monitor_usb(void *mon_void, FILE *mon_file, int loglevel, int tick,
 
   if ((d2p & D2P_DP_EN) || (d2p & D2P_DN_EN) || (d2p & D2P_D_EN)) {
     if (hdrive) {
-      fprintf(mon_file, "mon: %8d: Bus clash\n", tick);
+      if (mon->out_mode == DPI_MON_TEXT) {
+        fprintf(mon_file, "mon: %8d: Bus clash\n", tick);
+      } else if (mon->out_mode == DPI_MON_BINARY) {
+        dpi_mon_record(mon_file, USB_MON_CLASH, 0, tick, NULL, 0);
+      }
     }
     if (d2p & D2P_TXMODE_SE) {
       dp = ((d2p & D2P_DP_EN) && (d2p & D2P_DP)) ? 1 : 0;
@@ -130,13 +228,17 @@ void monitor_usb(void *mon_void, FILE *mon_file, int loglevel, int tick,
     mon->driver = M_HOST;
   } else {
     if ((mon->driver != M_NONE) || (mon->pu != (d2p & D2P_PU))) {
-      if (log) {
+      if (log && mon->out_mode == DPI_MON_TEXT) {
         if (d2p & D2P_PU) {
           fprintf(mon_file, "mon: %8d: Idle, FS resistor (d2p 0x%x)\n", tick,
                   d2p);
         } else {
           fprintf(mon_file, "mon: %8d: Idle, SE0\n", tick);
         }
+      } else if (log && mon->out_mode == DPI_MON_BINARY) {
+        uint8_t d2p_le[2];
+        dpi_mon_put_u16(d2p_le, d2p);
+        dpi_mon_record(mon_file, USB_MON_IDLE, 0, tick, d2p_le, 2);
       }
       mon->driver = M_NONE;
       mon->pu = (d2p & D2P_PU);
@@ -155,9 +257,11 @@ void monitor_usb(void *mon_void, FILE *mon_file, int loglevel, int tick,
   if (mon->state == MS_IDLE) {
     if ((mon->line & 0xfff) == ((DK << 10) | (DJ << 8) | (DK << 6) | (DJ << 4) |
                                 (DK << 2) | (DK << 0))) {
-      if (log) {
+      if (log && mon->out_mode == DPI_MON_TEXT) {
         fprintf(mon_file, "mon: %8d: (%c) SOP\n", tick,
                 mon->driver == M_HOST ? 'H' : 'D');
+      } else if (log && mon->out_mode == DPI_MON_BINARY) {
+        dpi_mon_record(mon_file, USB_MON_SOP, mon->driver, tick, NULL, 0);
       }
       mon->sopAt = tick;
       mon->state = MS_GET_PID;
@@ -166,65 +270,10 @@ void monitor_usb(void *mon_void, FILE *mon_file, int loglevel, int tick,
     return;
   }
   if ((mon->line & 0x3f) == ((SE0 << 4) | (SE0 << 2) | (DJ << 0))) {
-    if ((log || compact) && (mon->state == MS_GET_BYTES) && (mon->byte > 0)) {
-      int i;
-      int text = 1;
-      uint32_t pkt_crc16, comp_crc16;
-
-      if (compact && mon->byte == 2) {
-        fprintf(mon_file, "mon: %8d -- %8d: (%c) SOP, PID %s, EOP\n",
-                mon->sopAt, tick, mon->driver == M_HOST ? 'H' : 'D',
-                pid_2data(mon->lastpid, mon->bytes[0], mon->bytes[1]));
-      } else if (compact && mon->byte == 1) {
-        fprintf(mon_file, "mon: %8d -- %8d: (%c) SOP, PID %s %02x EOP\n",
-                mon->sopAt, tick, mon->driver == M_HOST ? 'H' : 'D',
-                decode_pid[mon->lastpid & 0xf], mon->bytes[0]);
-      } else {
-        if (compact) {
-          fprintf(mon_file, "mon: %8d -- %8d: (%c) SOP, PID %s, EOP\n",
-                  mon->sopAt, tick, mon->driver == M_HOST ? 'H' : 'D',
-                  decode_pid[mon->lastpid & 0xf]);
-        }
-        fprintf(mon_file, "mon:     %s: ",
-                mon->driver == M_HOST ? "h->d" : "d->h");
-        comp_crc16 = CRC16(mon->bytes, mon->byte - 2);
-        pkt_crc16 = mon->bytes[mon->byte - 2] | mon->bytes[mon->byte - 1] << 8;
-        for (i = 0; i < mon->byte; i++) {
-          fprintf(mon_file, "%02x%s", mon->bytes[i],
-                  ((i & 0xf) == 0xf) ? "\nmon:           "
-                                     : ((i + 1) == mon->byte) ? "" : ", ");
-          if ((mon->bytes[i] == 0x0d) || (mon->bytes[i] == 0x0a)) {
-            mon->bytes[i] = '_';
-          }
-          if (mon->bytes[i] == 0) {
-            mon->bytes[i] = '?';
-          }
-          if (i >= (mon->byte - 2)) {
-            mon->bytes[i] = 0;
-          } else if ((mon->bytes[i] < 32) || (mon->bytes[i] > 127)) {
-            text = 0;
-          }
-        }
-        if (comp_crc16 == pkt_crc16) {
-          fprintf(mon_file, "%s CRCOK\n",
-                  (mon->byte == MON_BYTES_SIZE) ? "..." : "");
-        } else {
-          fprintf(mon_file, "%s\nmon:           CRC16 %04x BAD expected %04x\n",
-                  (mon->byte == MON_BYTES_SIZE) ? "..." : "", pkt_crc16,
-                  comp_crc16);
-        }
-        if (text && mon->byte > 2) {
-          fprintf(mon_file, "mon:          %s\n", mon->bytes);
-        }
-      }
-    } else if (compact) {
-      fprintf(mon_file, "mon: %8d -- %8d: (%c) SOP, PID %s EOP\n", mon->sopAt,
-              tick, mon->driver == M_HOST ? 'H' : 'D',
-              decode_pid[mon->lastpid & 0xf]);
-    }
-    if (log) {
-      fprintf(mon_file, "mon: %8d: (%c) EOP\n", tick,
-              mon->driver == M_HOST ? 'H' : 'D');
+    if (mon->out_mode == DPI_MON_TEXT) {
+      log_packet(mon, mon_file, log, compact, tick);
+    } else if (mon->out_mode == DPI_MON_BINARY) {
+      record_packet(mon, mon_file, tick);
     }
     mon->state = MS_IDLE;
     return;
@@ -232,9 +281,14 @@ void monitor_usb(void *mon_void, FILE *mon_file, int loglevel, int tick,
   int newbit = (((mon->line & 0xc) >> 2) == (mon->line & 0x3)) ? 1 : 0;
   mon->rawbits = (mon->rawbits << 1) | newbit;
   if ((mon->rawbits & 0x7e) == 0x7e) {
-    if (newbit == 1) {
+    if (newbit == 1 && mon->out_mode == DPI_MON_TEXT) {
       fprintf(mon_file, "mon: %8d: (%c) Bitstuff error, got 1 after 0x%x\n",
               tick, mon->driver == M_HOST ? 'H' : 'D', mon->rawbits);
+    } else if (newbit == 1 && mon->out_mode == DPI_MON_BINARY) {
+      uint8_t rawbits_le[4];
+      dpi_mon_put_u32(rawbits_le, mon->rawbits);
+      dpi_mon_record(mon_file, USB_MON_BITSTUFF, mon->driver, tick,
+                     rawbits_le, 4);
     }
     /* Ignore bit stuff bit */
     return;
@@ -245,23 +299,32 @@ void monitor_usb(void *mon_void, FILE *mon_file, int loglevel, int tick,
     return;
   }
   switch (mon->state) {
-    case MS_GET_PID:
-      if (((mon->bits & 0xf0) >> 4) ^ (mon->bits & 0x0f)) {
+    case MS_GET_PID: {
+      int good_pid = ((mon->bits & 0xf0) >> 4) ^ (mon->bits & 0x0f);
+      mon->pid = mon->bits;
+      if (good_pid) {
         *lastpid = mon->bits;
         mon->lastpid = mon->bits;
-        if (log) {
+      }
+      if (log && mon->out_mode == DPI_MON_TEXT) {
+        if (good_pid) {
           fprintf(mon_file, "mon: %8d: (%c) PID %s (0x%x)\n", tick,
                   mon->driver == M_HOST ? 'H' : 'D',
                   decode_pid[mon->bits & 0xf], mon->bits);
+        } else {
+          fprintf(mon_file, "mon: %8d: (%c) BAD PID 0x%x\n", tick,
+                  mon->driver == M_HOST ? 'H' : 'D', mon->bits);
         }
-      } else if (log) {
-        fprintf(mon_file, "mon: %8d: (%c) BAD PID 0x%x\n", tick,
-                mon->driver == M_HOST ? 'H' : 'D', mon->bits);
+      } else if (log && mon->out_mode == DPI_MON_BINARY) {
+        uint8_t pid = mon->bits;
+        dpi_mon_record(mon_file, good_pid ? USB_MON_PID : USB_MON_BAD_PID,
+                       mon->driver, tick, &pid, 1);
       }
       mon->state = MS_GET_BYTES;
       mon->needbits = 8;
       mon->byte = 0;
       break;
+    }
 
     case MS_GET_BYTES:
       mon->bytes[mon->byte] = mon->bits & 0xff;
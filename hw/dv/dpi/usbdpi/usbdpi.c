@@ -3,6 +3,8 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "usbdpi.h"
+#include "dpi_ctx.h"
+#include "dpi_mon.h"
 
 #ifdef __linux__
 #include <pty.h>
@@ -38,11 +40,18 @@ static const char *hs_states[] = {
     "HS_SENDACK 8",    "HS_WAIT_PKT 9",  "HS_ACKIFDATA 10",    "HS_SENDHI 11",
     "HS_EMPTYDATA 12", "HS_WAITACK2 13", "HS_NEXTFRAME 14"};
 
-void *usbdpi_create(const char *name, int loglevel) {
+void *usbdpi_create(const char *name, int loglevel, const char *mon_mode) {
   struct usbdpi_ctx *ctx =
       (struct usbdpi_ctx *)calloc(1, sizeof(struct usbdpi_ctx));
   assert(ctx);
 
+  int mon = dpi_mon_parse_mode(mon_mode);
+  if (mon < 0) {
+    fprintf(stderr, "USB: Unknown monitor mode `%s', turning it off.\n",
+            mon_mode);
+    mon = DPI_MON_OFF;
+  }
+
   ctx->tick = 0;
   ctx->frame = 0;
   ctx->framepend = 0;
@@ -53,7 +62,8 @@ void *usbdpi_create(const char *name, int loglevel) {
   ctx->driving = 0;
   ctx->hostSt = HS_NEXTFRAME;
   ctx->loglevel = loglevel;
-  ctx->mon = monitor_usb_init();
+  ctx->mon_mode = mon;
+  ctx->mon = monitor_usb_init(mon);
   ctx->baudrate_set_successfully = 0;
 
   char cwd[PATH_MAX];
@@ -64,20 +74,34 @@ void *usbdpi_create(const char *name, int loglevel) {
   int rv;
 
   // Monitor log file
-  rv = snprintf(ctx->mon_pathname, PATH_MAX, "%s/%s.log", cwd, name);
-  assert(rv <= PATH_MAX && rv > 0);
-  ctx->mon_file = fopen(ctx->mon_pathname, "w");
-  if (ctx->mon_file == NULL) {
-    fprintf(stderr, "USB: Unable to open monitor file at %s: %s\n",
-            ctx->mon_pathname, strerror(errno));
-    return NULL;
+  if (ctx->mon_mode != DPI_MON_OFF) {
+    rv = snprintf(ctx->mon_pathname, PATH_MAX, "%s/%s.%s", cwd, name,
+                  ctx->mon_mode == DPI_MON_TEXT ? "log" : "mon");
+    assert(rv <= PATH_MAX && rv > 0);
+    ctx->mon_file = dpi_mon_open(ctx->mon_pathname, ctx->mon_mode,
+                                 DPI_MON_KIND_USB, loglevel);
+    if (ctx->mon_file == NULL) {
+      fprintf(stderr, "USB: Unable to open monitor file at %s: %s\n",
+              ctx->mon_pathname, strerror(errno));
+      return NULL;
+    }
+    if (ctx->mon_mode == DPI_MON_TEXT) {
+      printf(
+          "\nUSB: Monitor output file created at %s. Works well with tail:\n"
+          "$ tail -f %s\n",
+          ctx->mon_pathname, ctx->mon_pathname);
+    } else {
+      printf(
+          "\nUSB: Binary monitor output file created at %s. Convert it with:\n"
+          "$ util/dpi_mon_convert.py %s\n",
+          ctx->mon_pathname, ctx->mon_pathname);
+      if (loglevel & LOG_BIT) {
+        printf("USB: Bit level logging needs the text monitor.\n");
+      }
+    }
   }
-  // more useful for tail -f
-  setlinebuf(ctx->mon_file);
-  printf(
-      "\nUSB: Monitor output file created at %s. Works well with tail:\n"
-      "$ tail -f %s\n",
-      ctx->mon_pathname, ctx->mon_pathname);
+
+  dpi_ctx_register(ctx, "usbdpi", name);
 
   return (void *)ctx;
 }
@@ -85,7 +109,7 @@ void *usbdpi_create(const char *name, int loglevel) {
 const char *decode_usb[] = {"SE0", "0-K", "1-J", "SE1"};
 
 void usbdpi_device_to_host(void *ctx_void, const svBitVecVal *usb_d2p) {
-  struct usbdpi_ctx *ctx = (struct usbdpi_ctx *)ctx_void;
+  struct usbdpi_ctx *ctx = (struct usbdpi_ctx *)dpi_ctx_resolve(ctx_void);
   assert(ctx);
   int d2p = usb_d2p[0];
   int dp, dn;
@@ -119,12 +143,21 @@ void usbdpi_device_to_host(void *ctx_void, const svBitVecVal *usb_d2p) {
            ctx->tick);
   }
   if ((d2p & D2P_PU) != ctx->last_pu) {
-    n = snprintf(obuf, MAX_OBUF, "%4x %8d Pullup change to %s%s%s\n",
-                 ctx->frame, ctx->tick, (d2p & D2P_DPPU) ? "DP Pulled up " : "",
-                 (d2p & D2P_DNPU) ? "DN Pulled up " : "",
-                 (d2p & D2P_TXMODE_SE) ? "SingleEnded" : "Differential");
-    ssize_t written = fwrite(obuf, sizeof(char), (size_t)n, ctx->mon_file);
-    assert(written == n);
+    if (ctx->mon_mode == DPI_MON_TEXT) {
+      n = snprintf(obuf, MAX_OBUF, "%4x %8d Pullup change to %s%s%s\n",
+                   ctx->frame, ctx->tick,
+                   (d2p & D2P_DPPU) ? "DP Pulled up " : "",
+                   (d2p & D2P_DNPU) ? "DN Pulled up " : "",
+                   (d2p & D2P_TXMODE_SE) ? "SingleEnded" : "Differential");
+      ssize_t written = fwrite(obuf, sizeof(char), (size_t)n, ctx->mon_file);
+      assert(written == n);
+    } else if (ctx->mon_mode == DPI_MON_BINARY) {
+      uint8_t pullup[4];
+      dpi_mon_put_u16(&pullup[0], ctx->frame);
+      dpi_mon_put_u16(&pullup[2], d2p);
+      dpi_mon_record(ctx->mon_file, USB_MON_PULLUP, 0, ctx->tick, pullup,
+                     sizeof(pullup));
+    }
     ctx->last_pu = d2p & D2P_PU;
   }
   if (d2p & D2P_TXMODE_SE) {
@@ -157,7 +190,7 @@ void usbdpi_device_to_host(void *ctx_void, const svBitVecVal *usb_d2p) {
     }
   }
 
-  if (ctx->loglevel & LOG_BIT) {
+  if ((ctx->loglevel & LOG_BIT) && ctx->mon_mode == DPI_MON_TEXT) {
     const char *pullup = (d2p & D2P_PU) ? "PU" : "  ";
     const char *state =
         (ctx->state == ST_GET) ? decode_usb[dp << 1 | dn] : "ZZ ";
@@ -685,7 +718,7 @@ int inv_driving(struct usbdpi_ctx *ctx, int d2p) {
 }
 
 char usbdpi_host_to_device(void *ctx_void, const svBitVecVal *usb_d2p) {
-  struct usbdpi_ctx *ctx = (struct usbdpi_ctx *)ctx_void;
+  struct usbdpi_ctx *ctx = (struct usbdpi_ctx *)dpi_ctx_resolve(ctx_void);
   assert(ctx);
   int d2p = usb_d2p[0];
   uint32_t last_driving = ctx->driving;
@@ -871,7 +904,7 @@ char usbdpi_host_to_device(void *ctx_void, const svBitVecVal *usb_d2p) {
       ctx->bit <<= 1;
       break;
   }
-  if ((ctx->loglevel & LOG_BIT) &&
+  if ((ctx->loglevel & LOG_BIT) && ctx->mon_mode == DPI_MON_TEXT &&
       (force_stat || (ctx->driving != last_driving))) {
     int n;
     char obuf[MAX_OBUF];
@@ -888,10 +921,13 @@ char usbdpi_host_to_device(void *ctx_void, const svBitVecVal *usb_d2p) {
 }
 
 void usbdpi_close(void *ctx_void) {
-  struct usbdpi_ctx *ctx = (struct usbdpi_ctx *)ctx_void;
+  struct usbdpi_ctx *ctx = (struct usbdpi_ctx *)dpi_ctx_resolve(ctx_void);
   if (!ctx) {
     return;
   }
-  fclose(ctx->mon_file);
+  if (ctx->mon_file) {
+    fclose(ctx->mon_file);
+  }
+  dpi_ctx_unregister(ctx);
   free(ctx);
 }
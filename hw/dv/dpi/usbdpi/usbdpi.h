@@ -93,6 +93,33 @@
 #define HS_NEXTFRAME 14
 
 #define SEND_MAX 32
+
+// Records in a binary monitor log (see dpi_mon.h). Where a record is about
+// a packet, its flags hold the driver of the bus: USB_MON_HOST or
+// USB_MON_DEVICE. The records marked as verbose are only written if bit 0x02
+// of the log level is set.
+#define USB_MON_HOST 1
+#define USB_MON_DEVICE 2
+// Both the host and the device drive the bus. No payload.
+#define USB_MON_CLASH 1
+// Bus idle (verbose). Payload: u16 d2p
+#define USB_MON_IDLE 2
+// Start of packet (verbose). No payload.
+#define USB_MON_SOP 3
+// Good PID (verbose). Payload: u8 PID
+#define USB_MON_PID 4
+// Bad PID (verbose). Payload: u8 PID
+#define USB_MON_BAD_PID 5
+// Bit stuffing error. Payload: u32 raw bits
+#define USB_MON_BITSTUFF 6
+// End of packet. Payload: u32 tick of the start of packet, u8 last good PID,
+// u8 PID of this packet, then the bytes that followed the PID (including the
+// CRC). The PID of this packet is only valid with USB_MON_PKT_HAS_PID set.
+#define USB_MON_PACKET 7
+#define USB_MON_PKT_HAS_PID 0x4
+// Pullup change. Payload: u16 frame, u16 d2p
+#define USB_MON_PULLUP 8
+
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -101,6 +128,8 @@ extern "C" {
 
 struct usbdpi_ctx {
   int loglevel;
+  // Monitor output mode, DPI_MON_OFF, DPI_MON_BINARY or DPI_MON_TEXT
+  int mon_mode;
   FILE *mon_file;
   char mon_pathname[PATH_MAX];
   void *mon;
@@ -126,14 +155,14 @@ struct usbdpi_ctx {
   int baudrate_set_successfully;
 };
 
-void *usbdpi_create(const char *name, int loglevel);
+void *usbdpi_create(const char *name, int loglevel, const char *mon_mode);
 void usbdpi_device_to_host(void *ctx_void, const svBitVecVal *usb_d2p);
 char usbdpi_host_to_device(void *ctx_void, const svBitVecVal *usb_d2p);
 void usbdpi_close(void *ctx_void);
 uint32_t CRC5(uint32_t dwInput, int iBitcnt);
 uint32_t CRC16(uint8_t *data, int bytes);
 
-void *monitor_usb_init(void);
+void *monitor_usb_init(int mon_mode);
 void monitor_usb(void *mon, FILE *mon_file, int log, int tick, int hdrive,
                  int p2d, int d2p, int *lastpid);
 
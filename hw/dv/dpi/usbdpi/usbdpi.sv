@@ -8,6 +8,11 @@
 // 0x01 -- monitor_usb (packet level)
 // 0x02 -- more verbose monitor
 // 0x08 -- bit level
+//
+// The monitor is off unless the `USBDPI_MON_<name>` plusarg selects "text"
+// (written to <name>.log) or "binary" (written to <name>.mon, and converted
+// to text or pcap with util/dpi_mon_convert.py). Bit level logging is only
+// available in text mode.
 
 module usbdpi #(
   parameter string NAME = "usb0",
@@ -37,7 +42,8 @@ module usbdpi #(
   input  logic pullupdn_en_d2p
 );
   import "DPI-C" function
-    chandle usbdpi_create(input string name, input int loglevel);
+    chandle usbdpi_create(input string name, input int loglevel,
+                          input string mon_mode);
 
   import "DPI-C" function
     void usbdpi_device_to_host(input chandle ctx, input bit [10:0] d2p);
@@ -49,9 +55,11 @@ module usbdpi #(
     byte usbdpi_host_to_device(input chandle ctx, input bit [10:0] d2p);
 
   chandle ctx;
+  string mon_mode = "off";
 
   initial begin
-    ctx = usbdpi_create(NAME, LOG_LEVEL);
+    $value$plusargs({"USBDPI_MON_", NAME, "=%s"}, mon_mode);
+    ctx = usbdpi_create(NAME, LOG_LEVEL, mon_mode);
   end
 
   final begin
@@ -7,9 +7,12 @@
 #include <cassert>
 #include <cstring>
 #include <fcntl.h>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <libelf.h>
 #include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <vector>
@@ -32,6 +35,70 @@ class ElfError : public std::exception {
   std::string msg_;
 };
 
+// Class wrapping the contents of a file, which are mapped into memory if
+// possible. If the file can't be mapped (for example, because it's a pipe),
+// the contents are read into a buffer instead.
+class MappedFile {
+ public:
+  MappedFile(const std::string &path) : data_(nullptr), size_(0) {
+    int fd = open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      throw ElfError(path, "could not open file.");
+    }
+
+    // The mapping is read-only, so a stray write faults rather than silently
+    // diverging from the file. libelf only writes to its input when
+    // converting between byte orders, and ElfFile refuses files that would
+    // need that.
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED) {
+        data_ = static_cast<char *>(ptr);
+        size_ = st.st_size;
+        close(fd);
+        return;
+      }
+    }
+
+    char chunk[4096];
+    ssize_t got;
+    while ((got = read(fd, chunk, sizeof chunk)) > 0) {
+      buf_.insert(buf_.end(), chunk, chunk + got);
+    }
+    close(fd);
+    if (got < 0) {
+      throw ElfError(path, "could not read file.");
+    }
+    data_ = buf_.data();
+    size_ = buf_.size();
+  }
+
+  ~MappedFile() {
+    if (buf_.empty() && data_) {
+      munmap(data_, size_);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  char *GetData() const { return data_; }
+  size_t GetSize() const { return size_; }
+
+ private:
+  char *data_;
+  size_t size_;
+  std::vector<char> buf_;
+};
+
+// The ELF data encoding (ELFDATA2LSB or ELFDATA2MSB) of the host
+char HostElfData() {
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const uint8_t *>(&probe) ? ELFDATA2LSB
+                                                    : ELFDATA2MSB;
+}
+
 // Class wrapping an open ELF file
 class ElfFile {
  public:
@@ -41,28 +108,28 @@ class ElfFile {
       throw std::runtime_error(elf_errmsg(-1));
     }
 
-    fd_ = open(path.c_str(), O_RDONLY, 0);
-    if (fd_ < 0) {
-      throw ElfError(path, "could not open file.");
+    file_ = std::make_shared<MappedFile>(path);
+
+    // Segments are staged as views into the file, so its byte order must
+    // match the host's. This also means libelf never needs to convert (and
+    // so write to) the mapping.
+    if (file_->GetSize() > EI_DATA &&
+        file_->GetData()[EI_DATA] != HostElfData()) {
+      throw ElfError(path, "byte order doesn't match the host.");
     }
 
-    ptr_ = elf_begin(fd_, ELF_C_READ, NULL);
+    ptr_ = elf_memory(file_->GetData(), file_->GetSize());
     if (!ptr_) {
-      close(fd_);
       throw ElfError(path, elf_errmsg(-1));
     }
 
     if (elf_kind(ptr_) != ELF_K_ELF) {
       elf_end(ptr_);
-      close(fd_);
       throw ElfError(path, "not an ELF file.");
     }
   }
 
-  ~ElfFile() {
-    elf_end(ptr_);
-    close(fd_);
-  }
+  ~ElfFile() { elf_end(ptr_); }
 
   size_t GetPhdrNum() {
     size_t phnum;
@@ -79,8 +146,19 @@ class ElfFile {
     return phdrs;
   }
 
+  size_t GetFileSize() const { return file_->GetSize(); }
+
+  // Make a StagedSeg for a segment whose file contents are at offset off in
+  // the file. The caller must have checked that they fit.
+  StagedSeg GetSeg(size_t off, uint32_t file_sz, uint32_t mem_sz) const {
+    assert(off + std::min(file_sz, mem_sz) <= file_->GetSize());
+    const uint8_t *view =
+        reinterpret_cast<const uint8_t *>(file_->GetData()) + off;
+    return StagedSeg(file_, view, std::min(file_sz, mem_sz), mem_sz);
+  }
+
   std::string path_;
-  int fd_;
+  std::shared_ptr<MappedFile> file_;
   Elf *ptr_;
 };
 }  // namespace
@@ -179,9 +257,7 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
   // range [low, high] (inclusive).
   assert(low <= high);
 
-  size_t file_size;
-  const char *file_data = elf_rawfile(elf.ptr_, &file_size);
-  assert(file_data);
+  size_t file_size = elf.GetFileSize();
 
   StagedMem ret;
 
@@ -202,15 +278,12 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
     }
 
     uint32_t off = phdr.p_paddr - low;
-    uint32_t dst_len = phdr.p_memsz;
-    uint32_t src_len = std::min(phdr.p_filesz, dst_len);
 
-    if (!dst_len)
+    if (!phdr.p_memsz)
       continue;
 
-    std::vector<uint8_t> seg(dst_len, 0);
-    memcpy(&seg[0], file_data + phdr.p_offset, src_len);
-    ret.AddSegment(off, std::move(seg));
+    ret.AddSegment(off,
+                   elf.GetSeg(phdr.p_offset, phdr.p_filesz, phdr.p_memsz));
   }
 
   return ret.GetFlat();
@@ -219,10 +292,10 @@ static std::vector<uint8_t> FlattenElfFile(const std::string &filepath) {
 // Merge seg0 and seg1, overwriting any overlapping data in seg0 with
 // that from seg1. rng0/rng1 is the base and top address of seg0/seg1,
 // respectively.
-static std::vector<uint8_t> MergeSegments(const AddrRange<uint32_t> &rng0,
-                                          std::vector<uint8_t> &&seg0,
-                                          const AddrRange<uint32_t> &rng1,
-                                          std::vector<uint8_t> &&seg1) {
+static StagedSeg MergeSegments(const AddrRange<uint32_t> &rng0,
+                               StagedSeg &&seg0,
+                               const AddrRange<uint32_t> &rng1,
+                               StagedSeg &&seg1) {
   // First, deal with the special case where seg1 completely contains
   // seg0 (since there's no copying needed at all).
   if (rng1.lo <= rng0.lo && rng0.hi <= rng1.hi) {
@@ -236,49 +309,264 @@ static std::vector<uint8_t> MergeSegments(const AddrRange<uint32_t> &rng0,
   assert(seg0.size() <= new_len);
   assert(seg1.size() <= new_len);
 
-  // We want to avoid copying if possible. The next most efficient
-  // case (after just returning seg1) is when seg0 doesn't stick out
-  // the left hand end. In this case, we can extend seg1 to the right
-  // (which might not cause a copy) and then copy just the bytes we
-  // need from seg0.
-  if (rng1.lo <= rng0.lo) {
-    assert(rng1.hi < rng0.hi);
-    assert(new_len == seg1.size() + (rng0.hi - rng1.hi));
-
-    size_t old_len = seg1.size();
-    std::vector<uint8_t> ret = std::move(seg1);
-    ret.resize(new_len);
-
-    // We know that that rng0 isn't completely contained in rng1 and
-    // that rng0 doesn't stick out of the left hand end. That means it
-    // must stick out of the right (so rng1.hi < rng0.hi). However, we
-    // also know that the two ranges overlap, so rng0.lo <= rng1.hi.
-    assert(rng0.lo <= rng1.hi);
-
-    // src_off is the index of the first byte that needs copying from
-    // seg0. Note that this is always at least 1 (because there is an
-    // actual overlap).
-    uint32_t src_off = 1 + (rng1.hi - rng0.lo);
-
-    assert(seg0.size() == src_off + (rng0.hi - rng1.hi));
-
-    memcpy(&ret[old_len], &seg0[src_off], rng0.hi - rng1.hi);
-    return ret;
-  }
-
-  // In this final case, seg0 sticks out the left hand end. That means
-  // we'll have to copy seg1 whatever happens (because we have to
-  // shuffle its elements to the right). Work by resizing seg0 and
-  // then writing seg1 where it's needed.
-  std::vector<uint8_t> ret = std::move(seg0);
-  ret.resize(new_len);
-
-  uint32_t off = rng1.lo - rng0.lo;
-  memcpy(&ret[off], &seg1[0], seg1.size());
+  // Otherwise, the merged segment can't be a view of a single buffer, so
+  // copy both segments into a new one. Overlapping segments are rare, so this
+  // isn't worth optimising.
+  std::vector<uint8_t> ret(new_len);
+  seg0.CopyOut(0, &ret[rng0.lo - new_bot], seg0.size());
+  seg1.CopyOut(0, &ret[rng1.lo - new_bot], seg1.size());
+  return StagedSeg(std::move(ret));
+}
+
+StagedSeg::StagedSeg(std::shared_ptr<const void> owner, const uint8_t *view,
+                     size_t view_len, size_t size)
+    : owner_(std::move(owner)), view_(view), view_len_(view_len) {
+  assert(view_len <= size);
+  tail_.resize(size - view_len, 0);
+}
+
+void StagedSeg::CopyOut(size_t off, uint8_t *dst, size_t len) const {
+  assert(off + len <= size());
+
+  if (off < view_len_) {
+    size_t from_view = std::min(len, view_len_ - off);
+    memcpy(dst, view_ + off, from_view);
+    dst += from_view;
+    off += from_view;
+    len -= from_view;
+  }
+  if (len) {
+    memcpy(dst, &tail_[off - view_len_], len);
+  }
+}
+
+std::vector<uint8_t> StagedSeg::ToVector() const {
+  std::vector<uint8_t> ret(size());
+  CopyOut(0, ret.data(), ret.size());
   return ret;
 }
 
-void StagedMem::AddSegment(uint32_t offset, std::vector<uint8_t> &&seg) {
+// Encode seg for mem_area, starting at word lo_word, appending the resulting
+// physical images to images. The viewed part of the segment is encoded
+// straight from the view. Only the word that straddles the end of the view (if
+// any) is copied, together with the tail.
+static void EncodeSegment(const MemArea &mem_area, uint32_t lo_word,
+                          const StagedSeg &seg,
+                          std::vector<MemArea::PhysImage> *images) {
+  uint32_t width_byte = mem_area.GetWidthByte();
+  size_t view_words = seg.GetViewLen() / width_byte;
+  size_t view_bytes = view_words * width_byte;
+
+  if (view_words) {
+    images->emplace_back();
+    mem_area.Encode(lo_word, seg.GetView(), view_bytes, &images->back());
+  }
+
+  if (view_bytes < seg.size()) {
+    std::vector<uint8_t> rest(seg.size() - view_bytes);
+    seg.CopyOut(view_bytes, rest.data(), rest.size());
+    images->emplace_back();
+    mem_area.Encode(lo_word + view_words, rest.data(), rest.size(),
+                    &images->back());
+  }
+}
+
+// 64-bit FNV-1a hash, used to name image cache files. Pass the result of a
+// previous call as h to hash several buffers. This only picks a file name:
+// cache files also hold the data that they were encoded from, which is
+// compared in full before an entry is used.
+static const uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ull;
+
+static uint64_t Fnv1a64(uint64_t h, const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    h = (h ^ data[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+static uint64_t Fnv1a64(uint64_t h, uint64_t val) {
+  uint8_t bytes[8];
+  for (int i = 0; i < 8; ++i) {
+    bytes[i] = val >> (8 * i);
+  }
+  return Fnv1a64(h, bytes, sizeof bytes);
+}
+
+// Append the contents of seg, which starts at byte offset lo, to src. The view
+// and the tail are separate chunks, so nothing is copied.
+static void AddSegmentChunks(uint32_t lo, const StagedSeg &seg,
+                             std::vector<DpiMemUtil::ImageChunk> *src) {
+  if (seg.GetViewLen()) {
+    src->push_back({lo, seg.GetView(), seg.GetViewLen()});
+  }
+  if (!seg.GetTail().empty()) {
+    src->push_back({(uint32_t)(lo + seg.GetViewLen()), seg.GetTail().data(),
+                    seg.GetTail().size()});
+  }
+}
+
+// The image cache file format. All integers are little-endian uint32_t.
+//
+//   magic (8 bytes), version, key length, key
+//   number of source chunks
+//   for each chunk: byte offset, length n, n bytes of data
+//   number of images
+//   for each image: number of words n, n physical addresses,
+//                   n * SV_MEM_STRIDE_BYTES bytes of data
+static const char kImageCacheMagic[8] = {'O', 'T', 'M', 'E',
+                                         'M', 'I', 'M', 'G'};
+static const uint32_t kImageCacheVersion = 2;
+
+static void PutU32(std::ostream &os, uint32_t val) {
+  uint8_t bytes[4] = {(uint8_t)val, (uint8_t)(val >> 8), (uint8_t)(val >> 16),
+                      (uint8_t)(val >> 24)};
+  os.write(reinterpret_cast<const char *>(bytes), sizeof bytes);
+}
+
+static bool GetU32(std::istream &is, uint32_t *val) {
+  uint8_t bytes[4];
+  if (!is.read(reinterpret_cast<char *>(bytes), sizeof bytes)) {
+    return false;
+  }
+  *val = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+         ((uint32_t)bytes[3] << 24);
+  return true;
+}
+
+// Read a source chunk from is and check that it matches chunk exactly.
+static bool MatchImageChunk(std::istream &is,
+                            const DpiMemUtil::ImageChunk &chunk) {
+  uint32_t off, len;
+  if (!GetU32(is, &off) || off != chunk.off || !GetU32(is, &len) ||
+      len != chunk.len) {
+    return false;
+  }
+
+  char buf[4096];
+  for (size_t done = 0; done < len;) {
+    size_t todo = std::min(sizeof buf, len - done);
+    if (!is.read(buf, todo) || memcmp(buf, chunk.data + done, todo) != 0) {
+      return false;
+    }
+    done += todo;
+  }
+  return true;
+}
+
+// Try to read images for key and src from the cache file at path, checking
+// that they fit in a memory with num_words words. Returns false if the file
+// doesn't exist or was encoded from some other key or data, or if it's
+// malformed in any way.
+static bool ReadImageCache(const std::string &path, const std::string &key,
+                           const std::vector<DpiMemUtil::ImageChunk> &src,
+                           uint32_t num_words,
+                           std::vector<MemArea::PhysImage> *images) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is) {
+    return false;
+  }
+
+  char magic[sizeof kImageCacheMagic];
+  uint32_t version, key_len;
+  if (!is.read(magic, sizeof magic) ||
+      memcmp(magic, kImageCacheMagic, sizeof magic) != 0 ||
+      !GetU32(is, &version) || version != kImageCacheVersion ||
+      !GetU32(is, &key_len) || key_len != key.size()) {
+    return false;
+  }
+
+  std::string file_key(key_len, '\0');
+  uint32_t num_chunks;
+  if (!is.read(&file_key[0], key_len) || file_key != key ||
+      !GetU32(is, &num_chunks) || num_chunks != src.size()) {
+    return false;
+  }
+
+  for (const DpiMemUtil::ImageChunk &chunk : src) {
+    if (!MatchImageChunk(is, chunk)) {
+      return false;
+    }
+  }
+
+  uint32_t num_images;
+  if (!GetU32(is, &num_images)) {
+    return false;
+  }
+
+  images->clear();
+  for (uint32_t i = 0; i < num_images; ++i) {
+    uint32_t n;
+    if (!GetU32(is, &n) || n > num_words) {
+      return false;
+    }
+    MemArea::PhysImage image;
+    image.phys_addrs.resize(n);
+    for (uint32_t j = 0; j < n; ++j) {
+      uint32_t addr;
+      if (!GetU32(is, &addr) || addr >= num_words ||
+          (j && addr <= image.phys_addrs[j - 1])) {
+        return false;
+      }
+      image.phys_addrs[j] = addr;
+    }
+    image.data.resize((size_t)n * SV_MEM_STRIDE_BYTES);
+    if (!is.read(reinterpret_cast<char *>(image.data.data()),
+                 image.data.size())) {
+      return false;
+    }
+    images->push_back(std::move(image));
+  }
+
+  // Check that there's no trailing junk
+  return is.peek() == std::char_traits<char>::eof();
+}
+
+// Write images for key and src to the cache file at path. The file is written
+// under a temporary name and then renamed, so concurrent simulations sharing a
+// cache directory never see a partial file. Returns false on failure.
+static bool WriteImageCache(const std::string &path, const std::string &key,
+                            const std::vector<DpiMemUtil::ImageChunk> &src,
+                            const std::vector<MemArea::PhysImage> &images) {
+  std::ostringstream tmp_oss;
+  tmp_oss << path << ".tmp." << getpid();
+  std::string tmp_path = tmp_oss.str();
+
+  {
+    std::ofstream os(tmp_path, std::ios::binary | std::ios::trunc);
+    os.write(kImageCacheMagic, sizeof kImageCacheMagic);
+    PutU32(os, kImageCacheVersion);
+    PutU32(os, key.size());
+    os.write(key.data(), key.size());
+    PutU32(os, src.size());
+    for (const DpiMemUtil::ImageChunk &chunk : src) {
+      PutU32(os, chunk.off);
+      PutU32(os, chunk.len);
+      os.write(reinterpret_cast<const char *>(chunk.data), chunk.len);
+    }
+    PutU32(os, images.size());
+    for (const MemArea::PhysImage &image : images) {
+      PutU32(os, image.phys_addrs.size());
+      for (uint32_t addr : image.phys_addrs) {
+        PutU32(os, addr);
+      }
+      os.write(reinterpret_cast<const char *>(image.data.data()),
+               image.data.size());
+    }
+    os.close();
+    if (!os) {
+      unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void StagedMem::AddSegment(uint32_t offset, StagedSeg &&seg) {
   if (seg.empty())
     return;
 
@@ -299,20 +587,20 @@ std::vector<uint8_t> StagedMem::GetFlat() const {
 
   for (const auto &pr : segs_) {
     const AddrRange<uint32_t> &rng = pr.first;
-    const std::vector<uint8_t> &seg = pr.second;
+    const StagedSeg &seg = pr.second;
     assert(seg.size() == 1 + (rng.hi - rng.lo));
     assert(min_addr_ <= rng.lo);
 
     uint32_t off = rng.lo - min_addr_;
     assert(off + seg.size() <= ret.size());
 
-    memcpy(&ret[off], &seg[0], seg.size());
+    seg.CopyOut(0, &ret[off], seg.size());
   }
   return ret;
 }
 
 void DpiMemUtil::RegisterMemoryArea(const std::string &name, uint32_t base,
-                                    const MemArea *mem_area) {
+                                    const MemArea *mem_area, bool read_only) {
   assert(mem_area);
 
   // Check that we don't overflow the address space.
@@ -352,6 +640,7 @@ void DpiMemUtil::RegisterMemoryArea(const std::string &name, uint32_t base,
   mem_areas_.push_back(mem_area);
   base_addrs_.push_back(base);
   names_.push_back(name);
+  read_only_.push_back(read_only);
 }
 
 MemImageType DpiMemUtil::GetMemImageType(const std::string &path,
@@ -401,10 +690,23 @@ void DpiMemUtil::LoadFileToNamedMem(bool verbose, const std::string &name,
 
   try {
     switch (type) {
-      case kMemImageElf:
-        m.Write(0, FlattenElfFile(filepath));
+      case kMemImageElf: {
+        std::vector<uint8_t> data = FlattenElfFile(filepath);
+        WriteImages(verbose, it->second, {{0, data.data(), data.size()}},
+                    [&](std::vector<MemArea::PhysImage> *images) {
+                      images->emplace_back();
+                      m.Encode(0, data.data(), data.size(), &images->back());
+                    });
         break;
+      }
       case kMemImageVmem:
+        // This doesn't go through WriteImages, so we no longer know what's
+        // in the memory.
+        if (skip_zero_ || skip_unchanged_) {
+          MemShadow &shadow = shadows_[it->second];
+          shadow.data.resize((size_t)m.GetSizeWords() * SV_MEM_STRIDE_BYTES);
+          shadow.known.assign(m.GetSizeWords(), false);
+        }
         m.LoadVmem(filepath);
         break;
       default:
@@ -431,25 +733,162 @@ void DpiMemUtil::LoadElfToMemories(bool verbose, const std::string &filepath) {
 
     const MemArea &mem_area = *mem_areas_[mem_area_it->second];
 
-    for (const auto seg_pr : staged_mem.GetSegs()) {
-      const AddrRange<uint32_t> &seg_rng = seg_pr.first;
-      const std::vector<uint8_t> &seg_data = seg_pr.second;
-
-      assert(seg_rng.lo % mem_area.GetWidthByte() == 0);
-      uint32_t lo_word = seg_rng.lo / mem_area.GetWidthByte();
-
-      try {
-        mem_area.Write(lo_word, seg_data);
-      } catch (const SVScoped::Error &err) {
-        std::ostringstream oss;
-        oss << "No memory found at `" << err.scope_name_
-            << "' (the scope associated with region `" << mem_name
-            << "', used by a segment that starts at LMA 0x" << std::hex
-            << base_addrs_[mem_area_it->second] + seg_rng.lo << ").";
-        throw std::runtime_error(oss.str());
-      }
+    std::vector<ImageChunk> src;
+    for (const auto &seg_pr : staged_mem.GetSegs()) {
+      assert(seg_pr.first.lo % mem_area.GetWidthByte() == 0);
+      AddSegmentChunks(seg_pr.first.lo, seg_pr.second, &src);
+    }
+
+    try {
+      WriteImages(verbose, mem_area_it->second, src,
+                  [&](std::vector<MemArea::PhysImage> *images) {
+                    for (const auto &seg_pr : staged_mem.GetSegs()) {
+                      uint32_t lo_word =
+                          seg_pr.first.lo / mem_area.GetWidthByte();
+                      EncodeSegment(mem_area, lo_word, seg_pr.second, images);
+                    }
+                  });
+    } catch (const SVScoped::Error &err) {
+      std::ostringstream oss;
+      oss << "No memory found at `" << err.scope_name_
+          << "' (the scope associated with region `" << mem_name
+          << "', used by a segment that starts at LMA 0x" << std::hex
+          << base_addrs_[mem_area_it->second] + staged_mem.GetBounds().first
+          << ").";
+      throw std::runtime_error(oss.str());
+    }
+  }
+}
+
+void DpiMemUtil::SetImageCacheDir(const std::string &dir) {
+  image_cache_dir_ = dir;
+}
+
+void DpiMemUtil::SetLoadSkip(bool skip_zero, bool skip_unchanged) {
+  skip_zero_ = skip_zero;
+  skip_unchanged_ = skip_unchanged;
+  // WriteImage() doesn't keep the shadows up to date when nothing is skipped
+  if (!skip_zero && !skip_unchanged) {
+    shadows_.clear();
+  }
+}
+
+void DpiMemUtil::ForgetMemContents(bool keep_read_only) {
+  for (auto it = shadows_.begin(); it != shadows_.end();) {
+    if (keep_read_only && read_only_[it->first]) {
+      ++it;
+    } else {
+      it = shadows_.erase(it);
+    }
+  }
+}
+
+void DpiMemUtil::WriteImages(
+    bool verbose, size_t mem_idx, const std::vector<ImageChunk> &src,
+    const std::function<void(std::vector<MemArea::PhysImage> *)> &encode) {
+  const MemArea &mem_area = *mem_areas_[mem_idx];
+  std::vector<MemArea::PhysImage> images;
+
+  bool hit = false;
+  std::string key, path;
+  if (!image_cache_dir_.empty()) {
+    // The key identifies everything about the memory that affects how data
+    // is encoded. The file is named by a hash of the key and the source data,
+    // but both are stored in the file and checked in full.
+    std::ostringstream key_oss;
+    key_oss << "words=" << mem_area.GetSizeWords()
+            << ";width=" << mem_area.GetWidthByte()
+            << ";stride=" << SV_MEM_STRIDE_BYTES
+            << ";enc=" << mem_area.GetEncodingId();
+    key = key_oss.str();
+
+    uint64_t hash = Fnv1a64(kFnvOffsetBasis,
+                            reinterpret_cast<const uint8_t *>(key.data()),
+                            key.size());
+    for (const ImageChunk &chunk : src) {
+      hash = Fnv1a64(hash, chunk.off);
+      hash = Fnv1a64(hash, chunk.len);
+      hash = Fnv1a64(hash, chunk.data, chunk.len);
+    }
+
+    std::ostringstream path_oss;
+    path_oss << image_cache_dir_ << "/" << std::hex << std::setfill('0')
+             << std::setw(16) << hash << ".phys";
+    path = path_oss.str();
+
+    hit = ReadImageCache(path, key, src, mem_area.GetSizeWords(), &images);
+    if (verbose) {
+      std::cout << "Image cache " << (hit ? "hit" : "miss") << " for memory `"
+                << names_[mem_idx] << "' (" << path << ")." << std::endl;
+    }
+  }
+
+  if (!hit) {
+    images.clear();
+    encode(&images);
+  }
+
+  size_t num_words = 0, num_skipped = 0;
+  for (const MemArea::PhysImage &image : images) {
+    num_words += image.phys_addrs.size();
+    num_skipped += WriteImage(mem_idx, image);
+  }
+  if (verbose && (skip_zero_ || skip_unchanged_)) {
+    std::cout << "Skipped " << num_skipped << " of " << num_words
+              << " words already in memory `" << names_[mem_idx] << "'."
+              << std::endl;
+  }
+
+  if (!image_cache_dir_.empty() && !hit &&
+      !WriteImageCache(path, key, src, images)) {
+    std::cerr << "WARNING: Failed to write memory image cache file `" << path
+              << "'." << std::endl;
+  }
+}
+
+size_t DpiMemUtil::WriteImage(size_t mem_idx, const MemArea::PhysImage &image) {
+  const MemArea &mem_area = *mem_areas_[mem_idx];
+
+  if (!skip_zero_ && !skip_unchanged_) {
+    mem_area.WritePhys(image);
+    return 0;
+  }
+
+  // Create the shadow for this memory if this is the first load since the
+  // skip options were set. If we are allowed to assume that memories start
+  // out zeroed, every word starts out known to be zero.
+  auto pr = shadows_.emplace(mem_idx, MemShadow());
+  MemShadow &shadow = pr.first->second;
+  if (pr.second) {
+    shadow.data.resize((size_t)mem_area.GetSizeWords() * SV_MEM_STRIDE_BYTES);
+    shadow.known.resize(mem_area.GetSizeWords(), skip_zero_);
+  }
+
+  // Only write the words whose contents aren't known to match
+  MemArea::PhysImage to_write;
+  for (size_t i = 0; i < image.phys_addrs.size(); ++i) {
+    uint32_t addr = image.phys_addrs[i];
+    assert(addr < shadow.known.size());
+    const uint8_t *src = &image.data[i * SV_MEM_STRIDE_BYTES];
+    uint8_t *dst = &shadow.data[(size_t)addr * SV_MEM_STRIDE_BYTES];
+
+    if (shadow.known[addr] && memcmp(src, dst, SV_MEM_STRIDE_BYTES) == 0) {
+      continue;
+    }
+
+    to_write.phys_addrs.push_back(addr);
+    to_write.data.insert(to_write.data.end(), src, src + SV_MEM_STRIDE_BYTES);
+
+    // If we're remembering what we write, the word is now known to hold src.
+    // Otherwise, we can't assume anything about it any more.
+    if (skip_unchanged_) {
+      memcpy(dst, src, SV_MEM_STRIDE_BYTES);
     }
+    shadow.known[addr] = skip_unchanged_;
   }
+
+  mem_area.WritePhys(to_write);
+  return image.phys_addrs.size() - to_write.phys_addrs.size();
 }
 
 void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
@@ -461,9 +900,7 @@ void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
   // Allow subclasses to get at the loaded ELF data if they need it
   OnElfLoaded(elf.ptr_);
 
-  size_t file_size;
-  const char *file_data = elf_rawfile(elf.ptr_, &file_size);
-  assert(file_data);
+  size_t file_size = elf.GetFileSize();
 
   size_t phnum = elf.GetPhdrNum();
   const Elf32_Phdr *phdrs = elf.GetPhdrs();
@@ -517,11 +954,10 @@ void DpiMemUtil::StageElf(bool verbose, const std::string &path) {
     // there isn't one, make a new empty one.
     StagedMem &staged_mem = staging_area_[name];
 
-    const char *seg_data = file_data + phdr.p_offset;
-    std::vector<uint8_t> vec(phdr.p_memsz, 0);
-    memcpy(&vec[0], seg_data, std::min(phdr.p_filesz, phdr.p_memsz));
-
-    staged_mem.AddSegment(local_base, std::move(vec));
+    // The segment's file contents stay in the mapped file. Only the zero fill
+    // at the end of the segment is stored in the segment itself.
+    staged_mem.AddSegment(
+        local_base, elf.GetSeg(phdr.p_offset, phdr.p_filesz, phdr.p_memsz));
   }
 }
 
@@ -4,6 +4,7 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_CPP_DPI_MEMUTIL_H_
 #define OPENTITAN_HW_DV_VERILATOR_CPP_DPI_MEMUTIL_H_
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -22,6 +23,48 @@ enum MemImageType {
   kMemImageVmem,
 };
 
+// A segment of staged data.
+//
+// The contents are a prefix that is a read-only view into some other buffer
+// (such as a memory-mapped ELF file), followed by a tail that is owned by the
+// segment. The view is kept alive by holding a reference to its owner. When a
+// segment is loaded from an ELF file, the view covers the bytes that come
+// from the file and the tail is the zero fill for the rest of the segment (as
+// used for .bss). A segment built from a vector has no view.
+class StagedSeg {
+ public:
+  StagedSeg() : view_(nullptr), view_len_(0) {}
+
+  explicit StagedSeg(std::vector<uint8_t> &&data)
+      : view_(nullptr), view_len_(0), tail_(std::move(data)) {}
+
+  StagedSeg(std::shared_ptr<const void> owner, const uint8_t *view,
+            size_t view_len, size_t size);
+
+  size_t size() const { return view_len_ + tail_.size(); }
+  bool empty() const { return size() == 0; }
+
+  uint8_t operator[](size_t idx) const {
+    return idx < view_len_ ? view_[idx] : tail_[idx - view_len_];
+  }
+
+  // Copy len bytes, starting at offset off, to dst.
+  void CopyOut(size_t off, uint8_t *dst, size_t len) const;
+
+  // Return a copy of the contents as a single vector.
+  std::vector<uint8_t> ToVector() const;
+
+  const uint8_t *GetView() const { return view_; }
+  size_t GetViewLen() const { return view_len_; }
+  const std::vector<uint8_t> &GetTail() const { return tail_; }
+
+ private:
+  std::shared_ptr<const void> owner_;
+  const uint8_t *view_;
+  size_t view_len_;
+  std::vector<uint8_t> tail_;
+};
+
 // Staged data for a given memory area.
 //
 // This is represented as an ordered list of disjoint segments (as loaded from
@@ -34,13 +77,16 @@ class StagedMem {
   StagedMem() : min_addr_(~(uint32_t)0), max_addr_(0) {}
 
   // Add a segment to the tracked memory
-  void AddSegment(uint32_t offset, std::vector<uint8_t> &&seg);
+  void AddSegment(uint32_t offset, StagedSeg &&seg);
+  void AddSegment(uint32_t offset, std::vector<uint8_t> &&seg) {
+    AddSegment(offset, StagedSeg(std::move(seg)));
+  }
 
   // Glob together the tracked segments, interspersing them with
   // zeros, and return as a single flat array.
   std::vector<uint8_t> GetFlat() const;
 
-  typedef RangedMap<uint32_t, std::vector<uint8_t>> SegMap;
+  typedef RangedMap<uint32_t, StagedSeg> SegMap;
 
   std::pair<uint32_t, uint32_t> GetBounds() const {
     return std::make_pair(min_addr_, max_addr_);
@@ -58,6 +104,7 @@ class StagedMem {
  * These utilities require the corresponding DPI functions:
  * simutil_memload()
  * simutil_set_mem()
+ * simutil_set_mem_block() (optional, used for faster loading)
  * to be defined somewhere as SystemVerilog functions.
  */
 class DpiMemUtil {
@@ -79,11 +126,15 @@ class DpiMemUtil {
    * must not be null. This function does not take ownership of the object,
    * which must survive at least as long as the DpiMemutil object.
    *
+   * |read_only| should be true if the design never writes to the memory (as
+   * for a ROM). What is remembered about the contents of such a memory is
+   * kept by ForgetMemContents() (see SetLoadSkip()).
+   *
    * Memories must be registered before command arguments are parsed by
    * ParseCommandArgs() in order for them to be known.
    */
   void RegisterMemoryArea(const std::string &name, uint32_t base,
-                          const MemArea *mem_area);
+                          const MemArea *mem_area, bool read_only = false);
 
   /**
    * Guess the type of the file at |path|.
@@ -123,16 +174,75 @@ class DpiMemUtil {
    * Load an ELF file into a staging area in this object, which can then be
    * accessed with GetMemoryData().
    *
+   * The file is mapped into memory and the staged segments are views into the
+   * mapping, so loaded data isn't copied. Only zero fill at the end of
+   * segments is stored separately. The mapping stays alive until the staging
+   * area is replaced.
+   *
    * If the load fails, raises a std::exception with information about what
    * happened.
    */
   void StageElf(bool verbose, const std::string &path);
 
+  /**
+   * Set a directory in which to cache encoded memory images
+   *
+   * When this is set, the physical contents that are written to a memory when
+   * loading an ELF file (after adding integrity bits and scrambling) are
+   * stored in the directory and reused if the same data is loaded into a
+   * memory with the same geometry and encoding (including any scrambling key
+   * and nonce) again. The directory must already exist and may be shared
+   * between simulations. An empty string disables the cache, which is the
+   * default.
+   */
+  void SetImageCacheDir(const std::string &dir);
+
+  /**
+   * Choose which words to skip when loading ELF files into memories
+   *
+   * If skip_zero is true, memories are assumed to hold zeros (in their
+   * physical encoding) before anything is loaded into them, as they do after
+   * reset, and words whose encoded contents are zero aren't written. This is
+   * only valid for loads at the start of simulation.
+   *
+   * If skip_unchanged is true, the encoded contents of every word that is
+   * loaded are remembered and a later load only writes the words that have
+   * changed. This assumes that the design hasn't written to the memory in the
+   * meantime.
+   *
+   * Both options default to false, in which case every word is written and
+   * nothing is remembered. Turning both off forgets anything that has been
+   * remembered about memory contents.
+   */
+  void SetLoadSkip(bool skip_zero, bool skip_unchanged);
+
+  /**
+   * Forget what has been remembered about memory contents
+   *
+   * Call this when the memories may have changed since they were loaded, for
+   * example because the design has run or a checkpoint has been restored. If
+   * keep_read_only is true, what is remembered about memories registered as
+   * read-only is kept, so a later load still skips the words that it doesn't
+   * change.
+   */
+  void ForgetMemContents(bool keep_read_only);
+
   /**
    * Get the contents of the staging area by memory name
    */
   const StagedMem &GetMemoryData(const std::string &mem_name) const;
 
+  /**
+   * A piece of the data being loaded into a memory: len bytes at data, which
+   * go at byte offset off in the memory. The image cache uses a list of these
+   * to identify the data that an image was encoded from.
+   */
+  struct ImageChunk {
+    uint32_t off;
+    const uint8_t *data;
+    size_t len;
+  };
+
  protected:
   /**
    * A hook for subclasses to do extra computations with loaded ELF data. This
@@ -148,6 +258,7 @@ class DpiMemUtil {
   std::vector<const MemArea *> mem_areas_;
   std::vector<uint32_t> base_addrs_;
   std::vector<std::string> names_;
+  std::vector<bool> read_only_;
 
   std::map<std::string, size_t> name_to_mem_;
   RangedMap<uint32_t, size_t> addr_to_mem_;
@@ -159,6 +270,42 @@ class DpiMemUtil {
   std::map<std::string, StagedMem> staging_area_;
   const StagedMem empty_;
 
+  // Directory for the image cache, or empty if the cache is disabled.
+  std::string image_cache_dir_;
+
+  // The physical contents of a memory, as far as we know them. known has an
+  // entry for each physical word, and the contents of the word at address i
+  // are at data[i * SV_MEM_STRIDE_BYTES] if known[i] is true.
+  struct MemShadow {
+    std::vector<uint8_t> data;
+    std::vector<bool> known;
+  };
+
+  // Options set by SetLoadSkip and the shadows that they use, keyed by
+  // memory index.
+  bool skip_zero_ = false;
+  bool skip_unchanged_ = false;
+  std::map<size_t, MemShadow> shadows_;
+
+  /**
+   * Write encoded images to the memory with index mem_idx, going through the
+   * image cache if it is enabled.
+   *
+   * src is the data being loaded. It is only read if the cache is enabled,
+   * in which case cache entries are matched against it in full. On a cache
+   * miss, encode is called to compute the images, which are then written to
+   * the memory and stored in the cache.
+   */
+  void WriteImages(
+      bool verbose, size_t mem_idx, const std::vector<ImageChunk> &src,
+      const std::function<void(std::vector<MemArea::PhysImage> *)> &encode);
+
+  /**
+   * Write an encoded image to the memory with index mem_idx, skipping words
+   * as chosen by SetLoadSkip(). Returns the number of words skipped.
+   */
+  size_t WriteImage(size_t mem_idx, const MemArea::PhysImage &image);
+
   /**
    * Find the index of a memory area containing the given segment's addresses.
    * Raises a std::exception if none is found.
@@ -0,0 +1,96 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#ifndef OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_LANES_H_
+#define OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_LANES_H_
+
+// Utility functions for packing 39-bit ECC codewords (32 data bits and 7 check
+// bits) into the physical bits of a memory word, and unpacking them again.
+//
+// A codeword ("lane") is held in a uint64_t, with the data in bits 31:0 and the
+// check bits in bits 38:32. A memory word with width_32 lanes has them packed
+// back to back, with lane 0 in the least significant bits, and occupies
+// (39 * width_32 + 7) / 8 bytes, stored little-endian.
+
+#include <cassert>
+#include <cstdint>
+
+// The number of bits in a lane
+static const uint32_t kEcc32LaneBits = 39;
+
+// The largest number of lanes supported by Ecc32GetLaneFns
+static const uint32_t kEcc32MaxLanes = 8;
+
+// Pack width_32 lanes into buf, writing (39 * width_32 + 7) / 8 bytes. Any
+// unused bits at the top of the last byte are zeroed.
+template <uint32_t width_32>
+inline void Ecc32PackLanes(uint8_t *buf, const uint64_t *lanes) {
+  // acc holds acc_bits bits that haven't been written to buf yet. Whole bytes
+  // are flushed after adding each lane, so acc_bits is at most 7 + 39 and the
+  // accumulator never overflows.
+  uint64_t acc = 0;
+  uint32_t acc_bits = 0;
+  for (uint32_t i = 0; i < width_32; ++i) {
+    acc |= (lanes[i] & ((1ull << kEcc32LaneBits) - 1)) << acc_bits;
+    acc_bits += kEcc32LaneBits;
+    while (acc_bits >= 8) {
+      *buf++ = acc & 0xff;
+      acc >>= 8;
+      acc_bits -= 8;
+    }
+  }
+  if (acc_bits) {
+    *buf = acc & 0xff;
+  }
+}
+
+// Unpack width_32 lanes from buf, reading (39 * width_32 + 7) / 8 bytes.
+template <uint32_t width_32>
+inline void Ecc32UnpackLanes(uint64_t *lanes, const uint8_t *buf) {
+  uint64_t acc = 0;
+  uint32_t acc_bits = 0;
+  for (uint32_t i = 0; i < width_32; ++i) {
+    while (acc_bits < kEcc32LaneBits) {
+      acc |= (uint64_t)*buf++ << acc_bits;
+      acc_bits += 8;
+    }
+    lanes[i] = acc & ((1ull << kEcc32LaneBits) - 1);
+    acc >>= kEcc32LaneBits;
+    acc_bits -= kEcc32LaneBits;
+  }
+}
+
+// A pair of pack and unpack functions for a given number of lanes
+struct Ecc32LaneFns {
+  void (*pack)(uint8_t *buf, const uint64_t *lanes);
+  void (*unpack)(uint64_t *lanes, const uint8_t *buf);
+};
+
+// Get the pack and unpack functions for width_32 lanes. Memory widths are
+// only known at runtime, so this picks between the instantiations of the
+// templates above.
+inline Ecc32LaneFns Ecc32GetLaneFns(uint32_t width_32) {
+  switch (width_32) {
+    case 1:
+      return {Ecc32PackLanes<1>, Ecc32UnpackLanes<1>};
+    case 2:
+      return {Ecc32PackLanes<2>, Ecc32UnpackLanes<2>};
+    case 3:
+      return {Ecc32PackLanes<3>, Ecc32UnpackLanes<3>};
+    case 4:
+      return {Ecc32PackLanes<4>, Ecc32UnpackLanes<4>};
+    case 5:
+      return {Ecc32PackLanes<5>, Ecc32UnpackLanes<5>};
+    case 6:
+      return {Ecc32PackLanes<6>, Ecc32UnpackLanes<6>};
+    case 7:
+      return {Ecc32PackLanes<7>, Ecc32UnpackLanes<7>};
+    case 8:
+      return {Ecc32PackLanes<8>, Ecc32UnpackLanes<8>};
+    default:
+      assert(0);
+      return {nullptr, nullptr};
+  }
+}
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_LANES_H_
@@ -5,7 +5,11 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_MEM_AREA_H_
 #define OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_MEM_AREA_H_
 
+#include <vector>
+
+#include "ecc32_lanes.h"
 #include "mem_area.h"
+#include "secded_enc.h"
 
 /**
  * A memory that implements 32-bit ECC, storing 39 = 32 + 7 bits of physical
@@ -22,16 +26,42 @@ class Ecc32MemArea : public MemArea {
    */
   Ecc32MemArea(const std::string &scope, uint32_t size, uint32_t width_32);
 
+  /** An ECC error found when reading the memory */
+  struct EccError {
+    uint32_t word;     ///< Logical address of the memory word
+    uint32_t lane;     ///< Index of the 32-bit lane within the word
+    secded_err_t err;  ///< Whether the error could be corrected
+  };
+
+  /** Read data from this memory area, checking integrity bits
+   *
+   * This behaves like MemArea::Read, returning the data bits as they are
+   * stored in the memory. The check bits of each 32-bit lane are checked, but
+   * errors are not corrected. Every lane with an error is recorded and can be
+   * retrieved with GetReadErrors().
+   */
+  std::vector<uint8_t> Read(uint32_t word_offset,
+                            uint32_t num_words) const override;
+
+  /** Return the ECC errors found by the most recent call to Read() */
+  const std::vector<EccError> &GetReadErrors() const { return read_errors_; }
+
   void LoadVmem(const std::string &path) const override;
 
+  std::string GetEncodingId() const override;
+
  protected:
-  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                   const std::vector<uint8_t> &data, size_t start_idx,
+  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *data,
+                   size_t data_len, size_t start_idx,
                    uint32_t dst_word) const override;
 
   void ReadBuffer(std::vector<uint8_t> &data,
                   const uint8_t buf[SV_MEM_WIDTH_BYTES],
                   uint32_t src_word) const override;
+
+ private:
+  Ecc32LaneFns lane_fns_;
+  mutable std::vector<EccError> read_errors_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_ECC32_MEM_AREA_H_
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <numeric>
 #include <sstream>
 
 #include "sv_scoped.h"
@@ -16,6 +17,57 @@ extern "C" {
 void simutil_memload(const char *file);
 int simutil_set_mem(int index, const svBitVecVal *val);
 int simutil_get_mem(int index, svBitVecVal *val);
+
+// The block transfer functions are declared weak. If the simulator doesn't
+// provide them, they will be null and we fall back to word-at-a-time accesses.
+int simutil_set_mem_block(int index, int count, const svBitVecVal *vals)
+    __attribute__((weak));
+int simutil_get_mem_block(int index, int count, svBitVecVal *vals)
+    __attribute__((weak));
+}
+
+// Return the order in which to transfer words with the given physical
+// addresses: a permutation of indices into phys_addrs, sorted by physical
+// address. For memories with no address scrambling, this is the identity.
+static std::vector<uint32_t> GetPhysOrder(
+    const std::vector<uint32_t> &phys_addrs) {
+  std::vector<uint32_t> order(phys_addrs.size());
+  std::iota(order.begin(), order.end(), 0);
+  if (!std::is_sorted(phys_addrs.begin(), phys_addrs.end())) {
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return phys_addrs[a] < phys_addrs[b];
+    });
+  }
+  return order;
+}
+
+// Return true if order (as returned by GetPhysOrder) is the identity
+// permutation.
+static bool IsIdentityOrder(const std::vector<uint32_t> &order) {
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    if (order[i] != i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Walk phys_addrs, which must be sorted, calling fn(pos, phys_addr, len) for
+// each run of consecutive physical addresses. pos is the index in phys_addrs
+// of the first word in the run.
+template <typename Fn>
+static void ForEachPhysRun(const std::vector<uint32_t> &phys_addrs, Fn fn) {
+  size_t pos = 0;
+  while (pos < phys_addrs.size()) {
+    uint32_t base = phys_addrs[pos];
+    uint32_t len = 1;
+    while (pos + len < phys_addrs.size() &&
+           phys_addrs[pos + len] == base + len) {
+      ++len;
+    }
+    fn(pos, base, len);
+    pos += len;
+  }
 }
 
 MemArea::MemArea(const std::string &scope, uint32_t num_words,
@@ -25,43 +77,71 @@ MemArea::MemArea(const std::string &scope, uint32_t num_words,
   assert(width_byte <= SV_MEM_WIDTH_BYTES);
 }
 
-void MemArea::Write(uint32_t word_offset,
-                    const std::vector<uint8_t> &data) const {
-  // This "mini buffer" is used to transfer each write to SystemVerilog.
-  // `simutil_set_mem` takes a fixed SV_MEM_WIDTH_BITS-bit vector but it will
-  // only use the bits required for the RAM width. As an example, for a 32-bit
-  // wide RAM only elements 3:0 of `minibuf` will be written to memory. Since
-  // the simulator may still read bits from minibuf it does not use, we must
-  // use a fixed allocation of the full bit vector size to avoid an out of
-  // bounds access.
-  uint8_t minibuf[SV_MEM_WIDTH_BYTES];
-  memset(minibuf, 0, sizeof minibuf);
-  assert(width_byte_ <= sizeof minibuf);
-
-  uint32_t data_words = (data.size() + width_byte_ - 1) / width_byte_;
+void MemArea::Write(uint32_t word_offset, const uint8_t *data,
+                    size_t len) const {
+  PhysImage image;
+  Encode(word_offset, data, len, &image);
+
+  // Both ToPhysAddr and WriteBuffers might set the scope with `SVScoped` so
+  // only write the memory (which constructs an `SVScoped`) once Encode has
+  // called them all so they don't interact causing incorrect relative path
+  // behaviour.
+  WritePhys(image);
+}
+
+void MemArea::Encode(uint32_t word_offset, const uint8_t *data, size_t len,
+                     PhysImage *image) const {
+  assert(image);
+
+  uint32_t data_words = (len + width_byte_ - 1) / width_byte_;
   assert(word_offset + data_words <= num_words_);
 
+  std::vector<uint32_t> phys_addrs(data_words);
   for (uint32_t i = 0; i < data_words; ++i) {
-    uint32_t dst_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(dst_word);
+    phys_addrs[i] = ToPhysAddr(word_offset + i);
+  }
+  std::vector<uint32_t> order = GetPhysOrder(phys_addrs);
 
-    WriteBuffer(minibuf, data, i * width_byte_, dst_word);
+  // Stage the physical contents of every word, in logical order. Each word
+  // gets a slot of SV_MEM_STRIDE_BYTES bytes. The simulator may read bits of a
+  // slot that aren't used by the memory, so the staging area is
+  // zero-initialised (WriteBuffers needn't clear them).
+  std::vector<uint8_t> staged(data_words * SV_MEM_STRIDE_BYTES, 0);
+  WriteBuffers(staged.data(), data, len, 0, word_offset, data_words);
 
-    // Both ToPhysAddr and WriteBuffer might set the scope with `SVScoped` so
-    // only construct `SVScoped` once they've both been called so they don't
-    // interact causing incorrect relative path behaviour. If this fails to set
-    // scope, it will throw an error which should be caught at this function's
-    // callsite.
-    SVScoped scoped(scope_);
-    if (!simutil_set_mem(phys_addr, (svBitVecVal *)minibuf)) {
-      std::ostringstream oss;
-      oss << "Could not set memory at byte offset 0x" << std::hex
-          << dst_word * width_byte_ << ".";
-      throw std::runtime_error(oss.str());
+  // If the physical addresses are scrambled, reorder the slots so that they
+  // are sorted by physical address.
+  if (!IsIdentityOrder(order)) {
+    std::vector<uint8_t> sorted(staged.size());
+    std::vector<uint32_t> sorted_addrs(data_words);
+    for (uint32_t pos = 0; pos < data_words; ++pos) {
+      memcpy(&sorted[pos * SV_MEM_STRIDE_BYTES],
+             &staged[order[pos] * SV_MEM_STRIDE_BYTES], SV_MEM_STRIDE_BYTES);
+      sorted_addrs[pos] = phys_addrs[order[pos]];
     }
+    staged.swap(sorted);
+    phys_addrs.swap(sorted_addrs);
   }
+
+  image->phys_addrs = std::move(phys_addrs);
+  image->data = std::move(staged);
 }
 
+void MemArea::WritePhys(const PhysImage &image) const {
+  assert(image.data.size() == image.phys_addrs.size() * SV_MEM_STRIDE_BYTES);
+
+  // If this fails to set scope, it will throw an error which should be caught
+  // at this function's callsite.
+  SVScoped scoped(scope_);
+  ForEachPhysRun(image.phys_addrs,
+                 [&](size_t pos, uint32_t phys_addr, uint32_t len) {
+                   WritePhysBlock(phys_addr, len,
+                                  &image.data[pos * SV_MEM_STRIDE_BYTES]);
+                 });
+}
+
+std::string MemArea::GetEncodingId() const { return "plain"; }
+
 std::vector<uint8_t> MemArea::Read(uint32_t word_offset,
                                    uint32_t num_words) const {
   assert(word_offset + num_words <= num_words_);
@@ -69,37 +149,128 @@ std::vector<uint8_t> MemArea::Read(uint32_t word_offset,
   uint32_t num_bytes = width_byte_ * num_words;
   assert(num_words <= num_bytes);
 
-  // See Write for an explanation for this buffer.
-  uint8_t minibuf[SV_MEM_WIDTH_BYTES];
-  memset(minibuf, 0, sizeof minibuf);
-  assert(width_byte_ <= sizeof minibuf);
+  std::vector<uint32_t> phys_addrs(num_words);
+  for (uint32_t i = 0; i < num_words; ++i) {
+    phys_addrs[i] = ToPhysAddr(word_offset + i);
+  }
+  std::vector<uint32_t> order = GetPhysOrder(phys_addrs);
+  bool identity = IsIdentityOrder(order);
+
+  std::vector<uint32_t> sorted_addrs;
+  if (!identity) {
+    sorted_addrs.resize(num_words);
+    for (uint32_t pos = 0; pos < num_words; ++pos) {
+      sorted_addrs[pos] = phys_addrs[order[pos]];
+    }
+  }
+
+  // Read the physical contents of every word, sorted by physical address (see
+  // Encode for the layout of the staging area).
+  std::vector<uint8_t> staged(num_words * SV_MEM_STRIDE_BYTES, 0);
+  {
+    // Both ToPhysAddr and ReadBuffers might set the scope with `SVScoped`.
+    // Keep the `SVScoped` here confined to an inner scope so they don't
+    // interact causing incorrect relative path behaviour. If this fails to
+    // set scope, it will throw an error which should be caught at this
+    // function's callsite.
+    SVScoped scoped(scope_);
+    ForEachPhysRun(identity ? phys_addrs : sorted_addrs,
+                   [&](size_t pos, uint32_t phys_addr, uint32_t len) {
+                     ReadPhysBlock(phys_addr, len,
+                                   &staged[pos * SV_MEM_STRIDE_BYTES]);
+                   });
+  }
+
+  // ReadBuffers appends to ret, so put the slots back in logical order.
+  if (!identity) {
+    std::vector<uint8_t> unsorted(staged.size());
+    for (uint32_t pos = 0; pos < num_words; ++pos) {
+      memcpy(&unsorted[order[pos] * SV_MEM_STRIDE_BYTES],
+             &staged[pos * SV_MEM_STRIDE_BYTES], SV_MEM_STRIDE_BYTES);
+    }
+    staged.swap(unsorted);
+  }
 
   std::vector<uint8_t> ret;
   ret.reserve(num_bytes);
+  ReadBuffers(ret, staged.data(), word_offset, num_words);
 
-  for (uint32_t i = 0; i < num_words; ++i) {
-    uint32_t src_word = word_offset + i;
-    uint32_t phys_addr = ToPhysAddr(src_word);
-
-    {
-      // Both ToPhysAddr and ReadBuffer might set the scope with `SVScoped`.
-      // Keep the `SVScoped` here confined to an inner scope so they don't
-      // interact causing incorrect relative path behaviour. If this fails to
-      // set scope, it will throw an error which should be caught at this
-      // function's callsite.
-      SVScoped scoped(scope_);
-      if (!simutil_get_mem(phys_addr, (svBitVecVal *)minibuf)) {
-        std::ostringstream oss;
-        oss << "Could not read memory at byte offset 0x" << std::hex
-            << src_word * width_byte_ << ".";
-        throw std::runtime_error(oss.str());
+  return ret;
+}
+
+void MemArea::WritePhysBlock(uint32_t phys_addr, uint32_t num_words,
+                             const uint8_t *buf) const {
+  assert(phys_addr + num_words <= num_words_);
+
+  for (uint32_t done = 0; done < num_words;) {
+    const uint8_t *src = buf + done * SV_MEM_STRIDE_BYTES;
+    uint32_t index = phys_addr + done;
+    bool ok;
+    uint32_t count;
+
+    if (simutil_set_mem_block) {
+      count = std::min(num_words - done, (uint32_t)SV_MEM_BLOCK_WORDS);
+
+      // simutil_set_mem_block takes a fixed size vector, so a short final
+      // chunk must be copied to a full-sized buffer that can be read in full.
+      svBitVecVal block[SV_MEM_BLOCK_WORDS * SV_MEM_WIDTH_WORDS];
+      const svBitVecVal *vals = (const svBitVecVal *)src;
+      if (count < SV_MEM_BLOCK_WORDS) {
+        memset(block, 0, sizeof block);
+        memcpy(block, src, count * SV_MEM_STRIDE_BYTES);
+        vals = block;
       }
+      ok = simutil_set_mem_block(index, count, vals);
+    } else {
+      count = 1;
+      ok = simutil_set_mem(index, (const svBitVecVal *)src);
     }
 
-    ReadBuffer(ret, minibuf, src_word);
+    if (!ok) {
+      std::ostringstream oss;
+      oss << "Could not set memory at physical word 0x" << std::hex << index
+          << ".";
+      throw std::runtime_error(oss.str());
+    }
+    done += count;
   }
+}
 
-  return ret;
+void MemArea::ReadPhysBlock(uint32_t phys_addr, uint32_t num_words,
+                            uint8_t *buf) const {
+  assert(phys_addr + num_words <= num_words_);
+
+  for (uint32_t done = 0; done < num_words;) {
+    uint8_t *dst = buf + done * SV_MEM_STRIDE_BYTES;
+    uint32_t index = phys_addr + done;
+    bool ok;
+    uint32_t count;
+
+    if (simutil_get_mem_block) {
+      count = std::min(num_words - done, (uint32_t)SV_MEM_BLOCK_WORDS);
+
+      // As in WritePhysBlock, a short final chunk goes through a full-sized
+      // buffer because simutil_get_mem_block writes the whole vector.
+      if (count < SV_MEM_BLOCK_WORDS) {
+        svBitVecVal block[SV_MEM_BLOCK_WORDS * SV_MEM_WIDTH_WORDS];
+        ok = simutil_get_mem_block(index, count, block);
+        memcpy(dst, block, count * SV_MEM_STRIDE_BYTES);
+      } else {
+        ok = simutil_get_mem_block(index, count, (svBitVecVal *)dst);
+      }
+    } else {
+      count = 1;
+      ok = simutil_get_mem(index, (svBitVecVal *)dst);
+    }
+
+    if (!ok) {
+      std::ostringstream oss;
+      oss << "Could not read memory at physical word 0x" << std::hex << index
+          << ".";
+      throw std::runtime_error(oss.str());
+    }
+    done += count;
+  }
 }
 
 void MemArea::LoadVmem(const std::string &path) const {
@@ -108,10 +279,10 @@ void MemArea::LoadVmem(const std::string &path) const {
   simutil_memload(path.c_str());
 }
 
-void MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                          const std::vector<uint8_t> &data, size_t start_idx,
+void MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *data,
+                          size_t data_len, size_t start_idx,
                           uint32_t dst_word) const {
-  size_t words_left = data.size() - start_idx;
+  size_t words_left = data_len - start_idx;
   size_t to_copy = std::min(words_left, (size_t)width_byte_);
   if (to_copy < width_byte_) {
     memset(buf, 0, SV_MEM_WIDTH_BYTES);
@@ -126,3 +297,19 @@ void MemArea::ReadBuffer(std::vector<uint8_t> &data,
   std::copy_n(reinterpret_cast<const char *>(buf), width_byte_,
               std::back_inserter(data));
 }
+
+void MemArea::WriteBuffers(uint8_t *bufs, const uint8_t *data,
+                           size_t data_len, size_t start_idx,
+                           uint32_t first_word, uint32_t num_words) const {
+  for (uint32_t i = 0; i < num_words; ++i) {
+    WriteBuffer(bufs + i * SV_MEM_STRIDE_BYTES, data, data_len,
+                start_idx + i * width_byte_, first_word + i);
+  }
+}
+
+void MemArea::ReadBuffers(std::vector<uint8_t> &data, const uint8_t *bufs,
+                          uint32_t first_word, uint32_t num_words) const {
+  for (uint32_t i = 0; i < num_words; ++i) {
+    ReadBuffer(data, bufs + i * SV_MEM_STRIDE_BYTES, first_word + i);
+  }
+}
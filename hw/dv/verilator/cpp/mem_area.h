@@ -14,6 +14,13 @@
 #define SV_MEM_WIDTH_BITS 312
 #define SV_MEM_WIDTH_BYTES ((SV_MEM_WIDTH_BITS + 7) / 8)
 
+// The block transfer functions in prim_util_memload.svh move up to
+// SV_MEM_BLOCK_WORDS memory words per call. Each word is stored in a slot of
+// SV_MEM_WIDTH_WORDS 32-bit words (so SV_MEM_STRIDE_BYTES bytes).
+#define SV_MEM_BLOCK_WORDS 64
+#define SV_MEM_WIDTH_WORDS ((SV_MEM_WIDTH_BITS + 31) / 32)
+#define SV_MEM_STRIDE_BYTES (4 * SV_MEM_WIDTH_WORDS)
+
 /**
  * A "memory area", representing a memory in the simulated design.
  */
@@ -38,26 +45,75 @@ class MemArea {
   /** Write data to this memory area at the given word offset
    *
    * This assumes that the result will fit in the memory. If the scope cannot
-   * be set, this throws an SVScoped::Error. If a call to \c simutil_set_mem
-   * fails, this throws a \c std::runtime_error.
+   * be set, this throws an SVScoped::Error. If a DPI call to write the memory
+   * fails, this throws a \c std::runtime_error. Words are encoded with
+   * Encode() and then written with WritePhys(), which uses WritePhysBlock()
+   * for each run of consecutive physical addresses.
    *
    * @param word_offset The offset, in words, of the first word that should be
    *                    written.
    *
    * @param data        The data that should be written. If the length is not a
-   *                    multiple of \p word_offset, the last word will be
+   *                    multiple of the word width, the last word will be
    *                    zero-extended.
+   *
+   * @param len         The length of \p data in bytes.
+   */
+  virtual void Write(uint32_t word_offset, const uint8_t *data,
+                     size_t len) const;
+
+  /** Write the contents of a vector to this memory area
+   *
+   * This is equivalent to calling Write() with the vector's data and size.
+   */
+  void Write(uint32_t word_offset, const std::vector<uint8_t> &data) const {
+    Write(word_offset, data.data(), data.size());
+  }
+
+  /** The physical contents of a set of memory words
+   *
+   * phys_addrs is sorted and the contents of the word at physical address
+   * phys_addrs[i] are the SV_MEM_STRIDE_BYTES bytes of data starting at
+   * <tt>i * SV_MEM_STRIDE_BYTES</tt>.
+   */
+  struct PhysImage {
+    std::vector<uint32_t> phys_addrs;
+    std::vector<uint8_t> data;
+  };
+
+  /** Compute the physical contents that Write() would write
+   *
+   * This does the address mapping and data encoding of Write(), storing the
+   * result in \p image rather than writing it to the memory. Write() is
+   * equivalent to Encode() followed by WritePhys().
    */
-  virtual void Write(uint32_t word_offset,
-                     const std::vector<uint8_t> &data) const;
+  virtual void Encode(uint32_t word_offset, const uint8_t *data, size_t len,
+                      PhysImage *image) const;
+
+  /** Write physical contents, as computed by Encode(), to the memory
+   *
+   * If the scope cannot be set, this throws an SVScoped::Error. If a DPI call
+   * to write the memory fails, this throws a \c std::runtime_error.
+   */
+  void WritePhys(const PhysImage &image) const;
+
+  /** Return a string that identifies how this memory encodes data
+   *
+   * Two memories with the same size, width and encoding ID give the same
+   * result from Encode() for the same data, so this can be used as part of
+   * the key when caching physical images. The default implementation returns
+   * "plain", since no encoding is done.
+   */
+  virtual std::string GetEncodingId() const;
 
   /** Read data from this memory area, starting at the given offset.
    *
    * This assumes that there are <tt>word_offset + num_words</tt> words in the
    * memory. Returns a vector with <tt>num_words * width_byte_</tt> elements.
    *
-   * If the scope cannot be set, this throws an SVScoped::Error. If a call to
-   * simutil_get_mem fails, this throws a std::runtime_error.
+   * If the scope cannot be set, this throws an SVScoped::Error. If a DPI call
+   * to read the memory fails, this throws a std::runtime_error. Words are read
+   * with ReadPhysBlock(), in runs of consecutive physical addresses.
    *
    * @param word_offset The offset, in words, of the first word that should be
    *                    written.
@@ -70,6 +126,33 @@ class MemArea {
   /** Use \c simutil_memload to load a vmem file into the memory */
   virtual void LoadVmem(const std::string &path) const;
 
+  /** Write a contiguous range of physical words to the memory
+   *
+   * This bypasses any address mapping or data encoding done by Write(). Words
+   * are transferred with \c simutil_set_mem_block, falling back to one call
+   * to \c simutil_set_mem per word if the simulator doesn't provide the block
+   * transfer function. The caller must set the SystemVerilog scope of the
+   * memory (see SVScoped). If a DPI call fails, this throws a
+   * std::runtime_error.
+   *
+   * @param phys_addr The physical address of the first word to write.
+   *
+   * @param num_words The number of words to write.
+   *
+   * @param buf       Physical data, with each word occupying
+   *                  SV_MEM_STRIDE_BYTES bytes.
+   */
+  void WritePhysBlock(uint32_t phys_addr, uint32_t num_words,
+                      const uint8_t *buf) const;
+
+  /** Read a contiguous range of physical words from the memory
+   *
+   * This is the counterpart of WritePhysBlock(), using \c
+   * simutil_get_mem_block (or \c simutil_get_mem as a fallback).
+   */
+  void ReadPhysBlock(uint32_t phys_addr, uint32_t num_words,
+                     uint8_t *buf) const;
+
   const std::string &GetScope() const { return scope_; }
   uint32_t GetSizeWords() const { return num_words_; }
   uint32_t GetSizeBytes() const { return num_words_ * width_byte_; }
@@ -91,11 +174,12 @@ class MemArea {
    *
    * @param buf       Destination buffer
    * @param data      A large buffer that contains the data to be written
+   * @param data_len  The length of \p data in bytes
    * @param start_idx An offset into \p data for the start of the memory word
    * @param dst_word  Logical address of the location being written
    */
-  virtual void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                           const std::vector<uint8_t> &data, size_t start_idx,
+  virtual void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *data,
+                           size_t data_len, size_t start_idx,
                            uint32_t dst_word) const;
 
   /** Extract the logical memory contents corresponding to the physical
@@ -115,6 +199,43 @@ class MemArea {
                           const uint8_t buf[SV_MEM_WIDTH_BYTES],
                           uint32_t src_word) const;
 
+  /** Write the physical data for a run of consecutive memory words
+   *
+   * This fills in \p bufs for the words at logical addresses \p first_word to
+   * <tt>first_word + num_words - 1</tt>. Each word gets SV_MEM_STRIDE_BYTES
+   * bytes of \p bufs, which has been zeroed by the caller. The default
+   * implementation calls WriteBuffer() for each word. Memories whose encoding
+   * has setup that can be shared between words (such as scrambling) can
+   * override this to do that setup once per run.
+   *
+   * @param bufs       Destination buffer, with space for \p num_words words
+   * @param data       A large buffer that contains the data to be written
+   * @param data_len   The length of \p data in bytes
+   * @param start_idx  An offset into \p data for the start of the first word
+   * @param first_word Logical address of the first word being written
+   * @param num_words  The number of words to write
+   */
+  virtual void WriteBuffers(uint8_t *bufs, const uint8_t *data,
+                            size_t data_len, size_t start_idx,
+                            uint32_t first_word, uint32_t num_words) const;
+
+  /** Extract the logical contents of a run of consecutive memory words
+   *
+   * This is the counterpart of WriteBuffers(), appending the logical contents
+   * of the words at logical addresses \p first_word to <tt>first_word +
+   * num_words - 1</tt> to \p data. The default implementation calls
+   * ReadBuffer() for each word.
+   *
+   * @param data       The target, onto which the extracted memory contents
+   *                   should be appended.
+   * @param bufs       Source buffer (physical memory bits), laid out as for
+   *                   WriteBuffers()
+   * @param first_word Logical address of the first word being read
+   * @param num_words  The number of words to read
+   */
+  virtual void ReadBuffers(std::vector<uint8_t> &data, const uint8_t *bufs,
+                           uint32_t first_word, uint32_t num_words) const;
+
   /** Convert a logical address to physical address
    *
    * Some memories may have a mapping between the address supplied on the
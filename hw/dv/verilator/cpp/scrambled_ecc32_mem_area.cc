@@ -6,10 +6,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 
-#include "scramble_model.h"
 #include "sv_scoped.h"
 
 // This is the maximum width of a nonce that's supported by the code in
@@ -17,32 +17,28 @@
 static const uint32_t kScrMaxNonceWidth = 320;
 static const uint32_t kScrMaxNonceWidthByte = (kScrMaxNonceWidth + 7) / 8;
 
-// Functions to convert from integer address to/from a little-endian vector of
-// bytes, addr_width is given in bits
-static std::vector<uint8_t> AddrIntToBytes(uint32_t addr, uint32_t addr_width) {
-  uint32_t addr_width_bytes = (addr_width + 7) / 8;
-  std::vector<uint8_t> addr_bytes(addr_width_bytes);
+// The widest address for which we build an address scrambling table. The table
+// has 2^kMaxAddrTableWidth entries.
+static const uint32_t kMaxAddrTableWidth = 20;
 
-  for (int i = 0; i < addr_width_bytes; ++i) {
-    addr_bytes[i] = addr & 0xff;
-    addr >>= 8;
+// Pack the first num_bytes bytes of a physical memory word into little-endian
+// 64-bit words, zeroing any bits above them.
+static void PackPhysWord(uint64_t *dst, const uint8_t *src,
+                         uint32_t num_bytes) {
+  for (uint32_t i = 0; i < (num_bytes + 7) / 8; ++i) {
+    dst[i] = 0;
+  }
+  for (uint32_t i = 0; i < num_bytes; ++i) {
+    dst[i / 8] |= (uint64_t)src[i] << (8 * (i % 8));
   }
-
-  return addr_bytes;
 }
 
-static uint32_t AddrBytesToInt(const std::vector<uint8_t> &addr) {
-  assert(addr.size() <= 4);
-
-  uint32_t addr_out = 0;
-  int cur_shift = 0;
-
-  for (int i = 0; i < addr.size(); ++i) {
-    addr_out |= (addr[i] << cur_shift);
-    cur_shift += 8;
+// The inverse of PackPhysWord
+static void UnpackPhysWord(uint8_t *dst, const uint64_t *src,
+                           uint32_t num_bytes) {
+  for (uint32_t i = 0; i < num_bytes; ++i) {
+    dst[i] = (src[i / 8] >> (8 * (i % 8))) & 0xff;
   }
-
-  return addr_out;
 }
 
 // Converts svBitVecVal (bit[m:n] SV type) into a byte vector
@@ -114,6 +110,32 @@ std::vector<uint8_t> ScrambledEcc32MemArea::GetScrambleNonce() const {
   return ByteVecFromSV(nonce_minibuf, GetNonceWidthByte());
 }
 
+// A guard that loads the scrambling context of a memory area for the duration
+// of a transfer and invalidates it afterwards.
+class ScrambledEcc32MemArea::ScrambleCtxScope {
+ public:
+  ScrambleCtxScope(const ScrambledEcc32MemArea &mem) : mem_(mem) {
+    assert(!mem_.scr_ctx_valid_);
+    mem_.scr_ctx_.key = mem_.GetScrambleKey();
+    mem_.scr_ctx_.nonce = mem_.GetScrambleNonce();
+    mem_.scr_ctx_.prince_key = scramble_prince_key(mem_.scr_ctx_.key);
+
+    const std::vector<uint8_t> &nonce = mem_.scr_ctx_.nonce;
+    std::vector<uint64_t> &nonce_packed = mem_.scr_ctx_.nonce_packed;
+    nonce_packed.assign((nonce.size() + 7) / 8, 0);
+    for (size_t i = 0; i < nonce.size(); ++i) {
+      nonce_packed[i / 8] |= (uint64_t)nonce[i] << (8 * (i % 8));
+    }
+
+    mem_.scr_ctx_valid_ = true;
+    mem_.UpdateAddrTable();
+  }
+  ~ScrambleCtxScope() { mem_.scr_ctx_valid_ = false; }
+
+ private:
+  const ScrambledEcc32MemArea &mem_;
+};
+
 ScrambledEcc32MemArea::ScrambledEcc32MemArea(const std::string &scope,
                                              uint32_t size, uint32_t width_32,
                                              bool repeat_keystream)
@@ -121,11 +143,66 @@ ScrambledEcc32MemArea::ScrambledEcc32MemArea(const std::string &scope,
           SVScoped::join_sv_scopes(
               scope, "u_prim_ram_1p_adv.u_mem.gen_generic.u_impl_generic"),
           size, width_32),
-      scr_scope_(scope) {
+      scr_scope_(scope),
+      scr_ctx_valid_(false) {
   addr_width_ = vbits(size);
   repeat_keystream_ = repeat_keystream;
 }
 
+void ScrambledEcc32MemArea::Encode(uint32_t word_offset, const uint8_t *data,
+                                   size_t len, PhysImage *image) const {
+  ScrambleCtxScope ctx_scope(*this);
+  Ecc32MemArea::Encode(word_offset, data, len, image);
+}
+
+std::vector<uint8_t> ScrambledEcc32MemArea::Read(uint32_t word_offset,
+                                                 uint32_t num_words) const {
+  ScrambleCtxScope ctx_scope(*this);
+  return Ecc32MemArea::Read(word_offset, num_words);
+}
+
+std::string ScrambledEcc32MemArea::GetEncodingId() const {
+  std::ostringstream oss;
+  oss << "scrambled_ecc32:" << (repeat_keystream_ ? "repeat" : "multi") << ":"
+      << std::hex << std::setfill('0');
+  for (uint8_t b : GetScrambleKey()) {
+    oss << std::setw(2) << (unsigned)b;
+  }
+  oss << ":";
+  for (uint8_t b : GetScrambleNonce()) {
+    oss << std::setw(2) << (unsigned)b;
+  }
+  return oss.str();
+}
+
+void ScrambledEcc32MemArea::UpdateAddrTable() const {
+  const ScrambleCtx &ctx = GetScrambleCtx();
+
+  if (addr_width_ > kMaxAddrTableWidth || ctx.nonce == addr_table_nonce_) {
+    return;
+  }
+
+  uint32_t num_addrs = 1u << addr_width_;
+  log_to_phys_.resize(num_addrs);
+
+  for (uint32_t addr = 0; addr < num_addrs; ++addr) {
+    uint32_t phys_addr = scramble_addr_packed(
+        addr, addr_width_, ctx.nonce_packed.data(), GetNonceWidth());
+    assert(phys_addr < num_addrs);
+    log_to_phys_[addr] = phys_addr;
+  }
+
+  addr_table_nonce_ = ctx.nonce;
+}
+
+const ScrambledEcc32MemArea::ScrambleCtx &
+ScrambledEcc32MemArea::GetScrambleCtx() const {
+  // The per-word functions are only called from Encode() and Read(), which
+  // load the context first.
+  assert(scr_ctx_valid_);
+  return scr_ctx_;
+}
+
 uint32_t ScrambledEcc32MemArea::GetPhysWidth() const {
   return (GetWidthByte() / 4) * 39;
 }
@@ -151,41 +228,87 @@ uint32_t ScrambledEcc32MemArea::GetNonceWidthByte() const {
 }
 
 void ScrambledEcc32MemArea::WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                                        const std::vector<uint8_t> &data,
+                                        const uint8_t *data, size_t data_len,
                                         size_t start_idx,
                                         uint32_t dst_word) const {
-  // Compute integrity
-  Ecc32MemArea::WriteBuffer(buf, data, start_idx, dst_word);
-
-  std::vector<uint8_t> scramble_buf =
-      std::vector<uint8_t>(buf, buf + GetPhysWidthByte());
-
-  // Scramble data with integrity
-  scramble_buf = scramble_encrypt_data(
-      scramble_buf, GetPhysWidth(), 39, AddrIntToBytes(dst_word, addr_width_),
-      addr_width_, GetScrambleNonce(), GetScrambleKey(), repeat_keystream_);
-
-  // Copy scrambled data to write buffer
-  std::copy(scramble_buf.begin(), scramble_buf.end(), &buf[0]);
+  WriteBuffers(buf, data, data_len, start_idx, dst_word, 1);
 }
 
 void ScrambledEcc32MemArea::ReadBuffer(std::vector<uint8_t> &data,
                                        const uint8_t buf[SV_MEM_WIDTH_BYTES],
                                        uint32_t src_word) const {
-  // Unscramble data from read buffer
-  std::vector<uint8_t> scrambled_data =
-      std::vector<uint8_t>(buf, buf + GetPhysWidthByte());
-  std::vector<uint8_t> unscrambled_data = scramble_decrypt_data(
-      scrambled_data, GetPhysWidth(), 39, AddrIntToBytes(src_word, addr_width_),
-      addr_width_, GetScrambleNonce(), GetScrambleKey(), repeat_keystream_);
+  ReadBuffers(data, buf, src_word, 1);
+}
+
+void ScrambledEcc32MemArea::WriteBuffers(uint8_t *bufs, const uint8_t *data,
+                                         size_t data_len, size_t start_idx,
+                                         uint32_t first_word,
+                                         uint32_t num_words) const {
+  uint32_t phys_width_byte = GetPhysWidthByte();
+  uint32_t stride = (GetPhysWidth() + 63) / 64;
+  std::vector<uint64_t> packed(num_words * stride);
+
+  // Compute integrity
+  for (uint32_t i = 0; i < num_words; ++i) {
+    uint8_t *buf = bufs + i * SV_MEM_STRIDE_BYTES;
+    Ecc32MemArea::WriteBuffer(buf, data, data_len, start_idx + i * width_byte_,
+                              first_word + i);
+    PackPhysWord(&packed[i * stride], buf, phys_width_byte);
+  }
+
+  // Scramble data with integrity
+  const ScrambleCtx &ctx = GetScrambleCtx();
+  scramble_encrypt_data_batch(packed.data(), packed.data(), num_words,
+                              GetPhysWidth(), 39, first_word, addr_width_,
+                              ctx.nonce_packed.data(), ctx.prince_key,
+                              repeat_keystream_);
+
+  // Copy scrambled data to write buffers
+  for (uint32_t i = 0; i < num_words; ++i) {
+    UnpackPhysWord(bufs + i * SV_MEM_STRIDE_BYTES, &packed[i * stride],
+                   phys_width_byte);
+  }
+}
+
+void ScrambledEcc32MemArea::ReadBuffers(std::vector<uint8_t> &data,
+                                        const uint8_t *bufs,
+                                        uint32_t first_word,
+                                        uint32_t num_words) const {
+  uint32_t phys_width_byte = GetPhysWidthByte();
+  uint32_t stride = (GetPhysWidth() + 63) / 64;
+  std::vector<uint64_t> packed(num_words * stride);
+
+  for (uint32_t i = 0; i < num_words; ++i) {
+    PackPhysWord(&packed[i * stride], bufs + i * SV_MEM_STRIDE_BYTES,
+                 phys_width_byte);
+  }
+
+  // Unscramble data from read buffers
+  const ScrambleCtx &ctx = GetScrambleCtx();
+  scramble_decrypt_data_batch(packed.data(), packed.data(), num_words,
+                              GetPhysWidth(), 39, first_word, addr_width_,
+                              ctx.nonce_packed.data(), ctx.prince_key,
+                              repeat_keystream_);
 
   // Strip integrity to give final result
-  Ecc32MemArea::ReadBuffer(data, &unscrambled_data[0], src_word);
+  uint8_t unscrambled[SV_MEM_WIDTH_BYTES];
+  for (uint32_t i = 0; i < num_words; ++i) {
+    UnpackPhysWord(unscrambled, &packed[i * stride], phys_width_byte);
+    Ecc32MemArea::ReadBuffer(data, unscrambled, first_word + i);
+  }
 }
 
 uint32_t ScrambledEcc32MemArea::ToPhysAddr(uint32_t logical_addr) const {
+  const ScrambleCtx &ctx = GetScrambleCtx();
+
+  // If we have an address table for this nonce, UpdateAddrTable has already
+  // done the work.
+  if (!log_to_phys_.empty()) {
+    assert(logical_addr < log_to_phys_.size());
+    return log_to_phys_[logical_addr];
+  }
+
   // Scramble logical address to get physical address
-  return AddrBytesToInt(scramble_addr(AddrIntToBytes(logical_addr, addr_width_),
-                                      addr_width_, GetScrambleNonce(),
-                                      GetNonceWidth()));
+  return scramble_addr_packed(logical_addr, addr_width_,
+                              ctx.nonce_packed.data(), GetNonceWidth());
 }
@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "ecc32_mem_area.h"
+#include "scramble_model.h"
 
 /**
  * A memory that implements scrambling over a 32-bit ECC integrity protection
@@ -32,15 +33,80 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
   ScrambledEcc32MemArea(const std::string &scope, uint32_t size,
                         uint32_t width_32, bool repeat_keystream = true);
 
+  /** Add integrity bits to data and scramble it
+   *
+   * This is used by Write(). The scrambling key and nonce are read from the
+   * design once, at the start of the call, rather than for every word.
+   */
+  void Encode(uint32_t word_offset, const uint8_t *data, size_t len,
+              PhysImage *image) const override;
+
+  /** Read and descramble data from this memory area
+   *
+   * As with Encode(), the key and nonce are read once per call.
+   */
+  std::vector<uint8_t> Read(uint32_t word_offset,
+                            uint32_t num_words) const override;
+
+  /** Return an encoding ID that includes the current key and nonce
+   *
+   * This reads the scrambling key and nonce from the design, so the result
+   * changes whenever the memory is re-keyed.
+   */
+  std::string GetEncodingId() const override;
+
  private:
-  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES],
-                   const std::vector<uint8_t> &data, size_t start_idx,
+  /**
+   * Scrambling state read from the design, together with the PRINCE key
+   * derived from it.
+   *
+   * This is loaded by a ScrambleCtxScope at the start of each Encode() or
+   * Read() and invalidated when that transfer finishes, so a key rotated by
+   * the RTL is picked up by the next transfer.
+   */
+  struct ScrambleCtx {
+    std::vector<uint8_t> key;
+    std::vector<uint8_t> nonce;
+    std::vector<uint64_t> nonce_packed;
+    ScramblePrinceKey prince_key;
+  };
+
+  class ScrambleCtxScope;
+
+  const ScrambleCtx &GetScrambleCtx() const;
+
+  /**
+   * Make sure the address table matches the nonce in the scrambling context.
+   *
+   * The nonce only changes when the memory is re-keyed, so the full mapping
+   * from logical to physical addresses is computed once per nonce. This is
+   * only done for memories with at most kMaxAddrTableWidth address bits; for
+   * larger memories the table stays empty and addresses are scrambled one at a
+   * time.
+   */
+  void UpdateAddrTable() const;
+
+  void WriteBuffer(uint8_t buf[SV_MEM_WIDTH_BYTES], const uint8_t *data,
+                   size_t data_len, size_t start_idx,
                    uint32_t dst_word) const override;
 
   void ReadBuffer(std::vector<uint8_t> &data,
                   const uint8_t buf[SV_MEM_WIDTH_BYTES],
                   uint32_t src_word) const override;
 
+  /**
+   * Add integrity bits to a run of words and then scramble them together.
+   *
+   * The keystream setup that doesn't depend on the address is done once for
+   * the whole run (see scramble_encrypt_data_batch).
+   */
+  void WriteBuffers(uint8_t *bufs, const uint8_t *data, size_t data_len,
+                    size_t start_idx, uint32_t first_word,
+                    uint32_t num_words) const override;
+
+  void ReadBuffers(std::vector<uint8_t> &data, const uint8_t *bufs,
+                   uint32_t first_word, uint32_t num_words) const override;
+
   uint32_t ToPhysAddr(uint32_t logical_addr) const override;
 
   uint32_t GetPhysWidth() const;
@@ -55,6 +121,14 @@ class ScrambledEcc32MemArea : public Ecc32MemArea {
   std::string scr_scope_;
   uint32_t addr_width_;
   bool repeat_keystream_;
+
+  mutable ScrambleCtx scr_ctx_;
+  mutable bool scr_ctx_valid_;
+
+  // Address table, indexed by logical address, and the nonce that it was
+  // computed for.
+  mutable std::vector<uint32_t> log_to_phys_;
+  mutable std::vector<uint8_t> addr_table_nonce_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_SCRAMBLED_ECC32_MEM_AREA_H_
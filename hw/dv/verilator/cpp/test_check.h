@@ -0,0 +1,57 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_CPP_TEST_CHECK_H_
+#define OPENTITAN_HW_DV_VERILATOR_CPP_TEST_CHECK_H_
+
+// Checks for the host tests of DV models (see hw/meson.build). This can be
+// included from C or C++.
+//
+// A test calls TEST_CHECK() for each property that it checks, which keeps
+// going after a failure so that one run shows everything that is wrong, and
+// returns test_check_result() from main(). Only the first
+// TEST_CHECK_MAX_MESSAGES failures are printed, so a test that checks
+// something in a loop doesn't flood the log when it fails.
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#define TEST_CHECK_MAX_MESSAGES 20
+
+static int test_check_failures;
+
+// Count a failed check at file:line, printing a message for the first few
+static inline void test_check_fail(const char *file, int line, const char *fmt,
+                                   ...) {
+  if (++test_check_failures > TEST_CHECK_MAX_MESSAGES) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  printf("%s:%d: FAIL: ", file, line);
+  vprintf(fmt, args);
+  printf("\n");
+  va_end(args);
+}
+
+// Check that cond is true. If not, print a message, formatted with printf
+// from the remaining arguments.
+#define TEST_CHECK(cond, ...)                           \
+  do {                                                  \
+    if (!(cond)) {                                      \
+      test_check_fail(__FILE__, __LINE__, __VA_ARGS__); \
+    }                                                   \
+  } while (0)
+
+// Print a summary of the checks and return the exit code for main()
+static inline int test_check_result(void) {
+  if (test_check_failures) {
+    printf("%d check(s) failed.\n", test_check_failures);
+    return 1;
+  }
+  printf("All checks passed.\n");
+  return 0;
+}
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_CPP_TEST_CHECK_H_
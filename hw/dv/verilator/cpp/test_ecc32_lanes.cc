@@ -0,0 +1,103 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Test of packing and unpacking ECC lanes, run by the DV model tests in
+// hw/meson.build.
+//
+// For every supported number of lanes, it checks the packed bytes against a
+// bit-at-a-time reference, checks that only the packed bytes are written, and
+// round-trips lanes through bytes and bytes through lanes.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hw/dv/verilator/cpp/ecc32_lanes.h"
+#include "hw/dv/verilator/cpp/test_check.h"
+
+static const int kNumTrials = 1000;
+static const uint8_t kGuard = 0xa5;
+
+// Check ok, naming the number of lanes if it fails
+static void check(bool ok, uint32_t width_32, const char *what) {
+  TEST_CHECK(ok, "%s (%u lanes)", what, width_32);
+}
+
+static uint64_t rand64() {
+  uint64_t val = 0;
+  for (int i = 0; i < 4; ++i) {
+    val = (val << 16) ^ (rand() & 0xffff);
+  }
+  return val;
+}
+
+// Bit j of lane i goes to bit 39 * i + j of the buffer
+static void ref_pack(uint8_t *buf, const uint64_t *lanes, uint32_t width_32) {
+  uint32_t num_bytes = (kEcc32LaneBits * width_32 + 7) / 8;
+  memset(buf, 0, num_bytes);
+  for (uint32_t i = 0; i < width_32; ++i) {
+    for (uint32_t j = 0; j < kEcc32LaneBits; ++j) {
+      uint32_t pos = kEcc32LaneBits * i + j;
+      buf[pos / 8] |= ((lanes[i] >> j) & 1) << (pos % 8);
+    }
+  }
+}
+
+static void test_width(uint32_t width_32) {
+  Ecc32LaneFns fns = Ecc32GetLaneFns(width_32);
+  uint32_t num_bytes = (kEcc32LaneBits * width_32 + 7) / 8;
+  uint64_t lane_mask = (1ull << kEcc32LaneBits) - 1;
+
+  for (int trial = 0; trial < kNumTrials; ++trial) {
+    // The bits above each lane are ignored when packing
+    uint64_t lanes[kEcc32MaxLanes];
+    for (uint32_t i = 0; i < width_32; ++i) {
+      lanes[i] = rand64();
+    }
+    if (trial == 0) {
+      memset(lanes, 0xff, sizeof(lanes));
+    }
+
+    uint8_t buf[kEcc32MaxLanes * 5 + 1];
+    uint8_t expected[kEcc32MaxLanes * 5];
+    memset(buf, kGuard, sizeof(buf));
+    fns.pack(buf, lanes);
+    ref_pack(expected, lanes, width_32);
+    check(memcmp(buf, expected, num_bytes) == 0, width_32,
+          "packed bytes match the reference");
+    check(buf[num_bytes] == kGuard, width_32, "pack writes past the end");
+
+    uint64_t unpacked[kEcc32MaxLanes + 1];
+    unpacked[width_32] = 0x1234;
+    fns.unpack(unpacked, buf);
+    bool lanes_ok = true;
+    for (uint32_t i = 0; i < width_32; ++i) {
+      lanes_ok = lanes_ok && unpacked[i] == (lanes[i] & lane_mask);
+    }
+    check(lanes_ok, width_32, "unpack(pack(lanes)) == lanes");
+    check(unpacked[width_32] == 0x1234, width_32,
+          "unpack writes past the end");
+
+    // Any bytes round-trip, apart from the unused bits of the last byte
+    for (uint32_t i = 0; i < num_bytes; ++i) {
+      buf[i] = rand();
+    }
+    fns.unpack(unpacked, buf);
+    uint8_t repacked[kEcc32MaxLanes * 5];
+    fns.pack(repacked, unpacked);
+    uint32_t top_bits = (kEcc32LaneBits * width_32) % 8;
+    if (top_bits) {
+      buf[num_bytes - 1] &= (1 << top_bits) - 1;
+    }
+    check(memcmp(buf, repacked, num_bytes) == 0, width_32,
+          "pack(unpack(bytes)) == bytes");
+  }
+}
+
+int main(void) {
+  srand(1);
+  for (uint32_t width_32 = 1; width_32 <= kEcc32MaxLanes; ++width_32) {
+    test_width(width_32);
+  }
+  return test_check_result();
+}
@@ -0,0 +1,156 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Test of Ecc32MemArea, run by the DV model tests in hw/meson.build.
+//
+// Data is written to a fake simulator and read back. For each supported width,
+// the physical contents of the memory are checked against a bit-at-a-time
+// reference. Bits of the physical memory are then flipped, to check that
+// Read() returns the data as stored and reports each lane with an error.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "hw/dv/verilator/cpp/ecc32_mem_area.h"
+#include "hw/dv/verilator/cpp/test_check.h"
+#include "hw/dv/verilator/cpp/test_fake_sim.h"
+
+static const char kScope[] = "TOP.u_mem";
+static const uint32_t kNumWords = 64;
+
+static uint64_t rand_state = 0x9e3779b97f4a7c15;
+
+// xorshift64, so that the inputs don't depend on the C library
+static uint64_t next_rand() {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return rand_state;
+}
+
+static std::vector<uint8_t> rand_bytes(size_t len) {
+  std::vector<uint8_t> bytes(len);
+  for (uint8_t &byte : bytes) {
+    byte = next_rand() >> 56;
+  }
+  return bytes;
+}
+
+// Flip bit of lane in physical word addr. Bits 31:0 of a lane are data and
+// bits 38:32 are check bits.
+static void flip_bit(uint32_t addr, uint32_t lane, uint32_t bit) {
+  uint32_t pos = 39 * lane + bit;
+  FakeSimWord(FakeSimGetScope(kScope), addr)[pos / 8] ^= 1 << (pos % 8);
+}
+
+static bool has_error(const Ecc32MemArea &mem, uint32_t word, uint32_t lane,
+                      secded_err_t err) {
+  for (const Ecc32MemArea::EccError &e : mem.GetReadErrors()) {
+    if (e.word == word && e.lane == lane && e.err == err) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The physical contents of a word of the memory, computed a bit at a time.
+// Each 32-bit lane of data gets 7 check bits, and bit j of lane i is stored in
+// bit 39 * i + j.
+static std::vector<uint8_t> expected_phys(const uint8_t *data,
+                                          uint32_t width_32) {
+  std::vector<uint8_t> word(SV_MEM_STRIDE_BYTES, 0);
+  for (uint32_t lane = 0; lane < width_32; ++lane) {
+    uint8_t bytes[4];
+    memcpy(bytes, &data[4 * lane], 4);
+    uint64_t bits = bytes[0] | (uint64_t)bytes[1] << 8 |
+                    (uint64_t)bytes[2] << 16 | (uint64_t)bytes[3] << 24 |
+                    (uint64_t)enc_secded_39_32(bytes) << 32;
+    for (uint32_t i = 0; i < 39; ++i) {
+      uint32_t pos = 39 * lane + i;
+      word[pos / 8] |= ((bits >> i) & 1) << (pos % 8);
+    }
+  }
+  return word;
+}
+
+static void test_width(uint32_t width_32) {
+  uint32_t width_byte = 4 * width_32;
+  FakeSimScope &fake = FakeSimAddMem(kScope, kNumWords);
+  Ecc32MemArea mem(kScope, kNumWords, width_32);
+
+  // Write all but the first word, with data that doesn't end on a lane
+  // boundary, so that the last word is zero-extended.
+  std::vector<uint8_t> data = rand_bytes((kNumWords - 1) * width_byte - 3);
+  mem.Write(1, data);
+  std::vector<uint8_t> padded(width_byte, 0);
+  padded.insert(padded.end(), data.begin(), data.end());
+  padded.resize(kNumWords * width_byte, 0);
+
+  bool phys_ok = true;
+  for (uint32_t addr = 0; addr < kNumWords; ++addr) {
+    std::vector<uint8_t> expected =
+        expected_phys(&padded[addr * width_byte], width_32);
+    if (addr == 0) {
+      expected.assign(SV_MEM_STRIDE_BYTES, 0);
+    }
+    phys_ok = phys_ok && memcmp(FakeSimWord(fake, addr), expected.data(),
+                                SV_MEM_STRIDE_BYTES) == 0;
+  }
+  TEST_CHECK(phys_ok, "physical contents (%u lanes)", width_32);
+
+  TEST_CHECK(mem.Read(0, kNumWords) == padded, "read back (%u lanes)",
+             width_32);
+  TEST_CHECK(mem.GetReadErrors().empty(), "errors in a clean read (%u lanes)",
+             width_32);
+}
+
+static void test_read_errors() {
+  const uint32_t width_32 = 2;
+  const uint32_t width_byte = 4 * width_32;
+  FakeSimAddMem(kScope, kNumWords);
+  Ecc32MemArea mem(kScope, kNumWords, width_32);
+
+  std::vector<uint8_t> data = rand_bytes(kNumWords * width_byte);
+  mem.Write(0, data);
+  TEST_CHECK(mem.Read(0, kNumWords) == data, "clean read back");
+  TEST_CHECK(mem.GetReadErrors().empty(), "errors in a clean read");
+
+  // A data bit in lane 1 of word 5, a check bit in lane 0 of word 7, and two
+  // data bits in lane 0 of word 9
+  flip_bit(5, 1, 3);
+  flip_bit(7, 0, 35);
+  flip_bit(9, 0, 0);
+  flip_bit(9, 0, 17);
+
+  // Only the data bits are flipped in what is read, since nothing is
+  // corrected
+  std::vector<uint8_t> stored(data);
+  stored[5 * width_byte + 4] ^= 1 << 3;
+  stored[9 * width_byte + 0] ^= 1 << 0;
+  stored[9 * width_byte + 2] ^= 1 << 1;
+  TEST_CHECK(mem.Read(0, kNumWords) == stored, "read of flipped bits");
+  TEST_CHECK(mem.GetReadErrors().size() == 3, "%zu errors reported",
+             mem.GetReadErrors().size());
+  TEST_CHECK(has_error(mem, 5, 1, kSecdedCorrected), "flipped data bit");
+  TEST_CHECK(has_error(mem, 7, 0, kSecdedCorrected), "flipped check bit");
+  TEST_CHECK(has_error(mem, 9, 0, kSecdedUncorrectable),
+             "two flipped data bits");
+
+  // Errors are reported by logical address, and only for the latest read
+  mem.Read(6, 2);
+  TEST_CHECK(mem.GetReadErrors().size() == 1 &&
+                 has_error(mem, 7, 0, kSecdedCorrected),
+             "errors in a partial read");
+  mem.Read(10, 4);
+  TEST_CHECK(mem.GetReadErrors().empty(), "errors kept from an earlier read");
+}
+
+int main(void) {
+  for (uint32_t width_32 = 1; width_32 <= kEcc32MaxLanes; ++width_32) {
+    test_width(width_32);
+  }
+  test_read_errors();
+  return test_check_result();
+}
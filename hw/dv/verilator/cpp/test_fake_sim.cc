@@ -0,0 +1,123 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "test_fake_sim.h"
+
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <svdpi.h>
+
+#include "mem_area.h"
+
+static std::map<std::string, FakeSimScope> scopes;
+static FakeSimScope *cur_scope;
+
+FakeSimScope &FakeSimGetScope(const std::string &name) {
+  FakeSimScope &scope = scopes[name];
+  scope.name = name;
+  return scope;
+}
+
+FakeSimScope &FakeSimAddMem(const std::string &name, uint32_t num_words) {
+  FakeSimScope &scope = FakeSimGetScope(name);
+  scope.mem.assign(num_words * SV_MEM_STRIDE_BYTES, 0);
+  return scope;
+}
+
+uint8_t *FakeSimWord(FakeSimScope &scope, uint32_t index) {
+  assert((index + 1) * SV_MEM_STRIDE_BYTES <= scope.mem.size());
+  return &scope.mem[index * SV_MEM_STRIDE_BYTES];
+}
+
+// Return the current scope if it has a memory with count words at index
+static FakeSimScope *GetMemScope(int index, int count) {
+  if (!cur_scope || index < 0 || count < 0 ||
+      (size_t)(index + count) * SV_MEM_STRIDE_BYTES > cur_scope->mem.size()) {
+    return nullptr;
+  }
+  return cur_scope;
+}
+
+// Copy a byte vector into a little-endian bit vector
+static int ToBitVec(svBitVecVal *dst, const std::vector<uint8_t> &src) {
+  if (src.empty()) {
+    return 0;
+  }
+  memset(dst, 0, 4 * ((src.size() + 3) / 4));
+  for (size_t i = 0; i < src.size(); ++i) {
+    dst[i / 4] |= (svBitVecVal)src[i] << (8 * (i % 4));
+  }
+  return 1;
+}
+
+extern "C" {
+
+svScope svGetScope(void) { return cur_scope; }
+
+svScope svSetScope(const svScope scope) {
+  svScope prev = cur_scope;
+  cur_scope = (FakeSimScope *)scope;
+  return prev;
+}
+
+svScope svGetScopeFromName(const char *name) {
+  auto it = scopes.find(name);
+  return it == scopes.end() ? nullptr : &it->second;
+}
+
+const char *svGetNameFromScope(const svScope scope) {
+  return ((const FakeSimScope *)scope)->name.c_str();
+}
+
+void simutil_memload(const char *file) {}
+
+int simutil_set_mem(int index, const svBitVecVal *val) {
+  FakeSimScope *scope = GetMemScope(index, 1);
+  if (!scope) {
+    return 0;
+  }
+  ++scope->num_word_calls;
+  memcpy(FakeSimWord(*scope, index), val, SV_MEM_STRIDE_BYTES);
+  return 1;
+}
+
+int simutil_get_mem(int index, svBitVecVal *val) {
+  FakeSimScope *scope = GetMemScope(index, 1);
+  if (!scope) {
+    return 0;
+  }
+  ++scope->num_word_calls;
+  memcpy(val, FakeSimWord(*scope, index), SV_MEM_STRIDE_BYTES);
+  return 1;
+}
+
+int simutil_set_mem_block(int index, int count, const svBitVecVal *vals) {
+  FakeSimScope *scope = GetMemScope(index, count);
+  if (!scope || count > SV_MEM_BLOCK_WORDS) {
+    return 0;
+  }
+  ++scope->num_block_calls;
+  memcpy(FakeSimWord(*scope, index), vals, count * SV_MEM_STRIDE_BYTES);
+  return 1;
+}
+
+int simutil_get_mem_block(int index, int count, svBitVecVal *vals) {
+  FakeSimScope *scope = GetMemScope(index, count);
+  if (!scope || count > SV_MEM_BLOCK_WORDS) {
+    return 0;
+  }
+  ++scope->num_block_calls;
+  memcpy(vals, FakeSimWord(*scope, index), count * SV_MEM_STRIDE_BYTES);
+  return 1;
+}
+
+int simutil_get_scramble_key(svBitVecVal *key) {
+  return cur_scope ? ToBitVec(key, cur_scope->scramble_key) : 0;
+}
+
+int simutil_get_scramble_nonce(svBitVecVal *nonce) {
+  return cur_scope ? ToBitVec(nonce, cur_scope->scramble_nonce) : 0;
+}
+}
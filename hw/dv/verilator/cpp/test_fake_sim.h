@@ -0,0 +1,48 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_CPP_TEST_FAKE_SIM_H_
+#define OPENTITAN_HW_DV_VERILATOR_CPP_TEST_FAKE_SIM_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A fake simulator for host tests of memory areas (see hw/meson.build)
+ *
+ * This implements the svdpi.h scope functions and the DPI exports that
+ * MemArea and its subclasses call, for scopes that a test creates by name.
+ * Linking it into a test program means that a memory area constructed with
+ * one of those scope names reads and writes the fake instead of a design.
+ */
+struct FakeSimScope {
+  std::string name;
+
+  /** The contents of the memory at this scope, if any
+   *
+   * Each word takes SV_MEM_STRIDE_BYTES bytes, holding its bits in
+   * little-endian order, as passed to and from simutil_set_mem.
+   */
+  std::vector<uint8_t> mem;
+
+  /** The scrambling key and nonce returned at this scope, as byte vectors */
+  std::vector<uint8_t> scramble_key;
+  std::vector<uint8_t> scramble_nonce;
+
+  /** The number of calls made to the word and block transfer functions */
+  unsigned num_word_calls;
+  unsigned num_block_calls;
+};
+
+/** Return the scope with the given name, creating it if necessary */
+FakeSimScope &FakeSimGetScope(const std::string &name);
+
+/** Create a memory of num_words zero words at the named scope */
+FakeSimScope &FakeSimAddMem(const std::string &name, uint32_t num_words);
+
+/** Return a pointer to the bytes of word index of a fake memory */
+uint8_t *FakeSimWord(FakeSimScope &scope, uint32_t index);
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_CPP_TEST_FAKE_SIM_H_
@@ -0,0 +1,206 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Test of ScrambledEcc32MemArea, run by the DV model tests in hw/meson.build.
+//
+// Data goes through MemArea::Write() and MemArea::Read() to a fake simulator,
+// so it is encoded and decoded a run of words at a time by WriteBuffers() and
+// ReadBuffers(). The physical contents of the fake memory are checked against
+// the byte vector functions of the scrambling model, applied word by word.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "hw/dv/verilator/cpp/scrambled_ecc32_mem_area.h"
+#include "hw/dv/verilator/cpp/test_check.h"
+#include "hw/dv/verilator/cpp/test_fake_sim.h"
+#include "hw/ip/prim/dv/prim_secded/secded_enc.h"
+
+struct TestConfig {
+  uint32_t size;
+  uint32_t width_32;
+  bool repeat_keystream;
+};
+
+static const TestConfig kConfigs[] = {
+    {1024, 1, true},
+    {256, 2, false},
+    {128, 8, false},
+};
+
+static const char kScope[] = "TOP.u_ram";
+static const char kMemScope[] =
+    "TOP.u_ram.u_prim_ram_1p_adv.u_mem.gen_generic.u_impl_generic";
+
+static uint64_t rand_state = 0x9e3779b97f4a7c15;
+
+// xorshift64, so that the inputs don't depend on the C library
+static uint64_t next_rand() {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return rand_state;
+}
+
+static std::vector<uint8_t> rand_bytes(size_t len) {
+  std::vector<uint8_t> bytes(len);
+  for (uint8_t &byte : bytes) {
+    byte = next_rand() >> 56;
+  }
+  return bytes;
+}
+
+// Give the memory a new random key and nonce
+static void rekey(const TestConfig &cfg) {
+  // The nonce has 64 bits for each PRINCE instance used for the keystream
+  uint32_t phys_width_byte = (39 * cfg.width_32 + 7) / 8;
+  uint32_t num_prince = cfg.repeat_keystream ? 1 : (phys_width_byte + 7) / 8;
+
+  FakeSimScope &scr = FakeSimGetScope(kScope);
+  scr.scramble_key = rand_bytes(2 * kPrinceWidthByte);
+  scr.scramble_nonce = rand_bytes(8 * num_prince);
+}
+
+static uint32_t addr_width(uint32_t size) {
+  uint32_t width = 1;
+  while ((1u << width) < size) {
+    ++width;
+  }
+  return width;
+}
+
+static std::vector<uint8_t> addr_bytes(uint32_t addr, uint32_t addr_width) {
+  std::vector<uint8_t> bytes((addr_width + 7) / 8);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = addr >> (8 * i);
+  }
+  return bytes;
+}
+
+// The physical contents of a word of the memory, computed one word at a time
+// from the logical data of the word
+static std::vector<uint8_t> expected_phys(const TestConfig &cfg, uint32_t addr,
+                                          const uint8_t *data) {
+  uint32_t phys_width = 39 * cfg.width_32;
+  std::vector<uint8_t> word((phys_width + 7) / 8, 0);
+  for (uint32_t lane = 0; lane < cfg.width_32; ++lane) {
+    uint8_t bytes[4];
+    memcpy(bytes, &data[4 * lane], 4);
+    uint64_t bits = bytes[0] | (uint64_t)bytes[1] << 8 |
+                    (uint64_t)bytes[2] << 16 | (uint64_t)bytes[3] << 24 |
+                    (uint64_t)enc_secded_39_32(bytes) << 32;
+    for (uint32_t i = 0; i < 39; ++i) {
+      uint32_t bit = 39 * lane + i;
+      word[bit / 8] |= ((bits >> i) & 1) << (bit % 8);
+    }
+  }
+
+  const FakeSimScope &scr = FakeSimGetScope(kScope);
+  uint32_t width = addr_width(cfg.size);
+  return scramble_encrypt_data(word, phys_width, 39, addr_bytes(addr, width),
+                               width, scr.scramble_nonce, scr.scramble_key,
+                               cfg.repeat_keystream);
+}
+
+static uint32_t expected_phys_addr(const TestConfig &cfg, uint32_t addr) {
+  const FakeSimScope &scr = FakeSimGetScope(kScope);
+  uint32_t width = addr_width(cfg.size);
+  std::vector<uint8_t> phys =
+      scramble_addr(addr_bytes(addr, width), width, scr.scramble_nonce,
+                    8 * scr.scramble_nonce.size());
+  uint32_t phys_addr = 0;
+  for (size_t i = 0; i < phys.size(); ++i) {
+    phys_addr |= (uint32_t)phys[i] << (8 * i);
+  }
+  return phys_addr;
+}
+
+// Write data starting at word first, check the physical contents of the
+// memory and read the data back
+static void check_write_read(const TestConfig &cfg,
+                             const ScrambledEcc32MemArea &mem, uint32_t first,
+                             const std::vector<uint8_t> &data) {
+  uint32_t width_byte = 4 * cfg.width_32;
+  uint32_t num_words = (data.size() + width_byte - 1) / width_byte;
+  std::vector<uint8_t> padded(data);
+  padded.resize(num_words * width_byte, 0);
+
+  FakeSimScope &fake = FakeSimGetScope(kMemScope);
+  std::vector<uint8_t> before = fake.mem;
+  fake.num_word_calls = 0;
+  fake.num_block_calls = 0;
+  mem.Write(first, data);
+
+  std::vector<bool> written(cfg.size, false);
+  bool phys_ok = true;
+  for (uint32_t i = 0; i < num_words; ++i) {
+    uint32_t phys_addr = expected_phys_addr(cfg, first + i);
+    std::vector<uint8_t> expected =
+        expected_phys(cfg, first + i, &padded[i * width_byte]);
+    phys_ok = phys_ok && phys_addr < cfg.size &&
+              memcmp(FakeSimWord(fake, phys_addr), expected.data(),
+                     expected.size()) == 0;
+    written[phys_addr % cfg.size] = true;
+  }
+  TEST_CHECK(phys_ok, "physical contents (%u words at 0x%x, width_32 %u)",
+             num_words, first, cfg.width_32);
+
+  bool others_ok = true;
+  for (uint32_t addr = 0; addr < cfg.size; ++addr) {
+    others_ok = others_ok &&
+                (written[addr] ||
+                 memcmp(FakeSimWord(fake, addr),
+                        &before[addr * SV_MEM_STRIDE_BYTES],
+                        SV_MEM_STRIDE_BYTES) == 0);
+  }
+  TEST_CHECK(others_ok, "words outside the write changed (width_32 %u)",
+             cfg.width_32);
+
+  TEST_CHECK(mem.Read(first, num_words) == padded,
+             "read back (%u words at 0x%x, width_32 %u)", num_words, first,
+             cfg.width_32);
+  TEST_CHECK(mem.GetReadErrors().empty(), "ECC errors (width_32 %u)",
+             cfg.width_32);
+
+  // A read of part of the range gives the same data
+  if (num_words > 2) {
+    std::vector<uint8_t> middle(padded.begin() + width_byte,
+                                padded.end() - width_byte);
+    TEST_CHECK(mem.Read(first + 1, num_words - 2) == middle,
+               "partial read back (width_32 %u)", cfg.width_32);
+  }
+
+  TEST_CHECK(fake.num_block_calls > 0 && fake.num_word_calls == 0,
+             "words not transferred in blocks (width_32 %u)", cfg.width_32);
+}
+
+static void test_config(const TestConfig &cfg) {
+  FakeSimAddMem(kMemScope, cfg.size);
+  rekey(cfg);
+  ScrambledEcc32MemArea mem(kScope, cfg.size, cfg.width_32,
+                            cfg.repeat_keystream);
+  uint32_t width_byte = 4 * cfg.width_32;
+
+  // The whole memory, and then a run of words that isn't a whole number of
+  // blocks, and doesn't end on a word boundary
+  check_write_read(cfg, mem, 0, rand_bytes(cfg.size * width_byte));
+  check_write_read(cfg, mem, 3,
+                   rand_bytes((SV_MEM_BLOCK_WORDS + 7) * width_byte - 1));
+
+  // Once the memory is re-keyed, what was written before reads back as
+  // something else, and what is written now reads back as it was written.
+  std::vector<uint8_t> data = mem.Read(0, cfg.size);
+  rekey(cfg);
+  TEST_CHECK(mem.Read(0, cfg.size) != data, "read with a new key (width_32 %u)",
+             cfg.width_32);
+  check_write_read(cfg, mem, 0, rand_bytes(cfg.size * width_byte));
+}
+
+int main(void) {
+  for (const TestConfig &cfg : kConfigs) {
+    test_config(cfg);
+  }
+  return test_check_result();
+}
@@ -13,20 +13,8 @@
 #include <string>
 #include <vector>
 
-namespace {
-// An instruction to load the file at filepath to the memory called name. If
-// name is the empty string then type must be kMemImageElf and this is an
-// instruction to load an ELF file, picking memories by LMA.
-struct LoadArg {
-  std::string name;
-  std::string filepath;
-  MemImageType type;
-};
-}  // namespace
-
-// Parse a meminit command-line argument. This should be of the form
-// mem_area,file[,type]. Throw a std::runtime_error if something looks wrong.
-static LoadArg ParseMemArg(std::string mem_argument) {
+VerilatorMemUtil::LoadArg VerilatorMemUtil::ParseMemArg(
+    std::string mem_argument) {
   std::array<std::string, 3> args;
   size_t pos = 0;
   size_t end_pos = 0;
@@ -80,15 +68,32 @@ static void PrintHelp() {
                "  Print registered memory regions\n\n"
                "--verbose-mem-load\n"
                "  Print a message for each memory load\n\n"
+               "--mem-load-skip-zero\n"
+               "  Assume memories start zeroed and don't load zero words\n\n"
+               "--mem-load-diff\n"
+               "  Only load words that changed since the previous load. Once\n"
+               "  the design has run, this only applies to read-only\n"
+               "  memories.\n\n"
+               "--mem-image-cache=DIR\n"
+               "  Cache encoded memory images in DIR and reuse them when the\n"
+               "  same data is loaded again\n\n"
                "-h|--help\n"
                "  Show help\n\n";
 }
 
-VerilatorMemUtil::VerilatorMemUtil() : allocation_(new DpiMemUtil()) {
+VerilatorMemUtil::VerilatorMemUtil()
+    : allocation_(new DpiMemUtil()),
+      verbose_(false),
+      skip_unchanged_(false),
+      memories_at_reset_(true) {
   mem_util_ = allocation_.get();
 }
 
-VerilatorMemUtil::VerilatorMemUtil(DpiMemUtil *mem_util) : mem_util_(mem_util) {
+VerilatorMemUtil::VerilatorMemUtil(DpiMemUtil *mem_util)
+    : mem_util_(mem_util),
+      verbose_(false),
+      skip_unchanged_(false),
+      memories_at_reset_(true) {
   assert(mem_util);
 }
 
@@ -102,11 +107,16 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
       {"meminit", required_argument, nullptr, 'l'},
       {"verbose-mem-load", no_argument, nullptr, 'V'},
       {"load-elf", required_argument, nullptr, 'E'},
+      {"mem-image-cache", required_argument, nullptr, 'I'},
+      {"mem-load-skip-zero", no_argument, nullptr, 'Z'},
+      {"mem-load-diff", no_argument, nullptr, 'D'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, no_argument, nullptr, 0}};
 
   std::vector<LoadArg> load_args;
   bool verbose = false;
+  bool skip_zero = false;
+  bool skip_unchanged = false;
 
   // Reset the command parsing index in-case other utils have already parsed
   // some arguments
@@ -161,6 +171,15 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
         load_args.push_back(
             {.name = "", .filepath = optarg, .type = kMemImageElf});
         break;
+      case 'I':
+        mem_util_->SetImageCacheDir(optarg);
+        break;
+      case 'Z':
+        skip_zero = true;
+        break;
+      case 'D':
+        skip_unchanged = true;
+        break;
       case 'h':
         PrintHelp();
         return true;
@@ -174,14 +193,41 @@ bool VerilatorMemUtil::ParseCLIArguments(int argc, char **argv,
     }
   }
 
-  for (const LoadArg &arg : load_args) {
+  // When this is called again (as in a batch child), the model may have run
+  // since the last load, so the memories no longer hold their reset values
+  // and only the contents of read-only memories are still known.
+  mem_util_->ForgetMemContents(true);
+  mem_util_->SetLoadSkip(skip_zero && memories_at_reset_, skip_unchanged);
+  memories_at_reset_ = false;
+
+  load_args_ = load_args;
+  verbose_ = verbose;
+  skip_unchanged_ = skip_unchanged;
+  return LoadFiles();
+}
+
+bool VerilatorMemUtil::RestoreCheckpoint(std::istream &is) {
+  // The memory contents came from the checkpoint, so they are no longer the
+  // values from reset and we don't know what has changed, even in read-only
+  // memories.
+  mem_util_->ForgetMemContents(false);
+  mem_util_->SetLoadSkip(false, skip_unchanged_);
+
+  // Load the files from the command line again, over the top of the restored
+  // contents. This lets a checkpoint taken after boot be used to run a
+  // different test.
+  return LoadFiles();
+}
+
+bool VerilatorMemUtil::LoadFiles() {
+  for (const LoadArg &arg : load_args_) {
     try {
       if (!arg.name.empty()) {
-        mem_util_->LoadFileToNamedMem(verbose, arg.name, arg.filepath,
+        mem_util_->LoadFileToNamedMem(verbose_, arg.name, arg.filepath,
                                       arg.type);
       } else {
         assert(arg.type == kMemImageElf);
-        mem_util_->LoadElfToMemories(verbose, arg.filepath);
+        mem_util_->LoadElfToMemories(verbose_, arg.filepath);
       }
     } catch (const std::exception &err) {
       std::cerr << "ERROR: " << err.what() << std::endl;
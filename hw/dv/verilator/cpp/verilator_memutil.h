@@ -9,6 +9,8 @@
 //
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "dpi_memutil.h"
 #include "sim_ctrl_extension.h"
@@ -23,18 +25,51 @@ class VerilatorMemUtil : public SimCtrlExtension {
   // Declared in SimCtrlExtension
   bool ParseCLIArguments(int argc, char **argv, bool &exit_app) override;
 
+  // Declared in SimCtrlExtension. Memories are loaded before the simulation
+  // starts, so there's nothing to do on clock edges.
+  unsigned long GetNextWakeup(unsigned long sim_time) override {
+    return kNoWakeup;
+  }
+
+  // Declared in SimCtrlExtension. Memory contents are part of the Verilated
+  // model, so there's nothing to save, but the files given on the command line
+  // are loaded again after restoring a checkpoint.
+  bool RestoreCheckpoint(std::istream &is) override;
+
   // Get underlying DpiMemUtil object
   DpiMemUtil *GetUnderlying() { return mem_util_; }
 
   // Pass-thru function to underlying object
   void RegisterMemoryArea(const std::string &name, uint32_t base,
-                          const MemArea *mem_area) {
-    return mem_util_->RegisterMemoryArea(name, base, mem_area);
+                          const MemArea *mem_area, bool read_only = false) {
+    return mem_util_->RegisterMemoryArea(name, base, mem_area, read_only);
   }
 
  private:
+  // An instruction to load the file at filepath to the memory called name. If
+  // name is the empty string then type must be kMemImageElf and this is an
+  // instruction to load an ELF file, picking memories by LMA.
+  struct LoadArg {
+    std::string name;
+    std::string filepath;
+    MemImageType type;
+  };
+
+  // Parse a meminit command-line argument. This should be of the form
+  // mem_area,file[,type]. Throw a std::runtime_error if something looks wrong.
+  static LoadArg ParseMemArg(std::string mem_argument);
+
+  // Load the files given on the command line
+  bool LoadFiles();
+
   DpiMemUtil *mem_util_;
   std::unique_ptr<DpiMemUtil> allocation_;
+  std::vector<LoadArg> load_args_;
+  bool verbose_;
+  bool skip_unchanged_;
+  // True until the first call to ParseCLIArguments(), after which the
+  // memories can't be assumed to hold their reset values.
+  bool memories_at_reset_;
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_CPP_VERILATOR_MEMUTIL_H_
@@ -5,8 +5,21 @@
 #ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
 #define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
 
+#include <iosfwd>
+
+/**
+ * Extension to the simulation controller
+ *
+ * All methods are called from the thread that runs the simulation main loop,
+ * and never while the model is being evaluated. The worker threads of a model
+ * verilated with --threads only run during evaluation, so extensions can
+ * access the model without any locking.
+ */
 class SimCtrlExtension {
  public:
+  // Returned by GetNextWakeup() if OnClock() shouldn't be called again
+  static const unsigned long kNoWakeup = ~0ul;
+
   virtual ~SimCtrlExtension() = default;
 
   /**
@@ -29,13 +42,57 @@ class SimCtrlExtension {
 
   /**
    * Function to be called every clock cycle
+   *
+   * This is called on the first rising clock edge of the simulation and then
+   * as scheduled by GetNextWakeup().
    */
   virtual void OnClock(unsigned long sim_time) {}
 
+  /**
+   * Get the number of clock cycles between calls to OnClock()
+   *
+   * This is used by the default implementation of GetNextWakeup().
+   */
+  virtual unsigned long GetClockDivider() const { return 1; }
+
+  /**
+   * Get the earliest simulation time at which OnClock() should next be called
+   *
+   * This is called after each call to OnClock(), which will next be called on
+   * the first rising clock edge at or after the returned time. The default
+   * implementation asks for a call every GetClockDivider() clock cycles.
+   * Extensions that don't need OnClock() at all can return kNoWakeup, and
+   * ones that wait for some event can return the time it is due.
+   *
+   * @param sim_time Simulation time passed to the last call to OnClock()
+   */
+  virtual unsigned long GetNextWakeup(unsigned long sim_time) {
+    // Simulation time counts half clock cycles
+    return sim_time + 2 * GetClockDivider() - 1;
+  }
+
   /**
    * Function to be called after executing the simulation
    */
   virtual void PostExec() {}
+
+  /**
+   * Save any state that isn't part of the Verilated model to a checkpoint
+   *
+   * @param os Stream to write the state to
+   */
+  virtual void SaveCheckpoint(std::ostream &os) {}
+
+  /**
+   * Restore state written by SaveCheckpoint()
+   *
+   * This is called after the Verilated model has been restored from the
+   * checkpoint.
+   *
+   * @param is Stream to read the state from
+   * @return Return code, true == success
+   */
+  virtual bool RestoreCheckpoint(std::istream &is) { return true; }
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_EXTENSION_H_
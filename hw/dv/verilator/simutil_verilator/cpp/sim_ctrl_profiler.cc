@@ -0,0 +1,255 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "sim_ctrl_profiler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <typeinfo>
+#include <unistd.h>
+
+// Get the (demangled, if possible) name of the dynamic type of an extension
+static std::string ExtensionName(const SimCtrlExtension &ext) {
+  const char *mangled = typeid(ext).name();
+  int status;
+  char *demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+  std::string name = (status == 0) ? demangled : mangled;
+  free(demangled);
+  return name;
+}
+
+static double ToSeconds(SimCtrlProfiler::Clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+// Read the name of a thread of this process and the CPU time it has used, in
+// seconds, from /proc. Returns false if the thread has gone away.
+static bool ReadThreadStat(int tid, std::string *name, double *cpu_s) {
+  std::ostringstream path;
+  path << "/proc/self/task/" << tid << "/stat";
+  std::ifstream is(path.str());
+  std::string stat;
+  if (!std::getline(is, stat)) {
+    return false;
+  }
+
+  // The name is in brackets and may contain spaces and brackets itself, so
+  // find the last closing bracket. After that, the fields are the state
+  // (field 3) and on up to utime and stime (fields 14 and 15).
+  size_t open = stat.find('(');
+  size_t close = stat.rfind(')');
+  if (open == std::string::npos || close == std::string::npos ||
+      close < open) {
+    return false;
+  }
+  *name = stat.substr(open + 1, close - open - 1);
+
+  std::istringstream fields(stat.substr(close + 1));
+  std::string field;
+  for (int i = 3; i < 14; ++i) {
+    fields >> field;
+  }
+  unsigned long utime, stime;
+  if (!(fields >> utime >> stime)) {
+    return false;
+  }
+  *cpu_s = static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+  return true;
+}
+
+SimCtrlProfiler::SimCtrlProfiler()
+    : enabled_(false),
+      last_report_time_(Clock::now()),
+      last_report_cycle_(0) {
+  SetExtensions({});
+}
+
+void SimCtrlProfiler::SetExtensions(
+    const std::vector<SimCtrlExtension *> &extensions) {
+  sections_.clear();
+  sections_.push_back({"eval", Clock::duration::zero(), 0});
+  sections_.push_back({"trace", Clock::duration::zero(), 0});
+  for (const SimCtrlExtension *ext : extensions) {
+    sections_.push_back({ExtensionName(*ext), Clock::duration::zero(), 0});
+  }
+}
+
+std::vector<int> SimCtrlProfiler::ListThreads() {
+  std::vector<int> tids;
+  DIR *dir = opendir("/proc/self/task");
+  if (!dir) {
+    return tids;
+  }
+  while (struct dirent *entry = readdir(dir)) {
+    int tid = atoi(entry->d_name);
+    if (tid > 0) {
+      tids.push_back(tid);
+    }
+  }
+  closedir(dir);
+  std::sort(tids.begin(), tids.end());
+  return tids;
+}
+
+void SimCtrlProfiler::Start(unsigned long cycle) {
+  last_report_time_ = Clock::now();
+  last_report_cycle_ = cycle;
+
+  thread_start_cpu_s_.clear();
+  if (enabled_) {
+    for (int tid : ListThreads()) {
+      std::string name;
+      double cpu_s;
+      if (ReadThreadStat(tid, &name, &cpu_s)) {
+        thread_start_cpu_s_[tid] = cpu_s;
+      }
+    }
+  }
+}
+
+void SimCtrlProfiler::SampleThreads() {
+  threads_.clear();
+  if (!enabled_) {
+    return;
+  }
+  for (int tid : ListThreads()) {
+    ThreadSample sample;
+    sample.tid = tid;
+    if (!ReadThreadStat(tid, &sample.name, &sample.cpu_s)) {
+      continue;
+    }
+    // Threads started during the run count from zero
+    auto it = thread_start_cpu_s_.find(tid);
+    if (it != thread_start_cpu_s_.end()) {
+      sample.cpu_s -= it->second;
+    }
+    threads_.push_back(sample);
+  }
+}
+
+void SimCtrlProfiler::PrintReport(std::ostream &os, unsigned long cycle) {
+  Clock::time_point now = Clock::now();
+  double elapsed_s = ToSeconds(now - last_report_time_);
+  double speed_hz =
+      elapsed_s > 0 ? (cycle - last_report_cycle_) / elapsed_s : 0.0;
+
+  os << "Cycle " << cycle << ": " << speed_hz << " cycles/s over the last "
+     << elapsed_s << " s" << std::endl;
+  if (enabled_) {
+    PrintSections(os);
+  }
+
+  last_report_time_ = now;
+  last_report_cycle_ = cycle;
+}
+
+void SimCtrlProfiler::PrintSections(std::ostream &os) const {
+  Clock::duration total = Clock::duration::zero();
+  for (const Section &section : sections_) {
+    total += section.total;
+  }
+  double total_s = ToSeconds(total);
+
+  std::ios_base::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << "  " << std::left << std::setw(32) << "Section" << std::right
+     << std::setw(12) << "Time (s)" << std::setw(8) << "Share"
+     << std::setw(14) << "Calls" << std::endl;
+  for (const Section &section : sections_) {
+    double section_s = ToSeconds(section.total);
+    double share = total_s > 0 ? 100.0 * section_s / total_s : 0.0;
+    os << "  " << std::left << std::setw(32) << section.name << std::right
+       << std::fixed << std::setprecision(3) << std::setw(12) << section_s
+       << std::setprecision(1) << std::setw(7) << share << "%"
+       << std::setw(14) << section.calls << std::endl;
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void SimCtrlProfiler::PrintThreads(std::ostream &os,
+                                   double wallclock_s) const {
+  std::ios_base::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << "  " << std::left << std::setw(10) << "Thread" << std::setw(22)
+     << "Name" << std::right << std::setw(12) << "CPU (s)" << std::setw(14)
+     << "Utilisation" << std::endl;
+  for (const ThreadSample &thread : threads_) {
+    double utilisation =
+        wallclock_s > 0 ? 100.0 * thread.cpu_s / wallclock_s : 0.0;
+    os << "  " << std::left << std::setw(10) << thread.tid << std::setw(22)
+       << thread.name << std::right << std::fixed << std::setprecision(3)
+       << std::setw(12) << thread.cpu_s << std::setprecision(1)
+       << std::setw(13) << utilisation << "%" << std::endl;
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
+
+void SimCtrlProfiler::WriteJsonString(std::ostream &os, const std::string &s) {
+  os << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+         << static_cast<int>(c) << std::dec << std::setfill(' ');
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+bool SimCtrlProfiler::WriteJson(const std::string &path,
+                                const std::string &name, unsigned long cycles,
+                                double wallclock_s) const {
+  std::ofstream os(path);
+  if (!os) {
+    std::cerr << "ERROR: Cannot open `" << path << "' to write statistics."
+              << std::endl;
+    return false;
+  }
+
+  double speed_hz = wallclock_s > 0 ? cycles / wallclock_s : 0.0;
+
+  os << std::setprecision(9) << "{\n  \"name\": ";
+  WriteJsonString(os, name);
+  os << ",\n  \"cycles\": " << cycles
+     << ",\n  \"wallclock_s\": " << wallclock_s
+     << ",\n  \"cycles_per_s\": " << speed_hz << ",\n  \"sections\": [";
+  if (enabled_) {
+    for (size_t i = 0; i < sections_.size(); ++i) {
+      os << (i ? ",\n" : "\n") << "    {\"name\": ";
+      WriteJsonString(os, sections_[i].name);
+      os << ", \"time_s\": " << ToSeconds(sections_[i].total)
+         << ", \"calls\": " << sections_[i].calls << "}";
+    }
+    os << "\n  ";
+  }
+  os << "],\n  \"threads\": [";
+  if (enabled_) {
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      os << (i ? ",\n" : "\n") << "    {\"name\": ";
+      WriteJsonString(os, threads_[i].name);
+      os << ", \"cpu_s\": " << threads_[i].cpu_s << ", \"utilisation\": "
+         << (wallclock_s > 0 ? threads_[i].cpu_s / wallclock_s : 0.0) << "}";
+    }
+    os << "\n  ";
+  }
+  os << "]\n}\n";
+
+  if (!os) {
+    std::cerr << "ERROR: Failed to write statistics to `" << path << "'."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,154 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_PROFILER_H_
+#define OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_PROFILER_H_
+
+#include <chrono>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sim_ctrl_extension.h"
+
+/**
+ * Wallclock profiler for the simulation main loop
+ *
+ * This keeps a running total of the time spent in each section of the main
+ * loop: evaluating the model, dumping traces and each extension's OnClock().
+ * Timing only happens once Enable() has been called, so that simulations that
+ * don't ask for a profile don't pay for reading the clock.
+ *
+ * It also measures the CPU time used by each thread of the process, which
+ * shows how well the work of a model verilated with --threads is spread.
+ */
+class SimCtrlProfiler {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Indices of the timed sections. Extension i is section
+  // kSectionFirstExtension + i.
+  enum {
+    kSectionEval = 0,
+    kSectionTrace = 1,
+    kSectionFirstExtension = 2,
+  };
+
+  SimCtrlProfiler();
+
+  /**
+   * Start timing sections
+   */
+  void Enable() { enabled_ = true; }
+
+  /**
+   * Are sections being timed?
+   */
+  bool Enabled() const { return enabled_; }
+
+  /**
+   * Set up a section for each extension, named after its class, and clear
+   * the totals for all sections
+   */
+  void SetExtensions(const std::vector<SimCtrlExtension *> &extensions);
+
+  /**
+   * Call fn, adding the time it takes to the given section if enabled
+   */
+  template <typename Fn>
+  void Time(size_t section, Fn fn) {
+    if (!enabled_) {
+      fn();
+      return;
+    }
+    Clock::time_point start = Clock::now();
+    fn();
+    sections_[section].total += Clock::now() - start;
+    ++sections_[section].calls;
+  }
+
+  /**
+   * Write s to os as a JSON string, quoting any characters that need it
+   */
+  static void WriteJsonString(std::ostream &os, const std::string &s);
+
+  /**
+   * Get the IDs of the threads of this process, in ascending order
+   *
+   * The main thread comes first, followed by any threads started by the
+   * model (Verilator's worker and trace threads), in the order they were
+   * created.
+   */
+  static std::vector<int> ListThreads();
+
+  /**
+   * Mark the start of the run, for measuring speed from the first report and
+   * CPU time per thread
+   */
+  void Start(unsigned long cycle);
+
+  /**
+   * Measure the CPU time each thread has used since the start of the run
+   */
+  void SampleThreads();
+
+  /**
+   * Get the wallclock time since the last report (or the start of the run)
+   */
+  Clock::duration SinceLastReport() const {
+    return Clock::now() - last_report_time_;
+  }
+
+  /**
+   * Print the simulation speed since the last report and, if enabled, the
+   * time spent in each section so far
+   */
+  void PrintReport(std::ostream &os, unsigned long cycle);
+
+  /**
+   * Print the time spent in each section so far
+   */
+  void PrintSections(std::ostream &os) const;
+
+  /**
+   * Print the CPU time used by each thread at the last SampleThreads() and
+   * its utilisation over the given wallclock time
+   */
+  void PrintThreads(std::ostream &os, double wallclock_s) const;
+
+  /**
+   * Write a summary of the run as JSON, for tracking simulation speed in CI
+   *
+   * @param path File to write
+   * @param name Name of the simulation
+   * @param cycles Number of cycles simulated
+   * @param wallclock_s Wallclock time taken for the run, in seconds
+   * @return Return code, true == success
+   */
+  bool WriteJson(const std::string &path, const std::string &name,
+                 unsigned long cycles, double wallclock_s) const;
+
+ private:
+  struct Section {
+    std::string name;
+    Clock::duration total;
+    unsigned long calls;
+  };
+
+  struct ThreadSample {
+    int tid;
+    std::string name;
+    double cpu_s;
+  };
+
+  bool enabled_;
+  std::vector<Section> sections_;
+  std::map<int, double> thread_start_cpu_s_;
+  std::vector<ThreadSample> threads_;
+  Clock::time_point last_report_time_;
+  unsigned long last_report_cycle_;
+};
+
+#endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_SIM_CTRL_PROFILER_H_
@@ -33,6 +33,16 @@
 
 // VM_TRACE_FMT_FST must be set by the user when calling Verilator with
 // --trace-fst. VM_TRACE is set by Verilator itself.
+// Verilator doesn't tell us whether the model was built with --savable, so
+// builds that use it must pass -DVM_SAVABLE=1 in CFLAGS as well.
+#ifndef VM_SAVABLE
+#define VM_SAVABLE 0
+#endif
+
+#if VM_SAVABLE == 1
+#include "verilated_save.h"
+#endif
+
 #if VM_TRACE == 1
 #ifdef VM_TRACE_FMT_FST
 #include "verilated_fst_c.h"
@@ -123,6 +133,11 @@ class VerilatedToplevel {
   virtual const char *name() const = 0;
   virtual void trace(VerilatedTracer &tfp, int levels, int options) = 0;
 
+#if VM_SAVABLE == 1
+  virtual void save(VerilatedSerialize &os) = 0;
+  virtual void restore(VerilatedDeserialize &is) = 0;
+#endif
+
   /**
    * Get the Verilator-generated device under test
    *
@@ -150,6 +165,14 @@ class TOPLEVEL_NAME : public VERILATED_TOPLEVEL_NAME, public VerilatedToplevel {
     assert(0 && "Tracing not enabled.");
 #endif
   }
+#if VM_SAVABLE == 1
+  void save(VerilatedSerialize &os) {
+    os << static_cast<VERILATED_TOPLEVEL_NAME &>(*this);
+  }
+  void restore(VerilatedDeserialize &is) {
+    is >> static_cast<VERILATED_TOPLEVEL_NAME &>(*this);
+  }
+#endif
 };
 
 #endif  // OPENTITAN_HW_DV_VERILATOR_SIMUTIL_VERILATOR_CPP_VERILATED_TOPLEVEL_H_
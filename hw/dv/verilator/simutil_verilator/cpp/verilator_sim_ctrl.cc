@@ -4,17 +4,33 @@
 
 #include "verilator_sim_ctrl.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
 #include <getopt.h>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <sched.h>
 #include <signal.h>
+#include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <verilated.h>
 
+#include "dpi_ctx.h"
+
 // This is defined by Verilator and passed through the command line
 #ifndef VM_TRACE
 #define VM_TRACE 0
 #endif
 
+// The first thing in a checkpoint file, after Verilator's own header
+static const char kCheckpointMagic[] = "opentitan-sim-checkpoint-1";
+
 /**
  * Get the current simulation time
  *
@@ -106,10 +122,55 @@ static bool read_ul_arg(unsigned long *arg_val, const char *arg_name,
   return true;
 }
 
+// Parse a list of CPUs like "0-3,6" into cpus. Returns false (having printed
+// an error) if the list is malformed.
+static bool ParseCpuList(const char *arg_text, std::vector<int> *cpus) {
+  std::istringstream iss(arg_text);
+  std::string range;
+  cpus->clear();
+  while (std::getline(iss, range, ',')) {
+    unsigned long first, last;
+    size_t dash = range.find('-');
+    std::string first_text = range.substr(0, dash);
+    std::string last_text =
+        dash == std::string::npos ? first_text : range.substr(dash + 1);
+    if (!read_ul_arg(&first, "cpu-affinity", first_text.c_str()) ||
+        !read_ul_arg(&last, "cpu-affinity", last_text.c_str())) {
+      return false;
+    }
+    if (last < first || last >= CPU_SETSIZE) {
+      std::cerr << "ERROR: Bad CPU range `" << range
+                << "' in cpu-affinity argument." << std::endl;
+      return false;
+    }
+    for (unsigned long cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+  }
+  if (cpus->empty()) {
+    std::cerr << "ERROR: Empty cpu-affinity argument." << std::endl;
+    return false;
+  }
+  return true;
+}
+
 bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
   const struct option long_options[] = {
       {"term-after-cycles", required_argument, nullptr, 'c'},
       {"trace", no_argument, nullptr, 't'},
+      {"trace-start", required_argument, nullptr, 'T'},
+      {"trace-stop", required_argument, nullptr, 'P'},
+      {"trace-file", required_argument, nullptr, 'W'},
+      {"save-checkpoint-at", required_argument, nullptr, 'S'},
+      {"restore-checkpoint", required_argument, nullptr, 'R'},
+      {"batch", required_argument, nullptr, 'B'},
+      {"batch-fork-at", required_argument, nullptr, 'F'},
+      {"batch-jobs", required_argument, nullptr, 'J'},
+      {"batch-summary", required_argument, nullptr, 'Y'},
+      {"profile", no_argument, nullptr, 'O'},
+      {"stats-interval", required_argument, nullptr, 'N'},
+      {"stats-json", required_argument, nullptr, 'j'},
+      {"cpu-affinity", required_argument, nullptr, 'a'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, no_argument, nullptr, 0}};
 
@@ -134,12 +195,99 @@ bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
         }
         TraceOn();
         break;
+      case 'T':
+      case 'P':
+      case 'W':
+        if (!tracing_possible_) {
+          std::cerr << "ERROR: Tracing has not been enabled at compile time."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+        if (c == 'W') {
+          trace_file_name_ = optarg;
+        } else if (c == 'T') {
+          if (!read_ul_arg(&trace_start_cycle_, "trace-start", optarg)) {
+            exit_app = true;
+            return false;
+          }
+          trace_start_pending_ = true;
+        } else {
+          if (!read_ul_arg(&trace_stop_cycle_, "trace-stop", optarg)) {
+            exit_app = true;
+            return false;
+          }
+          trace_stop_pending_ = true;
+        }
+        break;
       case 'c':
         if (!read_ul_arg(&term_after_cycles_, "term-after-cycles", optarg)) {
           exit_app = true;
           return false;
         }
         break;
+      case 'S':
+      case 'R':
+        if (!checkpointing_possible_) {
+          std::cerr << "ERROR: Checkpointing has not been enabled at compile "
+                       "time."
+                    << std::endl;
+          exit_app = true;
+          return false;
+        }
+        if (c == 'R') {
+          restore_checkpoint_path_ = optarg;
+        } else {
+          if (!read_ul_arg(&save_checkpoint_cycle_, "save-checkpoint-at",
+                           optarg)) {
+            exit_app = true;
+            return false;
+          }
+          save_checkpoint_ = true;
+        }
+        break;
+      case 'B':
+        batch_list_path_ = optarg;
+        break;
+      case 'F':
+        if (!read_ul_arg(&batch_fork_cycle_, "batch-fork-at", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        batch_fork_cycle_given_ = true;
+        break;
+      case 'Y':
+        batch_summary_path_ = optarg;
+        break;
+      case 'J':
+        if (!read_ul_arg(&batch_jobs_, "batch-jobs", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        if (batch_jobs_ == 0) {
+          std::cerr << "ERROR: batch-jobs must be at least 1." << std::endl;
+          exit_app = true;
+          return false;
+        }
+        break;
+      case 'O':
+        profiler_.Enable();
+        break;
+      case 'N':
+        if (!read_ul_arg(&stats_interval_s_, "stats-interval", optarg)) {
+          exit_app = true;
+          return false;
+        }
+        break;
+      case 'j':
+        stats_json_path_ = optarg;
+        break;
+      case 'a':
+        if (!ParseCpuList(optarg, &cpu_affinity_)) {
+          exit_app = true;
+          return false;
+        }
+        break;
       case 'h':
         PrintHelp();
         exit_app = true;
@@ -155,6 +303,33 @@ bool VerilatorSimCtrl::ParseCommandArgs(int argc, char **argv, bool &exit_app) {
     }
   }
 
+  // A trace window starts with tracing off, even if --trace was given too.
+  if (trace_start_pending_) {
+    TraceOff();
+    tracing_enabled_changed_ = false;
+    tracing_ever_enabled_ = false;
+  }
+  if (trace_start_pending_ && trace_stop_pending_ &&
+      trace_stop_cycle_ <= trace_start_cycle_) {
+    std::cerr << "ERROR: trace-stop must be after trace-start." << std::endl;
+    exit_app = true;
+    return false;
+  }
+
+  // Every child in a batch would write to the same trace file
+  if (!batch_list_path_.empty() && (tracing_enabled_ || trace_start_pending_)) {
+    std::cerr << "ERROR: Tracing can't be used with --batch. Run the test "
+                 "on its own to trace it."
+              << std::endl;
+    exit_app = true;
+    return false;
+  }
+  if (!batch_list_path_.empty() && !stats_json_path_.empty()) {
+    std::cerr << "ERROR: --stats-json can't be used with --batch." << std::endl;
+    exit_app = true;
+    return false;
+  }
+
   // Pass args to verilator
   Verilated::commandArgs(argc, argv);
 
@@ -180,6 +355,9 @@ void VerilatorSimCtrl::RunSimulation() {
               << std::endl
               << "$ kill -USR1 " << getpid() << std::endl;
   }
+  std::cout << "Statistics can be printed by sending SIGUSR2 to this process:"
+            << std::endl
+            << "$ kill -USR2 " << getpid() << std::endl;
   // Call all extension pre-exec methods
   for (auto it = extension_array_.begin(); it != extension_array_.end(); ++it) {
     (*it)->PreExec();
@@ -228,12 +406,30 @@ VerilatorSimCtrl::VerilatorSimCtrl()
       tracing_enabled_changed_(false),
       tracing_ever_enabled_(false),
       tracing_possible_(VM_TRACE),
+      trace_start_pending_(false),
+      trace_start_cycle_(0),
+      trace_stop_pending_(false),
+      trace_stop_cycle_(0),
       initial_reset_delay_cycles_(2),
       reset_duration_cycles_(2),
       request_stop_(false),
       simulation_success_(true),
       tracer_(VerilatedTracer()),
-      term_after_cycles_(0) {}
+      term_after_cycles_(0),
+      next_extension_wakeup_(0),
+      checkpointing_possible_(VM_SAVABLE),
+      save_checkpoint_(false),
+      save_checkpoint_cycle_(0),
+      run_start_time_(0),
+      batch_fork_cycle_given_(false),
+      batch_fork_cycle_(0),
+      batch_jobs_(1),
+      batch_forked_(false),
+      batch_job_result_(nullptr),
+      stats_interval_s_(0),
+      stats_requested_(false),
+      pinned_threads_(0),
+      model_threads_(1) {}
 
 void VerilatorSimCtrl::RegisterSignalHandler() {
   struct sigaction sigIntHandler;
@@ -244,6 +440,7 @@ void VerilatorSimCtrl::RegisterSignalHandler() {
 
   sigaction(SIGINT, &sigIntHandler, NULL);
   sigaction(SIGUSR1, &sigIntHandler, NULL);
+  sigaction(SIGUSR2, &sigIntHandler, NULL);
 }
 
 void VerilatorSimCtrl::SignalHandler(int sig) {
@@ -260,6 +457,9 @@ void VerilatorSimCtrl::SignalHandler(int sig) {
         simctrl.TraceOn();
       }
       break;
+    case SIGUSR2:
+      simctrl.stats_requested_ = true;
+      break;
   }
 }
 
@@ -267,8 +467,48 @@ void VerilatorSimCtrl::PrintHelp() const {
   std::cout << "Execute a simulation model for " << GetName() << "\n\n";
   if (tracing_possible_) {
     std::cout << "-t|--trace\n"
-                 "  Write a trace file from the start\n\n";
+                 "  Write a trace file from the start\n\n"
+                 "--trace-start=CYCLE\n"
+                 "  Start tracing at CYCLE\n\n"
+                 "--trace-stop=CYCLE\n"
+                 "  Stop tracing at CYCLE\n\n"
+                 "--trace-file=FILE\n"
+                 "  Write the trace to FILE (default: "
+              << GetTraceFileName() << ")\n\n";
   }
+  if (checkpointing_possible_) {
+    std::cout << "--save-checkpoint-at=CYCLE\n"
+                 "  Save a checkpoint to "
+              << GetCheckpointFileName()
+              << " at the start of CYCLE\n\n"
+                 "--restore-checkpoint=FILE\n"
+                 "  Start the simulation from the checkpoint in FILE\n\n";
+  }
+  std::cout << "--batch=FILE\n"
+               "  Run a batch of tests, forking a child process for each one.\n"
+               "  Each line of FILE gives the arguments for a test, such as\n"
+               "  --meminit=flash,test.elf. Besides arguments for the\n"
+               "  extensions, a test can have --seed=N, -c|--term-after-\n"
+               "  cycles=N and -t|--trace. Test N runs in directory\n"
+               "  batch_N, with its output in sim.log. Needs a single-\n"
+               "  threaded model (verilated without --threads).\n\n"
+               "--batch-fork-at=CYCLE\n"
+               "  Fork the batch children at CYCLE (default: end of reset)\n\n"
+               "--batch-jobs=N\n"
+               "  Run up to N batch children at once (default: 1)\n\n"
+               "--batch-summary=FILE\n"
+               "  Write the results of the batch to FILE as JSON\n\n";
+  std::cout << "--profile\n"
+               "  Measure the time spent evaluating the model, tracing and in\n"
+               "  each extension, and include it in the statistics\n\n"
+               "--stats-interval=SECONDS\n"
+               "  Print the simulation speed every SECONDS during the run\n\n"
+               "--stats-json=FILE\n"
+               "  Write the final statistics to FILE as JSON\n\n";
+  std::cout << "--cpu-affinity=LIST\n"
+               "  Pin the main thread and then each of the model's threads to\n"
+               "  the CPUs in LIST in turn, e.g. 0-3,8. The model's thread\n"
+               "  count is set when it is verilated (with --threads).\n\n";
   std::cout << "-c|--term-after-cycles=N\n"
                "  Terminate simulation after N cycles. 0 means no timeout.\n\n"
                "-h|--help\n"
@@ -298,13 +538,15 @@ bool VerilatorSimCtrl::TraceOff() {
 }
 
 void VerilatorSimCtrl::PrintStatistics() const {
-  double speed_hz = time_ / 2 / (GetExecutionTimeMs() / 1000.0);
+  // If we started from a checkpoint, only count the cycles we ran.
+  unsigned long cycles = (time_ - run_start_time_) / 2;
+  double speed_hz = cycles / (GetExecutionTimeMs() / 1000.0);
   double speed_khz = speed_hz / 1000.0;
 
   std::cout << std::endl
             << "Simulation statistics" << std::endl
             << "=====================" << std::endl
-            << "Executed cycles:  " << time_ / 2 << std::endl
+            << "Executed cycles:  " << cycles << std::endl
             << "Wallclock time:   " << GetExecutionTimeMs() / 1000.0 << " s"
             << std::endl
             << "Simulation speed: " << speed_hz << " cycles/s "
@@ -314,9 +556,37 @@ void VerilatorSimCtrl::PrintStatistics() const {
   if (tracing_enabled_ && FileSize(GetTraceFileName(), trace_size_byte)) {
     std::cout << "Trace file size:  " << trace_size_byte << " B" << std::endl;
   }
+  if (profiler_.Enabled()) {
+    std::cout << std::endl << "Time spent in each part of the main loop:"
+              << std::endl;
+    profiler_.PrintSections(std::cout);
+    std::cout << std::endl << "CPU time used by each thread:" << std::endl;
+    profiler_.PrintThreads(std::cout, GetExecutionTimeMs() / 1000.0);
+  }
+
+  if (!stats_json_path_.empty()) {
+    profiler_.WriteJson(stats_json_path_, GetName(), cycles,
+                        GetExecutionTimeMs() / 1000.0);
+  }
+}
+
+void VerilatorSimCtrl::MaybePrintStatsReport() {
+  // Reading the clock is much slower than a check of the cycle count, so
+  // only look at it every 1024 cycles.
+  bool due = stats_interval_s_ && (time_ % 2048 == 0) &&
+             profiler_.SinceLastReport() >=
+                 std::chrono::seconds(stats_interval_s_);
+  if (!due && !stats_requested_) {
+    return;
+  }
+  stats_requested_ = false;
+  profiler_.PrintReport(std::cout, time_ / 2);
 }
 
 const char *VerilatorSimCtrl::GetTraceFileName() const {
+  if (!trace_file_name_.empty()) {
+    return trace_file_name_.c_str();
+  }
 #ifdef VM_TRACE_FMT_FST
   return "sim.fst";
 #else
@@ -324,6 +594,129 @@ const char *VerilatorSimCtrl::GetTraceFileName() const {
 #endif
 }
 
+const char *VerilatorSimCtrl::GetCheckpointFileName() const {
+  return "sim.ckpt";
+}
+
+bool VerilatorSimCtrl::SaveCheckpoint(const char *path) {
+#if VM_SAVABLE == 1
+  VerilatedSave os;
+  os.open(path);
+  if (!os.isOpen()) {
+    std::cerr << "ERROR: Could not open checkpoint file `" << path
+              << "' for writing." << std::endl;
+    return false;
+  }
+
+  std::string magic(kCheckpointMagic);
+  std::string name = GetName();
+  vluint64_t time = time_;
+  os << magic << name << time;
+
+  top_->save(os);
+
+  // Save the context pointers of DPI models, so that RestoreCheckpoint() can
+  // map them to the contexts created by the restoring process.
+  vluint32_t num_ctxs = dpi_ctx_count();
+  os << num_ctxs;
+  for (size_t i = 0; i < num_ctxs; ++i) {
+    void *ctx;
+    const char *ctx_kind, *ctx_name;
+    dpi_ctx_get(i, &ctx, &ctx_kind, &ctx_name);
+
+    std::string kind_str(ctx_kind), name_str(ctx_name);
+    vluint64_t ptr = reinterpret_cast<uintptr_t>(ctx);
+    os << kind_str << name_str << ptr;
+  }
+
+  vluint32_t num_exts = extension_array_.size();
+  os << num_exts;
+  for (SimCtrlExtension *ext : extension_array_) {
+    std::ostringstream oss;
+    ext->SaveCheckpoint(oss);
+    std::string state = oss.str();
+    os << state;
+  }
+
+  os.close();
+  return true;
+#else
+  assert(0 && "Checkpointing not enabled.");
+  return false;
+#endif
+}
+
+bool VerilatorSimCtrl::RestoreCheckpoint(const std::string &path) {
+#if VM_SAVABLE == 1
+  VerilatedRestore is;
+  is.open(path.c_str());
+  if (!is.isOpen()) {
+    std::cerr << "ERROR: Could not open checkpoint file `" << path << "'."
+              << std::endl;
+    return false;
+  }
+
+  std::string magic, name;
+  vluint64_t time;
+  is >> magic >> name >> time;
+  if (magic != kCheckpointMagic) {
+    std::cerr << "ERROR: `" << path << "' is not a checkpoint file."
+              << std::endl;
+    return false;
+  }
+  if (name != GetName()) {
+    std::cerr << "ERROR: Checkpoint file `" << path
+              << "' was saved by a simulation of " << name << ", not "
+              << GetName() << "." << std::endl;
+    return false;
+  }
+
+  top_->restore(is);
+  time_ = time;
+
+  vluint32_t num_ctxs;
+  is >> num_ctxs;
+  for (vluint32_t i = 0; i < num_ctxs; ++i) {
+    std::string kind_str, name_str;
+    vluint64_t ptr;
+    is >> kind_str >> name_str >> ptr;
+    if (!dpi_ctx_alias(reinterpret_cast<void *>(ptr), kind_str.c_str(),
+                       name_str.c_str())) {
+      std::cerr << "ERROR: Checkpoint file `" << path << "' has a context for "
+                << kind_str << " instance " << name_str
+                << ", which doesn't exist in this simulation." << std::endl;
+      return false;
+    }
+  }
+
+  vluint32_t num_exts;
+  is >> num_exts;
+  if (num_exts != extension_array_.size()) {
+    std::cerr << "ERROR: Checkpoint file `" << path << "' has state for "
+              << num_exts << " extensions, but " << extension_array_.size()
+              << " are registered." << std::endl;
+    return false;
+  }
+  for (SimCtrlExtension *ext : extension_array_) {
+    std::string state;
+    is >> state;
+    std::istringstream iss(state);
+    if (!ext->RestoreCheckpoint(iss)) {
+      std::cerr << "ERROR: Failed to restore extension state from checkpoint "
+                   "file `"
+                << path << "'." << std::endl;
+      return false;
+    }
+  }
+
+  is.close();
+  return true;
+#else
+  assert(0 && "Checkpointing not enabled.");
+  return false;
+#endif
+}
+
 void VerilatorSimCtrl::Run() {
   assert(top_ && "Use SetTop() first.");
 
@@ -333,22 +726,86 @@ void VerilatorSimCtrl::Run() {
     top_->trace(tracer_, 99, 0);
   }
 
+  // The model starts its worker threads when it is constructed. The DPI
+  // models may start helper threads of their own in their setup routines.
+  model_threads_ = SimCtrlProfiler::ListThreads().size();
+
   // Evaluate all initial blocks, including the DPI setup routines
   top_->eval();
 
+  // Restoring a checkpoint overwrites the state set up by the initial blocks
+  // and skips the cycles (including any reset) that came before it.
+  if (!restore_checkpoint_path_.empty()) {
+    if (!RestoreCheckpoint(restore_checkpoint_path_)) {
+      simulation_success_ = false;
+      time_begin_ = time_end_ = std::chrono::steady_clock::now();
+      top_->final();
+      return;
+    }
+    std::cout << "Restored checkpoint from " << restore_checkpoint_path_
+              << " at cycle " << time_ / 2 << "." << std::endl;
+  }
+  run_start_time_ = time_;
+  profiler_.SetExtensions(extension_array_);
+
+  if (!cpu_affinity_.empty() && !PinThreads()) {
+    simulation_success_ = false;
+    time_begin_ = time_end_ = std::chrono::steady_clock::now();
+    top_->final();
+    return;
+  }
+  ScheduleExtensions();
+
   std::cout << std::endl
             << "Simulation running, end by pressing CTRL-c." << std::endl;
 
   time_begin_ = std::chrono::steady_clock::now();
+  profiler_.Start(time_ / 2);
   UnsetReset();
   Trace();
 
   unsigned long start_reset_cycle_ = initial_reset_delay_cycles_;
   unsigned long end_reset_cycle_ = start_reset_cycle_ + reset_duration_cycles_;
 
+  if (!batch_fork_cycle_given_) {
+    batch_fork_cycle_ = end_reset_cycle_;
+  }
+
   while (1) {
     unsigned long cycle_ = time_ / 2;
 
+    // If we restored a checkpoint from after the fork cycle, fork at once.
+    if (!batch_list_path_.empty() && !batch_forked_ &&
+        cycle_ >= batch_fork_cycle_ && time_ % 2 == 0) {
+      batch_forked_ = true;
+      if (!RunBatch()) {
+        break;
+      }
+    }
+
+    // Open and close the trace window. These check for cycles at or after
+    // the window edges, rather than exactly at them, so that a window that
+    // starts before a restored checkpoint still works.
+    if (time_ % 2 == 0) {
+      if (trace_start_pending_ && cycle_ >= trace_start_cycle_) {
+        trace_start_pending_ = false;
+        TraceOn();
+      }
+      if (trace_stop_pending_ && cycle_ >= trace_stop_cycle_) {
+        trace_stop_pending_ = false;
+        TraceOff();
+      }
+    }
+
+    if (save_checkpoint_ && time_ == 2 * save_checkpoint_cycle_) {
+      if (!SaveCheckpoint(GetCheckpointFileName())) {
+        RequestStop(false);
+        break;
+      }
+      std::cout << "Saved checkpoint at cycle " << cycle_ << " to "
+                << GetCheckpointFileName() << "." << std::endl;
+    }
+
     if (cycle_ == start_reset_cycle_) {
       SetReset();
     } else if (cycle_ == end_reset_cycle_) {
@@ -357,18 +814,17 @@ void VerilatorSimCtrl::Run() {
 
     *sig_clk_ = !*sig_clk_;
 
-    // Call all extension on-clock methods
-    if (*sig_clk_) {
-      for (auto it = extension_array_.begin(); it != extension_array_.end();
-           ++it) {
-        (*it)->OnClock(time_);
-      }
+    // Call the on-clock methods of any extensions that are due
+    if (*sig_clk_ && time_ >= next_extension_wakeup_) {
+      RunExtensions();
     }
 
-    top_->eval();
+    profiler_.Time(SimCtrlProfiler::kSectionEval, [&] { top_->eval(); });
     time_++;
 
-    Trace();
+    profiler_.Time(SimCtrlProfiler::kSectionTrace, [&] { Trace(); });
+
+    MaybePrintStatsReport();
 
     if (request_stop_) {
       std::cout << "Received stop request, shutting down simulation."
@@ -387,14 +843,430 @@ void VerilatorSimCtrl::Run() {
     }
   }
 
+  profiler_.SampleThreads();
   top_->final();
   time_end_ = std::chrono::steady_clock::now();
 
+  // Tell the parent of a batch how this test went
+  if (batch_job_result_) {
+    batch_job_result_->cycles = time_ / 2;
+    batch_job_result_->timed_out = !request_stop_ && !Verilated::gotFinish() &&
+                                   term_after_cycles_ &&
+                                   time_ / 2 >= term_after_cycles_;
+    batch_job_result_->finished = true;
+  }
+
   if (TracingEverEnabled()) {
     tracer_.close();
   }
 }
 
+bool VerilatorSimCtrl::PinThreads() {
+  std::vector<int> tids = SimCtrlProfiler::ListThreads();
+  for (size_t i = pinned_threads_; i < tids.size(); ++i) {
+    int cpu = cpu_affinity_[i % cpu_affinity_.size()];
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(tids[i], sizeof(cpus), &cpus) != 0) {
+      std::cerr << "ERROR: Could not pin thread " << tids[i] << " to CPU "
+                << cpu << ": " << strerror(errno) << std::endl;
+      return false;
+    }
+  }
+  if (tids.size() > pinned_threads_) {
+    std::cout << "Pinned " << tids.size() - pinned_threads_
+              << " thread(s) to the CPUs given with --cpu-affinity."
+              << std::endl;
+  }
+  pinned_threads_ = tids.size();
+  return true;
+}
+
+void VerilatorSimCtrl::ScheduleExtensions() {
+  extension_wakeup_.assign(extension_array_.size(), time_);
+  next_extension_wakeup_ =
+      extension_array_.empty() ? SimCtrlExtension::kNoWakeup : time_;
+}
+
+void VerilatorSimCtrl::RunExtensions() {
+  // There are only ever a handful of extensions, so a linear scan is cheaper
+  // than keeping them in a priority queue.
+  unsigned long next_wakeup = SimCtrlExtension::kNoWakeup;
+  for (size_t i = 0; i < extension_array_.size(); ++i) {
+    if (extension_wakeup_[i] <= time_) {
+      SimCtrlExtension *ext = extension_array_[i];
+      profiler_.Time(SimCtrlProfiler::kSectionFirstExtension + i,
+                     [&] { ext->OnClock(time_); });
+      extension_wakeup_[i] = ext->GetNextWakeup(time_);
+    }
+    if (extension_wakeup_[i] < next_wakeup) {
+      next_wakeup = extension_wakeup_[i];
+    }
+  }
+  next_extension_wakeup_ = next_wakeup;
+}
+
+// Split a line of a batch list into arguments, separated by whitespace
+static std::vector<std::string> SplitBatchLine(const std::string &line) {
+  std::vector<std::string> args;
+  std::istringstream iss(line);
+  std::string arg;
+  while (iss >> arg) {
+    args.push_back(arg);
+  }
+  return args;
+}
+
+bool VerilatorSimCtrl::RunBatch() {
+  // Only the calling thread survives a fork, so a child of a model with
+  // worker threads would hang in its first evaluation. DPI helper threads
+  // don't count: they are stopped before forking and restarted explicitly.
+  if (model_threads_ > 1) {
+    std::cerr << "ERROR: --batch needs a single-threaded model. Verilate "
+                 "without --threads to use it."
+              << std::endl;
+    RequestStop(false);
+    return false;
+  }
+
+  std::vector<std::vector<std::string>> tests;
+  std::ifstream list(batch_list_path_);
+  if (!list) {
+    std::cerr << "ERROR: Could not open batch list `" << batch_list_path_
+              << "'." << std::endl;
+    RequestStop(false);
+    return false;
+  }
+  std::string line;
+  while (std::getline(list, line)) {
+    std::vector<std::string> args = SplitBatchLine(line);
+    if (args.empty() || args[0][0] == '#') {
+      continue;
+    }
+    tests.push_back(args);
+  }
+
+  std::cout << "Forking " << tests.size() << " batch tests at cycle "
+            << time_ / 2 << "." << std::endl;
+
+  // The children write their results here. Anonymous mappings start zeroed.
+  size_t results_size = std::max<size_t>(1, tests.size()) *
+                        sizeof(BatchJobResult);
+  void *results_mem = mmap(nullptr, results_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results_mem == MAP_FAILED) {
+    std::cerr << "ERROR: Failed to map memory for batch results: "
+              << strerror(errno) << std::endl;
+    RequestStop(false);
+    return false;
+  }
+  BatchJobResult *job_results = static_cast<BatchJobResult *>(results_mem);
+
+  std::vector<int> statuses(tests.size(), -1);
+  std::vector<std::chrono::steady_clock::time_point> begin(tests.size()),
+      end(tests.size());
+  std::map<pid_t, size_t> running;
+  size_t next = 0;
+
+  // Make sure that nothing buffered in the parent is written by the children
+  // as well.
+  fflush(nullptr);
+  std::cout.flush();
+
+  // Stop the DPI helper threads, which don't survive a fork. This also keeps
+  // the parent from reading input that is meant for the children until the
+  // batch is done.
+  dpi_ctx_stop_threads();
+
+  while (next < tests.size() || !running.empty()) {
+    if (next < tests.size() && running.size() < batch_jobs_) {
+      size_t idx = next++;
+      begin[idx] = end[idx] = std::chrono::steady_clock::now();
+
+      pid_t pid = fork();
+      if (pid < 0) {
+        std::cerr << "ERROR: Failed to fork batch test " << idx << "."
+                  << std::endl;
+        continue;
+      }
+
+      if (pid == 0) {
+        // Send this test's output to its own directory
+        std::ostringstream dir_name;
+        dir_name << "batch_" << idx;
+        std::string dir = dir_name.str();
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+          std::cerr << "ERROR: Could not create `" << dir
+                    << "': " << strerror(errno) << std::endl;
+          _exit(1);
+        }
+        int fd = open((dir + "/sim.log").c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+          dup2(fd, STDOUT_FILENO);
+          dup2(fd, STDERR_FILENO);
+          close(fd);
+        }
+
+        std::vector<std::string> args = tests[idx];
+        args.insert(args.begin(), "batch");
+        std::vector<char *> argv;
+        for (std::string &arg : args) {
+          argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+
+        batch_job_result_ = &job_results[idx];
+        run_start_time_ = time_;
+        profiler_.SetExtensions(extension_array_);
+        time_begin_ = std::chrono::steady_clock::now();
+        profiler_.Start(time_ / 2);
+
+        // Any files named in the arguments are relative to the directory
+        // that the batch was started from, so parse them before moving to
+        // the test's directory.
+        bool args_ok =
+            ParseBatchJobArgs(args.size(), argv.data(), batch_job_result_);
+        for (SimCtrlExtension *ext : extension_array_) {
+          bool exit_app = false;
+          if (!args_ok ||
+              !ext->ParseCLIArguments(args.size(), argv.data(), exit_app) ||
+              exit_app) {
+            args_ok = false;
+            break;
+          }
+        }
+        if (!args_ok || chdir(dir.c_str()) != 0) {
+          RequestStop(false);
+        }
+        dpi_ctx_reopen_files();
+        dpi_ctx_start_threads();
+
+        // The arguments may have changed what the extensions need to do
+        ScheduleExtensions();
+        return true;
+      }
+
+      running[pid] = idx;
+      continue;
+    }
+
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      break;
+    }
+    auto it = running.find(pid);
+    if (it == running.end()) {
+      continue;
+    }
+    statuses[it->second] = status;
+    end[it->second] = std::chrono::steady_clock::now();
+    running.erase(it);
+  }
+  dpi_ctx_start_threads();
+
+  std::vector<double> wall_s(tests.size());
+  for (size_t idx = 0; idx < tests.size(); ++idx) {
+    wall_s[idx] = std::chrono::duration<double>(end[idx] - begin[idx]).count();
+  }
+
+  // Report the results
+  size_t num_passed = 0;
+  std::cout << std::endl
+            << "Batch results" << std::endl
+            << "=============" << std::endl;
+  for (size_t idx = 0; idx < tests.size(); ++idx) {
+    const BatchJobResult &result = job_results[idx];
+    std::string status = GetBatchStatus(statuses[idx], result);
+    if (status == "PASS") {
+      ++num_passed;
+    }
+
+    std::cout << "batch_" << idx << ": " << status;
+    if (statuses[idx] >= 0 && WIFSIGNALED(statuses[idx])) {
+      std::cout << " (signal " << WTERMSIG(statuses[idx]) << ")";
+    }
+    if (statuses[idx] >= 0) {
+      std::cout << " in " << wall_s[idx] << " s";
+    }
+    if (result.finished) {
+      std::cout << ", " << result.cycles << " cycles";
+    }
+    std::cout << ":";
+    for (const std::string &arg : tests[idx]) {
+      std::cout << " " << arg;
+    }
+    std::cout << std::endl;
+  }
+  std::cout << num_passed << " of " << tests.size() << " tests passed."
+            << std::endl;
+
+  bool summary_ok = batch_summary_path_.empty() ||
+                    WriteBatchSummary(tests, statuses, wall_s, job_results);
+  munmap(results_mem, results_size);
+
+  simulation_success_ = summary_ok && num_passed == tests.size();
+  return false;
+}
+
+const char *VerilatorSimCtrl::GetBatchStatus(int status,
+                                             const BatchJobResult &result) {
+  if (status < 0) {
+    return "ERROR";
+  }
+  if (WIFSIGNALED(status)) {
+    return "CRASH";
+  }
+  if (result.timed_out) {
+    return "TIMEOUT";
+  }
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    return "PASS";
+  }
+  return "FAIL";
+}
+
+bool VerilatorSimCtrl::ParseBatchJobArgs(int argc, char **argv,
+                                         BatchJobResult *result) {
+  const struct option long_options[] = {
+      {"seed", required_argument, nullptr, 's'},
+      {"term-after-cycles", required_argument, nullptr, 'c'},
+      {"trace", no_argument, nullptr, 't'},
+      {nullptr, no_argument, nullptr, 0}};
+
+  // Reset the command parsing index and don't complain about the options
+  // that are meant for the extensions.
+  optind = 1;
+  opterr = 0;
+  while (1) {
+    int c = getopt_long(argc, argv, ":c:t", long_options, nullptr);
+    if (c == -1) {
+      break;
+    }
+
+    switch (c) {
+      case 's':
+        if (!read_ul_arg(&result->seed, "seed", optarg)) {
+          return false;
+        }
+        result->has_seed = true;
+        Verilated::randSeed(result->seed);
+        break;
+      case 'c':
+        if (!read_ul_arg(&term_after_cycles_, "term-after-cycles", optarg)) {
+          return false;
+        }
+        break;
+      case 't':
+        if (!tracing_possible_) {
+          std::cerr << "ERROR: Tracing has not been enabled at compile time."
+                    << std::endl;
+          return false;
+        }
+        TraceOn();
+        result->traced = true;
+        break;
+      case ':':  // missing argument
+        std::cerr << "ERROR: Missing argument." << std::endl;
+        return false;
+      default:;
+    }
+  }
+  result->timeout_cycles = term_after_cycles_;
+  return true;
+}
+
+bool VerilatorSimCtrl::WriteBatchSummary(
+    const std::vector<std::vector<std::string>> &tests,
+    const std::vector<int> &statuses, const std::vector<double> &wall_s,
+    const BatchJobResult *results) const {
+  std::ofstream os(batch_summary_path_);
+  if (!os) {
+    std::cerr << "ERROR: Cannot open `" << batch_summary_path_
+              << "' to write the batch summary." << std::endl;
+    return false;
+  }
+
+  size_t num_passed = 0;
+  os << std::setprecision(9) << "{\n  \"batch_list\": ";
+  SimCtrlProfiler::WriteJsonString(os, batch_list_path_);
+  os << ",\n  \"fork_cycle\": " << batch_fork_cycle_ << ",\n  \"jobs\": [";
+  for (size_t idx = 0; idx < tests.size(); ++idx) {
+    const BatchJobResult &result = results[idx];
+    std::string status = GetBatchStatus(statuses[idx], result);
+    if (status == "PASS") {
+      ++num_passed;
+    }
+    std::ostringstream dir;
+    dir << "batch_" << idx;
+
+    os << (idx ? ",\n" : "\n") << "    {\n      \"index\": " << idx
+       << ",\n      \"args\": [";
+    for (size_t i = 0; i < tests[idx].size(); ++i) {
+      os << (i ? ", " : "");
+      SimCtrlProfiler::WriteJsonString(os, tests[idx][i]);
+    }
+    os << "],\n      \"status\": \"" << status << "\"";
+
+    os << ",\n      \"exit_code\": ";
+    if (statuses[idx] >= 0 && WIFEXITED(statuses[idx])) {
+      os << WEXITSTATUS(statuses[idx]);
+    } else {
+      os << "null";
+    }
+    os << ",\n      \"signal\": ";
+    if (statuses[idx] >= 0 && WIFSIGNALED(statuses[idx])) {
+      os << WTERMSIG(statuses[idx]);
+    } else {
+      os << "null";
+    }
+
+    os << ",\n      \"seed\": ";
+    if (result.has_seed) {
+      os << result.seed;
+    } else {
+      os << "null";
+    }
+    os << ",\n      \"timeout_cycles\": ";
+    if (result.timeout_cycles) {
+      os << result.timeout_cycles;
+    } else {
+      os << "null";
+    }
+    os << ",\n      \"cycles\": ";
+    if (result.finished) {
+      os << result.cycles;
+    } else {
+      os << "null";
+    }
+    os << ",\n      \"wall_s\": " << wall_s[idx];
+
+    os << ",\n      \"dir\": ";
+    SimCtrlProfiler::WriteJsonString(os, dir.str());
+    os << ",\n      \"log\": ";
+    SimCtrlProfiler::WriteJsonString(os, dir.str() + "/sim.log");
+    os << ",\n      \"trace\": ";
+    if (result.traced) {
+      SimCtrlProfiler::WriteJsonString(os,
+                                       dir.str() + "/" + GetTraceFileName());
+    } else {
+      os << "null";
+    }
+    os << "\n    }";
+  }
+  os << (tests.empty() ? "" : "\n  ") << "],\n  \"passed\": " << num_passed
+     << ",\n  \"total\": " << tests.size() << "\n}\n";
+
+  if (!os) {
+    std::cerr << "ERROR: Failed to write the batch summary to `"
+              << batch_summary_path_ << "'." << std::endl;
+    return false;
+  }
+  return true;
+}
+
 std::string VerilatorSimCtrl::GetName() const {
   if (top_) {
     return top_->name();
@@ -456,6 +1328,10 @@ void VerilatorSimCtrl::Trace() {
     tracer_.open(GetTraceFileName());
     std::cout << "Writing simulation traces to " << GetTraceFileName()
               << std::endl;
+    // Tracing may have started a thread of its own
+    if (!cpu_affinity_.empty() && !PinThreads()) {
+      RequestStop(false);
+    }
   }
 
   tracer_.dump(GetTime());
@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "sim_ctrl_extension.h"
+#include "sim_ctrl_profiler.h"
 #include "verilated_toplevel.h"
 
 enum VerilatorSimCtrlFlags {
@@ -73,7 +74,8 @@ class VerilatorSimCtrl {
    *
    * This function performs the following tasks:
    * 1. Sets up a signal handler to enable tracing to be turned on/off during
-   *    a run by sending SIGUSR1 to the process
+   *    a run by sending SIGUSR1 to the process, and statistics to be printed
+   *    by sending SIGUSR2
    * 2. Prints some tracer-related helper messages
    * 3. Runs the simulation
    * 4. Prints some further helper messages and statistics once the simulation
@@ -122,6 +124,19 @@ class VerilatorSimCtrl {
   unsigned long GetTime() const { return time_; }
 
  private:
+  // The result of a test in a batch, written by the child process that runs
+  // it into memory shared with the parent
+  struct BatchJobResult {
+    bool has_seed;
+    unsigned long seed;
+    unsigned long timeout_cycles;
+    bool traced;
+    // Set once the child has finished simulating
+    bool finished;
+    bool timed_out;
+    unsigned long cycles;
+  };
+
   VerilatedToplevel *top_;
   CData *sig_clk_;
   CData *sig_rst_;
@@ -131,6 +146,11 @@ class VerilatorSimCtrl {
   bool tracing_enabled_changed_;
   bool tracing_ever_enabled_;
   bool tracing_possible_;
+  bool trace_start_pending_;
+  unsigned long trace_start_cycle_;
+  bool trace_stop_pending_;
+  unsigned long trace_stop_cycle_;
+  std::string trace_file_name_;
   unsigned int initial_reset_delay_cycles_;
   unsigned int reset_duration_cycles_;
   volatile unsigned int request_stop_;
@@ -140,6 +160,28 @@ class VerilatorSimCtrl {
   VerilatedTracer tracer_;
   unsigned long term_after_cycles_;
   std::vector<SimCtrlExtension *> extension_array_;
+  std::vector<unsigned long> extension_wakeup_;
+  unsigned long next_extension_wakeup_;
+  bool checkpointing_possible_;
+  bool save_checkpoint_;
+  unsigned long save_checkpoint_cycle_;
+  std::string restore_checkpoint_path_;
+  unsigned long run_start_time_;
+  std::string batch_list_path_;
+  bool batch_fork_cycle_given_;
+  unsigned long batch_fork_cycle_;
+  unsigned long batch_jobs_;
+  bool batch_forked_;
+  std::string batch_summary_path_;
+  BatchJobResult *batch_job_result_;
+  SimCtrlProfiler profiler_;
+  unsigned long stats_interval_s_;
+  std::string stats_json_path_;
+  volatile bool stats_requested_;
+  std::vector<int> cpu_affinity_;
+  size_t pinned_threads_;
+  // Threads in the process before the DPI models were set up
+  size_t model_threads_;
 
   /**
    * Default constructor
@@ -199,11 +241,135 @@ class VerilatorSimCtrl {
    */
   bool TracingPossible() const { return tracing_possible_; }
 
+  /**
+   * Is checkpointing support compiled into the simulation?
+   *
+   * This needs a model that was verilated with --savable (see VM_SAVABLE in
+   * verilated_toplevel.h).
+   */
+  bool CheckpointingPossible() const { return checkpointing_possible_; }
+
+  /**
+   * Get the file name of the checkpoint file written by
+   * --save-checkpoint-at
+   */
+  const char *GetCheckpointFileName() const;
+
+  /**
+   * Save a checkpoint to the file at path
+   *
+   * The checkpoint contains the state of the Verilated model, the simulation
+   * time, the contexts of DPI models and the state of every registered
+   * extension.
+   *
+   * @return Return code, true == success
+   */
+  bool SaveCheckpoint(const char *path);
+
+  /**
+   * Restore a checkpoint written by SaveCheckpoint()
+   *
+   * This must be called after the initial blocks have been evaluated, so that
+   * DPI models have created contexts to replace the ones in the checkpoint.
+   *
+   * @return Return code, true == success
+   */
+  bool RestoreCheckpoint(const std::string &path);
+
+  /**
+   * Run the tests in the batch list, forking a child process for each
+   *
+   * Each line of the batch list gives the command line arguments for one test.
+   * Each child takes the options of its own (see ParseBatchJobArgs()), passes
+   * its arguments to the registered extensions (so a line like
+   * "--meminit=flash,test.elf" backdoor-loads a test image) and then carries
+   * on simulating from the current state until the test finishes.
+   *
+   * Each test runs in its own directory, batch_<N>, where N is the index of
+   * the test in the list. Its output goes to sim.log there, and DPI models
+   * reopen their log files there (see dpi_ctx_reopen_files()). If
+   * --batch-summary was given, the results of all tests are written to that
+   * file as JSON.
+   *
+   * @return true in a child process, which should carry on with the
+   *         simulation. false in the parent, once all children have finished
+   *         and a report of their results has been printed.
+   */
+  bool RunBatch();
+
+  /**
+   * Parse the options of a test in a batch that are handled by the
+   * simulation controller
+   *
+   * These are --seed=N (the Verilator random seed), -c|--term-after-cycles=N
+   * and -t|--trace. The test's result is updated to record them.
+   *
+   * @return Return code, true == success
+   */
+  bool ParseBatchJobArgs(int argc, char **argv, BatchJobResult *result);
+
+  /**
+   * Get the status of a test in a batch: PASS, FAIL, TIMEOUT, CRASH (killed
+   * by a signal) or ERROR (couldn't be started)
+   *
+   * @param status Status from waitpid(), or -1 if the test wasn't started
+   * @param result Result written by the test
+   */
+  static const char *GetBatchStatus(int status, const BatchJobResult &result);
+
+  /**
+   * Write a JSON summary of the results of a batch
+   *
+   * @return Return code, true == success
+   */
+  bool WriteBatchSummary(const std::vector<std::vector<std::string>> &tests,
+                         const std::vector<int> &statuses,
+                         const std::vector<double> &wall_s,
+                         const BatchJobResult *results) const;
+
+  /**
+   * Schedule every extension's OnClock() for the next rising clock edge
+   *
+   * This must be called before the main loop starts and whenever the
+   * simulation time jumps or extensions are reconfigured, because their
+   * schedules may no longer hold.
+   */
+  void ScheduleExtensions();
+
+  /**
+   * Call OnClock() for every extension that is due and reschedule them
+   *
+   * This is called on rising clock edges at or after
+   * next_extension_wakeup_, so the main loop doesn't make any virtual calls
+   * on edges where no extension has anything to do.
+   */
+  void RunExtensions();
+
+  /**
+   * Pin any threads that haven't been pinned yet to the CPUs given with
+   * --cpu-affinity
+   *
+   * The threads are taken in the order given by
+   * SimCtrlProfiler::ListThreads(), so the main thread gets the first CPU in
+   * the list and the model's threads get the following ones, wrapping round
+   * if there are more threads than CPUs. This is called once the model has
+   * started its worker threads and again when tracing starts a trace thread.
+   *
+   * @return Return code, true == success
+   */
+  bool PinThreads();
+
   /**
    * Print statistics about the simulation run
    */
   void PrintStatistics() const;
 
+  /**
+   * Print a report of the simulation speed during the run if one has been
+   * requested with SIGUSR2 or is due because of --stats-interval
+   */
+  void MaybePrintStatsReport();
+
   /**
    * Get the file name of the trace file
    */
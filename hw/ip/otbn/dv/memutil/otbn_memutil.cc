@@ -207,7 +207,7 @@ extern "C" svBit OtbnMemUtilGetSegData(
   // Copy data from the segment into a uint32_t. Zero-initialize it, in case
   // to_copy < 4.
   uint32_t data = 0;
-  memcpy(&data, &it->second[seg_off], to_copy);
+  it->second.CopyOut(seg_off, reinterpret_cast<uint8_t *>(&data), to_copy);
 
   // Now copy that uint32_t into data_value and return success.
   memcpy(data_value, &data, 4);
@@ -87,9 +87,21 @@ struct OtbnModel {
     return iss_.get();
   }
 
+  // Read the contents of imem or dmem from the design. The data is returned
+  // as stored, and a warning is printed to stderr for each ECC error.
   std::vector<uint8_t> get_sim_memory(bool is_imem) const {
-    const MemArea &mem_area = mem_util_.GetMemArea(is_imem);
-    return mem_area.Read(0, mem_area.GetSizeWords());
+    const Ecc32MemArea &mem_area = mem_util_.GetMemArea(is_imem);
+    std::vector<uint8_t> data = mem_area.Read(0, mem_area.GetSizeWords());
+
+    for (const Ecc32MemArea::EccError &err : mem_area.GetReadErrors()) {
+      std::cerr << "WARNING: "
+                << (err.err == kSecdedCorrected ? "Correctable"
+                                                : "Uncorrectable")
+                << " ECC error in " << (is_imem ? "imem" : "dmem")
+                << " word 0x" << std::hex << err.word << std::dec << ", lane "
+                << err.lane << ".\n";
+    }
+    return data;
   }
 
   void set_sim_memory(bool is_imem, const std::vector<uint8_t> &data) const {
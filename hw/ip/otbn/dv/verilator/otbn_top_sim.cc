@@ -85,6 +85,11 @@ class OtbnTraceUtil : public SimCtrlExtension {
     return true;
   }
 
+  // The trace is written by a listener, so this has no work on clock edges
+  virtual unsigned long GetNextWakeup(unsigned long sim_time) {
+    return kNoWakeup;
+  }
+
   ~OtbnTraceUtil() {
     if (log_trace_listener_)
       OtbnTraceSource::get().RemoveListener(log_trace_listener_.get());
@@ -6,316 +6,471 @@
 
 #include <algorithm>
 #include <cassert>
-#include <functional>
-#include <iostream>
 #include <stdint.h>
 #include <vector>
 
 #include "prince_ref.h"
 
-uint8_t PRESENT_SBOX4[] = {0xc, 0x5, 0x6, 0xb, 0x9, 0x0, 0xa, 0xd,
-                           0x3, 0xe, 0xf, 0x8, 0x4, 0x7, 0x1, 0x2};
+static const uint8_t PRESENT_SBOX4[] = {0xc, 0x5, 0x6, 0xb, 0x9, 0x0,
+                                        0xa, 0xd, 0x3, 0xe, 0xf, 0x8,
+                                        0x4, 0x7, 0x1, 0x2};
 
-uint8_t PRESENT_SBOX4_INV[] = {0x5, 0xe, 0xf, 0x8, 0xc, 0x1, 0x2, 0xd,
-                               0xb, 0x4, 0x6, 0x3, 0x0, 0x7, 0x9, 0xa};
+static const uint8_t PRESENT_SBOX4_INV[] = {0x5, 0xe, 0xf, 0x8, 0xc, 0x1,
+                                            0x2, 0xd, 0xb, 0x4, 0x6, 0x3,
+                                            0x0, 0x7, 0x9, 0xa};
 
 static const uint32_t kNumAddrSubstPermRounds = 2;
 static const uint32_t kNumDataSubstPermRounds = 2;
 static const uint32_t kNumPrinceHalfRounds = 2;
 
-static std::vector<uint8_t> byte_reverse_vector(
-    const std::vector<uint8_t> &vec_in) {
-  std::vector<uint8_t> vec_out(vec_in.size());
+// Masks for the steps of the butterfly permutation. Step i of gathering the
+// even bits of a word into its bottom half ORs the word with itself shifted
+// right by 2^i and then ANDs with kButterflyMasks[i + 1]. Spreading the bottom
+// half back out to the even bits runs the steps in reverse, with left shifts.
+static const uint64_t kButterflyMasks[] = {
+    0x5555555555555555, 0x3333333333333333, 0x0f0f0f0f0f0f0f0f,
+    0x00ff00ff00ff00ff, 0x0000ffff0000ffff, 0x00000000ffffffff};
+
+// Byte-wide lookup tables, built once from the nibble S-boxes above. Applying
+// an S-box to each nibble of a byte is a single lookup in sbox/sbox_inv.
+namespace {
+struct ScrambleTables {
+  uint8_t sbox[256];
+  uint8_t sbox_inv[256];
+  uint8_t bit_reverse[256];
+
+  ScrambleTables() {
+    for (int i = 0; i < 256; ++i) {
+      sbox[i] = PRESENT_SBOX4[i & 0xf] | (PRESENT_SBOX4[i >> 4] << 4);
+      sbox_inv[i] =
+          PRESENT_SBOX4_INV[i & 0xf] | (PRESENT_SBOX4_INV[i >> 4] << 4);
+
+      uint8_t rev = 0;
+      for (int j = 0; j < 8; ++j) {
+        rev |= ((i >> j) & 1) << (7 - j);
+      }
+      bit_reverse[i] = rev;
+    }
+  }
+};
 
-  std::reverse_copy(std::begin(vec_in), std::end(vec_in), std::begin(vec_out));
+const ScrambleTables kTables;
+}  // namespace
 
-  return vec_out;
+// A mask for the bottom width bits of a word.
+static uint64_t low_mask(uint32_t width) {
+  assert(width <= 64);
+  return (width == 64) ? ~(uint64_t)0 : (((uint64_t)1 << width) - 1);
 }
 
-static uint8_t read_vector_bit(const std::vector<uint8_t> &vec,
-                               uint32_t bit_pos) {
-  assert(bit_pos / 8 < vec.size());
+// Read width bits (at most 64) from a packed vector, starting at bit lsb.
+static uint64_t read_packed_bits(const uint64_t *vec, uint32_t lsb,
+                                 uint32_t width) {
+  if (!width) {
+    return 0;
+  }
 
-  return (vec[bit_pos / 8] >> (bit_pos % 8)) & 1;
-}
+  uint32_t word = lsb / 64;
+  uint32_t shift = lsb % 64;
 
-static void or_vector_bit(std::vector<uint8_t> &vec, uint32_t bit_pos,
-                          uint8_t bit) {
-  assert(bit_pos / 8 < vec.size());
+  uint64_t bits = vec[word] >> shift;
+  if (shift && (shift + width > 64)) {
+    bits |= vec[word + 1] << (64 - shift);
+  }
 
-  vec[bit_pos / 8] |= bit << (bit_pos % 8);
+  return bits & low_mask(width);
 }
 
-static std::vector<uint8_t> xor_vectors(const std::vector<uint8_t> &vec_a,
-                                        const std::vector<uint8_t> &vec_b) {
-  assert(vec_a.size() == vec_b.size());
-
-  std::vector<uint8_t> vec_out(vec_a.size());
+// OR width bits (at most 64) into a packed vector, starting at bit lsb. bits
+// must have no bits set at or above width.
+static void or_packed_bits(uint64_t *vec, uint32_t lsb, uint32_t width,
+                           uint64_t bits) {
+  assert((bits & ~low_mask(width)) == 0);
 
-  std::transform(vec_a.begin(), vec_a.end(), vec_b.begin(), vec_out.begin(),
-                 std::bit_xor<uint8_t>{});
+  uint32_t word = lsb / 64;
+  uint32_t shift = lsb % 64;
 
-  return vec_out;
+  vec[word] |= bits << shift;
+  if (shift && (shift + width > 64)) {
+    vec[word + 1] |= bits >> (64 - shift);
+  }
 }
 
-// Run each 4-bit chunk of bytes from `in` through the SBOX. Where `bit_width`
-// isn't a multiple of 4 the remaining bits are just copied straight through.
-// `invert` choose whether to use the inverted SBOX or not.
-static std::vector<uint8_t> scramble_sbox_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width,
-                                                uint8_t sbox[16]) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
-
-  // Iterate through each 4 bit chunk of the data and apply the appropriate SBOX
-  for (int i = 0; i < bit_width / 4; ++i) {
-    uint8_t sbox_in, sbox_out;
-
-    sbox_in = in[i / 2];
-
-    int shift = (i % 2) ? 4 : 0;
-    sbox_in = (sbox_in >> shift) & 0xf;
+// Run each 4-bit chunk of `in` through the S-box table `sbox`. Where
+// `bit_width` isn't a multiple of 4 the remaining bits are just copied
+// straight through.
+static uint64_t scramble_sbox_layer(uint64_t in, uint32_t bit_width,
+                                    const uint8_t sbox[256]) {
+  uint64_t out = 0;
+  for (uint32_t i = 0; i < (bit_width + 7) / 8; ++i) {
+    out |= (uint64_t)sbox[(in >> (8 * i)) & 0xff] << (8 * i);
+  }
 
-    sbox_out = sbox[sbox_in];
+  uint64_t sbox_mask = low_mask(bit_width & ~3u);
+  return (out & sbox_mask) | (in & ~sbox_mask & low_mask(bit_width));
+}
 
-    out[i / 2] |= sbox_out << shift;
-  }
+// Reverse the bottom bit_width bits of in
+static uint64_t scramble_flip_layer(uint64_t in, uint32_t bit_width) {
+  assert(0 < bit_width);
 
-  // Where bit_width is not a multiple of 4 copy over the remaining bits
-  if (bit_width % 4) {
-    int shift = ((bit_width % 8) >= 4) ? 4 : 0;
-    uint8_t nibble = (in[bit_width / 8] >> shift) & 0xf;
-    out[bit_width / 8] |= nibble << shift;
+  uint64_t out = 0;
+  for (int i = 0; i < 8; ++i) {
+    out = (out << 8) | kTables.bit_reverse[(in >> (8 * i)) & 0xff];
   }
 
-  return out;
+  return out >> (64 - bit_width);
 }
 
-// Reverse bits from incoming byte vector
-static std::vector<uint8_t> scramble_flip_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
-
-  for (int i = 0; i < bit_width; ++i) {
-    or_vector_bit(out, bit_width - i - 1, read_vector_bit(in, i));
+// Gather the even bits of in into the bottom 32 bits of the result
+static uint64_t gather_even_bits(uint64_t in) {
+  uint64_t x = in & kButterflyMasks[0];
+  for (int i = 0; i < 5; ++i) {
+    x = (x | (x >> (1 << i))) & kButterflyMasks[i + 1];
   }
+  return x;
+}
 
-  return out;
+// Spread the bottom 32 bits of in out to the even bits of the result
+static uint64_t spread_even_bits(uint64_t in) {
+  uint64_t x = in & kButterflyMasks[5];
+  for (int i = 4; i >= 0; --i) {
+    x = (x | (x << (1 << i))) & kButterflyMasks[i];
+  }
+  return x;
 }
 
-// Apply butterfly to incoming byte vector. Even bits are placed in the lower
-// half of the output, odd bits are placed in the upper half of the output.
-static std::vector<uint8_t> scramble_perm_layer(const std::vector<uint8_t> &in,
-                                                uint32_t bit_width,
-                                                bool invert) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  std::vector<uint8_t> out(in.size(), 0);
-
-  for (int i = 0; i < bit_width / 2; ++i) {
-    if (invert) {
-      or_vector_bit(out, i * 2, read_vector_bit(in, i));
-      or_vector_bit(out, i * 2 + 1, read_vector_bit(in, i + (bit_width / 2)));
-    } else {
-      or_vector_bit(out, i, read_vector_bit(in, i * 2));
-      or_vector_bit(out, i + (bit_width / 2), read_vector_bit(in, i * 2 + 1));
-    }
+// Apply butterfly to in. Even bits are placed in the lower half of the output,
+// odd bits are placed in the upper half of the output.
+static uint64_t scramble_perm_layer(uint64_t in, uint32_t bit_width,
+                                    bool invert) {
+  uint32_t half_width = bit_width / 2;
+  uint64_t half_mask = low_mask(half_width);
+
+  uint64_t out;
+  if (invert) {
+    out = spread_even_bits(in & half_mask) |
+          (spread_even_bits((in >> half_width) & half_mask) << 1);
+  } else {
+    uint64_t body = in & low_mask(2 * half_width);
+    out = gather_even_bits(body) | (gather_even_bits(body >> 1) << half_width);
   }
 
   if (bit_width % 2) {
     // Where bit_width isn't even, the final bit is copied across to the same
     // position
-    or_vector_bit(out, bit_width - 1, read_vector_bit(in, bit_width - 1));
+    out |= in & ((uint64_t)1 << (bit_width - 1));
   }
 
   return out;
 }
 
-// Apply a full set of subsitution/permutation rounds for encrypt to the
-// incoming byte vector
-static std::vector<uint8_t> scramble_subst_perm_enc(
-    const std::vector<uint8_t> &in, const std::vector<uint8_t> &key,
-    uint32_t bit_width, uint32_t num_rounds) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  assert(key.size() == ((bit_width + 7) / 8));
+// Apply a full set of subsitution/permutation rounds for encrypt to in
+static uint64_t scramble_subst_perm_enc(uint64_t in, uint64_t key,
+                                        uint32_t bit_width,
+                                        uint32_t num_rounds) {
+  assert(0 < bit_width && bit_width <= 64);
 
-  std::vector<uint8_t> state(in);
+  uint64_t state = in & low_mask(bit_width);
 
-  for (int i = 0; i < num_rounds; ++i) {
-    state = xor_vectors(state, key);
+  for (uint32_t i = 0; i < num_rounds; ++i) {
+    state ^= key;
 
-    state = scramble_sbox_layer(state, bit_width, PRESENT_SBOX4);
+    state = scramble_sbox_layer(state, bit_width, kTables.sbox);
     state = scramble_flip_layer(state, bit_width);
     state = scramble_perm_layer(state, bit_width, false);
   }
 
-  state = xor_vectors(state, key);
-
-  return state;
+  return state ^ key;
 }
 
-// Apply a full set of substitution/permutation rounds for decrypt to the
-// incoming byte vector
-static std::vector<uint8_t> scramble_subst_perm_dec(
-    const std::vector<uint8_t> &in, const std::vector<uint8_t> &key,
-    uint32_t bit_width, uint32_t num_rounds) {
-  assert(in.size() == ((bit_width + 7) / 8));
-  assert(key.size() == ((bit_width + 7) / 8));
+// Apply a full set of substitution/permutation rounds for decrypt to in
+static uint64_t scramble_subst_perm_dec(uint64_t in, uint64_t key,
+                                        uint32_t bit_width,
+                                        uint32_t num_rounds) {
+  assert(0 < bit_width && bit_width <= 64);
 
-  std::vector<uint8_t> state(in);
+  uint64_t state = in & low_mask(bit_width);
 
-  for (int i = 0; i < num_rounds; ++i) {
-    state = xor_vectors(state, key);
+  for (uint32_t i = 0; i < num_rounds; ++i) {
+    state ^= key;
 
     state = scramble_perm_layer(state, bit_width, true);
     state = scramble_flip_layer(state, bit_width);
-    state = scramble_sbox_layer(state, bit_width, PRESENT_SBOX4_INV);
+    state = scramble_sbox_layer(state, bit_width, kTables.sbox_inv);
   }
 
-  state = xor_vectors(state, key);
-
-  return state;
+  return state ^ key;
 }
 
-// Generate a keystream for XORing with data using PRINCE.
-// If repeat_keystream is set to true, the output from one PRINCE instance is
-// repeated when the keystream is greater than a single PRINCE width (64bit).
-// Otherwise, multiple PRINCEs are instantiated to form the keystream.
-static std::vector<uint8_t> scramble_gen_keystream(
-    const std::vector<uint8_t> &addr, uint32_t addr_width,
-    const std::vector<uint8_t> &nonce, const std::vector<uint8_t> &key,
-    uint32_t keystream_width, uint32_t num_half_rounds, bool repeat_keystream) {
-  assert(key.size() == (kPrinceWidthByte * 2));
-
-  // Determine how many PRINCE replications are required
-  uint32_t num_princes, num_repetitions;
-  if (repeat_keystream) {
-    num_princes = 1;
-    num_repetitions = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
-  } else {
-    num_princes = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
-    num_repetitions = 1;
+// The nonce bits of the initial vectors that PRINCE encrypts to generate a
+// keystream. These don't depend on the address, so can be computed once and
+// then used for many words.
+namespace {
+struct KeystreamIvs {
+  uint32_t addr_bits;
+  uint64_t nonce_part[kScrMaxDataWords];
+};
+}  // namespace
+
+// Compute the nonce bits of the initial vectors for a keystream of
+// keystream_width bits.
+static void scramble_keystream_ivs(KeystreamIvs *ivs, uint32_t addr_width,
+                                   const uint64_t *nonce,
+                                   uint32_t keystream_width,
+                                   bool repeat_keystream) {
+  uint32_t num_princes =
+      repeat_keystream ? 1
+                       : (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
+
+  ivs->addr_bits = std::min(addr_width, kPrinceWidth);
+  uint32_t nonce_bits = kPrinceWidth - ivs->addr_bits;
+
+  // The bottom addr_width bits of each initial vector are the address and the
+  // other bits are taken from nonce. Each PRINCE instantiation uses different
+  // nonce bits.
+  for (uint32_t i = 0; i < num_princes; ++i) {
+    ivs->nonce_part[i] =
+        nonce_bits ? read_packed_bits(nonce, i * nonce_bits, nonce_bits)
+                         << ivs->addr_bits
+                   : 0;
   }
+}
 
-  std::vector<uint8_t> keystream;
-
-  for (int i = 0; i < num_princes; ++i) {
-    // Initial vector is data for PRINCE to encrypt. Formed from nonce and data
-    // address
-    std::vector<uint8_t> iv(8, 0);
-
-    for (int j = 0; j < kPrinceWidth; ++j) {
-      if (j < addr_width) {
-        // Bottom addr_width bits of IV are address
-        or_vector_bit(iv, j, read_vector_bit(addr, j));
-      } else {
-        // Other bits are taken from nonce. Each PRINCE instantiation will use
-        // different nonce bits.
-        int nonce_bit = (j - addr_width) + i * (kPrinceWidth - addr_width);
-        or_vector_bit(iv, j, read_vector_bit(nonce, nonce_bit));
-      }
-    }
-
-    // PRINCE C reference model works on big-endian byte order
-    iv = byte_reverse_vector(iv);
-    auto key_be = byte_reverse_vector(key);
-
-    // Apply PRINCE to IV to produce keystream
-    std::vector<uint8_t> keystream_block(kPrinceWidthByte);
-    prince_enc_dec(&iv[0], &key_be[0], &keystream_block[0], 0, num_half_rounds,
-                   0);
-
-    // Flip keystream into little endian order and add to keystream vector
-    keystream_block = byte_reverse_vector(keystream_block);
-    // Repeat the output of a single PRINCE instance if needed
-    for (int k = 0; k < num_repetitions; ++k) {
-      keystream.insert(keystream.end(), keystream_block.begin(),
-                       keystream_block.end());
+// Generate a keystream of keystream_width bits for XORing with data using
+// PRINCE, writing it to keystream. If repeat_keystream is set to true, the
+// output from one PRINCE instance is repeated when the keystream is greater
+// than a single PRINCE width (64bit). Otherwise, multiple PRINCEs are
+// instantiated to form the keystream.
+static void scramble_gen_keystream(uint64_t *keystream, uint64_t addr,
+                                   const KeystreamIvs &ivs,
+                                   const ScramblePrinceKey &key,
+                                   uint32_t keystream_width,
+                                   uint32_t num_half_rounds,
+                                   bool repeat_keystream) {
+  uint32_t num_words = (keystream_width + kPrinceWidth - 1) / kPrinceWidth;
+  uint64_t addr_part = addr & low_mask(ivs.addr_bits);
+
+  for (uint32_t i = 0; i < num_words; ++i) {
+    if (repeat_keystream && i > 0) {
+      keystream[i] = keystream[0];
+      continue;
     }
-  }
 
-  // Total keystream bits generated are some multiple of kPrinceWidth. This can
-  // result in unused keystream bits. Remove the unused bytes from the keystream
-  // vector and zero out top unused bits in the final byte if required.
-  uint32_t keystream_bytes = (keystream_width + 7) / 8;
-  uint32_t keystream_bytes_to_erase = keystream.size() - keystream_bytes;
-  if (keystream_bytes_to_erase) {
-    keystream.erase(keystream.end() - keystream_bytes_to_erase,
-                    keystream.end());
+    uint64_t iv = addr_part | ivs.nonce_part[i];
+    keystream[i] =
+        prince_enc_dec_uint64(iv, key.k0, key.k1, 0, num_half_rounds, 0);
   }
 
-  if (keystream_width % 8) {
-    keystream[keystream.size() - 1] &= (1 << (keystream_width % 8)) - 1;
+  // Zero out top unused bits in the final word if required.
+  if (keystream_width % 64) {
+    keystream[num_words - 1] &= low_mask(keystream_width % 64);
   }
-
-  return keystream;
 }
 
 // Split incoming data into subst_perm_width chunks and individually apply the
 // substitution/permutation layer to each
-static std::vector<uint8_t> scramble_subst_perm_full_width(
-    const std::vector<uint8_t> &in, uint32_t bit_width,
-    uint32_t subst_perm_width, bool enc) {
-  assert(in.size() == ((bit_width + 7) / 8));
-
-  // Determine how many bytes each subst_perm_width chunk is and how many
-  // chunks are needed to cover the full bit_width.
-  uint32_t subst_perm_bytes = (subst_perm_width + 7) / 8;
+static void scramble_subst_perm_full_width(const uint64_t *in, uint64_t *out,
+                                           uint32_t bit_width,
+                                           uint32_t subst_perm_width,
+                                           bool enc) {
+  assert(0 < subst_perm_width && subst_perm_width <= 64);
+
+  uint32_t num_words = (bit_width + 63) / 64;
   uint32_t subst_perm_blocks =
       (bit_width + subst_perm_width - 1) / subst_perm_width;
 
-  std::vector<uint8_t> out(in.size(), 0);
-  std::vector<uint8_t> zero_key(subst_perm_bytes, 0);
+  // Work on a copy in case in and out are the same array
+  uint64_t tmp[kScrMaxDataWords] = {0};
 
   auto sp_scrambler = enc ? scramble_subst_perm_enc : scramble_subst_perm_dec;
 
-  for (int i = 0; i < subst_perm_blocks; ++i) {
+  for (uint32_t i = 0; i < subst_perm_blocks; ++i) {
     // Where bit_width does not evenly divide into subst_perm_width the
     // final block is smaller.
-    uint32_t bits_so_far = subst_perm_width * i;
-    uint32_t block_width = std::min(subst_perm_width, bit_width - bits_so_far);
+    uint32_t lsb = subst_perm_width * i;
+    uint32_t block_width = std::min(subst_perm_width, bit_width - lsb);
 
-    std::vector<uint8_t> subst_perm_data(subst_perm_bytes, 0);
+    uint64_t block = read_packed_bits(in, lsb, block_width);
+    uint64_t block_out =
+        sp_scrambler(block, 0, block_width, kNumDataSubstPermRounds);
+    or_packed_bits(tmp, lsb, block_width, block_out);
+  }
 
-    // Extract bits from in for this chunk
-    for (int j = 0; j < block_width; ++j) {
-      or_vector_bit(subst_perm_data, j,
-                    read_vector_bit(in, j + i * subst_perm_width));
-    }
+  std::copy(tmp, tmp + num_words, out);
+}
 
-    // Apply the substitution/permutation layer to the chunk
-    auto subst_perm_out = sp_scrambler(subst_perm_data, zero_key, block_width,
-                                       kNumDataSubstPermRounds);
+uint64_t scramble_addr_packed(uint64_t addr, uint32_t addr_width,
+                              const uint64_t *nonce, uint32_t nonce_width) {
+  assert(addr_width <= nonce_width);
 
-    // Write the result to the `out` vector
-    for (int j = 0; j < block_width; ++j) {
-      or_vector_bit(out, j + i * subst_perm_width,
-                    read_vector_bit(subst_perm_out, j));
-    }
+  // Address is scrambled by using substitution/permutation layer with the nonce
+  // used as a key.
+  uint64_t addr_enc_nonce =
+      read_packed_bits(nonce, nonce_width - addr_width, addr_width);
+
+  return scramble_subst_perm_enc(addr, addr_enc_nonce, addr_width,
+                                 kNumAddrSubstPermRounds);
+}
+
+// Encrypt one word of data, using keystream initial vectors from
+// scramble_keystream_ivs
+static void scramble_encrypt_word(const uint64_t *data_in, uint64_t *data_out,
+                                  uint32_t data_width,
+                                  uint32_t subst_perm_width, uint64_t addr,
+                                  const KeystreamIvs &ivs,
+                                  const ScramblePrinceKey &key,
+                                  bool repeat_keystream) {
+  // Data is encrypted by XORing with keystream then applying
+  // substitution/permutation layer
+  uint64_t data_enc[kScrMaxDataWords];
+  scramble_gen_keystream(data_enc, addr, ivs, key, data_width,
+                         kNumPrinceHalfRounds, repeat_keystream);
+
+  for (uint32_t i = 0; i < (data_width + 63) / 64; ++i) {
+    data_enc[i] ^= data_in[i];
   }
 
-  return out;
+  scramble_subst_perm_full_width(data_enc, data_out, data_width,
+                                 subst_perm_width, true);
+}
+
+// Decrypt one word of data, using keystream initial vectors from
+// scramble_keystream_ivs
+static void scramble_decrypt_word(const uint64_t *data_in, uint64_t *data_out,
+                                  uint32_t data_width,
+                                  uint32_t subst_perm_width, uint64_t addr,
+                                  const KeystreamIvs &ivs,
+                                  const ScramblePrinceKey &key,
+                                  bool repeat_keystream) {
+  // Data is decrypted by reversing substitution/permutation layer then XORing
+  // with keystream
+  uint64_t keystream[kScrMaxDataWords];
+  scramble_gen_keystream(keystream, addr, ivs, key, data_width,
+                         kNumPrinceHalfRounds, repeat_keystream);
+
+  scramble_subst_perm_full_width(data_in, data_out, data_width,
+                                 subst_perm_width, false);
+
+  for (uint32_t i = 0; i < (data_width + 63) / 64; ++i) {
+    data_out[i] ^= keystream[i];
+  }
+}
+
+void scramble_encrypt_data_packed(const uint64_t *data_in, uint64_t *data_out,
+                                  uint32_t data_width,
+                                  uint32_t subst_perm_width, uint64_t addr,
+                                  uint32_t addr_width, const uint64_t *nonce,
+                                  const ScramblePrinceKey &key,
+                                  bool repeat_keystream) {
+  scramble_encrypt_data_batch(data_in, data_out, 1, data_width,
+                              subst_perm_width, addr, addr_width, nonce, key,
+                              repeat_keystream);
+}
+
+void scramble_decrypt_data_packed(const uint64_t *data_in, uint64_t *data_out,
+                                  uint32_t data_width,
+                                  uint32_t subst_perm_width, uint64_t addr,
+                                  uint32_t addr_width, const uint64_t *nonce,
+                                  const ScramblePrinceKey &key,
+                                  bool repeat_keystream) {
+  scramble_decrypt_data_batch(data_in, data_out, 1, data_width,
+                              subst_perm_width, addr, addr_width, nonce, key,
+                              repeat_keystream);
+}
+
+void scramble_encrypt_data_batch(const uint64_t *data_in, uint64_t *data_out,
+                                 uint32_t num_words, uint32_t data_width,
+                                 uint32_t subst_perm_width, uint64_t first_addr,
+                                 uint32_t addr_width, const uint64_t *nonce,
+                                 const ScramblePrinceKey &key,
+                                 bool repeat_keystream) {
+  assert(0 < data_width && data_width <= kScrMaxDataWidth);
+
+  KeystreamIvs ivs;
+  scramble_keystream_ivs(&ivs, addr_width, nonce, data_width,
+                         repeat_keystream);
+
+  uint32_t stride = (data_width + 63) / 64;
+  for (uint32_t i = 0; i < num_words; ++i) {
+    scramble_encrypt_word(data_in + i * stride, data_out + i * stride,
+                          data_width, subst_perm_width, first_addr + i, ivs,
+                          key, repeat_keystream);
+  }
+}
+
+void scramble_decrypt_data_batch(const uint64_t *data_in, uint64_t *data_out,
+                                 uint32_t num_words, uint32_t data_width,
+                                 uint32_t subst_perm_width, uint64_t first_addr,
+                                 uint32_t addr_width, const uint64_t *nonce,
+                                 const ScramblePrinceKey &key,
+                                 bool repeat_keystream) {
+  assert(0 < data_width && data_width <= kScrMaxDataWidth);
+
+  KeystreamIvs ivs;
+  scramble_keystream_ivs(&ivs, addr_width, nonce, data_width,
+                         repeat_keystream);
+
+  uint32_t stride = (data_width + 63) / 64;
+  for (uint32_t i = 0; i < num_words; ++i) {
+    scramble_decrypt_word(data_in + i * stride, data_out + i * stride,
+                          data_width, subst_perm_width, first_addr + i, ivs,
+                          key, repeat_keystream);
+  }
+}
+
+// Helpers to convert between little endian byte vectors and packed vectors.
+// The packed vector must have room for (8 * vec.size() + 63) / 64 words.
+static void pack_vector(const std::vector<uint8_t> &vec, uint64_t *packed) {
+  std::fill(packed, packed + (vec.size() + 7) / 8, 0);
+  for (size_t i = 0; i < vec.size(); ++i) {
+    packed[i / 8] |= (uint64_t)vec[i] << (8 * (i % 8));
+  }
+}
+
+static std::vector<uint8_t> unpack_vector(const uint64_t *packed,
+                                          uint32_t bit_width) {
+  std::vector<uint8_t> vec((bit_width + 7) / 8);
+  for (size_t i = 0; i < vec.size(); ++i) {
+    vec[i] = (packed[i / 8] >> (8 * (i % 8))) & 0xff;
+  }
+  return vec;
+}
+
+static uint64_t pack_addr(const std::vector<uint8_t> &addr,
+                          uint32_t addr_width) {
+  assert(addr.size() == ((addr_width + 7) / 8));
+  assert(addr.size() <= 8);
+
+  uint64_t packed;
+  pack_vector(addr, &packed);
+  return packed;
+}
+
+ScramblePrinceKey scramble_prince_key(const std::vector<uint8_t> &key) {
+  assert(key.size() == (kPrinceWidthByte * 2));
+
+  ScramblePrinceKey ret = {0, 0};
+  for (uint32_t i = 0; i < kPrinceWidthByte; ++i) {
+    ret.k1 |= (uint64_t)key[i] << (8 * i);
+    ret.k0 |= (uint64_t)key[i + kPrinceWidthByte] << (8 * i);
+  }
+
+  return ret;
 }
 
 std::vector<uint8_t> scramble_addr(const std::vector<uint8_t> &addr_in,
                                    uint32_t addr_width,
                                    const std::vector<uint8_t> &nonce,
                                    uint32_t nonce_width) {
-  assert(addr_in.size() == ((addr_width + 7) / 8));
+  std::vector<uint64_t> nonce_packed((nonce.size() + 7) / 8);
+  pack_vector(nonce, nonce_packed.data());
 
-  std::vector<uint8_t> addr_enc_nonce(addr_in.size(), 0);
+  uint64_t addr_out =
+      scramble_addr_packed(pack_addr(addr_in, addr_width), addr_width,
+                           nonce_packed.data(), nonce_width);
 
-  // Address is scrambled by using substitution/permutation layer with the nonce
-  // used as a key.
-  // Extract relevant nonce bits for key
-  for (int i = 0; i < addr_width; ++i) {
-    or_vector_bit(addr_enc_nonce, i,
-                  read_vector_bit(nonce, nonce_width - addr_width + i));
-  }
-
-  // Apply substitution/permutation layer
-  return scramble_subst_perm_enc(addr_in, addr_enc_nonce, addr_width,
-                                 kNumAddrSubstPermRounds);
+  return unpack_vector(&addr_out, addr_width);
 }
 
 std::vector<uint8_t> scramble_encrypt_data(
@@ -323,20 +478,29 @@ std::vector<uint8_t> scramble_encrypt_data(
     uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
     uint32_t addr_width, const std::vector<uint8_t> &nonce,
     const std::vector<uint8_t> &key, bool repeat_keystream) {
-  assert(data_in.size() == ((data_width + 7) / 8));
-  assert(addr.size() == ((addr_width + 7) / 8));
+  return scramble_encrypt_data(data_in, data_width, subst_perm_width, addr,
+                               addr_width, nonce, scramble_prince_key(key),
+                               repeat_keystream);
+}
 
-  // Data is encrypted by XORing with keystream then applying
-  // substitution/permutation layer
+std::vector<uint8_t> scramble_encrypt_data(
+    const std::vector<uint8_t> &data_in, uint32_t data_width,
+    uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
+    uint32_t addr_width, const std::vector<uint8_t> &nonce,
+    const ScramblePrinceKey &key, bool repeat_keystream) {
+  assert(data_in.size() == ((data_width + 7) / 8));
+  assert(data_width <= kScrMaxDataWidth);
 
-  auto keystream =
-      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
-                             kNumPrinceHalfRounds, repeat_keystream);
+  uint64_t data[kScrMaxDataWords];
+  std::vector<uint64_t> nonce_packed((nonce.size() + 7) / 8);
+  pack_vector(data_in, data);
+  pack_vector(nonce, nonce_packed.data());
 
-  auto data_enc = xor_vectors(data_in, keystream);
+  scramble_encrypt_data_packed(data, data, data_width, subst_perm_width,
+                               pack_addr(addr, addr_width), addr_width,
+                               nonce_packed.data(), key, repeat_keystream);
 
-  return scramble_subst_perm_full_width(data_enc, data_width, subst_perm_width,
-                                        true);
+  return unpack_vector(data, data_width);
 }
 
 std::vector<uint8_t> scramble_decrypt_data(
@@ -344,19 +508,27 @@ std::vector<uint8_t> scramble_decrypt_data(
     uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
     uint32_t addr_width, const std::vector<uint8_t> &nonce,
     const std::vector<uint8_t> &key, bool repeat_keystream) {
-  assert(data_in.size() == ((data_width + 7) / 8));
-  assert(addr.size() == ((addr_width + 7) / 8));
+  return scramble_decrypt_data(data_in, data_width, subst_perm_width, addr,
+                               addr_width, nonce, scramble_prince_key(key),
+                               repeat_keystream);
+}
 
-  // Data is decrypted by reversing substitution/permutation layer then XORing
-  // with keystream
-  auto data_sp_out = scramble_subst_perm_full_width(data_in, data_width,
-                                                    subst_perm_width, false);
+std::vector<uint8_t> scramble_decrypt_data(
+    const std::vector<uint8_t> &data_in, uint32_t data_width,
+    uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
+    uint32_t addr_width, const std::vector<uint8_t> &nonce,
+    const ScramblePrinceKey &key, bool repeat_keystream) {
+  assert(data_in.size() == ((data_width + 7) / 8));
+  assert(data_width <= kScrMaxDataWidth);
 
-  auto keystream =
-      scramble_gen_keystream(addr, addr_width, nonce, key, data_width,
-                             kNumPrinceHalfRounds, repeat_keystream);
+  uint64_t data[kScrMaxDataWords];
+  std::vector<uint64_t> nonce_packed((nonce.size() + 7) / 8);
+  pack_vector(data_in, data);
+  pack_vector(nonce, nonce_packed.data());
 
-  auto data_dec = xor_vectors(data_sp_out, keystream);
+  scramble_decrypt_data_packed(data, data, data_width, subst_perm_width,
+                               pack_addr(addr, addr_width), addr_width,
+                               nonce_packed.data(), key, repeat_keystream);
 
-  return data_dec;
+  return unpack_vector(data, data_width);
 }
@@ -11,9 +11,33 @@
 const uint32_t kPrinceWidth = 64;
 const uint32_t kPrinceWidthByte = kPrinceWidth / 8;
 
+// Maximum data width supported by the scrambling functions. The width of the
+// substitution/permutation network (the address width for address scrambling
+// and subst_perm_width for data scrambling) is limited to 64 bits.
+const uint32_t kScrMaxDataWidth = 512;
+const uint32_t kScrMaxDataWords = kScrMaxDataWidth / 64;
+
 // C++ model of memory scrambling. All byte vectors are in little endian byte
 // order (least significant byte at index 0).
 
+/** The two 64-bit halves of a PRINCE key, as used by the cipher.
+ *
+ * The scrambling functions take the key as a little endian byte vector. Code
+ * that scrambles many words with the same key can convert the key once with
+ * scramble_prince_key() and use the overloads below that take this struct.
+ */
+struct ScramblePrinceKey {
+  uint64_t k0;  ///< Bits 127:64 of the key
+  uint64_t k1;  ///< Bits 63:0 of the key
+};
+
+/** Split a scrambling key into its PRINCE key halves
+ *
+ * @param key  Byte vector of scrambling key (2 * kPrinceWidthByte bytes)
+ * @return The key halves
+ */
+ScramblePrinceKey scramble_prince_key(const std::vector<uint8_t> &key);
+
 /** Scramble an address to give the physical address used to access the
  * scrambled memory. Return vector of scrambled address bytes
  *
@@ -48,6 +72,17 @@ std::vector<uint8_t> scramble_decrypt_data(
     uint32_t addr_width, const std::vector<uint8_t> &nonce,
     const std::vector<uint8_t> &key, bool repeat_keystream);
 
+/** Decrypt scrambled data with a precomputed PRINCE key
+ *
+ * This is equivalent to the function above, but takes the key in the form
+ * returned by scramble_prince_key().
+ */
+std::vector<uint8_t> scramble_decrypt_data(
+    const std::vector<uint8_t> &data_in, uint32_t data_width,
+    uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
+    uint32_t addr_width, const std::vector<uint8_t> &nonce,
+    const ScramblePrinceKey &key, bool repeat_keystream);
+
 /** Encrypt scrambled data
  * @param data_in          Byte vector of data to encrypt
  * @param data_width       Width of data in bits
@@ -68,4 +103,84 @@ std::vector<uint8_t> scramble_encrypt_data(
     uint32_t addr_width, const std::vector<uint8_t> &nonce,
     const std::vector<uint8_t> &key, bool repeat_keystream);
 
+/** Encrypt scrambled data with a precomputed PRINCE key
+ *
+ * This is equivalent to the function above, but takes the key in the form
+ * returned by scramble_prince_key().
+ */
+std::vector<uint8_t> scramble_encrypt_data(
+    const std::vector<uint8_t> &data_in, uint32_t data_width,
+    uint32_t subst_perm_width, const std::vector<uint8_t> &addr,
+    uint32_t addr_width, const std::vector<uint8_t> &nonce,
+    const ScramblePrinceKey &key, bool repeat_keystream);
+
+// Packed interface to the scrambling model. Data and nonces are little endian
+// arrays of 64-bit words (bits 63:0 are in word 0) and addresses are integers.
+// These functions don't allocate, and the byte vector functions above are
+// wrappers around them.
+
+/** Scramble an address to give the physical address used to access the
+ * scrambled memory.
+ *
+ * @param addr         Address (bits above addr_width are ignored)
+ * @param addr_width   Width of the address in bits (at most 64)
+ * @param nonce        Packed scrambling nonce
+ * @param nonce_width  Width of scramble nonce in bits
+ * @return Scrambled address
+ */
+uint64_t scramble_addr_packed(uint64_t addr, uint32_t addr_width,
+                              const uint64_t *nonce, uint32_t nonce_width);
+
+/** Decrypt scrambled data
+ *
+ * data_in and data_out hold (data_width + 63) / 64 words and may be the same
+ * array. Bits of data_out above data_width are zero. Other parameters are as
+ * for scramble_decrypt_data.
+ */
+void scramble_decrypt_data_packed(const uint64_t *data_in, uint64_t *data_out,
+                                  uint32_t data_width,
+                                  uint32_t subst_perm_width, uint64_t addr,
+                                  uint32_t addr_width, const uint64_t *nonce,
+                                  const ScramblePrinceKey &key,
+                                  bool repeat_keystream);
+
+/** Encrypt scrambled data
+ *
+ * data_in and data_out hold (data_width + 63) / 64 words and may be the same
+ * array. Bits of data_out above data_width are zero. Other parameters are as
+ * for scramble_encrypt_data.
+ */
+void scramble_encrypt_data_packed(const uint64_t *data_in, uint64_t *data_out,
+                                  uint32_t data_width,
+                                  uint32_t subst_perm_width, uint64_t addr,
+                                  uint32_t addr_width, const uint64_t *nonce,
+                                  const ScramblePrinceKey &key,
+                                  bool repeat_keystream);
+
+/** Decrypt a batch of words with consecutive addresses
+ *
+ * data_in and data_out are flat buffers of num_words words, each packed into
+ * (data_width + 63) / 64 64-bit words. The word at index i has address
+ * first_addr + i. The buffers may be the same. Work that doesn't depend on the
+ * address is done once for the whole batch. Other parameters are as for
+ * scramble_decrypt_data_packed.
+ */
+void scramble_decrypt_data_batch(const uint64_t *data_in, uint64_t *data_out,
+                                 uint32_t num_words, uint32_t data_width,
+                                 uint32_t subst_perm_width, uint64_t first_addr,
+                                 uint32_t addr_width, const uint64_t *nonce,
+                                 const ScramblePrinceKey &key,
+                                 bool repeat_keystream);
+
+/** Encrypt a batch of words with consecutive addresses
+ *
+ * This is the counterpart of scramble_decrypt_data_batch.
+ */
+void scramble_encrypt_data_batch(const uint64_t *data_in, uint64_t *data_out,
+                                 uint32_t num_words, uint32_t data_width,
+                                 uint32_t subst_perm_width, uint64_t first_addr,
+                                 uint32_t addr_width, const uint64_t *nonce,
+                                 const ScramblePrinceKey &key,
+                                 bool repeat_keystream);
+
 #endif  // OPENTITAN_HW_IP_PRIM_DV_PRIM_RAM_SCR_CPP_SCRAMBLE_MODEL_H_
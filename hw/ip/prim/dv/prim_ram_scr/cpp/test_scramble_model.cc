@@ -0,0 +1,197 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Test of the memory scrambling model, run by the DV model tests in
+// hw/meson.build.
+//
+// The byte vector functions are checked against known answers, which were
+// generated by the original byte-at-a-time model. The packed and batched
+// functions are checked against the byte vector functions, word by word.
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+#include "hw/dv/verilator/cpp/test_check.h"
+#include "hw/ip/prim/dv/prim_ram_scr/cpp/scramble_model.h"
+
+struct TestConfig {
+  uint32_t data_width;
+  uint32_t subst_perm_width;
+  uint32_t addr_width;
+  bool repeat_keystream;
+  // FNV-1a hashes of the outputs of the original model
+  uint64_t data_hash;
+  uint64_t addr_hash;
+};
+
+static const TestConfig kConfigs[] = {
+    {32, 32, 10, true, 0xaa5d8992d4560e79, 0xac7537967fbdce05},
+    {39, 39, 10, true, 0x11ec9aa35cacae83, 0x3fcda0ca10bcc325},
+    {39, 39, 15, false, 0x9023ce2ea08afe17, 0x20352da0c6e98ad9},
+    {40, 40, 13, true, 0x4064c1e506cd992c, 0x3503c5cd5413dd7e},
+    {64, 8, 12, false, 0x62a24d838f1e985f, 0xcbf415d9ccaad8f6},
+    {78, 39, 10, true, 0xdcab0c7d73601ae3, 0xfa9874f27ab99e55},
+    {156, 39, 14, false, 0x3c318d5accb7d5e0, 0x6ff23c9c75c7b3c2},
+    {156, 39, 9, true, 0x7ab40213730e130d, 0x93d4902eaaa04295},
+    {312, 39, 11, false, 0x1153fc061123d231, 0x58a17acaa1543cdf},
+};
+
+static const uint32_t kNonceWidth = 320;
+static const uint32_t kNumWords = 32;
+static const uint32_t kNumAddrs = 1024;
+
+static uint64_t rand_state;
+
+// xorshift64, so that the inputs don't depend on the C library
+static uint64_t next_rand() {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return rand_state;
+}
+
+static std::vector<uint8_t> rand_bytes(uint32_t width) {
+  std::vector<uint8_t> bytes((width + 7) / 8);
+  for (uint8_t &byte : bytes) {
+    byte = next_rand() >> 56;
+  }
+  if (width % 8) {
+    bytes.back() &= (1 << (width % 8)) - 1;
+  }
+  return bytes;
+}
+
+static std::vector<uint8_t> addr_bytes(uint64_t addr, uint32_t addr_width) {
+  std::vector<uint8_t> bytes((addr_width + 7) / 8);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = addr >> (8 * i);
+  }
+  return bytes;
+}
+
+static void hash_bytes(uint64_t *hash, const std::vector<uint8_t> &bytes) {
+  for (uint8_t byte : bytes) {
+    *hash = (*hash ^ byte) * 0x100000001b3;
+  }
+}
+
+static std::vector<uint64_t> packed(const std::vector<uint8_t> &bytes,
+                                    uint32_t width) {
+  std::vector<uint64_t> words((width + 63) / 64, 0);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    words[i / 8] |= (uint64_t)bytes[i] << (8 * (i % 8));
+  }
+  return words;
+}
+
+// Check ok, naming the configuration if it fails
+static void check(bool ok, const TestConfig &cfg, const char *what) {
+  TEST_CHECK(ok,
+             "%s (data_width %u, subst_perm_width %u, addr_width %u, %s)",
+             what, cfg.data_width, cfg.subst_perm_width, cfg.addr_width,
+             cfg.repeat_keystream ? "repeat" : "multi");
+}
+
+static void test_config(const TestConfig &cfg, uint64_t seed) {
+  rand_state = seed;
+  std::vector<uint8_t> key = rand_bytes(2 * kPrinceWidth);
+  std::vector<uint8_t> nonce = rand_bytes(kNonceWidth);
+  std::vector<uint64_t> nonce_packed = packed(nonce, kNonceWidth);
+  ScramblePrinceKey prince_key = scramble_prince_key(key);
+  uint32_t data_words = (cfg.data_width + 63) / 64;
+  uint64_t addr_mask = cfg.addr_width == 64 ? ~0ull
+                                            : (1ull << cfg.addr_width) - 1;
+
+  // Encrypt and decrypt a run of words with consecutive addresses
+  uint64_t first_addr = next_rand() & addr_mask;
+  std::vector<uint64_t> plain(kNumWords * data_words);
+  std::vector<uint64_t> enc_expected(kNumWords * data_words);
+  std::vector<uint64_t> dec_expected(kNumWords * data_words);
+  uint64_t data_hash = 0xcbf29ce484222325;
+  for (uint32_t i = 0; i < kNumWords; ++i) {
+    uint64_t addr = (first_addr + i) & addr_mask;
+    std::vector<uint8_t> addr_vec = addr_bytes(addr, cfg.addr_width);
+    std::vector<uint8_t> data = rand_bytes(cfg.data_width);
+
+    std::vector<uint8_t> enc = scramble_encrypt_data(
+        data, cfg.data_width, cfg.subst_perm_width, addr_vec, cfg.addr_width,
+        nonce, key, cfg.repeat_keystream);
+    std::vector<uint8_t> dec = scramble_decrypt_data(
+        data, cfg.data_width, cfg.subst_perm_width, addr_vec, cfg.addr_width,
+        nonce, key, cfg.repeat_keystream);
+    hash_bytes(&data_hash, enc);
+    hash_bytes(&data_hash, dec);
+
+    check(scramble_encrypt_data(data, cfg.data_width, cfg.subst_perm_width,
+                                addr_vec, cfg.addr_width, nonce, prince_key,
+                                cfg.repeat_keystream) == enc,
+          cfg, "encrypt with precomputed key");
+    check(scramble_decrypt_data(enc, cfg.data_width, cfg.subst_perm_width,
+                                addr_vec, cfg.addr_width, nonce, key,
+                                cfg.repeat_keystream) == data,
+          cfg, "decrypt(encrypt(data)) == data");
+
+    // The packed functions give the same results
+    std::vector<uint64_t> data_packed = packed(data, cfg.data_width);
+    std::vector<uint64_t> out(data_words);
+    scramble_encrypt_data_packed(data_packed.data(), out.data(),
+                                 cfg.data_width, cfg.subst_perm_width, addr,
+                                 cfg.addr_width, nonce_packed.data(),
+                                 prince_key, cfg.repeat_keystream);
+    check(out == packed(enc, cfg.data_width), cfg, "packed encrypt");
+    scramble_decrypt_data_packed(data_packed.data(), out.data(),
+                                 cfg.data_width, cfg.subst_perm_width, addr,
+                                 cfg.addr_width, nonce_packed.data(),
+                                 prince_key, cfg.repeat_keystream);
+    check(out == packed(dec, cfg.data_width), cfg, "packed decrypt");
+
+    std::copy(data_packed.begin(), data_packed.end(),
+              plain.begin() + i * data_words);
+    std::vector<uint64_t> enc_packed = packed(enc, cfg.data_width);
+    std::copy(enc_packed.begin(), enc_packed.end(),
+              enc_expected.begin() + i * data_words);
+    std::vector<uint64_t> dec_packed = packed(dec, cfg.data_width);
+    std::copy(dec_packed.begin(), dec_packed.end(),
+              dec_expected.begin() + i * data_words);
+  }
+  check(cfg.data_hash == data_hash, cfg, "data matches the original model");
+
+  // The batch functions give the same results, including in place
+  std::vector<uint64_t> batch(plain.size());
+  scramble_encrypt_data_batch(plain.data(), batch.data(), kNumWords,
+                              cfg.data_width, cfg.subst_perm_width, first_addr,
+                              cfg.addr_width, nonce_packed.data(), prince_key,
+                              cfg.repeat_keystream);
+  check(batch == enc_expected, cfg, "batch encrypt");
+  batch = plain;
+  scramble_decrypt_data_batch(batch.data(), batch.data(), kNumWords,
+                              cfg.data_width, cfg.subst_perm_width, first_addr,
+                              cfg.addr_width, nonce_packed.data(), prince_key,
+                              cfg.repeat_keystream);
+  check(batch == dec_expected, cfg, "batch decrypt in place");
+
+  // Address scrambling
+  uint64_t addr_hash = 0xcbf29ce484222325;
+  for (uint64_t i = 0; i < kNumAddrs && i <= addr_mask; ++i) {
+    uint64_t addr = (first_addr + i) & addr_mask;
+    std::vector<uint8_t> phys_vec = scramble_addr(
+        addr_bytes(addr, cfg.addr_width), cfg.addr_width, nonce, kNonceWidth);
+    hash_bytes(&addr_hash, phys_vec);
+
+    uint64_t phys = scramble_addr_packed(addr, cfg.addr_width,
+                                         nonce_packed.data(), kNonceWidth);
+    check(addr_bytes(phys, cfg.addr_width) == phys_vec, cfg,
+          "packed address scrambling");
+  }
+  check(cfg.addr_hash == addr_hash, cfg,
+        "addresses match the original model");
+}
+
+int main(void) {
+  for (size_t i = 0; i < sizeof(kConfigs) / sizeof(kConfigs[0]); ++i) {
+    test_config(kConfigs[i], 0x9e3779b97f4a7c15 * (i + 1));
+  }
+  return test_check_result();
+}
@@ -2,27 +2,101 @@
 // Licensed under the Apache License, Version 2.0, see LICENSE for details.
 // SPDX-License-Identifier: Apache-2.0
 //
-// SECDED encode code generated by
+// SECDED encode and decode code generated by
 // util/design/secded_gen.py from util/design/data/secded_cfg.hjson
 
 #ifndef OPENTITAN_HW_IP_PRIM_DV_PRIM_SECDED_SECDED_ENC_H_
 #define OPENTITAN_HW_IP_PRIM_DV_PRIM_SECDED_SECDED_ENC_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif  // __cplusplus
 
-// Integrity encode functions for varying bit widths matching the functionality
-// of the RTL modules of the same name. Each takes an array of bytes in
-// little-endian order and returns the calculated integrity bits.
+// The error status from decoding a word. This matches the err_o output of the
+// RTL decoders, where bit 0 flags a single (corrected) error and bit 1 flags a
+// double (uncorrectable) error.
+typedef enum secded_err {
+  kSecdedOk = 0,
+  kSecdedCorrected = 1,
+  kSecdedUncorrectable = 2,
+} secded_err_t;
+
+// Integrity encode and decode functions for varying bit widths matching the
+// functionality of the RTL modules of the same name.
+//
+// Each encode function takes an array of bytes in little-endian order and
+// returns the calculated integrity bits. Each decode function takes the same
+// array of bytes, together with the integrity bits that were stored with them.
+// It corrects any single bit error in the bytes in place and returns the error
+// status.
+//
+// The _buf variants work on num_words words at once. The words are stored
+// back to back in data, each taking as many bytes as for the single word
+// functions, and check holds the integrity bits for each word. If errs is not
+// NULL, the decode variants write the status of each word to it. They return
+// the most severe status of any word.
 
 uint8_t enc_secded_22_16(const uint8_t bytes[2]);
+secded_err_t dec_secded_22_16(uint8_t bytes[2], uint8_t check);
+void enc_secded_22_16_buf(const uint8_t *data, uint8_t *check,
+                          size_t num_words);
+secded_err_t dec_secded_22_16_buf(uint8_t *data, const uint8_t *check,
+                                  secded_err_t *errs, size_t num_words);
+
 uint8_t enc_secded_28_22(const uint8_t bytes[3]);
+secded_err_t dec_secded_28_22(uint8_t bytes[3], uint8_t check);
+void enc_secded_28_22_buf(const uint8_t *data, uint8_t *check,
+                          size_t num_words);
+secded_err_t dec_secded_28_22_buf(uint8_t *data, const uint8_t *check,
+                                  secded_err_t *errs, size_t num_words);
+
 uint8_t enc_secded_39_32(const uint8_t bytes[4]);
+secded_err_t dec_secded_39_32(uint8_t bytes[4], uint8_t check);
+void enc_secded_39_32_buf(const uint8_t *data, uint8_t *check,
+                          size_t num_words);
+secded_err_t dec_secded_39_32_buf(uint8_t *data, const uint8_t *check,
+                                  secded_err_t *errs, size_t num_words);
+
 uint8_t enc_secded_64_57(const uint8_t bytes[8]);
+secded_err_t dec_secded_64_57(uint8_t bytes[8], uint8_t check);
+void enc_secded_64_57_buf(const uint8_t *data, uint8_t *check,
+                          size_t num_words);
+secded_err_t dec_secded_64_57_buf(uint8_t *data, const uint8_t *check,
+                                  secded_err_t *errs, size_t num_words);
+
 uint8_t enc_secded_72_64(const uint8_t bytes[8]);
+secded_err_t dec_secded_72_64(uint8_t bytes[8], uint8_t check);
+void enc_secded_72_64_buf(const uint8_t *data, uint8_t *check,
+                          size_t num_words);
+secded_err_t dec_secded_72_64_buf(uint8_t *data, const uint8_t *check,
+                                  secded_err_t *errs, size_t num_words);
+
+uint8_t enc_secded_22_16_hamming(const uint8_t bytes[2]);
+secded_err_t dec_secded_22_16_hamming(uint8_t bytes[2], uint8_t check);
+void enc_secded_22_16_hamming_buf(const uint8_t *data, uint8_t *check,
+                                  size_t num_words);
+secded_err_t dec_secded_22_16_hamming_buf(uint8_t *data, const uint8_t *check,
+                                          secded_err_t *errs,
+                                          size_t num_words);
+
+uint8_t enc_secded_39_32_hamming(const uint8_t bytes[4]);
+secded_err_t dec_secded_39_32_hamming(uint8_t bytes[4], uint8_t check);
+void enc_secded_39_32_hamming_buf(const uint8_t *data, uint8_t *check,
+                                  size_t num_words);
+secded_err_t dec_secded_39_32_hamming_buf(uint8_t *data, const uint8_t *check,
+                                          secded_err_t *errs,
+                                          size_t num_words);
+
+uint8_t enc_secded_72_64_hamming(const uint8_t bytes[8]);
+secded_err_t dec_secded_72_64_hamming(uint8_t bytes[8], uint8_t check);
+void enc_secded_72_64_hamming_buf(const uint8_t *data, uint8_t *check,
+                                  size_t num_words);
+secded_err_t dec_secded_72_64_hamming_buf(uint8_t *data, const uint8_t *check,
+                                          secded_err_t *errs,
+                                          size_t num_words);
 
 #ifdef __cplusplus
 }  // extern "C"
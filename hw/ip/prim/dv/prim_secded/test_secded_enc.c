@@ -0,0 +1,148 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Test of the SECDED encoders and decoders, run by the DV model tests in
+// hw/meson.build.
+//
+// For every code, it encodes random words and checks that the decoder:
+// - accepts them unchanged,
+// - corrects every single bit error, in the data or the integrity bits, and
+// - reports every double bit error as uncorrectable, without changing the
+//   data.
+// It also checks the _buf variants against the single word functions.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hw/dv/verilator/cpp/test_check.h"
+#include "hw/ip/prim/dv/prim_secded/secded_enc.h"
+
+#define NUM_WORDS 16
+
+typedef struct test_code {
+  const char *name;
+  int data_bits;
+  int check_bits;
+  uint8_t (*enc)(const uint8_t *bytes);
+  secded_err_t (*dec)(uint8_t *bytes, uint8_t check);
+  void (*enc_buf)(const uint8_t *data, uint8_t *check, size_t num_words);
+  secded_err_t (*dec_buf)(uint8_t *data, const uint8_t *check,
+                          secded_err_t *errs, size_t num_words);
+} test_code_t;
+
+// The functions for the code with n bits in total, k of them data bits
+#define TEST_CODE(n, k, suffix)                                           \
+  {                                                                       \
+    "secded_" #n "_" #k #suffix, k, n - k, enc_secded_##n##_##k##suffix,  \
+        dec_secded_##n##_##k##suffix, enc_secded_##n##_##k##suffix##_buf, \
+        dec_secded_##n##_##k##suffix##_buf                                \
+  }
+
+static const test_code_t codes[] = {
+    TEST_CODE(22, 16, ),         TEST_CODE(28, 22, ),
+    TEST_CODE(39, 32, ),         TEST_CODE(64, 57, ),
+    TEST_CODE(72, 64, ),         TEST_CODE(22, 16, _hamming),
+    TEST_CODE(39, 32, _hamming), TEST_CODE(72, 64, _hamming),
+};
+
+// Flip bit |bit| of a codeword, where the data bits come first and the
+// integrity bits follow.
+static void flip_bit(const test_code_t *code, uint8_t *bytes, uint8_t *check,
+                     int bit) {
+  if (bit < code->data_bits) {
+    bytes[bit / 8] ^= 1 << (bit % 8);
+  } else {
+    *check ^= 1 << (bit - code->data_bits);
+  }
+}
+
+static void test_word(const test_code_t *code, const uint8_t *data) {
+  int num_bytes = (code->data_bits + 7) / 8;
+  int num_bits = code->data_bits + code->check_bits;
+  uint8_t check = code->enc(data);
+  uint8_t bytes[8];
+
+  memcpy(bytes, data, num_bytes);
+  TEST_CHECK(code->dec(bytes, check) == kSecdedOk &&
+                 memcmp(bytes, data, num_bytes) == 0,
+             "%s: clean word not accepted", code->name);
+
+  for (int a = 0; a < num_bits; ++a) {
+    memcpy(bytes, data, num_bytes);
+    uint8_t bad_check = check;
+    flip_bit(code, bytes, &bad_check, a);
+    TEST_CHECK(code->dec(bytes, bad_check) == kSecdedCorrected &&
+                   memcmp(bytes, data, num_bytes) == 0,
+               "%s: single bit error not corrected (bit %d)", code->name, a);
+
+    for (int b = a + 1; b < num_bits; ++b) {
+      memcpy(bytes, data, num_bytes);
+      bad_check = check;
+      flip_bit(code, bytes, &bad_check, a);
+      flip_bit(code, bytes, &bad_check, b);
+      uint8_t flipped[8];
+      memcpy(flipped, bytes, num_bytes);
+      TEST_CHECK(code->dec(bytes, bad_check) == kSecdedUncorrectable &&
+                     memcmp(bytes, flipped, num_bytes) == 0,
+                 "%s: double bit error not detected (bits %d, %d)",
+                 code->name, a, b);
+    }
+  }
+}
+
+static void test_buf(const test_code_t *code, const uint8_t *data) {
+  int num_bytes = (code->data_bits + 7) / 8;
+  uint8_t words[NUM_WORDS * 8];
+  uint8_t check[NUM_WORDS];
+  secded_err_t errs[NUM_WORDS];
+
+  memcpy(words, data, NUM_WORDS * num_bytes);
+  code->enc_buf(words, check, NUM_WORDS);
+  for (int i = 0; i < NUM_WORDS; ++i) {
+    TEST_CHECK(check[i] == code->enc(&data[i * num_bytes]),
+               "%s: buffer encode differs (word %d)", code->name, i);
+  }
+
+  // Word 1 gets a single bit error and word 2 a double bit error
+  words[num_bytes] ^= 0x01;
+  words[2 * num_bytes] ^= 0x03;
+  TEST_CHECK(
+      code->dec_buf(words, check, errs, NUM_WORDS) == kSecdedUncorrectable,
+      "%s: buffer decode status", code->name);
+  for (int i = 0; i < NUM_WORDS; ++i) {
+    secded_err_t expected =
+        i == 1 ? kSecdedCorrected : i == 2 ? kSecdedUncorrectable : kSecdedOk;
+    TEST_CHECK(errs[i] == expected &&
+                   (i == 2 || memcmp(&words[i * num_bytes],
+                                     &data[i * num_bytes], num_bytes) == 0),
+               "%s: buffer decode of word %d", code->name, i);
+  }
+}
+
+int main(void) {
+  srand(1);
+
+  for (size_t c = 0; c < sizeof(codes) / sizeof(codes[0]); ++c) {
+    const test_code_t *code = &codes[c];
+    int num_bytes = (code->data_bits + 7) / 8;
+    uint8_t data[NUM_WORDS * 8];
+    for (int i = 0; i < NUM_WORDS * num_bytes; ++i) {
+      data[i] = rand();
+    }
+    // Clear the bits above the data width, and make word 0 all zeros
+    for (int i = 0; i < NUM_WORDS; ++i) {
+      if (code->data_bits % 8) {
+        data[(i + 1) * num_bytes - 1] &= (1 << (code->data_bits % 8)) - 1;
+      }
+    }
+    memset(data, 0, num_bytes);
+
+    for (int i = 0; i < NUM_WORDS; ++i) {
+      test_word(code, &data[i * num_bytes]);
+    }
+    test_buf(code, data);
+  }
+
+  return test_check_result();
+}
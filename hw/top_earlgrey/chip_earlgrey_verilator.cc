@@ -35,7 +35,7 @@ int main(int argc, char **argv) {
                   ram1p_adv_scope,
               0x4000 / 4, 4);
 
-  memutil.RegisterMemoryArea("rom", 0x8000, &rom);
+  memutil.RegisterMemoryArea("rom", 0x8000, &rom, /*read_only=*/true);
   memutil.RegisterMemoryArea("ram", 0x10000000u, &ram);
   memutil.RegisterMemoryArea("flash", 0x20000000u, &flash);
   memutil.RegisterMemoryArea("otp", 0x40000000u /* (bogus LMA) */, &otp);
@@ -17,6 +17,9 @@ VFILE_DIR=.
 # How long to simulate
 SIM_CYCLES=757000
 
+# Write the USB monitor output to usb0.log, as text
+USB_MON=+USBDPI_MON_usb0=text
+
 # Expected output
 EXPECT_USB=hw/top_earlgrey/util/opentitan_earlgrey_usbdev_expected-usb
 EXPECT_UART=hw/top_earlgrey/util/opentitan_earlgrey_usbdev_expected-uart
@@ -28,7 +31,7 @@ IGNORE_USB="-I Pullup.change"
 IGNORE_UART="-I PHY.settings"
 
 echo "Simulation with normal pins, singleended"
-$VERILATOR --meminit=rom,$ROMCODE --meminit=flash,$FLASH --meminit=otp,$OTP -c $SIM_CYCLES &
+$VERILATOR --meminit=rom,$ROMCODE --meminit=flash,$FLASH --meminit=otp,$OTP -c $SIM_CYCLES $USB_MON &
 sleep 1
 echo 'l01 l00' > $VFILE_DIR/gpio0-write && cat $VFILE_DIR/gpio0-read
 cp $VFILE_DIR/usb0.log $VFILE_DIR/usb-noflip-se.log
@@ -36,21 +39,21 @@ cp $VFILE_DIR/uart0.log $VFILE_DIR/uart-noflip-se.log
 
 
 echo "Simulation with flipped pins, singleended"
-$VERILATOR --meminit=rom,$ROMCODE --meminit=flash,$FLASH --meminit=otp,$OTP -c $SIM_CYCLES &
+$VERILATOR --meminit=rom,$ROMCODE --meminit=flash,$FLASH --meminit=otp,$OTP -c $SIM_CYCLES $USB_MON &
 sleep 1
 echo 'l01 h00' > $VFILE_DIR/gpio0-write && cat $VFILE_DIR/gpio0-read
 cp $VFILE_DIR/usb0.log $VFILE_DIR/usb-flip-se.log
 cp $VFILE_DIR/uart0.log $VFILE_DIR/uart-flip-se.log
 
 echo "Simulation with normal pins, differential"
-$VERILATOR --meminit=rom,$ROMCODE --meminit=flash,$FLASH --meminit=otp,$OTP -c $SIM_CYCLES &
+$VERILATOR --meminit=rom,$ROMCODE --meminit=flash,$FLASH --meminit=otp,$OTP -c $SIM_CYCLES $USB_MON &
 sleep 1
 echo 'h01 l00' > $VFILE_DIR/gpio0-write && cat $VFILE_DIR/gpio0-read
 cp $VFILE_DIR/usb0.log $VFILE_DIR/usb-noflip-diff.log
 cp $VFILE_DIR/uart0.log $VFILE_DIR/uart-noflip-diff.log
 
 echo "Simulation with flipped pins, differential"
-$VERILATOR --meminit=rom,$ROMCODE --meminit=flash,$FLASH --meminit=otp,$OTP -c $SIM_CYCLES &
+$VERILATOR --meminit=rom,$ROMCODE --meminit=flash,$FLASH --meminit=otp,$OTP -c $SIM_CYCLES $USB_MON &
 sleep 1
 echo 'h01 h00' > $VFILE_DIR/gpio0-write && cat $VFILE_DIR/gpio0-read
 cp $VFILE_DIR/usb0.log $VFILE_DIR/usb-flip-diff.log
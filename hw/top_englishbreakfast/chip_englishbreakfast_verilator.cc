@@ -32,7 +32,7 @@ int main(int argc, char **argv) {
                     "gen_generic.u_impl_generic",
                 0x100000 / 8, 8);
 
-  memutil.RegisterMemoryArea("rom", 0x8000, &rom);
+  memutil.RegisterMemoryArea("rom", 0x8000, &rom, /*read_only=*/true);
   memutil.RegisterMemoryArea("ram", 0x10000000u, &ram);
   memutil.RegisterMemoryArea("flash", 0x20000000u, &flash);
   simctrl.RegisterExtension(&memutil);
@@ -57,7 +57,8 @@ class VerilatorSimEarlgrey:
         cmd_sim = [
             self._sim_path, '--meminit=rom,' + str(self._rom_vmem_path),
             '--meminit=otp,' + str(self._otp_img_path),
-            '+UARTDPI_LOG_uart0=' + str(self.uart0_log_path)
+            '+UARTDPI_LOG_uart0=' + str(self.uart0_log_path),
+            '+SPIDPI_MON_spi0=text'
         ]
         cmd_sim += extra_sim_args
 
@@ -25,24 +25,72 @@ COPYRIGHT = """// Copyright lowRISC contributors.
 //
 """
 
-C_SRC_TOP = """#include <stdbool.h>
+C_SRC_TOP = """#include <stddef.h>
 #include <stdint.h>
 
 #include "secded_enc.h"
 
-// Calculates even parity for a 64-bit word
-static uint8_t calc_parity(uint64_t word) {
-  bool parity = false;
+// The tables that describe a SECDED code.
+//
+// Every integrity bit is the XOR of a subset of the data bits, so the integrity
+// bits for a word are the XOR of the integrity bits for each of its bytes on
+// their own. enc_table[i][b] holds the integrity bits for a word whose only
+// non-zero byte is byte i, with value b.
+//
+// When decoding, the syndrome is the XOR of the integrity bits computed from
+// the data and those that were read with it. flip_table maps each syndrome to
+// the data bit that should be flipped to correct it (or -1 if no data bit
+// should be flipped) and err_table maps each syndrome to the error status
+// reported by the RTL decoder.
+typedef struct secded_code {
+  int num_bytes;
+  uint8_t check_mask;
+  const uint8_t (*enc_table)[256];
+  const int8_t *flip_table;
+  const uint8_t *err_table;
+} secded_code_t;
+
+static uint8_t secded_enc(const secded_code_t *code, const uint8_t *bytes) {
+  uint8_t check = 0;
+  for (int i = 0; i < code->num_bytes; ++i) {
+    check ^= code->enc_table[i][bytes[i]];
+  }
+  return check;
+}
 
-  while (word) {
-    if (word & 1) {
-      parity = !parity;
-    }
+static secded_err_t secded_dec(const secded_code_t *code, uint8_t *bytes,
+                               uint8_t check) {
+  uint8_t syndrome = (secded_enc(code, bytes) ^ check) & code->check_mask;
+
+  int flip_bit = code->flip_table[syndrome];
+  if (flip_bit >= 0) {
+    bytes[flip_bit / 8] ^= 1 << (flip_bit % 8);
+  }
+
+  return (secded_err_t)code->err_table[syndrome];
+}
 
-    word >>= 1;
+static void secded_enc_buf(const secded_code_t *code, const uint8_t *data,
+                           uint8_t *check, size_t num_words) {
+  for (size_t i = 0; i < num_words; ++i) {
+    check[i] = secded_enc(code, data + i * code->num_bytes);
   }
+}
 
-  return parity;
+static secded_err_t secded_dec_buf(const secded_code_t *code, uint8_t *data,
+                                   const uint8_t *check, secded_err_t *errs,
+                                   size_t num_words) {
+  secded_err_t worst = kSecdedOk;
+  for (size_t i = 0; i < num_words; ++i) {
+    secded_err_t err = secded_dec(code, data + i * code->num_bytes, check[i]);
+    if (errs) {
+      errs[i] = err;
+    }
+    if (err > worst) {
+      worst = err;
+    }
+  }
+  return worst;
 }
 """
 
@@ -50,16 +98,36 @@ C_H_TOP = """
 #ifndef OPENTITAN_HW_IP_PRIM_DV_PRIM_SECDED_SECDED_ENC_H_
 #define OPENTITAN_HW_IP_PRIM_DV_PRIM_SECDED_SECDED_ENC_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif  // __cplusplus
 
-// Integrity encode functions for varying bit widths matching the functionality
-// of the RTL modules of the same name. Each takes an array of bytes in
-// little-endian order and returns the calculated integrity bits.
-
+// The error status from decoding a word. This matches the err_o output of the
+// RTL decoders, where bit 0 flags a single (corrected) error and bit 1 flags a
+// double (uncorrectable) error.
+typedef enum secded_err {
+  kSecdedOk = 0,
+  kSecdedCorrected = 1,
+  kSecdedUncorrectable = 2,
+} secded_err_t;
+
+// Integrity encode and decode functions for varying bit widths matching the
+// functionality of the RTL modules of the same name.
+//
+// Each encode function takes an array of bytes in little-endian order and
+// returns the calculated integrity bits. Each decode function takes the same
+// array of bytes, together with the integrity bits that were stored with them.
+// It corrects any single bit error in the bytes in place and returns the error
+// status.
+//
+// The _buf variants work on num_words words at once. The words are stored
+// back to back in data, each taking as many bytes as for the single word
+// functions, and check holds the integrity bits for each word. If errs is not
+// NULL, the decode variants write the status of each word to it. They return
+// the most severe status of any word.
 """
 
 C_H_FOOT = """
@@ -338,13 +406,13 @@ def generate(cfgs, args):
 
     with open(c_src_filename, "w") as f:
         f.write(COPYRIGHT)
-        f.write("// SECDED encode code generated by\n")
+        f.write("// SECDED encode and decode code generated by\n")
         f.write(f"// util/design/secded_gen.py from {SECDED_CFG_FILE}\n\n")
         f.write(C_SRC_TOP)
 
     with open(c_h_filename, "w") as f:
         f.write(COPYRIGHT)
-        f.write("// SECDED encode code generated by\n")
+        f.write("// SECDED encode and decode code generated by\n")
         f.write(f"// util/design/secded_gen.py from {SECDED_CFG_FILE}\n")
         f.write(C_H_TOP)
 
@@ -360,9 +428,9 @@ def generate(cfgs, args):
         # write out rtl files
         write_enc_dec_files(n, k, m, codes, suffix, args.outdir, codetype)
 
-        # write out C files, only hsiao codes are supported
-        if codetype == "hsiao":
-            write_c_files(n, k, m, codes, suffix, c_src_filename, c_h_filename)
+        # write out C files
+        write_c_files(n, k, m, codes, suffix, c_src_filename, c_h_filename,
+                      codetype)
 
         # write out package typedefs
         pkg_type_str += print_pkg_types(n, k, m, codes, suffix, codetype)
@@ -541,7 +609,100 @@ def bytes_to_c_type(num_bytes):
     return None
 
 
-def write_c_files(n, k, m, codes, suffix, c_src_filename, c_h_filename):
+def c_values(values, indent):
+    """Format a list of C values, wrapping lines at 80 columns"""
+    lines = []
+    line = " " * indent
+    for i, value in enumerate(values):
+        text = value + ("," if i + 1 < len(values) else "")
+        if line.strip() and len(line) + 1 + len(text) > 80:
+            lines.append(line)
+            line = " " * indent
+        line += (" " if line.strip() else "") + text
+    lines.append(line)
+    return "\n".join(lines)
+
+
+def c_signature(ret, name, params):
+    """Format a C function signature in the style used by clang-format"""
+    one_line = f"{ret} {name}({', '.join(params)})"
+    if len(one_line) + 2 <= 80:
+        return one_line
+
+    # Try aligning the parameters with the opening parenthesis
+    prefix = f"{ret} {name}("
+    lines = [prefix]
+    for i, param in enumerate(params):
+        text = param + ("," if i + 1 < len(params) else ")")
+        if lines[-1] != prefix and len(lines[-1]) + 1 + len(text) > 78:
+            lines.append(" " * len(prefix))
+        sep = "" if lines[-1].endswith("(") or not lines[-1].strip() else " "
+        lines[-1] += sep + text
+    if all(len(line) <= 78 for line in lines):
+        return "\n".join(lines)
+
+    # Otherwise, break after the opening parenthesis
+    return f"{ret} {name}(\n    {', '.join(params)})"
+
+
+def calc_c_tables(k, m, codes, codetype):
+    in_bytes = math.ceil(k / 8)
+
+    # Hamming codes have codes for the first m - 1 integrity bits as well as
+    # the data bits: the final parity bit covers them too. The C code computes
+    # all the integrity bits from the data, so this folds the parity of the
+    # other integrity bits into the final parity bit. It also means that the
+    # syndrome seen by the C code differs from the RTL one: fold_ecc_parity
+    # converts between the two.
+    def fold_ecc_parity(value):
+        if len(codes) == k:
+            return value
+        low_mask = (1 << (m - 1)) - 1
+        return value ^ ((bin(value & low_mask).count("1") % 2) << (m - 1))
+
+    # The integrity bits for each value of each input byte
+    enc_table = []
+    for i in range(in_bytes):
+        byte_table = []
+        for value in range(256):
+            check = 0
+            for bit in range(8):
+                data_bit = 8 * i + bit
+                if data_bit < k and (value >> bit) & 1:
+                    check ^= fold_ecc_parity(calc_syndrome(codes[data_bit]))
+            byte_table.append(check)
+        enc_table.append(byte_table)
+
+    # The data bit that each syndrome corrects
+    flip_table = [-1] * (1 << m)
+    for i in range(k):
+        flip_table[fold_ecc_parity(calc_syndrome(codes[i]))] = i
+
+    # The error status for each syndrome, following print_dec
+    err_table = []
+    for c_syndrome in range(1 << m):
+        syndrome = fold_ecc_parity(c_syndrome)
+        if codetype == "hamming":
+            if (syndrome >> (m - 1)) & 1:
+                err = 1
+            elif syndrome & ((1 << (m - 1)) - 1):
+                err = 2
+            else:
+                err = 0
+        else:
+            if bin(syndrome).count("1") % 2:
+                err = 1
+            elif syndrome:
+                err = 2
+            else:
+                err = 0
+        err_table.append(err)
+
+    return enc_table, flip_table, err_table
+
+
+def write_c_files(n, k, m, codes, suffix, c_src_filename, c_h_filename,
+                  codetype):
     in_bytes = math.ceil(k / 8)
     out_bytes = math.ceil(m / 8)
 
@@ -551,40 +712,65 @@ def write_c_files(n, k, m, codes, suffix, c_src_filename, c_h_filename):
                     "generation")
         return
 
-    in_type = bytes_to_c_type(in_bytes)
-    out_type = bytes_to_c_type(out_bytes)
-
-    assert in_type
-    assert out_type
+    # The decoder tables are indexed by syndrome and the encoder tables hold
+    # integrity bits in a byte.
+    assert out_bytes == 1
+
+    name = f"{n}_{k}{suffix}"
+    code = f"secded_{name}"
+    enc_table, flip_table, err_table = calc_c_tables(k, m, codes, codetype)
+
+    enc_sig = c_signature("uint8_t", f"enc_secded_{name}",
+                          [f"const uint8_t bytes[{in_bytes}]"])
+    dec_sig = c_signature("secded_err_t", f"dec_secded_{name}",
+                          [f"uint8_t bytes[{in_bytes}]", "uint8_t check"])
+    enc_buf_sig = c_signature("void", f"enc_secded_{name}_buf",
+                              ["const uint8_t *data", "uint8_t *check",
+                               "size_t num_words"])
+    dec_buf_sig = c_signature("secded_err_t", f"dec_secded_{name}_buf",
+                              ["uint8_t *data", "const uint8_t *check",
+                               "secded_err_t *errs", "size_t num_words"])
 
     with open(c_src_filename, "a") as f:
-        # Write out function prototype in src
-        f.write(f"\n{out_type} enc_secded_{n}_{k}{suffix}"
-                f"(const uint8_t bytes[{in_bytes}]) {{\n")
-
-        # Form a single word from the incoming byte data
-        f.write(f"{in_type} word = ")
-        f.write(" | ".join(
-                [f"(({in_type})bytes[{i}] << {i*8})" for i in range(in_bytes)]))
-        f.write(";\n\n")
-
-        # AND the word with the codes, calculating parity of each and combine
-        # into a single word of integrity bits
-        f.write("return ")
-        parity_bit_masks = enumerate(calc_bitmasks(k, m, codes, False))
-        f.write(" | ".join(
-                [f"(calc_parity(word & 0x{mask:x}) << {par_bit})" for par_bit,
-                    mask in parity_bit_masks]))
-
-        f.write(";\n}\n")
+        # Write out the tables for this code
+        f.write(f"\nstatic const uint8_t {code}_enc_table[{in_bytes}][256] = {{\n")
+        for byte_table in enc_table:
+            body = c_values([f"0x{v:02x}" for v in byte_table], 5)
+            f.write("    {" + body[5:] + "},\n")
+        f.write("};\n")
+
+        f.write(f"\nstatic const int8_t {code}_flip_table[{1 << m}] = {{\n")
+        f.write(c_values([str(v) for v in flip_table], 4) + "};\n")
+
+        f.write(f"\nstatic const uint8_t {code}_err_table[{1 << m}] = {{\n")
+        f.write(c_values([str(v) for v in err_table], 4) + "};\n")
+
+        f.write(f"\nstatic const secded_code_t {code} = {{\n")
+        f.write(f"    {in_bytes}, 0x{(1 << m) - 1:x}, {code}_enc_table, "
+                f"{code}_flip_table,\n")
+        f.write(f"    {code}_err_table}};\n")
+
+        # Write out the functions, which just pass the tables to the generic
+        # code
+        f.write(f"\n{enc_sig} {{\n")
+        f.write(f"  return secded_enc(&{code}, bytes);\n}}\n")
+        f.write(f"\n{dec_sig} {{\n")
+        f.write(f"  return secded_dec(&{code}, bytes, check);\n}}\n")
+        f.write(f"\n{enc_buf_sig} {{\n")
+        f.write(f"  secded_enc_buf(&{code}, data, check, num_words);\n}}\n")
+        f.write(f"\n{dec_buf_sig} {{\n")
+        f.write(f"  return secded_dec_buf(&{code}, data, check, errs, "
+                f"num_words);\n}}\n")
 
     with open(c_h_filename, "a") as f:
-        # Write out function declaration in header
-        f.write(f"{out_type} enc_secded_{n}_{k}{suffix}"
-                f"(const uint8_t bytes[{in_bytes}]);\n")
+        # Write out function declarations in header
+        f.write("\n")
+        for sig in [enc_sig, dec_sig, enc_buf_sig, dec_buf_sig]:
+            f.write(f"{sig};\n")
 
 
 def format_c_files(c_src_filename, c_h_filename):
+    result = None
     try:
         # Call clang-format to in-place format generated C code. If there are
         # any issues log a warning.
@@ -792,7 +978,7 @@ def main():
                         default='hw/ip/prim/dv/prim_secded',
                         help='''
         C output directory. The output files are named secded_enc.c and
-        secded_enc.h
+        secded_enc.h, and contain encoders and decoders for each code
         ''')
     parser.add_argument('--verbose', '-v', action='store_true', help='Verbose')
 
@@ -0,0 +1,446 @@
+#!/usr/bin/env python3
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+"""Convert a binary DPI bus monitor log to text or pcap.
+
+The SPI and USB DPI models write a compact binary log of bus events when
+their monitor is in binary mode (e.g. +SPIDPI_MON_spi0=binary or
++USBDPI_MON_usb0=binary). This turns such a log into the text that the
+monitor writes in text mode, or, for USB, into a pcap file with the USB 2.0
+link type (one record per packet on the bus, PID and CRC included), which
+Wireshark can decode.
+
+The binary format is described in hw/dv/dpi/common/dpi_mon/dpi_mon.h.
+
+Typical usage:
+    ./util/dpi_mon_convert.py spi0.mon > spi0.log
+    ./util/dpi_mon_convert.py --format pcap -o usb0.pcap usb0.mon
+"""
+import argparse
+import logging as log
+import struct
+import sys
+
+MAGIC = b'OTDPIMON'
+VERSION = 1
+KIND_SPI = 1
+KIND_USB = 2
+
+HEADER = struct.Struct('<8sHBBI')
+RECORD = struct.Struct('<BBHI')
+
+# SPI records and pins, from spidpi.h
+SPI_MON_PINS = 1
+SPI_MON_END = 2
+P2D_SCK = 0x1
+P2D_CSB = 0x2
+P2D_SDI = 0x4
+D2P_SDO = 0x2
+D2P_SDO_EN = 0x1
+SPI_MON_BUFLEN = 65
+
+# USB records and pins, from usbdpi.h
+USB_MON_HOST = 1
+USB_MON_CLASH = 1
+USB_MON_IDLE = 2
+USB_MON_SOP = 3
+USB_MON_PID = 4
+USB_MON_BAD_PID = 5
+USB_MON_BITSTUFF = 6
+USB_MON_PACKET = 7
+USB_MON_PKT_HAS_PID = 0x4
+USB_MON_PULLUP = 8
+USB_MON_BYTES_SIZE = 1024
+D2P_DPPU = 4
+D2P_DNPU = 2
+D2P_TXMODE_SE = 1
+D2P_PU = D2P_DPPU | D2P_DNPU
+USB_PID_OUT = 0xE1
+USB_PID_IN = 0x69
+USB_PID_SOF = 0xA5
+USB_PID_SETUP = 0x2D
+USB_PID_DATA0 = 0xC3
+USB_PID_DATA1 = 0x4B
+
+# pcap with nanosecond timestamps, and the link type for USB 2.0 packets
+PCAP_MAGIC_NS = 0xa1b23c4d
+LINKTYPE_USB_2_0 = 288
+
+
+def read_records(in_file):
+    '''Read the header of a binary log and then yield its records
+
+    The first item is (kind, param). The rest are (type, flags, tick,
+    payload).
+    '''
+    header = in_file.read(HEADER.size)
+    if len(header) < HEADER.size:
+        raise ValueError('File is too short for a header')
+    magic, version, kind, _, param = HEADER.unpack(header)
+    if magic != MAGIC:
+        raise ValueError('Not a DPI monitor log')
+    if version != VERSION:
+        raise ValueError('Unsupported version {}'.format(version))
+    yield kind, param
+
+    while True:
+        rec = in_file.read(RECORD.size)
+        if not rec:
+            return
+        if len(rec) < RECORD.size:
+            log.warning('Ignoring a truncated record at the end of the log')
+            return
+        rec_type, flags, length, tick = RECORD.unpack(rec)
+        payload = in_file.read(length)
+        if len(payload) < length:
+            log.warning('Ignoring a truncated record at the end of the log')
+            return
+        yield rec_type, flags, tick, payload
+
+
+# Vertical waveform drawing, indexed by new value, new enable, old value and
+# old enable (as in monitor_spi.c)
+VERT = [
+    ' | ', '\\  ', ' | ', '  /', '/  ', '|  ', '/  ', ' / ', ' | ', '\\  ',
+    ' | ', '  /', '  \\', ' \\ ', '  \\', '  |'
+]
+
+
+def vertical_bit(cur, old, mask, enmask):
+    if enmask:
+        cur_en = 0x4 if cur & enmask else 0
+        old_en = 0x1 if old & enmask else 0
+    else:
+        cur_en = 0x4
+        old_en = 0x1
+    cur = 0x8 if cur & mask else 0
+    old = 0x2 if old & mask else 0
+    return VERT[cur | old | cur_en | old_en]
+
+
+class SpiMonitor:
+    '''A port of monitor_spi() from monitor_spi.c'''
+    def __init__(self, out, param):
+        self.out = out
+        mode = param >> 24
+        loglevel = param & 0xffffff
+        self.cpol = (mode & 2) >> 1
+        self.cpha = mode & 1
+        self.logbits = loglevel & 0x1
+        self.logpkts = loglevel & 0x8
+        self.prev_p2d = 0
+        self.prev_d2p = 0
+        self.bpos = 0
+        self.poff = 0
+        self.mobuf = [0] * SPI_MON_BUFLEN
+        self.sobuf = [0] * SPI_MON_BUFLEN
+
+    def log_signals(self, tick, p2d, d2p):
+        self.out.write('{:8d} SPI: {}  {}  {}  {}  '.format(
+            tick, vertical_bit(p2d, self.prev_p2d, P2D_CSB, 0),
+            vertical_bit(p2d, self.prev_p2d, P2D_SCK, 0),
+            vertical_bit(p2d, self.prev_p2d, P2D_SDI, 0),
+            vertical_bit(d2p, self.prev_d2p, D2P_SDO, D2P_SDO_EN)))
+
+    def log_packet(self):
+        self.out.write('H>D: ' + ''.join('{:02x} '.format(b)
+                                         for b in self.mobuf[:self.poff]) +
+                       'D>H: ' + ''.join('{:02x} '.format(b)
+                                         for b in self.sobuf[:self.poff]) +
+                       '\n')
+
+    def capture_bit(self, p2d, d2p):
+        sck = p2d & P2D_SCK
+        if not ((self.cpol == self.cpha and sck) or
+                (self.cpol != self.cpha and not sck)):
+            return
+        if (p2d & P2D_SDI) != (self.prev_p2d & P2D_SDI):
+            self.out.write('Check SDI tSU ')
+        if (d2p & D2P_SDO) != (self.prev_d2p & D2P_SDO):
+            self.out.write('Check SDO tSU ')
+        if p2d & P2D_SDI:
+            self.mobuf[self.poff] |= self.bpos
+        if d2p & D2P_SDO:
+            self.sobuf[self.poff] |= self.bpos
+        self.bpos >>= 1
+        if self.bpos == 0:
+            self.bpos = 0x80
+            if self.poff < SPI_MON_BUFLEN - 1:
+                self.poff += 1
+            self.mobuf[self.poff] = 0
+            self.sobuf[self.poff] = 0
+
+    def step(self, tick, p2d, d2p):
+        '''Monitor one tick'''
+        if tick == 1 and self.logbits:
+            self.out.write('              CSB SCK MO  MI\n')
+        if (p2d == self.prev_p2d and d2p == self.prev_d2p and
+                p2d & P2D_CSB):
+            return
+
+        if self.logbits:
+            self.log_signals(tick, p2d, d2p)
+
+        if not self.logpkts:
+            self.out.write('\n')
+        elif (p2d & P2D_CSB) and not (self.prev_p2d & P2D_CSB):
+            # end of packet
+            self.log_packet()
+            self.poff = 0
+        else:
+            if not (p2d & P2D_CSB) and (self.prev_p2d & P2D_CSB):
+                # start of packet
+                self.poff = 0
+                self.mobuf[0] = 0
+                self.sobuf[0] = 0
+                self.bpos = 0x80
+            elif not (p2d & P2D_CSB) and not (self.prev_p2d & P2D_CSB):
+                # inside packet
+                if (p2d & P2D_SCK) != (self.prev_p2d & P2D_SCK):
+                    self.capture_bit(p2d, d2p)
+            if self.logbits:
+                self.out.write('\n')
+        self.prev_p2d = p2d
+        self.prev_d2p = d2p
+
+    def run(self, start, end, p2d, d2p):
+        '''Monitor the ticks from start to end - 1, with unchanged pins'''
+        for tick in range(start, end):
+            # Nothing is logged for unchanged pins while CSB is high
+            if (tick != 1 and p2d == self.prev_p2d and
+                    d2p == self.prev_d2p and p2d & P2D_CSB):
+                return
+            self.step(tick, p2d, d2p)
+
+
+def spi_to_text(records, param, out):
+    mon = SpiMonitor(out, param)
+    p2d = 0
+    d2p = 0
+    next_tick = 1
+    for rec_type, _, tick, payload in records:
+        if rec_type == SPI_MON_PINS:
+            mon.run(next_tick, tick, p2d, d2p)
+            p2d, d2p = payload[0], payload[1]
+            mon.step(tick, p2d, d2p)
+            next_tick = tick + 1
+        elif rec_type == SPI_MON_END:
+            mon.run(next_tick, tick + 1, p2d, d2p)
+            next_tick = tick + 1
+        else:
+            log.warning('Ignoring unknown SPI record type %d', rec_type)
+
+
+DECODE_PID = [
+    'Rsvd', 'OUT', 'ACK', 'DATA0', 'PING', 'SOF', 'NYET', 'DATA2', 'SPLIT',
+    'IN', 'NAK', 'DATA1', 'PRE/ERR', 'SETUP', 'STALL', 'MDATA'
+]
+
+
+def crc5(value, bits):
+    '''The little-endian CRC5 of usb_crc.c'''
+    crc = 0x1f
+    for _ in range(bits):
+        if (value ^ crc) & 1:
+            crc = (crc >> 1) ^ 0x14
+        else:
+            crc >>= 1
+        value >>= 1
+    return crc ^ 0x1f
+
+
+def crc16(data):
+    '''The CRC16 of usb_crc.c'''
+    crc = 0xffff
+    for byte in data:
+        for _ in range(8):
+            if (byte ^ crc) & 1:
+                crc = (crc >> 1) ^ 0xa001
+            else:
+                crc >>= 1
+            byte >>= 1
+    return crc ^ 0xffff
+
+
+def pid_2data(pid, d0, d1):
+    crcok = 'OK' if crc5((d1 & 7) << 8 | d0, 11) == d1 >> 3 else 'BAD'
+    name = DECODE_PID[pid & 0xf]
+    if pid in (USB_PID_IN, USB_PID_OUT, USB_PID_SETUP):
+        return '{} {}.{} (CRC5 {:02x} {})'.format(name, d0 & 0x7f,
+                                                  (d1 & 7) << 1 | d0 >> 7,
+                                                  d1 >> 3, crcok)
+    if pid == USB_PID_SOF:
+        return 'SOF {:03x} (CRC5 {:02x} {})'.format((d1 & 7) << 8 | d0,
+                                                    d1 >> 3, crcok)
+    if pid in (USB_PID_DATA0, USB_PID_DATA1):
+        return '{} {:02x}, {:02x} ({})'.format(
+            name, d0, d1, 'CRC16 BAD' if d0 | d1 else 'NULL')
+    return '{} {:02x}, {:02x} (CRC5 {})'.format(name, d0, d1, crcok)
+
+
+def usb_packet_text(out, loglevel, tick, flags, payload):
+    '''A port of the end of packet logging in monitor_usb.c'''
+    verbose = loglevel & 0x2
+    compact = loglevel & 0x1
+    host = (flags & 3) == USB_MON_HOST
+    drv = 'H' if host else 'D'
+    sop_at = struct.unpack_from('<I', payload)[0]
+    lastpid = payload[4]
+    data = bytearray(payload[6:])
+    nbytes = len(data)
+    summary = 'mon: {:8d} -- {:8d}: ({}) SOP, PID '.format(sop_at, tick, drv)
+
+    if (verbose or compact) and nbytes > 0:
+        if compact and nbytes == 2:
+            out.write(summary + pid_2data(lastpid, data[0], data[1]) +
+                      ', EOP\n')
+        elif compact and nbytes == 1:
+            out.write(summary + '{} {:02x} EOP\n'.format(
+                DECODE_PID[lastpid & 0xf], data[0]))
+        else:
+            if compact:
+                out.write(summary + DECODE_PID[lastpid & 0xf] + ', EOP\n')
+            out.write('mon:     {}: '.format('h->d' if host else 'd->h'))
+            comp_crc16 = crc16(data[:nbytes - 2]) if nbytes > 2 else 0
+            pkt_crc16 = ((data[nbytes - 2] if nbytes >= 2 else 0) |
+                         data[nbytes - 1] << 8)
+            text = True
+            for i in range(nbytes):
+                if (i & 0xf) == 0xf:
+                    sep = '\nmon:           '
+                elif i + 1 == nbytes:
+                    sep = ''
+                else:
+                    sep = ', '
+                out.write('{:02x}{}'.format(data[i], sep))
+                if data[i] in (0x0d, 0x0a):
+                    data[i] = ord('_')
+                if data[i] == 0:
+                    data[i] = ord('?')
+                if i >= nbytes - 2:
+                    data[i] = 0
+                elif data[i] < 32 or data[i] > 127:
+                    text = False
+            more = '...' if nbytes == USB_MON_BYTES_SIZE else ''
+            if comp_crc16 == pkt_crc16:
+                out.write(more + ' CRCOK\n')
+            else:
+                out.write('{}\nmon:           CRC16 {:04x} BAD expected '
+                          '{:04x}\n'.format(more, pkt_crc16, comp_crc16))
+            if text and nbytes > 2:
+                out.write('mon:          {}\n'.format(
+                    data[:data.index(0)].decode('ascii')))
+    elif compact:
+        out.write(summary + DECODE_PID[lastpid & 0xf] + ' EOP\n')
+    if verbose:
+        out.write('mon: {:8d}: ({}) EOP\n'.format(tick, drv))
+
+
+def usb_to_text(records, loglevel, out):
+    for rec_type, flags, tick, payload in records:
+        drv = 'H' if (flags & 3) == USB_MON_HOST else 'D'
+        if rec_type == USB_MON_CLASH:
+            out.write('mon: {:8d}: Bus clash\n'.format(tick))
+        elif rec_type == USB_MON_IDLE:
+            d2p = struct.unpack_from('<H', payload)[0]
+            if d2p & D2P_PU:
+                out.write('mon: {:8d}: Idle, FS resistor (d2p '
+                          '0x{:x})\n'.format(tick, d2p))
+            else:
+                out.write('mon: {:8d}: Idle, SE0\n'.format(tick))
+        elif rec_type == USB_MON_SOP:
+            out.write('mon: {:8d}: ({}) SOP\n'.format(tick, drv))
+        elif rec_type == USB_MON_PID:
+            out.write('mon: {:8d}: ({}) PID {} (0x{:x})\n'.format(
+                tick, drv, DECODE_PID[payload[0] & 0xf], payload[0]))
+        elif rec_type == USB_MON_BAD_PID:
+            out.write('mon: {:8d}: ({}) BAD PID 0x{:x}\n'.format(
+                tick, drv, payload[0]))
+        elif rec_type == USB_MON_BITSTUFF:
+            rawbits = struct.unpack_from('<I', payload)[0]
+            out.write('mon: {:8d}: ({}) Bitstuff error, got 1 after '
+                      '0x{:x}\n'.format(tick, drv, rawbits))
+        elif rec_type == USB_MON_PACKET:
+            usb_packet_text(out, loglevel, tick, flags, payload)
+        elif rec_type == USB_MON_PULLUP:
+            frame, d2p = struct.unpack_from('<HH', payload)
+            out.write('{:4x} {:8d} Pullup change to {}{}{}\n'.format(
+                frame, tick, 'DP Pulled up ' if d2p & D2P_DPPU else '',
+                'DN Pulled up ' if d2p & D2P_DNPU else '',
+                'SingleEnded' if d2p & D2P_TXMODE_SE else 'Differential'))
+        else:
+            log.warning('Ignoring unknown USB record type %d', rec_type)
+
+
+def usb_to_pcap(records, clock_mhz, out):
+    out.write(
+        struct.pack('<IHHiIII', PCAP_MAGIC_NS, 2, 4, 0, 0, 65535,
+                    LINKTYPE_USB_2_0))
+    for rec_type, flags, _, payload in records:
+        if rec_type != USB_MON_PACKET or not flags & USB_MON_PKT_HAS_PID:
+            continue
+        # Time stamp packets with the start of packet
+        sop_at = struct.unpack_from('<I', payload)[0]
+        ns = int(sop_at * 1000 / clock_mhz)
+        data = payload[5:]
+        out.write(
+            struct.pack('<IIII', ns // 1000000000, ns % 1000000000, len(data),
+                        len(data)))
+        out.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', help='Binary monitor log')
+    parser.add_argument('-o',
+                        '--output',
+                        help='Output file (default: standard output)')
+    parser.add_argument('--format',
+                        choices=['text', 'pcap'],
+                        default='text',
+                        help='Output format. pcap is only supported for USB '
+                        '(default: %(default)s)')
+    parser.add_argument('--clock-mhz',
+                        type=float,
+                        default=48.0,
+                        help='Frequency of the USB monitor ticks, for pcap '
+                        'time stamps (default: %(default)s)')
+    args = parser.parse_args()
+
+    log.basicConfig(format='%(levelname)s: %(message)s')
+
+    try:
+        with open(args.input, 'rb') as in_file:
+            records = read_records(in_file)
+            kind, param = next(records)
+            if kind not in (KIND_SPI, KIND_USB):
+                raise ValueError('Unknown kind of monitor {}'.format(kind))
+            if args.format == 'pcap' and kind != KIND_USB:
+                raise ValueError('pcap output is only supported for USB')
+
+            binary = args.format == 'pcap'
+            if args.output:
+                out = open(args.output, 'wb' if binary else 'w')
+            else:
+                out = sys.stdout.buffer if binary else sys.stdout
+            try:
+                if binary:
+                    usb_to_pcap(records, args.clock_mhz, out)
+                elif kind == KIND_SPI:
+                    spi_to_text(records, param, out)
+                else:
+                    usb_to_text(records, param, out)
+            finally:
+                if args.output:
+                    out.close()
+    except (OSError, ValueError) as err:
+        log.error('%s: %s', args.input, err)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
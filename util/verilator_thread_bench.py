@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+# Copyright lowRISC contributors.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+"""Measure Earl Grey Verilator simulation speed at different thread counts.
+
+Verilator fixes a model's thread count when it verilates it, so this builds
+the chip_earlgrey_verilator simulation once for each thread count (in its own
+build root) and then runs each build for a fixed number of cycles. The speed
+of each run is read from the simulator's --stats-json output.
+
+Typical usage:
+    ./util/verilator_thread_bench.py --threads 1,2,4,8 --output bench.json \\
+        -- --meminit=rom,ROM_VMEM --meminit=flash,TEST_ELF \\
+        --meminit=otp,OTP_VMEM
+
+Arguments after "--" are passed to the simulator. The test should run for
+longer than --cycles, so that each run simulates the same work.
+"""
+import argparse
+import json
+import logging as log
+import os
+import subprocess
+import sys
+from pathlib import Path
+
+CORE = 'lowrisc:systems:chip_earlgrey_verilator'
+SIM_BINARY = 'sim-verilator/Vchip_earlgrey_verilator'
+
+
+def build(repo_top, build_root, threads):
+    '''Build the simulation with the given number of threads'''
+    cmd = [
+        'fusesoc', '--cores-root', str(repo_top), 'run',
+        '--flag=fileset_top', '--target=sim', '--setup', '--build',
+        '--build-root', str(build_root), CORE,
+        # This comes after the core's own '--threads 4', so overrides it.
+        '--verilator_options=--threads {}'.format(threads)
+    ]
+    log.info('Building with %d thread(s): %s', threads, ' '.join(cmd))
+    subprocess.run(cmd, cwd=repo_top, check=True)
+
+
+def run(build_root, threads, cycles, pin, sim_args):
+    '''Run a build of the simulation and return its statistics'''
+    stats_path = build_root / 'stats.json'
+    cmd = [
+        str(build_root / SIM_BINARY), '--term-after-cycles={}'.format(cycles),
+        '--stats-json={}'.format(stats_path), '--profile'
+    ]
+    if pin:
+        # The main thread is one of the model's threads
+        cmd.append('--cpu-affinity=0-{}'.format(threads - 1))
+    cmd += sim_args
+    log.info('Running with %d thread(s): %s', threads, ' '.join(cmd))
+    # The simulation fails if it times out, which is expected here.
+    subprocess.run(cmd, cwd=build_root, stdout=subprocess.DEVNULL)
+    with open(stats_path) as stats_file:
+        return json.load(stats_file)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--threads',
+                        default='1,2,4,8',
+                        help='Comma-separated list of thread counts to '
+                        'measure (default: %(default)s)')
+    parser.add_argument('--cycles',
+                        type=int,
+                        default=1000000,
+                        help='Number of cycles to simulate in each run '
+                        '(default: %(default)s)')
+    parser.add_argument('--build-root',
+                        type=Path,
+                        default=Path('build/verilator_thread_bench'),
+                        help='Directory for the builds (default: '
+                        '%(default)s)')
+    parser.add_argument('--no-build',
+                        action='store_true',
+                        help='Reuse existing builds')
+    parser.add_argument('--pin',
+                        action='store_true',
+                        help='Pin each simulator thread to its own CPU')
+    parser.add_argument('--output',
+                        type=Path,
+                        help='Write the results to this file as JSON')
+    parser.add_argument('--verbose', action='store_true')
+    parser.add_argument('sim_args',
+                        nargs='*',
+                        help='Arguments passed to the simulator')
+    args = parser.parse_args()
+
+    log.basicConfig(level=log.INFO if args.verbose else log.WARNING,
+                    format='%(levelname)s: %(message)s')
+
+    try:
+        thread_counts = [int(t) for t in args.threads.split(',')]
+    except ValueError:
+        log.error('Bad thread count list: %s', args.threads)
+        return 1
+
+    repo_top = Path(__file__).resolve().parent.parent
+    build_root = args.build_root.resolve()
+
+    results = []
+    for threads in thread_counts:
+        thread_root = build_root / 'threads{}'.format(threads)
+        try:
+            if not args.no_build:
+                build(repo_top, thread_root, threads)
+            stats = run(thread_root, threads, args.cycles, args.pin,
+                        args.sim_args)
+        except (subprocess.CalledProcessError, OSError, ValueError) as err:
+            log.error('Benchmark with %d thread(s) failed: %s', threads, err)
+            return 1
+        stats['model_threads'] = threads
+        results.append(stats)
+
+    print('{:>8} {:>14} {:>10}'.format('Threads', 'Cycles/s', 'Speedup'))
+    base_speed = results[0]['cycles_per_s']
+    for stats in results:
+        speedup = stats['cycles_per_s'] / base_speed if base_speed else 0
+        print('{:>8} {:>14.0f} {:>9.2f}x'.format(stats['model_threads'],
+                                                stats['cycles_per_s'],
+                                                speedup))
+
+    if args.output:
+        with open(args.output, 'w') as out_file:
+            json.dump({'cpu_count': os.cpu_count(), 'results': results},
+                      out_file,
+                      indent=2)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())